@@ -432,6 +432,26 @@ void ProtocolAdmin::parsePacket(NetworkMessage& msg)
 					break;
 				}
 
+				case CMD_DROPPED_PACKETS:
+				{
+					ConnectionManager::IpPacketMap ipPacketMap;
+					ConnectionManager::getInstance()->getDroppedPackets(ipPacketMap);
+
+					//ip and counter take 8 bytes, keep the answer inside a single message
+					uint16_t count = std::min((size_t)1024, ipPacketMap.size());
+					output->AddByte(AP_MSG_COMMAND_OK);
+					output->AddU16(count);
+
+					ConnectionManager::IpPacketMap::const_iterator it = ipPacketMap.begin();
+					for(; count > 0; ++it, --count)
+					{
+						output->AddU32(it->first);
+						output->AddU32((uint32_t)std::min((uint64_t)0xFFFFFFFF, it->second));
+					}
+
+					break;
+				}
+
 				default:
 				{
 					output->AddByte(AP_MSG_COMMAND_FAILED);
@@ -128,7 +128,8 @@ enum
 	//CMD_BAN_MANAGER = 10,
 	//CMD_SERVER_INFO = 11,
 	//CMD_GETHOUSE = 12,
-	CMD_SETOWNER = 13
+	CMD_SETOWNER = 13,
+	CMD_DROPPED_PACKETS = 14
 };
 
 
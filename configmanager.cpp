@@ -73,6 +73,10 @@ bool ConfigManager::loadFile(const std::string& _filename)
 		m_confString[HOUSE_RENT_PERIOD] = getGlobalString(L, "houseRentPeriod", "monthly");
 		m_confNumber[WORLD_ID] = getGlobalNumber(L, "worldId", 0);
 		m_confBool[STORE_TRASH] = getGlobalBool(L, "storeTrash", "yes");
+		m_confString[PLAYER_JOURNAL_FILE] = getGlobalString(L, "playerJournalFile", "");
+		m_confNumber[PLAYER_JOURNAL_SYNC] = getGlobalNumber(L, "playerJournalSync", 200);
+		m_confString[HTTP_METRICS_IP] = getGlobalString(L, "httpMetricsIp", "127.0.0.1");
+		m_confNumber[HTTP_METRICS_PORT] = getGlobalNumber(L, "httpMetricsPort", 7173);
 	}
 
 	m_confString[LOGIN_MSG] = getGlobalString(L, "loginMessage", "Welcome to the Forgotten Server!");
@@ -132,9 +136,17 @@ bool ConfigManager::loadFile(const std::string& _filename)
 	m_confNumber[PROTECTION_LEVEL] = getGlobalNumber(L, "protectionLevel", 1);
 	m_confBool[ADMIN_LOGS_ENABLED] = getGlobalBool(L, "adminLogsEnabled", "no");
 	m_confNumber[STATUSQUERY_TIMEOUT] = getGlobalNumber(L, "statusTimeout", 5 * 60 * 1000);
+	m_confNumber[STATUS_CACHE_TIME] = getGlobalNumber(L, "statusCacheTime", 2000);
+	m_confNumber[RSA_THREADS] = getGlobalNumber(L, "rsaThreads", 2);
+	m_confNumber[DATABASE_THREADS] = getGlobalNumber(L, "databaseThreads", 1);
 	m_confBool[BROADCAST_BANISHMENTS] = getGlobalBool(L, "broadcastBanishments", "yes");
 	m_confBool[GENERATE_ACCOUNT_NUMBER] = getGlobalBool(L, "generateAccountNumber", "yes");
 	m_confBool[INGAME_GUILD_MANAGEMENT] = getGlobalBool(L, "ingameGuildManagement", "yes");
+	m_confBool[INCREMENTAL_PLAYER_SAVE] = getGlobalBool(L, "incrementalPlayerSave", "yes");
+	m_confBool[ITEM_BLOB_STORAGE] = getGlobalBool(L, "itemBlobStorage", "no");
+	m_confNumber[PLAYER_JOURNAL_INTERVAL] = getGlobalNumber(L, "playerJournalInterval", 10000);
+	m_confNumber[BAN_REFRESH_INTERVAL] = getGlobalNumber(L, "banRefreshInterval", 5 * 60 * 1000);
+	m_confNumber[NAME_CACHE_SIZE] = getGlobalNumber(L, "nameCacheSize", 10000);
 	m_confNumber[LEVEL_TO_FORM_GUILD] = getGlobalNumber(L, "levelToFormGuild", 8);
 	m_confNumber[MIN_GUILDNAME] = getGlobalNumber(L, "guildNameMinLength", 4);
 	m_confNumber[MAX_GUILDNAME] = getGlobalNumber(L, "guildNameMaxLength", 20);
@@ -168,6 +180,14 @@ bool ConfigManager::loadFile(const std::string& _filename)
 	m_confNumber[MAX_PLAYER_SUMMONS] = getGlobalNumber(L, "maxPlayerSummons", 2);
 	m_confBool[SAVE_GLOBAL_STORAGE] = getGlobalBool(L, "saveGlobalStorage", "yes");
 	m_confBool[FORCE_CLOSE_SLOW_CONNECTION] = getGlobalBool(L, "forceSlowConnectionsToDisconnect", "no");
+	m_confBool[HTTP_METRICS] = getGlobalBool(L, "httpMetrics", "no");
+	m_confNumber[MAX_BYTES_PER_WRITE] = getGlobalNumber(L, "maxBytesPerWrite", 65536);
+	m_confNumber[MAX_PENDING_BYTES] = getGlobalNumber(L, "maxPendingBytesPerConnection", 262144);
+	m_confNumber[MAX_QUEUED_BYTES] = getGlobalNumber(L, "maxQueuedBytesPerConnection", 4194304);
+	m_confNumber[WALK_PACKETS_PER_SECOND] = getGlobalNumber(L, "maxWalkPacketsPerSecond", 20);
+	m_confNumber[LOOK_PACKETS_PER_SECOND] = getGlobalNumber(L, "maxLookPacketsPerSecond", 10);
+	m_confNumber[ITEM_PACKETS_PER_SECOND] = getGlobalNumber(L, "maxItemPacketsPerSecond", 25);
+	m_confNumber[OTHER_PACKETS_PER_SECOND] = getGlobalNumber(L, "maxOtherPacketsPerSecond", 50);
 	m_confBool[EXPERIENCE_STAGES] = getGlobalBool(L, "experienceStages", "no");
 	m_confBool[BLESSING_ONLY_PREMIUM] = getGlobalBool(L, "blessingsOnlyPremium", "yes");
 	m_confBool[BED_REQUIRE_PREMIUM] = getGlobalBool(L, "bedsRequirePremium", "yes");
@@ -63,6 +63,8 @@ class ConfigManager
 			SQL_FILE,
 			PASSWORD_TYPE,
 			MAP_AUTHOR,
+			PLAYER_JOURNAL_FILE,
+			HTTP_METRICS_IP,
 			LAST_STRING_CONFIG /* this must be the last one */
 		};
 
@@ -73,6 +75,7 @@ class ConfigManager
 			LOGIN_TIMEOUT,
 			PORT,
 			SQL_PORT,
+			HTTP_METRICS_PORT,
 			SQL_KEEPALIVE,
 			MAX_PLAYERS,
 			PZ_LOCKED,
@@ -104,6 +107,9 @@ class ConfigManager
 			PROTECTION_LEVEL,
 			PASSWORDTYPE,
 			STATUSQUERY_TIMEOUT,
+			STATUS_CACHE_TIME,
+			RSA_THREADS,
+			DATABASE_THREADS,
 			LEVEL_TO_FORM_GUILD,
 			MIN_GUILDNAME,
 			MAX_GUILDNAME,
@@ -123,6 +129,17 @@ class ConfigManager
 			WORLD_ID,
 			EXTRA_PARTY_PERCENT,
 			EXTRA_PARTY_LIMIT,
+			MAX_BYTES_PER_WRITE,
+			MAX_PENDING_BYTES,
+			MAX_QUEUED_BYTES,
+			WALK_PACKETS_PER_SECOND,
+			LOOK_PACKETS_PER_SECOND,
+			ITEM_PACKETS_PER_SECOND,
+			OTHER_PACKETS_PER_SECOND,
+			PLAYER_JOURNAL_INTERVAL,
+			BAN_REFRESH_INTERVAL,
+			NAME_CACHE_SIZE,
+			PLAYER_JOURNAL_SYNC,
 			LAST_NUMBER_CONFIG /* this must be the last one */
 		};
 
@@ -162,6 +179,8 @@ class ConfigManager
 			BROADCAST_BANISHMENTS,
 			SAVE_GLOBAL_STORAGE,
 			INGAME_GUILD_MANAGEMENT,
+			INCREMENTAL_PLAYER_SAVE,
+			ITEM_BLOB_STORAGE,
 			HOUSE_BUY_AND_SELL,
 			HOUSE_NEED_PREMIUM,
 			HOUSE_RENTASPRICE,
@@ -172,6 +191,7 @@ class ConfigManager
 			CANNOT_ATTACK_SAME_LOOKFEET,
 			AIMBOT_HOTKEY_ENABLED,
 			FORCE_CLOSE_SLOW_CONNECTION,
+			HTTP_METRICS,
 			EXPERIENCE_STAGES,
 			BLESSING_ONLY_PREMIUM,
 			BED_REQUIRE_PREMIUM,
@@ -27,6 +27,9 @@
 #include "protocolold.h"
 #include "admin.h"
 #include "status.h"
+#include "protocolhttp.h"
+#include "metrics.h"
+#include "rsa.h"
 #include "tasks.h"
 #include "scheduler.h"
 #include "configmanager.h"
@@ -46,6 +49,7 @@ ConnectionManager::ConnectionManager()
 	maxLoginTries = g_config.getNumber(ConfigManager::LOGIN_TRIES);
 	retryTimeout = (uint32_t)g_config.getNumber(ConfigManager::RETRY_TIMEOUT) / 1000;
 	loginTimeout = (uint32_t)g_config.getNumber(ConfigManager::LOGIN_TIMEOUT) / 1000;
+	ipDroppedRotated = time(NULL);
 }
 
 Connection* ConnectionManager::createConnection(boost::asio::io_service& io_service)
@@ -119,6 +123,29 @@ void ConnectionManager::addAttempt(uint32_t clientIp, bool success)
 	it->second.lastLogin = currentTime;
 }
 
+void ConnectionManager::addDroppedPacket(uint32_t clientIp)
+{
+	OTSYS_THREAD_LOCK_CLASS lockClass(m_connectionManagerLock);
+	time_t now = time(NULL);
+	if(now >= ipDroppedRotated + CONNECTION_DROPPED_PACKETS_PERIOD || (ipDroppedPackets[0].size() >= CONNECTION_MAX_TRACKED_IPS
+		&& ipDroppedPackets[0].find(clientIp) == ipDroppedPackets[0].end()))
+	{
+		ipDroppedPackets[1].swap(ipDroppedPackets[0]);
+		ipDroppedPackets[0].clear();
+		ipDroppedRotated = now;
+	}
+
+	ipDroppedPackets[0][clientIp]++;
+}
+
+void ConnectionManager::getDroppedPackets(IpPacketMap& ipPacketMap)
+{
+	OTSYS_THREAD_LOCK_CLASS lockClass(m_connectionManagerLock);
+	ipPacketMap = ipDroppedPackets[1];
+	for(IpPacketMap::const_iterator it = ipDroppedPackets[0].begin(); it != ipDroppedPackets[0].end(); ++it)
+		ipPacketMap[it->first] += it->second;
+}
+
 void ConnectionManager::closeAll()
 {
 	#ifdef __DEBUG_NET_DETAIL__
@@ -172,6 +199,7 @@ void Connection::closeConnectionTask()
 	m_closeState = CLOSE_STATE_CLOSING;
 	if(m_protocol)
 	{
+		Metrics::getInstance()->removeConnection(m_protocol->getProtocolId());
 		Dispatcher::getDispatcher().addTask(createTask(boost::bind(&Protocol::releaseProtocol, m_protocol)));
 		m_protocol->setConnection(NULL);
 		m_protocol = NULL;
@@ -233,6 +261,10 @@ void Connection::deleteConnectionTask()
 {
 	//dispather thread
 	assert(m_refCount == 0);
+	for(std::vector<OutputMessage*>::iterator it = m_writeBatch.begin(); it != m_writeBatch.end(); ++it)
+		OutputMessagePool::getInstance()->releaseMessage(*it, true);
+
+	m_writeBatch.clear();
 	while(!m_outputQueue.empty())
 	{
 		OutputMessagePool::getInstance()->releaseMessage(m_outputQueue.back(), true);
@@ -262,6 +294,24 @@ void Connection::parseHeader(const boost::system::error_code& error)
 		return;
 	}
 
+	if(m_httpOnly)
+	{
+		if(error || m_protocol || m_msg.getBuffer()[0] != 'G' || m_msg.getBuffer()[1] != 'E')
+		{
+			handleReadError(error);
+			OTSYS_THREAD_UNLOCK(m_connectionLock, "");
+			return;
+		}
+
+		//plain http request instead of a length header, take whatever else the client sent
+		m_pendingRead++;
+		m_socket.async_read_some(boost::asio::buffer(m_msg.getBuffer() + NetworkMessage::header_length,
+			NETWORKMESSAGE_MAXSIZE - NetworkMessage::header_length), boost::bind(&Connection::parseHttpRequest,
+			this, boost::asio::placeholders::error, boost::asio::placeholders::bytes_transferred));
+		OTSYS_THREAD_UNLOCK(m_connectionLock, "");
+		return;
+	}
+
 	int32_t size = m_msg.decodeHeader();
 	if(!error && size > 0 && size < NETWORKMESSAGE_MAXSIZE - 16)
 	{
@@ -335,6 +385,18 @@ void Connection::parsePacket(const boost::system::error_code& error)
 					return;
 			}
 
+			Metrics::getInstance()->addConnection(m_protocol->getProtocolId());
+			if(m_protocol->hasRSAFirstMessage() && RSAPool::getInstance()->isRunning()
+				&& m_msg.getMessageLength() - m_msg.getReadPos() >= 128)
+			{
+				//the handshake continues in parseFirstMessage, nothing else is read until then
+				m_pendingRead++;
+				RSAPool::getInstance()->addJob((char*)(m_msg.getBuffer() + m_msg.getMessageLength() - 128),
+					boost::bind(&Connection::onRSADecrypted, this));
+				OTSYS_THREAD_UNLOCK(m_connectionLock, "");
+				return;
+			}
+
 			m_protocol->onRecvFirstMessage(m_msg);
 		}
 		else
@@ -351,6 +413,59 @@ void Connection::parsePacket(const boost::system::error_code& error)
 	OTSYS_THREAD_UNLOCK(m_connectionLock, "");
 }
 
+void Connection::onRSADecrypted()
+{
+	m_ioService.post(boost::bind(&Connection::parseFirstMessage, this));
+}
+
+void Connection::parseFirstMessage()
+{
+	OTSYS_THREAD_LOCK(m_connectionLock, "");
+	m_pendingRead--;
+	if(m_closeState == CLOSE_STATE_CLOSING)
+	{
+		if(!closingConnection())
+			OTSYS_THREAD_UNLOCK(m_connectionLock, "");
+
+		return;
+	}
+
+	m_protocol->m_rsaDecrypted = true;
+	m_protocol->onRecvFirstMessage(m_msg);
+
+	m_pendingRead++;
+	boost::asio::async_read(m_socket, boost::asio::buffer(m_msg.getBuffer(), NetworkMessage::header_length),
+		boost::bind(&Connection::parseHeader, this, boost::asio::placeholders::error));
+	OTSYS_THREAD_UNLOCK(m_connectionLock, "");
+}
+
+void Connection::parseHttpRequest(const boost::system::error_code& error, size_t bytesTransferred)
+{
+	OTSYS_THREAD_LOCK(m_connectionLock, "");
+	m_pendingRead--;
+	if(m_closeState == CLOSE_STATE_CLOSING)
+	{
+		if(!closingConnection())
+			OTSYS_THREAD_UNLOCK(m_connectionLock, "");
+
+		return;
+	}
+
+	if(!error)
+	{
+		m_msg.setMessageLength(NetworkMessage::header_length + bytesTransferred);
+		m_msg.setReadPos(0);
+
+		m_protocol = new ProtocolHTTP(this);
+		Metrics::getInstance()->addConnection(m_protocol->getProtocolId());
+		m_protocol->onRecvFirstMessage(m_msg);
+	}
+	else
+		handleReadError(error);
+
+	OTSYS_THREAD_UNLOCK(m_connectionLock, "");
+}
+
 void Connection::handleReadError(const boost::system::error_code& error)
 {
 	#ifdef __DEBUG_NET_DETAIL__
@@ -390,21 +505,37 @@ bool Connection::send(OutputMessage* msg)
 		return false;
 	}
 
+	//cosmetic packets are dropped past maxPendingBytesPerConnection, a client that still
+	//does not read is closed before its queue grows past this
+	int32_t maxQueuedBytes = g_config.getNumber(ConfigManager::MAX_QUEUED_BYTES);
+	if(maxQueuedBytes > 0 && m_pendingBytes + msg->getMessageLength() > maxQueuedBytes)
+	{
+		if(m_closeState == CLOSE_STATE_NONE)
+		{
+			std::cout << "[Notice] Disconnecting connection with " << m_pendingBytes << " bytes queued" << std::endl;
+			closeConnection();
+		}
+
+		m_droppedMessages++;
+		OTSYS_THREAD_UNLOCK(m_connectionLock, "");
+		return false;
+	}
+
 	msg->getProtocol()->onSendMessage(msg);
-	if(m_pendingWrite == 0)
+	m_outputQueue.push_back(msg);
+	m_pendingBytes += msg->getMessageLength();
+	if(++m_pendingWrite == 1)
 	{
 		#ifdef __DEBUG_NET_DETAIL__
 		std::cout << "Connection::send " << msg->getMessageLength() << std::endl;
 		#endif
-		internalSend(msg);
+		internalSend();
 	}
 	else
 	{
 		#ifdef __DEBUG_NET__
 		std::cout << "Connection::send Adding to queue " << msg->getMessageLength() << std::endl;
 		#endif
-		m_outputQueue.push_back(msg);
-		m_pendingWrite++;
 		if(m_pendingWrite > 500 && g_config.getBool(ConfigManager::FORCE_CLOSE_SLOW_CONNECTION))
 		{
 			std::cout << "[Notice] Forcing slow connection to disconnect" << std::endl;
@@ -416,11 +547,50 @@ bool Connection::send(OutputMessage* msg)
 	return true;
 }
 
-void Connection::internalSend(OutputMessage* msg)
+void Connection::internalSend()
 {
-	m_pendingWrite++;
-	boost::asio::async_write(m_socket, boost::asio::buffer(msg->getOutputBuffer(), msg->getMessageLength()),
-		boost::bind(&Connection::onWriteOperation, this, msg, boost::asio::placeholders::error));
+	//encryption and checksum are done by the network thread, not the dispatcher
+	m_ioService.dispatch(boost::bind(&Connection::writeMessages, this));
+}
+
+void Connection::writeMessages()
+{
+	//network thread
+	OTSYS_THREAD_LOCK_CLASS lockClass(m_connectionLock);
+	if(m_outputQueue.empty() || !m_writeBatch.empty())
+		return;
+
+	//flush as much of the queue as fits in one scatter-gather write
+	int32_t maxBytes = g_config.getNumber(ConfigManager::MAX_BYTES_PER_WRITE), bytes = 0;
+	std::vector<boost::asio::const_buffer> buffers;
+	while(!m_outputQueue.empty() && m_writeBatch.size() < CONNECTION_MAX_WRITE_BUFFERS)
+	{
+		OutputMessage* msg = m_outputQueue.front();
+		//headers, padding and checksum add at most 16 bytes
+		if(!m_writeBatch.empty() && bytes + msg->getMessageLength() + 16 > maxBytes)
+			break;
+
+		m_outputQueue.pop_front();
+		m_pendingBytes -= msg->getMessageLength();
+		msg->getProtocol()->prepareMessage(msg);
+
+		bytes += msg->getMessageLength();
+		buffers.push_back(boost::asio::buffer(msg->getOutputBuffer(), msg->getMessageLength()));
+		m_writeBatch.push_back(msg);
+	}
+
+	m_writeCount++;
+	m_writtenMessages += m_writeBatch.size();
+	#ifdef __DEBUG_NET_DETAIL__
+	std::cout << "Connection::writeMessages " << m_writeBatch.size() << " messages, " << bytes << " bytes" << std::endl;
+	#endif
+	boost::asio::async_write(m_socket, buffers, boost::bind(&Connection::onWriteOperation,
+		this, boost::asio::placeholders::error));
+}
+
+bool Connection::isCongested() const
+{
+	return m_pendingBytes > g_config.getNumber(ConfigManager::MAX_PENDING_BYTES);
 }
 
 uint32_t Connection::getIP() const
@@ -435,40 +605,37 @@ uint32_t Connection::getIP() const
 	return 0;
 }
 
-void Connection::onWriteOperation(OutputMessage* msg, const boost::system::error_code& error)
+void Connection::onWriteOperation(const boost::system::error_code& error)
 {
 	#ifdef __DEBUG_NET_DETAIL__
 	std::cout << "onWriteOperation" << std::endl;
 	#endif
 
-	OutputMessagePool::getInstance()->releaseMessage(msg, true);
+	//only one write is in flight, so nobody else touches the batch now
+	std::vector<OutputMessage*> batch;
+	batch.swap(m_writeBatch);
+	for(std::vector<OutputMessage*>::iterator it = batch.begin(); it != batch.end(); ++it)
+		OutputMessagePool::getInstance()->releaseMessage(*it, true);
+
 	OTSYS_THREAD_LOCK(m_connectionLock, "");
 	if(!error)
 	{
-		if(m_pendingWrite > 0)
+		if(m_pendingWrite >= (int32_t)batch.size())
 		{
+			m_pendingWrite -= batch.size();
 			if(!m_outputQueue.empty())
-			{
-				OutputMessage* msg = m_outputQueue.front();
-				m_outputQueue.pop_front();
-				m_pendingWrite--;
-				internalSend(msg);
-				#ifdef __DEBUG_NET_DETAIL__
-				std::cout << "Connection::onWriteOperation send " << msg->getMessageLength() << std::endl;
-				#endif
-			}
-
-			m_pendingWrite--;
+				internalSend();
 		}
 		else
 		{
 			std::cout << "Error: [Connection::onWriteOperation] Getting unexpected notification!" << std::endl;
-			// Error. Pending operations counter is 0, but we are getting a notification!!
+			// Error. Pending operations counter is lower than the amount of written messages!!
+			m_pendingWrite = m_outputQueue.size();
 		}
 	}
 	else
 	{
-		m_pendingWrite--;
+		m_pendingWrite -= batch.size();
 		handleWriteError(error);
 	}
 
@@ -42,6 +42,12 @@ class Connection;
 #define PRINT_ASIO_ERROR(desc)
 #endif
 
+//asio does not submit more buffers than this in a single writev
+#define CONNECTION_MAX_WRITE_BUFFERS 64
+//dropped packet counters are kept for this many seconds, or until this many addresses were seen
+#define CONNECTION_DROPPED_PACKETS_PERIOD 3600
+#define CONNECTION_MAX_TRACKED_IPS 4096
+
 struct ConnectionBlock
 {
 	uint32_t lastLogin;
@@ -68,6 +74,10 @@ class ConnectionManager
 		bool isDisabled(uint32_t clientIp);
 		void addAttempt(uint32_t clientIp, bool success);
 
+		typedef std::map<uint32_t, uint64_t> IpPacketMap;
+		void addDroppedPacket(uint32_t clientIp);
+		void getDroppedPackets(IpPacketMap& ipPacketMap);
+
 		void closeAll();
 
 	protected:
@@ -76,6 +86,9 @@ class ConnectionManager
 
 		typedef std::map<uint32_t, ConnectionBlock > IpConnectionMap;
 		IpConnectionMap ipConnectionMap;
+		//current and previous period, the previous one is dropped on rotation
+		IpPacketMap ipDroppedPackets[2];
+		time_t ipDroppedRotated;
 
 		std::list<Connection*> m_connections;
 		OTSYS_THREAD_LOCKVAR m_connectionManagerLock;
@@ -96,7 +109,7 @@ class Connection : boost::noncopyable
 		};
 
 	private:
-		Connection(boost::asio::io_service& io_service) : m_socket(io_service)
+		Connection(boost::asio::io_service& io_service) : m_socket(io_service), m_ioService(io_service)
 		{
 			m_refCount = 0;
 			m_protocol = NULL;
@@ -104,6 +117,9 @@ class Connection : boost::noncopyable
 			m_closeState = CLOSE_STATE_NONE;
 			m_socketClosed = false;
 			m_writeError = m_readError = false;
+			m_writeCount = m_writtenMessages = m_droppedMessages = 0;
+			m_pendingBytes = 0;
+			m_httpOnly = false;
 			OTSYS_THREAD_LOCKVARINIT(m_connectionLock);
 
 #ifdef __ENABLE_SERVER_DIAGNOSTIC__
@@ -129,16 +145,32 @@ class Connection : boost::noncopyable
 
 		void closeConnection();
 		void acceptConnection();
+		//metrics listener, the only place http requests are answered
+		void acceptHttpConnection() {m_httpOnly = true; acceptConnection();}
 
 		bool send(OutputMessage* msg);
 		int32_t addRef() {return ++m_refCount;}
 		int32_t unRef() {return --m_refCount;}
 
+		uint64_t getWriteCount() const {return m_writeCount;}
+		uint64_t getWrittenMessages() const {return m_writtenMessages;}
+
+		//bytes waiting in the output queue, read without the lock as a hint only
+		bool isCongested() const;
+		int32_t getPendingBytes() const {return m_pendingBytes;}
+
+		void addDroppedMessage() {m_droppedMessages++;}
+		uint64_t getDroppedMessages() const {return m_droppedMessages;}
+
 	private:
 		void parseHeader(const boost::system::error_code& error);
 		void parsePacket(const boost::system::error_code& error);
+		void parseHttpRequest(const boost::system::error_code& error, size_t bytesTransferred);
+		//rsa worker thread, then network thread
+		void onRSADecrypted();
+		void parseFirstMessage();
 
-		void onWriteOperation(OutputMessage* msg, const boost::system::error_code& error);
+		void onWriteOperation(const boost::system::error_code& error);
 
 		void handleReadError(const boost::system::error_code& error);
 		void handleWriteError(const boost::system::error_code& error);
@@ -148,17 +180,22 @@ class Connection : boost::noncopyable
 		void deleteConnectionTask();
 		void releaseConnection();
 
-		void internalSend(OutputMessage* msg);
+		void internalSend();
+		void writeMessages();
 
 		NetworkMessage m_msg;
 		boost::asio::ip::tcp::socket m_socket;
-		bool m_socketClosed;
+		boost::asio::io_service& m_ioService;
+		bool m_socketClosed, m_httpOnly;
 
 		bool m_writeError;
 		bool m_readError;
 
 		int32_t m_pendingWrite;
 		std::list <OutputMessage*> m_outputQueue;
+		std::vector<OutputMessage*> m_writeBatch;
+		uint64_t m_writeCount, m_writtenMessages, m_droppedMessages;
+		int32_t m_pendingBytes;
 		int32_t m_pendingRead;
 		uint32_t m_closeState;
 		uint32_t m_refCount;
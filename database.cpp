@@ -35,51 +35,136 @@
 #include "databasepgsql.h"
 #endif
 
+#include "tasks.h"
+#include "databasetasks.h"
+#include <boost/thread/tss.hpp>
+
 #if defined MULTI_SQL_DRIVERS
 #include "configmanager.h"
 
 extern ConfigManager g_config;
 #endif
 
-OTSYS_THREAD_LOCKVAR DBQuery::databaseLock;
-
 Database* _Database::_instance = NULL;
 
+//connections are owned by the pool, threads only borrow them
+static void keepThreadInstance(Database* db) {}
+static boost::thread_specific_ptr<Database> threadInstance(&keepThreadInstance);
+
 Database* _Database::getInstance()
 {
+	if(Database* db = threadInstance.get())
+		return db;
+
 	if(!_instance)
-	{
+		_instance = createInstance();
+
+	return _instance;
+}
+
+Database* _Database::createInstance()
+{
+	Database* db = NULL;
 #if defined MULTI_SQL_DRIVERS
 #ifdef __USE_MYSQL__
-		if(g_config.getString(ConfigManager::SQL_TYPE) == "mysql")
-			_instance = new DatabaseMySQL;
+	if(g_config.getString(ConfigManager::SQL_TYPE) == "mysql")
+		db = new DatabaseMySQL;
 #endif
 #ifdef __USE_ODBC__
-		if(g_config.getString(ConfigManager::SQL_TYPE) == "odbc")
-			_instance = new DatabaseODBC;
+	if(g_config.getString(ConfigManager::SQL_TYPE) == "odbc")
+		db = new DatabaseODBC;
 #endif
 #ifdef __USE_SQLITE__
-		if(g_config.getString(ConfigManager::SQL_TYPE) == "sqlite")
-			_instance = new DatabaseSQLite;
+	if(g_config.getString(ConfigManager::SQL_TYPE) == "sqlite")
+		db = new DatabaseSQLite;
 #endif
 #ifdef __USE_PGSQL__
-		if(g_config.getString(ConfigManager::SQL_TYPE) == "pgsql")
-			_instance = new DatabasePgSQL;
+	if(g_config.getString(ConfigManager::SQL_TYPE) == "pgsql")
+		db = new DatabasePgSQL;
 #endif
 #else
-		_instance = new Database;
+	db = new Database;
 #endif
+	return db;
+}
+
+void _Database::setThreadInstance(Database* db)
+{
+	threadInstance.reset(db);
+}
+
+void _Database::asyncQuery(const std::string& query, const DBQueryCallback& callback/* = DBQueryCallback()*/)
+{
+	DatabaseTasks::getInstance()->addTask(createTask(boost::bind(&_Database::runQuery, query, callback)));
+}
+
+void _Database::asyncStore(const std::string& query, const DBStoreCallback& callback)
+{
+	DatabaseTasks::getInstance()->addTask(createTask(boost::bind(&_Database::runStore, query, callback)));
+}
+
+void _Database::asyncTransaction(const std::vector<std::string>& queries, const DBQueryCallback& callback/* = DBQueryCallback()*/)
+{
+	DatabaseTasks::getInstance()->addTask(createTask(boost::bind(&_Database::runTransaction, queries, callback)));
+}
 
-		OTSYS_THREAD_LOCKVARINIT(DBQuery::databaseLock);
+void _Database::runQuery(std::string query, DBQueryCallback callback)
+{
+	//database thread
+	bool success;
+	{
+		DBQuery lock;
+		success = getInstance()->executeQuery(query);
 	}
 
-	return _instance;
+	if(callback)
+		Dispatcher::getDispatcher().addTask(createTask(boost::bind(callback, success)));
+}
+
+void _Database::runStore(std::string query, DBStoreCallback callback)
+{
+	//database thread, the rows are read before the connection is unlocked
+	DBQuery lock;
+	Database* db = getInstance();
+
+	db->m_emptyResult = false;
+	DBResult* result = db->storeQuery(query);
+	callback(result, result || db->m_emptyResult);
+	if(result)
+		db->freeResult(result);
+}
+
+void _Database::runTransaction(std::vector<std::string> queries, DBQueryCallback callback)
+{
+	//database thread, the lock keeps every statement on this connection inside the transaction
+	bool success = true;
+	{
+		DBQuery lock;
+		Database* db = getInstance();
+
+		DBTransaction transaction(db);
+		if(!transaction.begin())
+			success = false;
+
+		for(std::vector<std::string>::iterator it = queries.begin(); success && it != queries.end(); ++it)
+		{
+			if(!db->executeQuery(*it))
+				success = false;
+		}
+
+		if(success)
+			success = transaction.commit();
+	}
+
+	if(callback)
+		Dispatcher::getDispatcher().addTask(createTask(boost::bind(callback, success)));
 }
 
 DBResult* _Database::verifyResult(DBResult* result)
 {
 	if(!result->next())
 	{
+		m_emptyResult = true;
 		_instance->freeResult(result);
 		return NULL;
 	}
@@ -89,57 +174,113 @@ DBResult* _Database::verifyResult(DBResult* result)
 
 DBQuery::DBQuery()
 {
-	OTSYS_THREAD_LOCK(databaseLock, "");
+	m_database = Database::getInstance();
+	OTSYS_THREAD_LOCK(m_database->m_queryLock, "");
 }
 
 DBQuery::~DBQuery()
 {
-	OTSYS_THREAD_UNLOCK(databaseLock, "");
+	OTSYS_THREAD_UNLOCK(m_database->m_queryLock, "");
 }
 
-DBInsert::DBInsert(Database* db)
+DBStatement& DBStatement::bind(DBStatementParam_t type, int64_t number, const std::string& data)
 {
-	m_db = db;
-	m_rows = 0;
+	DBStatementParam param;
+	param.type = type;
+	param.number = number;
+	param.data = data;
 
-	// checks if current database engine supports multiline INSERTs
-	m_multiLine = m_db->getParam(DBPARAM_MULTIINSERT) != 0;
+	m_params.push_back(param);
+	return *this;
 }
 
-void DBInsert::setQuery(const std::string& query)
+DBStatement& DBStatement::bindInt(int64_t value)
 {
-	m_query = query;
-	m_buf = "";
-	m_rows = 0;
+	return bind(DBSTATEMENT_INT, value, "");
 }
 
-bool DBInsert::addRow(const std::string& row)
+DBStatement& DBStatement::bindString(const std::string& value)
+{
+	return bind(DBSTATEMENT_STRING, 0, value);
+}
+
+DBStatement& DBStatement::bindBlob(const char* value, uint32_t length)
+{
+	return bind(DBSTATEMENT_BLOB, 0, std::string(value, length));
+}
+
+std::string DBStatement::getText(Database* db) const
 {
-	if(m_multiLine)
+	std::stringstream query;
+	uint32_t param = 0;
+
+	bool inString = false;
+	for(uint32_t i = 0; i < m_query.length(); ++i)
 	{
-		m_rows++;
-		int32_t size = m_buf.length();
+		char c = m_query[i];
+		if(c == '\'')
+			inString = !inString;
 
-		// adds new row to buffer
-		if(size == 0)
-			m_buf = "(" + row + ")";
-		else if(size > 8192)
+		if(c != '?' || inString || param >= m_params.size())
 		{
-			if(!execute())
-				return false;
-
-			m_buf = "(" + row + ")";
+			query << c;
+			continue;
 		}
-		else
-				m_buf += ",(" + row + ")";
 
-		return true;
+		const DBStatementParam& value = m_params[param++];
+		switch(value.type)
+		{
+			case DBSTATEMENT_INT:
+				query << value.number;
+				break;
+			case DBSTATEMENT_STRING:
+				query << db->escapeString(value.data);
+				break;
+			case DBSTATEMENT_BLOB:
+				query << db->escapeBlob(value.data.c_str(), value.data.length());
+				break;
+		}
 	}
-	else
+
+	return query.str();
+}
+
+DBInsert::DBInsert(Database* db)
+{
+	m_db = db;
+	m_size = 0;
+
+	// checks if current database engine supports multiline or bulk INSERTs
+	m_multiLine = m_db->getParam(DBPARAM_MULTIINSERT) != 0;
+	m_bulk = m_db->getParam(DBPARAM_BULKINSERT) != 0;
+
+	// keeps each statement within what the server accepts
+	m_limit = DATABASE_INSERT_BUFFER;
+	if(uint32_t maxSize = m_db->getMaxQuerySize())
+		m_limit = std::min(m_limit, maxSize);
+}
+
+void DBInsert::setQuery(const std::string& query)
+{
+	m_query = query;
+	m_rows.clear();
+	m_size = query.length();
+}
+
+bool DBInsert::addRow(const std::string& row)
+{
+	if(!m_multiLine && !m_bulk)
 	{
 		// executes INSERT for current row
-		return m_db->executeQuery(m_query + "(" + row + ")" );
+		return m_db->executeQuery(m_query + "(" + row + ")");
 	}
+
+	if(!m_rows.empty() && m_size + row.length() + 3 > m_limit && !execute())
+		return false;
+
+	m_rows.push_back(row);
+	m_size += row.length() + 3;
+	return true;
 }
 
 bool DBInsert::addRow(std::stringstream& row)
@@ -151,24 +292,31 @@ bool DBInsert::addRow(std::stringstream& row)
 
 bool DBInsert::execute()
 {
-	if(m_multiLine && m_buf.length() > 0)
+	if(m_rows.empty())
 	{
-		if(m_rows == 0)
-		{
-			//no rows to execute
-			return true;
-		}
-
-		m_rows = 0;
-
-		// executes buffer
-		bool res = m_db->executeQuery(m_query + m_buf);
-		m_buf = "";
-		return res;
+		// no rows to execute, or INSERTs were executed on-fly
+		return true;
 	}
+
+	bool res;
+	if(m_bulk)
+		res = m_db->executeInsert(m_query, m_rows);
 	else
 	{
-		// INSERTs were executed on-fly
-		return true;
+		std::string buf = m_query;
+		buf.reserve(m_size);
+		for(std::vector<std::string>::iterator it = m_rows.begin(); it != m_rows.end(); ++it)
+		{
+			if(it != m_rows.begin())
+				buf += ",";
+
+			buf += "(" + *it + ")";
+		}
+
+		res = m_db->executeQuery(buf);
 	}
+
+	m_rows.clear();
+	m_size = m_query.length();
+	return res;
 }
@@ -25,6 +25,8 @@
 #include "enums.h"
 
 #include <sstream>
+#include <vector>
+#include <boost/function.hpp>
 
 #ifdef MULTI_SQL_DRIVERS
 #define DATABASE_VIRTUAL virtual
@@ -72,12 +74,24 @@ typedef DATABASE_CLASS Database;
 typedef DBRES_CLASS DBResult;
 
 class DBQuery;
+class DBStatement;
+
+//prepared statements kept per connection, queries past this are prepared for a single use
+#define DATABASE_STATEMENT_CACHE 128
+//rows buffered by DBInsert before they are sent, in bytes
+#define DATABASE_INSERT_BUFFER 1048576
 
 enum DBParam_t
 {
-	DBPARAM_MULTIINSERT = 1
+	DBPARAM_MULTIINSERT = 1,
+	DBPARAM_CONNECTIONPOOL = 2,
+	DBPARAM_BULKINSERT = 4
 };
 
+typedef boost::function<void (bool)> DBQueryCallback;
+//the result is null when the query failed or returned no rows, success tells them apart
+typedef boost::function<void (DBResult*, bool)> DBStoreCallback;
+
 class _Database
 {
 	public:
@@ -90,6 +104,16 @@ class _Database
 		*/
 		static Database* getInstance();
 
+		/**
+		* Pooled connections.
+		*
+		* Opens another connection with the configured driver. A thread that sets it as its own instance gets it from getInstance() from then on, database worker threads do so when the driver supports DBPARAM_CONNECTIONPOOL.
+		*
+		* @return new connection handler, not necessarily connected
+		*/
+		static Database* createInstance();
+		static void setThreadInstance(Database* db);
+
 		/**
 		* Database information.
 		*
@@ -145,6 +169,54 @@ class _Database
 		*/
 		DATABASE_VIRTUAL DBResult* storeQuery(const std::string &query) { return 0; }
 
+		/**
+		* Queries database without buffering results.
+		*
+		* Same as storeQuery(), but rows are fetched from the server as next() reaches them instead of being read into memory at once. Until the result is freed the connection can't run anything else, so keep DBQuery held and don't run other queries while reading it.
+		*
+		* @param std::string query
+		* @return results object (null on error)
+		*/
+		DATABASE_VIRTUAL DBResult* streamQuery(const std::string &query) { return 0; }
+
+		/**
+		* Executes prepared statement.
+		*
+		* Prepares the statement on its first use on this connection and executes it with the bound values, which never go through escaping.
+		*
+		* @param DBStatement statement with all of its placeholders bound
+		* @return true on success, false on error
+		*/
+		DATABASE_VIRTUAL bool executeStatement(const DBStatement& stmt) { return 0; }
+
+		/**
+		* Queries database with prepared statement.
+		*
+		* Same as executeStatement(), for statements which generate results.
+		*
+		* @param DBStatement statement with all of its placeholders bound
+		* @return results object (null on error)
+		*/
+		DATABASE_VIRTUAL DBResult* storeStatement(const DBStatement& stmt) { return 0; }
+
+		/**
+		* Bulk insert.
+		*
+		* Inserts the rows buffered by DBInsert the fastest way the driver knows, used when it reports DBPARAM_BULKINSERT.
+		*
+		* @param std::string INSERT query prototype, ending with VALUES
+		* @param rows row data, as given to DBInsert::addRow()
+		* @return true on success, false on error
+		*/
+		DATABASE_VIRTUAL bool executeInsert(const std::string& query, const std::vector<std::string>& rows) { return 0; }
+
+		/**
+		* Largest query the server accepts.
+		*
+		* @return size in bytes, 0 if there is no limit
+		*/
+		DATABASE_VIRTUAL uint32_t getMaxQuerySize() { return 0; }
+
 		/**
 		* Escapes string for query.
 		*
@@ -186,15 +258,42 @@ class _Database
 		*/
 		DATABASE_VIRTUAL DatabaseEngine_t getDatabaseEngine() { return DATABASE_ENGINE_NONE; }
 
+		/**
+		* Asynchronous execution.
+		*
+		* Runs the query on a database worker thread and calls back on the dispatcher. A store callback is called on the worker instead, with the connection still locked, so it reads the rows before anything else runs on it. Results are freed after it returns, transaction queries run on a single connection.
+		*
+		* @param std::string query
+		* @param callback called with the result, optional for asyncQuery and asyncTransaction
+		*/
+		static void asyncQuery(const std::string& query, const DBQueryCallback& callback = DBQueryCallback());
+		static void asyncStore(const std::string& query, const DBStoreCallback& callback);
+		static void asyncTransaction(const std::vector<std::string>& queries, const DBQueryCallback& callback = DBQueryCallback());
+
 	protected:
-		_Database() { m_lastUse = time(NULL); }
+		_Database()
+		{
+			m_lastUse = time(NULL);
+			m_emptyResult = false;
+			OTSYS_THREAD_LOCKVARINIT(m_queryLock);
+		}
 		DATABASE_VIRTUAL ~_Database() {}
 
 		DBResult* verifyResult(DBResult* result);
 
+		static void runQuery(std::string query, DBQueryCallback callback);
+		static void runStore(std::string query, DBStoreCallback callback);
+		static void runTransaction(std::vector<std::string> queries, DBQueryCallback callback);
+
 		bool m_connected;
+		//set by verifyResult, a null result of the last query meant no rows rather than an error
+		bool m_emptyResult;
 		time_t m_lastUse;
 
+		//held by DBQuery, one per connection
+		friend class DBQuery;
+		OTSYS_THREAD_LOCKVAR m_queryLock;
+
 	private:
 		static Database* _instance;
 };
@@ -223,6 +322,18 @@ class _DBResult
 		*/
 		DATABASE_VIRTUAL const char* getDataStream(const std::string &s, uint64_t &size) { return 0; }
 
+		/** Get the index of a field, for reading it in every row without looking it up by name
+		*\returns The index of the field, -1 if there is no such field
+		*\param s The name of the field
+		*/
+		DATABASE_VIRTUAL int32_t getColumn(const std::string &s) { return -1; }
+		/** Same as the getters above, with the field given by getColumn()
+		*/
+		DATABASE_VIRTUAL int32_t getDataInt(int32_t column) { return 0; }
+		DATABASE_VIRTUAL int64_t getDataLong(int32_t column) { return 0; }
+		DATABASE_VIRTUAL std::string getDataString(int32_t column) { return "''"; }
+		DATABASE_VIRTUAL const char* getDataStream(int32_t column, uint64_t &size) { return 0; }
+
 		/**
 		* Moves to next result in set.
 		*
@@ -238,7 +349,7 @@ class _DBResult
 /**
  * Thread locking hack.
  *
- * By using this class for your queries you lock and unlock database for threads.
+ * By using this class for your queries you lock and unlock the connection of the current thread.
 */
 class DBQuery : public std::stringstream
 {
@@ -249,7 +360,70 @@ class DBQuery : public std::stringstream
 		virtual ~DBQuery();
 
 	protected:
-		static OTSYS_THREAD_LOCKVAR databaseLock;
+		Database* m_database;
+};
+
+enum DBStatementParam_t
+{
+	DBSTATEMENT_INT,
+	DBSTATEMENT_STRING,
+	DBSTATEMENT_BLOB
+};
+
+struct DBStatementParam
+{
+	DBStatementParam_t type;
+	int64_t number;
+	std::string data;
+
+	bool operator==(const DBStatementParam& param) const
+	{
+		return type == param.type && number == param.number && data == param.data;
+	}
+};
+
+/**
+ * Prepared statement.
+ *
+ * Query with ? placeholders and the typed values bound to them, in order. It is executed through Database::executeStatement() and Database::storeStatement(), the query text is parsed once per connection.
+ */
+class DBStatement
+{
+	public:
+		DBStatement(const std::string& query) {m_query = query;}
+		virtual ~DBStatement() {}
+
+		typedef std::vector<DBStatementParam> ParamList;
+
+		/**
+		* Binds value to the next placeholder.
+		*/
+		DBStatement& bindInt(int64_t value);
+		DBStatement& bindString(const std::string& value);
+		DBStatement& bindBlob(const char* value, uint32_t length);
+
+		/**
+		* Drops bound values, so the statement can be executed again.
+		*/
+		void clear() {m_params.clear();}
+
+		const std::string& getQuery() const {return m_query;}
+		const ParamList& getParams() const {return m_params;}
+
+		bool operator==(const DBStatement& stmt) const {return m_query == stmt.m_query && m_params == stmt.m_params;}
+
+		/**
+		* Query with escaped values in place of the placeholders, for drivers without prepared statements.
+		*
+		* @param Database* database wrapper used to escape the values
+		*/
+		std::string getText(Database* db) const;
+
+	protected:
+		DBStatement& bind(DBStatementParam_t type, int64_t number, const std::string& data);
+
+		std::string m_query;
+		ParamList m_params;
 };
 
 /**
@@ -278,7 +452,7 @@ class DBInsert
 		/**
 		* Adds new row to INSERT statement.
 		*
-		* On databases that doesn't support multiline INSERTs it simply execute INSERT for each row.
+		* Rows are buffered and sent once they reach DATABASE_INSERT_BUFFER or the server's query size limit. On databases that doesn't support multiline INSERTs nor bulk inserts it simply execute INSERT for each row.
 		*
 		* @param std::string& row data
 		*/
@@ -294,11 +468,11 @@ class DBInsert
 		bool execute();
 
 	protected:
-		bool m_multiLine;
+		bool m_multiLine, m_bulk;
 
-		uint32_t m_rows;
+		uint32_t m_size, m_limit;
 		std::string m_query;
-		std::string m_buf;
+		std::vector<std::string> m_rows;
 
 		Database* m_db;
 };
@@ -845,6 +845,129 @@ uint32_t DatabaseManager::updateDatabase()
 			return 8;
 		}
 
+		case 8:
+		{
+			std::cout << "> Updating database to version: 9..." << std::endl;
+
+			DBQuery query;
+			switch(db->getDatabaseEngine())
+			{
+				case DATABASE_ENGINE_MYSQL:
+				{
+					query << "CREATE TABLE `player_itemblobs` (`player_id` INT NOT NULL, `type` TINYINT(1) UNSIGNED NOT NULL, `data` LONGBLOB NOT NULL, UNIQUE (`player_id`, `type`), FOREIGN KEY (`player_id`) REFERENCES `players` (`id`) ON DELETE CASCADE) ENGINE = InnoDB;";
+					break;
+				}
+
+				case DATABASE_ENGINE_SQLITE:
+				{
+					query << "CREATE TABLE `player_itemblobs` (`player_id` INTEGER NOT NULL, `type` INTEGER NOT NULL, `data` BLOB NOT NULL, UNIQUE (`player_id`, `type`), FOREIGN KEY (`player_id`) REFERENCES `players` (`id`));";
+					break;
+				}
+
+				case DATABASE_ENGINE_POSTGRESQL:
+				{
+					query << "CREATE TABLE `player_itemblobs` (`player_id` INT NOT NULL, `type` SMALLINT NOT NULL, `data` BYTEA NOT NULL, UNIQUE (`player_id`, `type`), FOREIGN KEY (`player_id`) REFERENCES `players` (`id`) ON DELETE CASCADE);";
+					break;
+				}
+
+				default:
+					break;
+			}
+
+			db->executeQuery(query.str());
+			query.str("");
+			registerDatabaseConfig("db_version", 9);
+			return 9;
+		}
+
+		case 9:
+		{
+			std::cout << "> Updating database to version: 10..." << std::endl;
+
+			DBQuery query;
+			switch(db->getDatabaseEngine())
+			{
+				case DATABASE_ENGINE_MYSQL:
+				{
+					query << "CREATE TABLE `player_mail` (`id` INT NOT NULL AUTO_INCREMENT, `player_id` INT NOT NULL, `data` LONGBLOB NOT NULL, PRIMARY KEY (`id`), KEY (`player_id`), FOREIGN KEY (`player_id`) REFERENCES `players` (`id`) ON DELETE CASCADE) ENGINE = InnoDB;";
+					break;
+				}
+
+				case DATABASE_ENGINE_SQLITE:
+				{
+					query << "CREATE TABLE `player_mail` (`id` INTEGER PRIMARY KEY AUTOINCREMENT, `player_id` INTEGER NOT NULL, `data` BLOB NOT NULL, FOREIGN KEY (`player_id`) REFERENCES `players` (`id`));";
+					break;
+				}
+
+				case DATABASE_ENGINE_POSTGRESQL:
+				{
+					query << "CREATE TABLE `player_mail` (`id` SERIAL PRIMARY KEY, `player_id` INT NOT NULL, `data` BYTEA NOT NULL, FOREIGN KEY (`player_id`) REFERENCES `players` (`id`) ON DELETE CASCADE);";
+					break;
+				}
+
+				default:
+					break;
+			}
+
+			db->executeQuery(query.str());
+			query.str("");
+			registerDatabaseConfig("db_version", 10);
+			return 10;
+		}
+
+		case 10:
+		{
+			std::cout << "> Updating database to version: 11..." << std::endl;
+			if(db->getDatabaseEngine() == DATABASE_ENGINE_SQLITE)
+			{
+				//no cascades, checkTriggers recreates the trigger with the item blobs
+				DBQuery query;
+				query << "DROP TRIGGER IF EXISTS `ondelete_players`;";
+				db->executeQuery(query.str());
+
+				query.str("");
+				query << "DELETE FROM `player_itemblobs` WHERE `player_id` NOT IN (SELECT `id` FROM `players`);";
+				db->executeQuery(query.str());
+			}
+
+			registerDatabaseConfig("db_version", 11);
+			return 11;
+		}
+
+		case 11:
+		{
+			std::cout << "> Updating database to version: 12..." << std::endl;
+			if(db->getDatabaseEngine() == DATABASE_ENGINE_SQLITE)
+			{
+				//no cascades, checkTriggers recreates the trigger with the mail
+				DBQuery query;
+				query << "DROP TRIGGER IF EXISTS `ondelete_players`;";
+				db->executeQuery(query.str());
+
+				query.str("");
+				query << "DELETE FROM `player_mail` WHERE `player_id` NOT IN (SELECT `id` FROM `players`);";
+				db->executeQuery(query.str());
+			}
+
+			registerDatabaseConfig("db_version", 12);
+			return 12;
+		}
+
+		case 12:
+		{
+			std::cout << "> Updating database to version: 13..." << std::endl;
+
+			DBQuery query;
+			if(db->getDatabaseEngine() == DATABASE_ENGINE_SQLITE)
+				query << "ALTER TABLE `players` ADD `save_sequence` INTEGER NOT NULL DEFAULT 0;";
+			else
+				query << "ALTER TABLE `players` ADD `save_sequence` BIGINT NOT NULL DEFAULT 0;";
+
+			db->executeQuery(query.str());
+			registerDatabaseConfig("db_version", 13);
+			return 13;
+		}
+
 		default:
 			break;
 	}
@@ -1084,7 +1207,7 @@ void DatabaseManager::checkTriggers()
 				"CREATE TRIGGER \"oncreate_guilds\" AFTER INSERT ON \"guilds\" BEGIN INSERT INTO \"guild_ranks\" (\"name\", \"level\", \"guild_id\") VALUES (\"the Leader\", 3, NEW.\"id\"); INSERT INTO \"guild_ranks\" (\"name\", \"level\", \"guild_id\") VALUES (\"a Vice-Leader\", 2, NEW.\"id\"); INSERT INTO \"guild_ranks\" (\"name\", \"level\", \"guild_id\") VALUES (\"a Member\", 1, NEW.\"id\"); END;",
 				"CREATE TRIGGER \"oncreate_players\" AFTER INSERT ON \"players\" BEGIN INSERT INTO \"player_skills\" (\"player_id\", \"skillid\", \"value\") VALUES (NEW.\"id\", 0, 10); INSERT INTO \"player_skills\" (\"player_id\", \"skillid\", \"value\") VALUES (NEW.\"id\", 1, 10); INSERT INTO \"player_skills\" (\"player_id\", \"skillid\", \"value\") VALUES (NEW.\"id\", 2, 10); INSERT INTO \"player_skills\" (\"player_id\", \"skillid\", \"value\") VALUES (NEW.\"id\", 3, 10); INSERT INTO \"player_skills\" (\"player_id\", \"skillid\", \"value\") VALUES (NEW.\"id\", 4, 10); INSERT INTO \"player_skills\" (\"player_id\", \"skillid\", \"value\") VALUES (NEW.\"id\", 5, 10); INSERT INTO \"player_skills\" (\"player_id\", \"skillid\", \"value\") VALUES (NEW.\"id\", 6, 10); END;",
 				"CREATE TRIGGER \"ondelete_accounts\" BEFORE DELETE ON \"accounts\" FOR EACH ROW BEGIN DELETE FROM \"players\" WHERE \"account_id\" = OLD.\"id\"; DELETE FROM \"bans\" WHERE \"type\" != 1 AND \"type\" != 2 AND \"value\" = OLD.\"id\"; END;",
-				"CREATE TRIGGER \"ondelete_players\" BEFORE DELETE ON \"players\" FOR EACH ROW BEGIN SELECT RAISE(ROLLBACK, 'DELETE on table \"players\" violates foreign: \"ownerid\" from table \"guilds\"') WHERE (SELECT \"id\" FROM \"guilds\" WHERE \"ownerid\" = OLD.\"id\") IS NOT NULL; DELETE FROM \"player_viplist\" WHERE \"player_id\" = OLD.\"id\" OR \"vip_id\" = OLD.\"id\"; DELETE FROM \"player_storage\" WHERE \"player_id\" = OLD.\"id\"; DELETE FROM \"player_skills\" WHERE \"player_id\" = OLD.\"id\"; DELETE FROM \"player_items\" WHERE \"player_id\" = OLD.\"id\"; DELETE FROM \"player_depotitems\" WHERE \"player_id\" = OLD.\"id\"; DELETE FROM \"player_spells\" WHERE \"player_id\" = OLD.\"id\"; DELETE FROM \"bans\" WHERE \"type\" = 2 AND \"value\" = OLD.\"id\"; UPDATE \"houses\" SET \"owner\" = 0 WHERE \"owner\" = OLD.\"id\"; END;",
+				"CREATE TRIGGER \"ondelete_players\" BEFORE DELETE ON \"players\" FOR EACH ROW BEGIN SELECT RAISE(ROLLBACK, 'DELETE on table \"players\" violates foreign: \"ownerid\" from table \"guilds\"') WHERE (SELECT \"id\" FROM \"guilds\" WHERE \"ownerid\" = OLD.\"id\") IS NOT NULL; DELETE FROM \"player_viplist\" WHERE \"player_id\" = OLD.\"id\" OR \"vip_id\" = OLD.\"id\"; DELETE FROM \"player_storage\" WHERE \"player_id\" = OLD.\"id\"; DELETE FROM \"player_skills\" WHERE \"player_id\" = OLD.\"id\"; DELETE FROM \"player_items\" WHERE \"player_id\" = OLD.\"id\"; DELETE FROM \"player_depotitems\" WHERE \"player_id\" = OLD.\"id\"; DELETE FROM \"player_itemblobs\" WHERE \"player_id\" = OLD.\"id\"; DELETE FROM \"player_mail\" WHERE \"player_id\" = OLD.\"id\"; DELETE FROM \"player_spells\" WHERE \"player_id\" = OLD.\"id\"; DELETE FROM \"bans\" WHERE \"type\" = 2 AND \"value\" = OLD.\"id\"; UPDATE \"houses\" SET \"owner\" = 0 WHERE \"owner\" = OLD.\"id\"; END;",
 				"CREATE TRIGGER \"ondelete_guilds\" BEFORE DELETE ON \"guilds\" FOR EACH ROW BEGIN UPDATE \"players\" SET \"guildnick\" = '', \"rank_id\" = 0 WHERE \"rank_id\" IN (SELECT \"id\" FROM \"guild_ranks\" WHERE \"guild_id\" = OLD.\"id\"); DELETE FROM \"guild_ranks\" WHERE \"guild_id\" = OLD.\"id\"; END;",
 				"CREATE TRIGGER \"oninsert_players\" BEFORE INSERT ON \"players\" FOR EACH ROW BEGIN SELECT RAISE(ROLLBACK, 'INSERT on table \"players\" violates foreign: \"account_id\"') WHERE NEW.\"account_id\" IS NULL OR (SELECT \"id\" FROM \"accounts\" WHERE \"id\" = NEW.\"account_id\") IS NULL; SELECT RAISE(ROLLBACK, 'INSERT on table \"players\" violates foreign: \"group_id\"') WHERE NEW.\"group_id\" IS NULL OR (SELECT \"id\" FROM \"groups\" WHERE \"id\" = NEW.\"group_id\") IS NULL; END;",
 				"CREATE TRIGGER \"onupdate_players\" BEFORE UPDATE ON \"players\" FOR EACH ROW BEGIN SELECT RAISE(ROLLBACK, 'UPDATE on table \"players\" violates foreign: \"account_id\"') WHERE NEW.\"account_id\" IS NULL OR (SELECT \"id\" FROM \"accounts\" WHERE \"id\" = NEW.\"account_id\") IS NULL; SELECT RAISE(ROLLBACK, 'UPDATE on table \"players\" violates foreign: \"group_id\"') WHERE NEW.\"group_id\" IS NULL OR (SELECT \"id\" FROM \"groups\" WHERE \"id\" = NEW.\"group_id\") IS NULL; END;",
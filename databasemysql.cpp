@@ -26,6 +26,7 @@
 
 #include "database.h"
 #include "databasemysql.h"
+#include "metrics.h"
 #ifdef __MYSQL_ALT_INCLUDE__
 #include "errmsg.h"
 #else
@@ -40,13 +41,14 @@ extern ConfigManager g_config;
 DatabaseMySQL::DatabaseMySQL()
 {
 	m_connected = false;
+	m_maxQuerySize = 0;
 	if(!mysql_init(&m_handle))
 	{
 		std::cout << "Failed to initialize MySQL connection handler." << std::endl;
 		return;
 	}
 
-	my_bool reconnect = true;
+	MySQLBool reconnect = true;
 	mysql_options(&m_handle, MYSQL_OPT_RECONNECT, &reconnect);
 	uint32_t readTimeout = 10;
 	mysql_options(&m_handle, MYSQL_OPT_READ_TIMEOUT, (const char*)&readTimeout);
@@ -67,6 +69,16 @@ DatabaseMySQL::DatabaseMySQL()
 	m_connected = true;
 	m_attempts = 0;
 
+	//multi-row inserts are split to fit into a packet, leaving room for the packet header
+	if(DBResult* result = storeQuery("SELECT @@max_allowed_packet AS `size`"))
+	{
+		int64_t size = result->getDataLong("size");
+		if(size > 1024)
+			m_maxQuerySize = (uint32_t)std::min<int64_t>(size - 1024, 0xFFFFFFFF);
+
+		freeResult(result);
+	}
+
 	uint32_t keepAlive = g_config.getNumber(ConfigManager::SQL_KEEPALIVE);
 	if(keepAlive)
 		Scheduler::getScheduler().addEvent(createSchedulerTask((keepAlive * 1000), boost::bind(&DatabaseMySQL::keepAlive, this)));
@@ -74,6 +86,7 @@ DatabaseMySQL::DatabaseMySQL()
 
 DatabaseMySQL::~DatabaseMySQL()
 {
+	clearStatements();
 	mysql_close(&m_handle);
 }
 
@@ -82,6 +95,7 @@ bool DatabaseMySQL::getParam(DBParam_t param)
 	switch(param)
 	{
 		case DBPARAM_MULTIINSERT:
+		case DBPARAM_CONNECTIONPOOL:
 			return true;
 		default:
 			break;
@@ -128,6 +142,8 @@ bool DatabaseMySQL::executeQuery(const std::string &query)
 	if(!m_connected)
 		return false;
 
+	QueryTimer timer;
+
 	if(mysql_real_query(&m_handle, query.c_str(), query.length()) != 0)
 	{
 		int32_t error = mysql_errno(&m_handle);
@@ -149,17 +165,29 @@ bool DatabaseMySQL::executeQuery(const std::string &query)
 }
 
 DBResult* DatabaseMySQL::storeQuery(const std::string &query)
+{
+	return fetchQuery(query, false);
+}
+
+DBResult* DatabaseMySQL::streamQuery(const std::string &query)
+{
+	return fetchQuery(query, true);
+}
+
+DBResult* DatabaseMySQL::fetchQuery(const std::string& query, bool stream)
 {
 	if(!m_connected)
 		return NULL;
 
+	QueryTimer timer;
+
 	if(mysql_real_query(&m_handle, query.c_str(), query.length()) != 0)
 	{
 		int32_t error = mysql_errno(&m_handle);
 		if(error == CR_SERVER_LOST || error == CR_SERVER_GONE_ERROR)
 		{
 			if(reconnect())
-				return storeQuery(query);
+				return fetchQuery(query, stream);
 		}
 
 		std::cout << "mysql_real_query(): " << query << ": MYSQL ERROR: " << mysql_error(&m_handle) << std::endl;
@@ -167,7 +195,8 @@ DBResult* DatabaseMySQL::storeQuery(const std::string &query)
 
 	}
 
-	if(MYSQL_RES* m_res = mysql_store_result(&m_handle))
+	//streamed rows stay on the server until fetched
+	if(MYSQL_RES* m_res = (stream ? mysql_use_result(&m_handle) : mysql_store_result(&m_handle)))
 	{
 		DBResult* res = (DBResult*)new MySQLResult(m_res);
 		return verifyResult(res);
@@ -177,10 +206,189 @@ DBResult* DatabaseMySQL::storeQuery(const std::string &query)
 	if(error == CR_SERVER_LOST || error == CR_SERVER_GONE_ERROR)
 	{
 		if(reconnect())
-			return storeQuery(query);
+			return fetchQuery(query, stream);
+	}
+
+	std::cout << (stream ? "mysql_use_result(): " : "mysql_store_result(): ") << query << ": MYSQL ERROR: " << mysql_error(&m_handle) << std::endl;
+	return NULL;
+}
+
+MYSQL_STMT* DatabaseMySQL::prepareStatement(const DBStatement& stmt)
+{
+	OTSYS_THREAD_LOCK_CLASS lockClass(m_queryLock);
+	StatementMap::iterator it = m_statements.find(stmt.getQuery());
+	if(it != m_statements.end() && !it->second.used)
+	{
+		it->second.used = true;
+		return it->second.handle;
+	}
+
+	MYSQL_STMT* handle = mysql_stmt_init(&m_handle);
+	if(!handle)
+	{
+		std::cout << "mysql_stmt_init(): MYSQL ERROR: " << mysql_error(&m_handle) << std::endl;
+		return NULL;
+	}
+
+	if(mysql_stmt_prepare(handle, stmt.getQuery().c_str(), stmt.getQuery().length()) != 0)
+	{
+		int32_t error = mysql_stmt_errno(handle);
+		std::string message = mysql_stmt_error(handle);
+
+		mysql_stmt_close(handle);
+		if(error == CR_SERVER_LOST || error == CR_SERVER_GONE_ERROR)
+		{
+			clearStatements();
+			if(reconnect())
+				return prepareStatement(stmt);
+		}
+
+		std::cout << "mysql_stmt_prepare(): " << stmt.getQuery() << " - MYSQL ERROR: " << message << std::endl;
+		return NULL;
+	}
+
+	// lets results size their buffers after the longest value
+	MySQLBool updateMaxLength = true;
+	mysql_stmt_attr_set(handle, STMT_ATTR_UPDATE_MAX_LENGTH, &updateMaxLength);
+	if(it == m_statements.end() && m_statements.size() < DATABASE_STATEMENT_CACHE)
+	{
+		MySQLStatement& cached = m_statements[stmt.getQuery()];
+		cached.handle = handle;
+		cached.used = true;
+	}
+
+	return handle;
+}
+
+bool DatabaseMySQL::runStatement(MYSQL_STMT* handle, const DBStatement& stmt)
+{
+	const DBStatement::ParamList& params = stmt.getParams();
+	std::vector<MYSQL_BIND> binds(params.size());
+	std::vector<unsigned long> lengths(params.size());
+	for(uint32_t i = 0; i < params.size(); ++i)
+	{
+		const DBStatementParam& param = params[i];
+		MYSQL_BIND& bind = binds[i];
+
+		memset(&bind, 0, sizeof(MYSQL_BIND));
+		if(param.type == DBSTATEMENT_INT)
+		{
+			bind.buffer_type = MYSQL_TYPE_LONGLONG;
+			bind.buffer = (void*)&param.number;
+			continue;
+		}
+
+		lengths[i] = param.data.length();
+		bind.buffer_type = param.type == DBSTATEMENT_BLOB ? MYSQL_TYPE_BLOB : MYSQL_TYPE_STRING;
+		bind.buffer = (void*)param.data.c_str();
+		bind.buffer_length = lengths[i];
+		bind.length = &lengths[i];
+	}
+
+	// values are read by mysql_stmt_execute, the binds may go away after it
+	if(!binds.empty() && mysql_stmt_bind_param(handle, &binds[0]) != 0)
+		return false;
+
+	return mysql_stmt_execute(handle) == 0;
+}
+
+void DatabaseMySQL::releaseStatement(MYSQL_STMT* handle)
+{
+	OTSYS_THREAD_LOCK_CLASS lockClass(m_queryLock);
+	mysql_stmt_free_result(handle);
+	for(StatementMap::iterator it = m_statements.begin(); it != m_statements.end(); ++it)
+	{
+		if(it->second.handle != handle)
+			continue;
+
+		it->second.used = false;
+		return;
+	}
+
+	mysql_stmt_close(handle);
+}
+
+void DatabaseMySQL::clearStatements()
+{
+	// a reconnect drops the statements on the server, ones still in use are closed once released
+	OTSYS_THREAD_LOCK_CLASS lockClass(m_queryLock);
+	for(StatementMap::iterator it = m_statements.begin(); it != m_statements.end(); ++it)
+	{
+		if(!it->second.used)
+			mysql_stmt_close(it->second.handle);
+	}
+
+	m_statements.clear();
+}
+
+bool DatabaseMySQL::executeStatement(const DBStatement& stmt)
+{
+	if(!m_connected)
+		return false;
+
+	QueryTimer timer;
+
+	MYSQL_STMT* handle = prepareStatement(stmt);
+	if(!handle)
+		return false;
+
+	if(!runStatement(handle, stmt))
+	{
+		int32_t error = mysql_stmt_errno(handle);
+		std::string message = mysql_stmt_error(handle);
+
+		releaseStatement(handle);
+		if(error == CR_SERVER_LOST || error == CR_SERVER_GONE_ERROR)
+		{
+			clearStatements();
+			if(reconnect())
+				return executeStatement(stmt);
+		}
+
+		std::cout << "mysql_stmt_execute(): " << stmt.getQuery() << " - MYSQL ERROR: " << message << std::endl;
+		return false;
+	}
+
+	releaseStatement(handle);
+	return true;
+}
+
+DBResult* DatabaseMySQL::storeStatement(const DBStatement& stmt)
+{
+	if(!m_connected)
+		return NULL;
+
+	QueryTimer timer;
+
+	MYSQL_STMT* handle = prepareStatement(stmt);
+	if(!handle)
+		return NULL;
+
+	if(!runStatement(handle, stmt) || mysql_stmt_store_result(handle) != 0)
+	{
+		int32_t error = mysql_stmt_errno(handle);
+		std::string message = mysql_stmt_error(handle);
+
+		releaseStatement(handle);
+		if(error == CR_SERVER_LOST || error == CR_SERVER_GONE_ERROR)
+		{
+			clearStatements();
+			if(reconnect())
+				return storeStatement(stmt);
+		}
+
+		std::cout << "mysql_stmt_execute(): " << stmt.getQuery() << ": MYSQL ERROR: " << message << std::endl;
+		return NULL;
+	}
+
+	if(MYSQL_RES* metadata = mysql_stmt_result_metadata(handle))
+	{
+		DBResult* res = (DBResult*)new MySQLResult(handle, metadata, this);
+		return verifyResult(res);
 	}
 
-	std::cout << "mysql_store_result(): " << query << ": MYSQL ERROR: " << mysql_error(&m_handle) << std::endl;
+	releaseStatement(handle);
+	std::cout << "mysql_stmt_result_metadata(): " << stmt.getQuery() << ": statement gives no results." << std::endl;
 	return NULL;
 }
 
@@ -214,7 +422,11 @@ void DatabaseMySQL::keepAlive()
 {
 	int32_t delay = g_config.getNumber(ConfigManager::SQL_KEEPALIVE);
 	if(time(NULL) > (m_lastUse + delay))
+	{
+		//the connection may belong to a database thread
+		OTSYS_THREAD_LOCK_CLASS lockClass(m_queryLock);
 		mysql_ping(&m_handle);
+	}
 
 	Scheduler::getScheduler().addEvent(createSchedulerTask((delay * 1000), boost::bind(&DatabaseMySQL::keepAlive, this)));
 }
@@ -229,6 +441,7 @@ bool DatabaseMySQL::reconnect()
 		return false;
 	}
 
+	Metrics::getInstance()->addCounter(METRIC_DB_RECONNECTS, 1);
 	if(mysql_ping(&m_handle))
 		m_attempts = 0;
 	else
@@ -242,12 +455,7 @@ int32_t MySQLResult::getDataInt(const std::string &s)
 {
 	listNames_t::iterator it = m_listNames.find(s);
 	if(it != m_listNames.end())
-	{
-		if(m_row[it->second] == NULL)
-			return 0;
-
-		return atoi(m_row[it->second]);
-	}
+		return getDataInt(it->second);
 
 	std::cout << "Error during getDataInt(" << s << ")." << std::endl;
 	return 0; // Failed
@@ -257,12 +465,7 @@ int64_t MySQLResult::getDataLong(const std::string &s)
 {
 	listNames_t::iterator it = m_listNames.find(s);
 	if(it != m_listNames.end())
-	{
-		if(m_row[it->second] == NULL)
-			return 0;
-
-		return ATOI64(m_row[it->second]);
-	}
+		return getDataLong(it->second);
 
 	std::cout << "Error during getDataLong(" << s << ")." << std::endl;
 	return 0; // Failed
@@ -272,12 +475,7 @@ std::string MySQLResult::getDataString(const std::string &s)
 {
 	listNames_t::iterator it = m_listNames.find(s);
 	if(it != m_listNames.end())
-	{
-		if(m_row[it->second] == NULL)
-			return std::string("");
-
-		return std::string(m_row[it->second]);
-	}
+		return getDataString(it->second);
 
 	std::cout << "Error during getDataString(" << s << ")." << std::endl;
 	return std::string(""); // Failed
@@ -287,31 +485,115 @@ const char* MySQLResult::getDataStream(const std::string &s, uint64_t &size)
 {
 	listNames_t::iterator it = m_listNames.find(s);
 	if(it != m_listNames.end())
-	{
-		if(m_row[it->second] == NULL)
-		{
-			size = 0;
-			return NULL;
-		}
-
-		size = mysql_fetch_lengths(m_handle)[it->second];
-		return m_row[it->second];
-	}
+		return getDataStream(it->second, size);
 
 	std::cout << "Error during getDataStream(" << s << ")." << std::endl;
 	size = 0;
 	return NULL;
 }
 
+int32_t MySQLResult::getColumn(const std::string &s)
+{
+	listNames_t::iterator it = m_listNames.find(s);
+	if(it != m_listNames.end())
+		return it->second;
+
+	return -1;
+}
+
+int32_t MySQLResult::getDataInt(int32_t column)
+{
+	if(column < 0 || column >= (int32_t)m_fields || m_row[column] == NULL)
+		return 0;
+
+	return atoi(m_row[column]);
+}
+
+int64_t MySQLResult::getDataLong(int32_t column)
+{
+	if(column < 0 || column >= (int32_t)m_fields || m_row[column] == NULL)
+		return 0;
+
+	return ATOI64(m_row[column]);
+}
+
+std::string MySQLResult::getDataString(int32_t column)
+{
+	if(column < 0 || column >= (int32_t)m_fields || m_row[column] == NULL)
+		return std::string("");
+
+	return std::string(m_row[column]);
+}
+
+const char* MySQLResult::getDataStream(int32_t column, uint64_t &size)
+{
+	if(column < 0 || column >= (int32_t)m_fields || m_row[column] == NULL)
+	{
+		size = 0;
+		return NULL;
+	}
+
+	size = m_lengths[column];
+	return m_row[column];
+}
+
 bool MySQLResult::next()
 {
-	m_row = mysql_fetch_row(m_handle);
-	return m_row != NULL;
+	if(!m_statement)
+	{
+		m_row = mysql_fetch_row(m_handle);
+		if(!m_row)
+			return false;
+
+		m_lengths = mysql_fetch_lengths(m_handle);
+		return true;
+	}
+
+	int32_t ret = mysql_stmt_fetch(m_statement);
+	if(ret != 0 && ret != MYSQL_DATA_TRUNCATED)
+		return false;
+
+	bool rebind = false;
+	for(uint32_t i = 0; i < m_fields; ++i)
+	{
+		if(m_nulls[i])
+		{
+			m_row[i] = NULL;
+			continue;
+		}
+
+		MYSQL_BIND& bind = m_binds[i];
+		if(m_lengths[i] > bind.buffer_length)
+		{
+			// value outgrew the buffer, fetch it again into a larger one
+			delete[] (char*)bind.buffer;
+			bind.buffer = new char[m_lengths[i] + 1];
+			bind.buffer_length = m_lengths[i];
+			mysql_stmt_fetch_column(m_statement, &bind, i, 0);
+			rebind = true;
+		}
+
+		m_row[i] = (char*)bind.buffer;
+		m_row[i][m_lengths[i]] = '\0';
+	}
+
+	if(rebind)
+		mysql_stmt_bind_result(m_statement, m_binds);
+
+	return true;
 }
 
 MySQLResult::MySQLResult(MYSQL_RES* res)
 {
 	m_handle = res;
+	m_row = NULL;
+	m_lengths = NULL;
+
+	m_statement = NULL;
+	m_database = NULL;
+	m_binds = NULL;
+	m_nulls = NULL;
+	m_fields = mysql_num_fields(m_handle);
 	m_listNames.clear();
 
 	MYSQL_FIELD* field;
@@ -323,7 +605,49 @@ MySQLResult::MySQLResult(MYSQL_RES* res)
 	}
 }
 
+MySQLResult::MySQLResult(MYSQL_STMT* stmt, MYSQL_RES* metadata, DatabaseMySQL* database)
+{
+	m_handle = metadata;
+	m_statement = stmt;
+	m_database = database;
+	m_listNames.clear();
+
+	m_fields = mysql_num_fields(m_handle);
+	m_row = new char*[m_fields];
+	m_lengths = new unsigned long[m_fields];
+	m_nulls = new MySQLBool[m_fields];
+	m_binds = new MYSQL_BIND[m_fields];
+	memset(m_binds, 0, sizeof(MYSQL_BIND) * m_fields);
+
+	// every column is fetched as text, the same as in query results
+	for(uint32_t i = 0; i < m_fields; ++i)
+	{
+		MYSQL_FIELD* field = mysql_fetch_field_direct(m_handle, i);
+		m_listNames[field->name] = i;
+
+		unsigned long size = std::max(field->max_length, (unsigned long)32);
+		m_binds[i].buffer_type = MYSQL_TYPE_STRING;
+		m_binds[i].buffer = new char[size + 1];
+		m_binds[i].buffer_length = size;
+		m_binds[i].length = &m_lengths[i];
+		m_binds[i].is_null = &m_nulls[i];
+	}
+
+	mysql_stmt_bind_result(m_statement, m_binds);
+}
+
 MySQLResult::~MySQLResult()
 {
 	mysql_free_result(m_handle);
+	if(!m_statement)
+		return;
+
+	for(uint32_t i = 0; i < m_fields; ++i)
+		delete[] (char*)m_binds[i].buffer;
+
+	delete[] m_binds;
+	delete[] m_nulls;
+	delete[] m_lengths;
+	delete[] m_row;
+	m_database->releaseStatement(m_statement);
 }
@@ -30,6 +30,13 @@
 #else
 #include <mysql/mysql.h>
 #endif
+
+//MySQL 8.0 dropped my_bool in favour of plain bool, MariaDB still has it
+#if MYSQL_VERSION_ID >= 80001 && !defined(MARIADB_BASE_VERSION) && !defined(MARIADB_VERSION_ID) && !defined(LIBMARIADB)
+typedef bool MySQLBool;
+#else
+typedef my_bool MySQLBool;
+#endif
 #include <sstream>
 #include <map>
 
@@ -37,6 +44,8 @@
 
 class DatabaseMySQL : public _Database
 {
+	friend class MySQLResult;
+
 	public:
 		DatabaseMySQL();
 		DATABASE_VIRTUAL ~DatabaseMySQL();
@@ -49,20 +58,43 @@ class DatabaseMySQL : public _Database
 
 		DATABASE_VIRTUAL bool executeQuery(const std::string &query);
 		DATABASE_VIRTUAL DBResult* storeQuery(const std::string &query);
+		DATABASE_VIRTUAL DBResult* streamQuery(const std::string &query);
+
+		DATABASE_VIRTUAL bool executeStatement(const DBStatement& stmt);
+		DATABASE_VIRTUAL DBResult* storeStatement(const DBStatement& stmt);
 
 		DATABASE_VIRTUAL std::string escapeString(const std::string &s);
 		DATABASE_VIRTUAL std::string escapeBlob(const char* s, uint32_t length);
 
 		DATABASE_VIRTUAL void freeResult(DBResult *res);
 
+		DATABASE_VIRTUAL uint32_t getMaxQuerySize() {return m_maxQuerySize;}
+
 		DATABASE_VIRTUAL DatabaseEngine_t getDatabaseEngine() {return DATABASE_ENGINE_MYSQL;}
 
 	protected:
 		DATABASE_VIRTUAL void keepAlive();
 		DATABASE_VIRTUAL bool reconnect();
 
+		DBResult* fetchQuery(const std::string& query, bool stream);
+
+		MYSQL_STMT* prepareStatement(const DBStatement& stmt);
+		bool runStatement(MYSQL_STMT* handle, const DBStatement& stmt);
+		void releaseStatement(MYSQL_STMT* handle);
+		void clearStatements();
+
+		//a statement in use by a result is not handed out again until released
+		struct MySQLStatement
+		{
+			MYSQL_STMT* handle;
+			bool used;
+		};
+
+		typedef std::map<std::string, MySQLStatement> StatementMap;
+		StatementMap m_statements;
+
 		MYSQL m_handle;
-		uint32_t m_attempts;
+		uint32_t m_attempts, m_maxQuerySize;
 };
 
 class MySQLResult : public _DBResult
@@ -75,10 +107,17 @@ class MySQLResult : public _DBResult
 		DATABASE_VIRTUAL std::string getDataString(const std::string &s);
 		DATABASE_VIRTUAL const char* getDataStream(const std::string &s, uint64_t &size);
 
+		DATABASE_VIRTUAL int32_t getColumn(const std::string &s);
+		DATABASE_VIRTUAL int32_t getDataInt(int32_t column);
+		DATABASE_VIRTUAL int64_t getDataLong(int32_t column);
+		DATABASE_VIRTUAL std::string getDataString(int32_t column);
+		DATABASE_VIRTUAL const char* getDataStream(int32_t column, uint64_t &size);
+
 		DATABASE_VIRTUAL bool next();
 
 	protected:
 		MySQLResult(MYSQL_RES* res);
+		MySQLResult(MYSQL_STMT* stmt, MYSQL_RES* metadata, DatabaseMySQL* database);
 		DATABASE_VIRTUAL ~MySQLResult();
 
 		typedef std::map<const std::string, uint32_t> listNames_t;
@@ -86,6 +125,14 @@ class MySQLResult : public _DBResult
 
 		MYSQL_RES* m_handle;
 		MYSQL_ROW m_row;
+		unsigned long* m_lengths;
+
+		//statement results fetch rows into their own buffers
+		MYSQL_STMT* m_statement;
+		DatabaseMySQL* m_database;
+		MYSQL_BIND* m_binds;
+		MySQLBool* m_nulls;
+		uint32_t m_fields;
 };
 
 #endif
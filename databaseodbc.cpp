@@ -32,6 +32,7 @@
 
 #include "database.h"
 #include "databaseodbc.h"
+#include "metrics.h"
 
 #define RETURN_SUCCESS(ret) (ret == SQL_SUCCESS || ret == SQL_SUCCESS_WITH_INFO)
 
@@ -124,6 +125,10 @@ bool DatabaseODBC::getParam(DBParam_t param)
 			return false;
 			break;
 
+		case DBPARAM_CONNECTIONPOOL:
+			return true;
+			break;
+
 		default:
 			return false;
 	}
@@ -154,6 +159,8 @@ bool DatabaseODBC::executeQuery(const std::string& query)
 	if(!m_connected)
 		return false;
 
+	QueryTimer timer;
+
 	#ifdef __SQL_QUERY_DEBUG__
 	std::cout << "ODBC QUERY: " << query << std::endl;
 	#endif
@@ -185,6 +192,8 @@ DBResult* DatabaseODBC::storeQuery(const std::string& query)
 	if(!m_connected)
 		return NULL;
 
+	QueryTimer timer;
+
 	#ifdef __SQL_QUERY_DEBUG__
 	std::cout << "ODBC QUERY: " << query << std::endl;
 	#endif
@@ -293,15 +302,7 @@ int32_t ODBCResult::getDataInt(const std::string& s)
 {
 	listNames_t::iterator it = m_listNames.find(s);
 	if(it != m_listNames.end())
-	{
-		int32_t value;
-		SQLRETURN ret = SQLGetData(m_handle, it->second, SQL_C_SLONG, &value, 0, NULL);
-
-		if(RETURN_SUCCESS(ret))
-			return value;
-		else
-			std::cout << "Error during getDataInt(" << s << ")." << std::endl;
-	}
+		return getDataInt(it->second);
 
 	std::cout << "Error during getDataInt(" << s << ")." << std::endl;
 	return 0; // Failed
@@ -311,15 +312,7 @@ int64_t ODBCResult::getDataLong(const std::string& s)
 {
 	listNames_t::iterator it = m_listNames.find(s);
 	if(it != m_listNames.end())
-	{
-		int64_t value;
-		SQLRETURN ret = SQLGetData(m_handle, it->second, SQL_C_SBIGINT, &value, 0, NULL);
-
-		if(RETURN_SUCCESS(ret))
-			return value;
-		else
-			std::cout << "Error during getDataLong(" << s << ")." << std::endl;
-	}
+		return getDataLong(it->second);
 
 	std::cout << "Error during getDataLong(" << s << ")." << std::endl;
 	return 0; // Failed
@@ -329,18 +322,7 @@ std::string ODBCResult::getDataString(const std::string& s)
 {
 	listNames_t::iterator it = m_listNames.find(s);
 	if(it != m_listNames.end())
-	{
-		char* value = new char[1024];
-		SQLRETURN ret = SQLGetData(m_handle, it->second, SQL_C_CHAR, value, 1024, NULL);
-
-		if(RETURN_SUCCESS(ret))
-		{
-			std::string buff = std::string(value);
-			return buff;
-		}
-		else
-			std::cout << "Error during getDataString(" << s << ")." << std::endl;
-	}
+		return getDataString(it->second);
 
 	std::cout << "Error during getDataString(" << s << ")." << std::endl;
 	return std::string(""); // Failed
@@ -350,20 +332,72 @@ const char* ODBCResult::getDataStream(const std::string& s, uint64_t& size)
 {
 	listNames_t::iterator it = m_listNames.find(s);
 	if(it != m_listNames.end())
-	{
-		char* value = new char[1024];
-		SQLRETURN ret = SQLGetData(m_handle, it->second, SQL_C_BINARY, value, 1024, (SQLLEN*)&size);
-
-		if( RETURN_SUCCESS(ret))
-			return value;
-		else
-			std::cout << "Error during getDataStream(" << s << ")." << std::endl;
-	}
+		return getDataStream(it->second, size);
 
 	std::cout << "Error during getDataStream(" << s << ")." << std::endl;
 	return 0; // Failed
 }
 
+int32_t ODBCResult::getColumn(const std::string& s)
+{
+	listNames_t::iterator it = m_listNames.find(s);
+	if(it != m_listNames.end())
+		return it->second;
+
+	return -1;
+}
+
+int32_t ODBCResult::getDataInt(int32_t column)
+{
+	int32_t value;
+	SQLRETURN ret = SQLGetData(m_handle, column, SQL_C_SLONG, &value, 0, NULL);
+
+	if(RETURN_SUCCESS(ret))
+		return value;
+
+	std::cout << "Error during getDataInt(" << column << ")." << std::endl;
+	return 0; // Failed
+}
+
+int64_t ODBCResult::getDataLong(int32_t column)
+{
+	int64_t value;
+	SQLRETURN ret = SQLGetData(m_handle, column, SQL_C_SBIGINT, &value, 0, NULL);
+
+	if(RETURN_SUCCESS(ret))
+		return value;
+
+	std::cout << "Error during getDataLong(" << column << ")." << std::endl;
+	return 0; // Failed
+}
+
+std::string ODBCResult::getDataString(int32_t column)
+{
+	char* value = new char[1024];
+	SQLRETURN ret = SQLGetData(m_handle, column, SQL_C_CHAR, value, 1024, NULL);
+
+	std::string buff;
+	if(RETURN_SUCCESS(ret))
+		buff = value;
+	else
+		std::cout << "Error during getDataString(" << column << ")." << std::endl;
+
+	delete[] value;
+	return buff;
+}
+
+const char* ODBCResult::getDataStream(int32_t column, uint64_t& size)
+{
+	char* value = new char[1024];
+	SQLRETURN ret = SQLGetData(m_handle, column, SQL_C_BINARY, value, 1024, (SQLLEN*)&size);
+
+	if( RETURN_SUCCESS(ret))
+		return value;
+
+	std::cout << "Error during getDataStream(" << column << ")." << std::endl;
+	return 0; // Failed
+}
+
 bool ODBCResult::next()
 {
 	SQLRETURN ret = SQLFetch(m_handle);
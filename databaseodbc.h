@@ -60,6 +60,10 @@ class DatabaseODBC : public _Database
 
 		DATABASE_VIRTUAL bool executeQuery(const std::string& query);
 		DATABASE_VIRTUAL DBResult* storeQuery(const std::string& query);
+		DATABASE_VIRTUAL DBResult* streamQuery(const std::string& query) {return storeQuery(query);}
+
+		DATABASE_VIRTUAL bool executeStatement(const DBStatement& stmt) {return executeQuery(stmt.getText(this));}
+		DATABASE_VIRTUAL DBResult* storeStatement(const DBStatement& stmt) {return storeQuery(stmt.getText(this));}
 
 		DATABASE_VIRTUAL std::string escapeString(const std::string& s);
 		DATABASE_VIRTUAL std::string escapeBlob(const char *s, uint32_t length);
@@ -85,6 +89,12 @@ class ODBCResult : public _DBResult
 		DATABASE_VIRTUAL std::string getDataString(const std::string& s);
 		DATABASE_VIRTUAL const char* getDataStream(const std::string& s, uint64_t& size);
 
+		DATABASE_VIRTUAL int32_t getColumn(const std::string& s);
+		DATABASE_VIRTUAL int32_t getDataInt(int32_t column);
+		DATABASE_VIRTUAL int64_t getDataLong(int32_t column);
+		DATABASE_VIRTUAL std::string getDataString(int32_t column);
+		DATABASE_VIRTUAL const char* getDataStream(int32_t column, uint64_t& size);
+
 		DATABASE_VIRTUAL bool next();
 
 	protected:
@@ -22,6 +22,7 @@
 
 #include "database.h"
 #include "databasepgsql.h"
+#include "metrics.h"
 
 #include "configmanager.h"
 extern ConfigManager g_config;
@@ -34,6 +35,7 @@ DatabasePgSQL::DatabasePgSQL()
 	std::stringstream dns;
 	dns << "host='" << g_config.getString(ConfigManager::SQL_HOST) << "' dbname='" << g_config.getString(ConfigManager::SQL_DB) << "' user='" << g_config.getString(ConfigManager::SQL_USER) << "' password='" << g_config.getString(ConfigManager::SQL_PASS) << "' port='" << g_config.getNumber(ConfigManager::SQL_PORT) << "'";
 
+	m_statementId = 0;
 	m_handle = PQconnectdb(dns.str().c_str());
 	m_connected = PQstatus(m_handle) == CONNECTION_OK;
 
@@ -51,6 +53,8 @@ bool DatabasePgSQL::getParam(DBParam_t param)
 	switch(param)
 	{
 		case DBPARAM_MULTIINSERT:
+		case DBPARAM_CONNECTIONPOOL:
+		case DBPARAM_BULKINSERT:
 			return true;
 			break;
 
@@ -79,6 +83,8 @@ bool DatabasePgSQL::executeQuery(const std::string& query)
 	if(!m_connected)
 		return false;
 
+	QueryTimer timer;
+
 	#ifdef __SQL_QUERY_DEBUG__
 	std::cout << "PGSQL QUERY: " << query << std::endl;
 	#endif
@@ -104,6 +110,8 @@ DBResult* DatabasePgSQL::storeQuery(const std::string& query)
 	if(!m_connected)
 		return NULL;
 
+	QueryTimer timer;
+
 	#ifdef __SQL_QUERY_DEBUG__
 	std::cout << "PGSQL QUERY: " << query << std::endl;
 	#endif
@@ -124,6 +132,354 @@ DBResult* DatabasePgSQL::storeQuery(const std::string& query)
 	return verifyResult(results);
 }
 
+DBResult* DatabasePgSQL::streamQuery(const std::string& query)
+{
+	if(!m_connected)
+		return NULL;
+
+	QueryTimer timer;
+
+	#ifdef __SQL_QUERY_DEBUG__
+	std::cout << "PGSQL QUERY: " << query << std::endl;
+	#endif
+
+	if(!PQsendQuery(m_handle, _parse(query).c_str()))
+	{
+		std::cout << "PQsendQuery(): " << query << ": " << PQerrorMessage(m_handle) << std::endl;
+		return NULL;
+	}
+
+	//without single row mode the whole set still arrives as one result
+	PQsetSingleRowMode(m_handle);
+
+	DBResult* results = new PgSQLResult(NULL, this);
+	return verifyResult(results);
+}
+
+PGresult* DatabasePgSQL::runStatement(const DBStatement& stmt)
+{
+	OTSYS_THREAD_LOCK_CLASS lockClass(m_queryLock);
+	bool cached = true;
+
+	std::string name;
+	StatementMap::iterator it = m_statements.find(stmt.getQuery());
+	if(it == m_statements.end())
+	{
+		// numbers the placeholders, as PostgreSQL expects
+		std::stringstream query;
+		uint32_t param = 0;
+
+		bool inString = false;
+		std::string buf = _parse(stmt.getQuery());
+		for(uint32_t i = 0; i < buf.length(); ++i)
+		{
+			if(buf[i] == '\'')
+				inString = !inString;
+
+			if(buf[i] == '?' && !inString)
+				query << "$" << ++param;
+			else
+				query << buf[i];
+		}
+
+		std::stringstream ss;
+		ss << "stmt" << ++m_statementId;
+		name = ss.str();
+
+		PGresult* res = PQprepare(m_handle, name.c_str(), query.str().c_str(), 0, NULL);
+		if(PQresultStatus(res) != PGRES_COMMAND_OK)
+		{
+			std::cout << "PQprepare(): " << stmt.getQuery() << ": " << PQresultErrorMessage(res) << std::endl;
+			PQclear(res);
+			return NULL;
+		}
+
+		PQclear(res);
+		if(m_statements.size() < DATABASE_STATEMENT_CACHE)
+			m_statements[stmt.getQuery()] = name;
+		else
+			cached = false;
+	}
+	else
+		name = it->second;
+
+	// numbers are sent as text, blobs in binary format so they need no escaping
+	const DBStatement::ParamList& params = stmt.getParams();
+	std::vector<std::string> numbers(params.size());
+	std::vector<const char*> values(params.size());
+	std::vector<int32_t> lengths(params.size()), formats(params.size());
+	for(uint32_t i = 0; i < params.size(); ++i)
+	{
+		const DBStatementParam& param = params[i];
+		if(param.type == DBSTATEMENT_INT)
+		{
+			std::stringstream ss;
+			ss << param.number;
+			numbers[i] = ss.str();
+			values[i] = numbers[i].c_str();
+		}
+		else
+			values[i] = param.data.c_str();
+
+		lengths[i] = param.type == DBSTATEMENT_INT ? numbers[i].length() : param.data.length();
+		formats[i] = param.type == DBSTATEMENT_BLOB ? 1 : 0;
+	}
+
+	PGresult* res = PQexecPrepared(m_handle, name.c_str(), params.size(), params.empty() ? NULL : &values[0],
+		params.empty() ? NULL : &lengths[0], params.empty() ? NULL : &formats[0], 0);
+	if(!cached)
+		PQclear(PQexec(m_handle, ("DEALLOCATE " + name).c_str()));
+
+	ExecStatusType stat = PQresultStatus(res);
+	if(stat != PGRES_COMMAND_OK && stat != PGRES_TUPLES_OK)
+	{
+		std::cout << "PQexecPrepared(): " << stmt.getQuery() << ": " << PQresultErrorMessage(res) << std::endl;
+		PQclear(res);
+		return NULL;
+	}
+
+	return res;
+}
+
+bool DatabasePgSQL::executeStatement(const DBStatement& stmt)
+{
+	if(!m_connected)
+		return false;
+
+	QueryTimer timer;
+
+	#ifdef __SQL_QUERY_DEBUG__
+	std::cout << "PGSQL STATEMENT: " << stmt.getQuery() << std::endl;
+	#endif
+
+	PGresult* res = runStatement(stmt);
+	if(!res)
+		return false;
+
+	PQclear(res);
+	return true;
+}
+
+DBResult* DatabasePgSQL::storeStatement(const DBStatement& stmt)
+{
+	if(!m_connected)
+		return NULL;
+
+	QueryTimer timer;
+
+	#ifdef __SQL_QUERY_DEBUG__
+	std::cout << "PGSQL STATEMENT: " << stmt.getQuery() << std::endl;
+	#endif
+
+	PGresult* res = runStatement(stmt);
+	if(!res)
+		return NULL;
+
+	DBResult* results = new PgSQLResult(res);
+	return verifyResult(results);
+}
+
+bool DatabasePgSQL::executeInsert(const std::string& query, const std::vector<std::string>& rows)
+{
+	if(!m_connected)
+		return false;
+
+	//rows are sent through COPY, unless the prototype or one of them is not plain literals
+	std::string data;
+	bool copy = query.find("INSERT INTO ") == 0 && query.rfind(" VALUES ") == query.length() - 8;
+	for(std::vector<std::string>::const_iterator it = rows.begin(); copy && it != rows.end(); ++it)
+		copy = copyRow(*it, data);
+
+	if(!copy)
+	{
+		std::string buf = query;
+		for(std::vector<std::string>::const_iterator it = rows.begin(); it != rows.end(); ++it)
+		{
+			if(it != rows.begin())
+				buf += ",";
+
+			buf += "(" + *it + ")";
+		}
+
+		return executeQuery(buf);
+	}
+
+	QueryTimer timer;
+	std::string copyQuery = "COPY " + query.substr(12, query.length() - 20) + " FROM STDIN";
+
+	#ifdef __SQL_QUERY_DEBUG__
+	std::cout << "PGSQL QUERY: " << copyQuery << std::endl;
+	#endif
+
+	PGresult* res = PQexec(m_handle, _parse(copyQuery).c_str());
+	if(PQresultStatus(res) != PGRES_COPY_IN)
+	{
+		std::cout << "PQexec(): " << copyQuery << ": " << PQresultErrorMessage(res) << std::endl;
+		PQclear(res);
+		return false;
+	}
+
+	PQclear(res);
+	if(PQputCopyData(m_handle, data.c_str(), data.length()) != 1 || PQputCopyEnd(m_handle, NULL) != 1)
+		std::cout << "PQputCopyData(): " << copyQuery << ": " << PQerrorMessage(m_handle) << std::endl;
+
+	//the result of the copy, then NULL once the connection is ready again
+	bool ret = true;
+	while((res = PQgetResult(m_handle)))
+	{
+		if(PQresultStatus(res) != PGRES_COMMAND_OK)
+		{
+			std::cout << "PQputCopyEnd(): " << copyQuery << ": " << PQresultErrorMessage(res) << std::endl;
+			ret = false;
+		}
+
+		PQclear(res);
+	}
+
+	return ret;
+}
+
+bool DatabasePgSQL::copyRow(const std::string& row, std::string& data)
+{
+	//plain strings take backslash escapes too when standard_conforming_strings is off
+	const char* standard = PQparameterStatus(m_handle, "standard_conforming_strings");
+	bool backslashes = !standard || strcmp(standard, "on");
+
+	std::string line;
+	uint32_t i = 0, length = row.length();
+	for(uint32_t column = 0; ; ++column)
+	{
+		while(i < length && isspace(row[i]))
+			i++;
+
+		if(column)
+			line += '\t';
+
+		bool escape = i + 1 < length && (row[i] == 'E' || row[i] == 'e') && row[i + 1] == '\'';
+		if(escape || (i < length && row[i] == '\''))
+		{
+			//literal to its value, then the value to the COPY text format
+			escape = escape || backslashes;
+			for(i += (row[i] == '\'' ? 1 : 2); i < length; i++)
+			{
+				char c = row[i];
+				if(c == '\'')
+				{
+					if(i + 1 >= length || row[i + 1] != '\'')
+						break;
+
+					i++;
+				}
+				else if(c == '\\' && escape && i + 1 < length)
+				{
+					c = row[++i];
+					switch(c)
+					{
+						case 'b':
+							c = '\b';
+							break;
+						case 'f':
+							c = '\f';
+							break;
+						case 'n':
+							c = '\n';
+							break;
+						case 'r':
+							c = '\r';
+							break;
+						case 't':
+							c = '\t';
+							break;
+						case 'u':
+						case 'U':
+							return false;
+						case 'x':
+						{
+							int32_t value = 0, digits = 0;
+							for(; digits < 2 && i + 1 < length && isxdigit(row[i + 1]); ++digits)
+							{
+								char h = tolower(row[++i]);
+								value = value * 16 + (isdigit(h) ? h - '0' : h - 'a' + 10);
+							}
+
+							if(!digits)
+								return false;
+
+							c = (char)value;
+							break;
+						}
+						default:
+						{
+							if(c < '0' || c > '7')
+								break;
+
+							int32_t value = c - '0';
+							for(int32_t digits = 1; digits < 3 && i + 1 < length && row[i + 1] >= '0' && row[i + 1] <= '7'; ++digits)
+								value = value * 8 + row[++i] - '0';
+
+							c = (char)value;
+							break;
+						}
+					}
+				}
+
+				switch(c)
+				{
+					case '\0':
+						return false;
+					case '\\':
+						line += "\\\\";
+						break;
+					case '\n':
+						line += "\\n";
+						break;
+					case '\r':
+						line += "\\r";
+						break;
+					case '\t':
+						line += "\\t";
+						break;
+					default:
+						line += c;
+						break;
+				}
+			}
+
+			if(i >= length)
+				return false;
+
+			i++;
+		}
+		else
+		{
+			uint32_t start = i;
+			while(i < length && (isalnum(row[i]) || row[i] == '-' || row[i] == '.'))
+				i++;
+
+			std::string token = row.substr(start, i - start);
+			if(token.empty() || !strcasecmp(token.c_str(), "DEFAULT"))
+				return false;
+
+			if(!strcasecmp(token.c_str(), "NULL"))
+				line += "\\N";
+			else
+				line += token;
+		}
+
+		while(i < length && isspace(row[i]))
+			i++;
+
+		if(i == length)
+			break;
+
+		if(row[i++] != ',')
+			return false;
+	}
+
+	data += line + "\n";
+	return true;
+}
+
 std::string DatabasePgSQL::escapeString(const std::string& s)
 {
 	// remember to quote even empty string!
@@ -195,22 +551,47 @@ void DatabasePgSQL::freeResult(DBResult* res)
 
 int32_t PgSQLResult::getDataInt(const std::string& s)
 {
-	return atoi(PQgetvalue(m_handle, m_cursor, PQfnumber(m_handle, s.c_str())));
+	return getDataInt(PQfnumber(m_handle, s.c_str()));
 }
 
 int64_t PgSQLResult::getDataLong(const std::string& s)
 {
-	return ATOI64(PQgetvalue(m_handle, m_cursor, PQfnumber(m_handle, s.c_str())));
+	return getDataLong(PQfnumber(m_handle, s.c_str()));
 }
 
 std::string PgSQLResult::getDataString(const std::string& s)
 {
-	return std::string( PQgetvalue(m_handle, m_cursor, PQfnumber(m_handle, s.c_str())));
+	return getDataString(PQfnumber(m_handle, s.c_str()));
 }
 
 const char* PgSQLResult::getDataStream(const std::string& s, uint64_t& size)
 {
-	std::string buf = PQgetvalue(m_handle, m_cursor, PQfnumber(m_handle, s.c_str()));
+	return getDataStream(PQfnumber(m_handle, s.c_str()), size);
+}
+
+int32_t PgSQLResult::getColumn(const std::string& s)
+{
+	return PQfnumber(m_handle, s.c_str());
+}
+
+int32_t PgSQLResult::getDataInt(int32_t column)
+{
+	return atoi(PQgetvalue(m_handle, m_cursor, column));
+}
+
+int64_t PgSQLResult::getDataLong(int32_t column)
+{
+	return ATOI64(PQgetvalue(m_handle, m_cursor, column));
+}
+
+std::string PgSQLResult::getDataString(int32_t column)
+{
+	return std::string(PQgetvalue(m_handle, m_cursor, column));
+}
+
+const char* PgSQLResult::getDataStream(int32_t column, uint64_t& size)
+{
+	std::string buf = PQgetvalue(m_handle, m_cursor, column);
 	uint8_t* temp = PQunescapeBytea( (const uint8_t*)buf.c_str(), (size_t*)&size);
 	char* value = new char[buf.size()];
 	strcpy(value, (char*)temp);
@@ -220,21 +601,47 @@ const char* PgSQLResult::getDataStream(const std::string& s, uint64_t& size)
 
 bool PgSQLResult::next()
 {
-	if(m_cursor >= m_rows)
-		return false;
+	while(m_cursor >= m_rows)
+	{
+		if(!m_database)
+			return false;
+
+		//in single row mode each row comes as its own result, then an empty one and NULL
+		PQclear(m_handle);
+		m_handle = PQgetResult(m_database->m_handle);
+		m_cursor = m_rows = -1;
+		if(!m_handle)
+		{
+			m_database = NULL;
+			return false;
+		}
+
+		ExecStatusType stat = PQresultStatus(m_handle);
+		if(stat == PGRES_SINGLE_TUPLE || stat == PGRES_TUPLES_OK)
+			m_rows = PQntuples(m_handle) - 1;
+		else
+			std::cout << "PQgetResult(): " << PQresultErrorMessage(m_handle) << std::endl;
+	}
 
 	m_cursor++;
 	return true;
 }
 
-PgSQLResult::PgSQLResult(PGresult* results)
+PgSQLResult::PgSQLResult(PGresult* results, DatabasePgSQL* database/* = NULL*/)
 {
 	m_handle = results;
+	m_database = database;
 	m_cursor = -1;
-	m_rows = PQntuples(m_handle) - 1;
+	m_rows = results ? PQntuples(m_handle) - 1 : -1;
 }
 
 PgSQLResult::~PgSQLResult()
 {
 	PQclear(m_handle);
+	if(!m_database)
+		return;
+
+	//rows left unread have to be drained before the connection takes another query
+	while(PGresult* res = PQgetResult(m_database->m_handle))
+		PQclear(res);
 }
@@ -26,9 +26,12 @@
 #endif
 
 #include <postgresql/libpq-fe.h>
+#include <map>
 
 class DatabasePgSQL : public _Database
 {
+	friend class PgSQLResult;
+
 	public:
 		DatabasePgSQL();
 		DATABASE_VIRTUAL ~DatabasePgSQL();
@@ -41,6 +44,12 @@ class DatabasePgSQL : public _Database
 
 		DATABASE_VIRTUAL bool executeQuery(const std::string& query);
 		DATABASE_VIRTUAL DBResult* storeQuery(const std::string& query);
+		DATABASE_VIRTUAL DBResult* streamQuery(const std::string& query);
+
+		DATABASE_VIRTUAL bool executeStatement(const DBStatement& stmt);
+		DATABASE_VIRTUAL DBResult* storeStatement(const DBStatement& stmt);
+
+		DATABASE_VIRTUAL bool executeInsert(const std::string& query, const std::vector<std::string>& rows);
 
 		DATABASE_VIRTUAL std::string escapeString(const std::string& s);
 		DATABASE_VIRTUAL std::string escapeBlob(const char *s, uint32_t length);
@@ -51,6 +60,14 @@ class DatabasePgSQL : public _Database
 
 	protected:
 		std::string _parse(const std::string& s);
+		bool copyRow(const std::string& row, std::string& data);
+
+		PGresult* runStatement(const DBStatement& stmt);
+
+		//statement names by query text
+		typedef std::map<std::string, std::string> StatementMap;
+		StatementMap m_statements;
+		uint32_t m_statementId;
 
 		PGconn* m_handle;
 };
@@ -65,14 +82,23 @@ class PgSQLResult : public _DBResult
 		DATABASE_VIRTUAL std::string getDataString(const std::string& s);
 		DATABASE_VIRTUAL const char* getDataStream(const std::string& s, uint64_t& size);
 
+		DATABASE_VIRTUAL int32_t getColumn(const std::string& s);
+		DATABASE_VIRTUAL int32_t getDataInt(int32_t column);
+		DATABASE_VIRTUAL int64_t getDataLong(int32_t column);
+		DATABASE_VIRTUAL std::string getDataString(int32_t column);
+		DATABASE_VIRTUAL const char* getDataStream(int32_t column, uint64_t& size);
+
 		DATABASE_VIRTUAL bool next();
 
 	protected:
-		PgSQLResult(PGresult* results);
+		PgSQLResult(PGresult* results, DatabasePgSQL* database = NULL);
 		DATABASE_VIRTUAL ~PgSQLResult();
 
 		int32_t m_rows, m_cursor;
 		PGresult* m_handle;
+
+		//streamed results read the rest of their rows from the connection
+		DatabasePgSQL* m_database;
 };
 
 #endif
@@ -25,6 +25,7 @@
 
 #include "database.h"
 #include "databasesqlite.h"
+#include "metrics.h"
 
 #include "tools.h"
 
@@ -61,6 +62,9 @@ DatabaseSQLite::DatabaseSQLite()
 
 DatabaseSQLite::~DatabaseSQLite()
 {
+	for(StatementMap::iterator it = m_statements.begin(); it != m_statements.end(); ++it)
+		sqlite3_finalize(it->second.handle);
+
 	sqlite3_close(m_handle);
 }
 
@@ -68,7 +72,11 @@ bool DatabaseSQLite::getParam(DBParam_t param)
 {
 	switch(param)
 	{
+		case DBPARAM_BULKINSERT:
+			return true;
+
 		case DBPARAM_MULTIINSERT:
+		case DBPARAM_CONNECTIONPOOL: //writers would only wait on the file lock
 		default:
 			break;
 	}
@@ -123,6 +131,8 @@ bool DatabaseSQLite::executeQuery(const std::string &query)
 	if(!m_connected)
 		return false;
 
+	QueryTimer timer;
+
 	#ifdef __SQL_QUERY_DEBUG__
 	std::cout << "SQLITE QUERY: " << query << std::endl;
 	#endif
@@ -158,6 +168,8 @@ DBResult* DatabaseSQLite::storeQuery(const std::string &query)
 	if(!m_connected)
 		return NULL;
 
+	QueryTimer timer;
+
 	#ifdef __SQL_QUERY_DEBUG__
 	std::cout << "SQLITE QUERY: " << query << std::endl;
 	#endif
@@ -176,6 +188,266 @@ DBResult* DatabaseSQLite::storeQuery(const std::string &query)
 	return verifyResult(result);
 }
 
+sqlite3_stmt* DatabaseSQLite::prepareStatement(const DBStatement& stmt)
+{
+	OTSYS_THREAD_LOCK_CLASS lockClass(sqliteLock);
+	StatementMap::iterator it = m_statements.find(stmt.getQuery());
+	if(it != m_statements.end() && !it->second.used)
+	{
+		it->second.used = true;
+		return it->second.handle;
+	}
+
+	std::string buf = _parse(stmt.getQuery());
+	sqlite3_stmt* handle;
+	if(OTSYS_SQLITE3_PREPARE(m_handle, buf.c_str(), buf.length(), &handle, NULL) != SQLITE_OK)
+	{
+		sqlite3_finalize(handle);
+		std::cout << "OTSYS_SQLITE3_PREPARE(): SQLITE ERROR: " << sqlite3_errmsg(m_handle)  << " (" << buf << ")" << std::endl;
+		return NULL;
+	}
+
+	if(it == m_statements.end() && m_statements.size() < DATABASE_STATEMENT_CACHE)
+	{
+		SQLiteStatement& cached = m_statements[stmt.getQuery()];
+		cached.handle = handle;
+		cached.used = true;
+	}
+
+	const DBStatement::ParamList& params = stmt.getParams();
+	for(uint32_t i = 0; i < params.size(); ++i)
+	{
+		const DBStatementParam& param = params[i];
+		switch(param.type)
+		{
+			case DBSTATEMENT_INT:
+				sqlite3_bind_int64(handle, i + 1, param.number);
+				break;
+			case DBSTATEMENT_STRING:
+				sqlite3_bind_text(handle, i + 1, param.data.c_str(), param.data.length(), SQLITE_TRANSIENT);
+				break;
+			case DBSTATEMENT_BLOB:
+				sqlite3_bind_blob(handle, i + 1, param.data.c_str(), param.data.length(), SQLITE_TRANSIENT);
+				break;
+		}
+	}
+
+	return handle;
+}
+
+void DatabaseSQLite::releaseStatement(sqlite3_stmt* handle)
+{
+	OTSYS_THREAD_LOCK_CLASS lockClass(sqliteLock);
+	for(StatementMap::iterator it = m_statements.begin(); it != m_statements.end(); ++it)
+	{
+		if(it->second.handle != handle)
+			continue;
+
+		sqlite3_reset(handle);
+		sqlite3_clear_bindings(handle);
+		it->second.used = false;
+		return;
+	}
+
+	sqlite3_finalize(handle);
+}
+
+bool DatabaseSQLite::executeStatement(const DBStatement& stmt)
+{
+	OTSYS_THREAD_LOCK_CLASS lockClass(sqliteLock);
+	if(!m_connected)
+		return false;
+
+	QueryTimer timer;
+
+	#ifdef __SQL_QUERY_DEBUG__
+	std::cout << "SQLITE STATEMENT: " << stmt.getQuery() << std::endl;
+	#endif
+
+	sqlite3_stmt* handle = prepareStatement(stmt);
+	if(!handle)
+		return false;
+
+	int32_t ret = sqlite3_step(handle);
+	if(ret != SQLITE_OK && ret != SQLITE_DONE && ret != SQLITE_ROW)
+	{
+		std::cout << "sqlite3_step(): SQLITE ERROR: " << sqlite3_errmsg(m_handle) << " (" << stmt.getQuery() << ")" << std::endl;
+		releaseStatement(handle);
+		return false;
+	}
+
+	releaseStatement(handle);
+	return true;
+}
+
+DBResult* DatabaseSQLite::storeStatement(const DBStatement& stmt)
+{
+	OTSYS_THREAD_LOCK_CLASS lockClass(sqliteLock);
+	if(!m_connected)
+		return NULL;
+
+	QueryTimer timer;
+
+	#ifdef __SQL_QUERY_DEBUG__
+	std::cout << "SQLITE STATEMENT: " << stmt.getQuery() << std::endl;
+	#endif
+
+	sqlite3_stmt* handle = prepareStatement(stmt);
+	if(!handle)
+		return NULL;
+
+	DBResult* result = new SQLiteResult(handle, this);
+	return verifyResult(result);
+}
+
+static int32_t hexValue(char c)
+{
+	if(c >= '0' && c <= '9')
+		return c - '0';
+
+	if(c >= 'a' && c <= 'f')
+		return c - 'a' + 10;
+
+	if(c >= 'A' && c <= 'F')
+		return c - 'A' + 10;
+
+	return -1;
+}
+
+//reads the literals escapeString() and escapeBlob() produce back into values, false on anything else
+static bool parseRow(const std::string& row, DBStatement::ParamList& values)
+{
+	uint32_t i = 0, length = row.length();
+	while(true)
+	{
+		while(i < length && isspace(row[i]))
+			i++;
+
+		DBStatementParam value;
+		value.number = 0;
+		if(i + 1 < length && (row[i] == 'x' || row[i] == 'X') && row[i + 1] == '\'')
+		{
+			value.type = DBSTATEMENT_BLOB;
+			for(i += 2; i + 1 < length && row[i] != '\''; i += 2)
+			{
+				int32_t high = hexValue(row[i]), low = hexValue(row[i + 1]);
+				if(high < 0 || low < 0)
+					return false;
+
+				value.data += (char)((high << 4) | low);
+			}
+
+			if(i >= length || row[i] != '\'')
+				return false;
+
+			i++;
+		}
+		else if(i < length && row[i] == '\'')
+		{
+			value.type = DBSTATEMENT_STRING;
+			for(i++; i < length; i++)
+			{
+				if(row[i] == '\'')
+				{
+					if(i + 1 >= length || row[i + 1] != '\'')
+						break;
+
+					i++;
+				}
+
+				value.data += row[i];
+			}
+
+			if(i >= length)
+				return false;
+
+			i++;
+		}
+		else
+		{
+			uint32_t start = i;
+			if(i < length && row[i] == '-')
+				i++;
+
+			while(i < length && isdigit(row[i]))
+				i++;
+
+			if(i == start || !isdigit(row[i - 1]))
+				return false;
+
+			value.type = DBSTATEMENT_INT;
+			value.number = ATOI64(row.substr(start, i - start).c_str());
+		}
+
+		values.push_back(value);
+		while(i < length && isspace(row[i]))
+			i++;
+
+		if(i == length)
+			return true;
+
+		if(row[i++] != ',')
+			return false;
+	}
+}
+
+bool DatabaseSQLite::executeInsert(const std::string& query, const std::vector<std::string>& rows)
+{
+	OTSYS_THREAD_LOCK_CLASS lockClass(sqliteLock);
+	if(!m_connected)
+		return false;
+
+	//all rows go into one transaction, unless the caller already runs one
+	bool transaction = sqlite3_get_autocommit(m_handle) != 0;
+	if(transaction && !beginTransaction())
+		return false;
+
+	bool ret = true;
+	for(std::vector<std::string>::const_iterator it = rows.begin(); ret && it != rows.end(); ++it)
+	{
+		DBStatement::ParamList values;
+		if(!parseRow(*it, values))
+		{
+			ret = executeQuery(query + "(" + *it + ")");
+			continue;
+		}
+
+		//same text for every row of this shape, so the prepared statement is reused
+		std::string placeholders;
+		for(uint32_t i = 0; i < values.size(); ++i)
+			placeholders += i ? ", ?" : "?";
+
+		DBStatement stmt(query + "(" + placeholders + ")");
+		for(DBStatement::ParamList::iterator vit = values.begin(); vit != values.end(); ++vit)
+		{
+			switch(vit->type)
+			{
+				case DBSTATEMENT_INT:
+					stmt.bindInt(vit->number);
+					break;
+				case DBSTATEMENT_STRING:
+					stmt.bindString(vit->data);
+					break;
+				case DBSTATEMENT_BLOB:
+					stmt.bindBlob(vit->data.c_str(), vit->data.length());
+					break;
+			}
+		}
+
+		ret = executeStatement(stmt);
+	}
+
+	if(transaction)
+	{
+		if(ret)
+			ret = commit();
+		else
+			rollback();
+	}
+
+	return ret;
+}
+
 std::string DatabaseSQLite::escapeString(const std::string &s)
 {
 	// remember about quoiting even an empty string!
@@ -225,7 +497,7 @@ int32_t SQLiteResult::getDataInt(const std::string &s)
 {
 	listNames_t::iterator it = m_listNames.find(s);
 	if(it != m_listNames.end())
-		return sqlite3_column_int(m_handle, it->second);
+		return getDataInt(it->second);
 
 	std::cout << "Error during getDataInt(" << s << ")." << std::endl;
 	return 0; // Failed
@@ -235,7 +507,7 @@ int64_t SQLiteResult::getDataLong(const std::string &s)
 {
 	listNames_t::iterator it = m_listNames.find(s);
 	if(it != m_listNames.end())
-		return sqlite3_column_int64(m_handle, it->second);
+		return getDataLong(it->second);
 
 	std::cout << "Error during getDataLong(" << s << ")." << std::endl;
 	return 0; // Failed
@@ -245,10 +517,7 @@ std::string SQLiteResult::getDataString(const std::string &s)
 {
 	listNames_t::iterator it = m_listNames.find(s);
 	if(it != m_listNames.end() )
-	{
-		std::string value = (const char*)sqlite3_column_text(m_handle, it->second);
-		return value;
-	}
+		return getDataString(it->second);
 
 	std::cout << "Error during getDataString(" << s << ")." << std::endl;
 	return std::string(""); // Failed
@@ -258,25 +527,44 @@ const char* SQLiteResult::getDataStream(const std::string &s, uint64_t &size)
 {
 	listNames_t::iterator it = m_listNames.find(s);
 	if(it != m_listNames.end())
-	{
-		const char* value = (const char*)sqlite3_column_blob(m_handle, it->second);
-		size = sqlite3_column_bytes(m_handle, it->second);
-		return value;
-	}
+		return getDataStream(it->second, size);
 
 	std::cout << "Error during getDataStream(" << s << ")." << std::endl;
 	return NULL; // Failed
 }
 
+int32_t SQLiteResult::getColumn(const std::string &s)
+{
+	listNames_t::iterator it = m_listNames.find(s);
+	if(it != m_listNames.end())
+		return it->second;
+
+	return -1;
+}
+
+std::string SQLiteResult::getDataString(int32_t column)
+{
+	const char* value = (const char*)sqlite3_column_text(m_handle, column);
+	return value ? std::string(value) : std::string("");
+}
+
+const char* SQLiteResult::getDataStream(int32_t column, uint64_t &size)
+{
+	const char* value = (const char*)sqlite3_column_blob(m_handle, column);
+	size = sqlite3_column_bytes(m_handle, column);
+	return value;
+}
+
 bool SQLiteResult::next()
 {
 	// checks if after moving to next step we have a row result
 	return sqlite3_step(m_handle) == SQLITE_ROW;
 }
 
-SQLiteResult::SQLiteResult(sqlite3_stmt* stmt)
+SQLiteResult::SQLiteResult(sqlite3_stmt* stmt, DatabaseSQLite* database/* = NULL*/)
 {
 	m_handle = stmt;
+	m_database = database;
 	m_listNames.clear();
 
 	int32_t fields = sqlite3_column_count(m_handle);
@@ -286,5 +574,9 @@ SQLiteResult::SQLiteResult(sqlite3_stmt* stmt)
 
 SQLiteResult::~SQLiteResult()
 {
-	sqlite3_finalize(m_handle);
+	//statement results give the handle back to the cache
+	if(m_database)
+		m_database->releaseStatement(m_handle);
+	else
+		sqlite3_finalize(m_handle);
 }
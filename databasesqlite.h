@@ -31,6 +31,8 @@
 
 class DatabaseSQLite : public _Database
 {
+	friend class SQLiteResult;
+
 	public:
 		DatabaseSQLite();
 		DATABASE_VIRTUAL ~DatabaseSQLite();
@@ -43,6 +45,12 @@ class DatabaseSQLite : public _Database
 
 		DATABASE_VIRTUAL bool executeQuery(const std::string &query);
 		DATABASE_VIRTUAL DBResult* storeQuery(const std::string &query);
+		DATABASE_VIRTUAL DBResult* streamQuery(const std::string &query) {return storeQuery(query);}
+
+		DATABASE_VIRTUAL bool executeStatement(const DBStatement& stmt);
+		DATABASE_VIRTUAL DBResult* storeStatement(const DBStatement& stmt);
+
+		DATABASE_VIRTUAL bool executeInsert(const std::string& query, const std::vector<std::string>& rows);
 
 		DATABASE_VIRTUAL std::string escapeString(const std::string &s);
 		DATABASE_VIRTUAL std::string escapeBlob(const char* s, uint32_t length);
@@ -56,6 +64,19 @@ class DatabaseSQLite : public _Database
 	protected:
 		std::string _parse(const std::string &s);
 
+		sqlite3_stmt* prepareStatement(const DBStatement& stmt);
+		void releaseStatement(sqlite3_stmt* handle);
+
+		//a statement in use by a result is not handed out again until released
+		struct SQLiteStatement
+		{
+			sqlite3_stmt* handle;
+			bool used;
+		};
+
+		typedef std::map<std::string, SQLiteStatement> StatementMap;
+		StatementMap m_statements;
+
 		OTSYS_THREAD_LOCKVAR sqliteLock;
 		sqlite3* m_handle;
 };
@@ -70,16 +91,23 @@ class SQLiteResult : public _DBResult
 		DATABASE_VIRTUAL std::string getDataString(const std::string &s);
 		DATABASE_VIRTUAL const char* getDataStream(const std::string &s, uint64_t &size);
 
+		DATABASE_VIRTUAL int32_t getColumn(const std::string &s);
+		DATABASE_VIRTUAL int32_t getDataInt(int32_t column) {return sqlite3_column_int(m_handle, column);}
+		DATABASE_VIRTUAL int64_t getDataLong(int32_t column) {return sqlite3_column_int64(m_handle, column);}
+		DATABASE_VIRTUAL std::string getDataString(int32_t column);
+		DATABASE_VIRTUAL const char* getDataStream(int32_t column, uint64_t &size);
+
 		DATABASE_VIRTUAL bool next();
 
 	protected:
-		SQLiteResult(sqlite3_stmt* stmt);
+		SQLiteResult(sqlite3_stmt* stmt, DatabaseSQLite* database = NULL);
 		DATABASE_VIRTUAL ~SQLiteResult();
 
 		typedef std::map<const std::string, uint32_t> listNames_t;
 		listNames_t m_listNames;
 
 		sqlite3_stmt* m_handle;
+		DatabaseSQLite* m_database;
 };
 
 #endif
@@ -0,0 +1,99 @@
+//////////////////////////////////////////////////////////////////////
+// OpenTibia - an opensource roleplaying game
+//////////////////////////////////////////////////////////////////////
+// Worker threads for blocking database work
+//////////////////////////////////////////////////////////////////////
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software Foundation,
+// Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+//////////////////////////////////////////////////////////////////////
+#include "otpch.h"
+
+#include "databasetasks.h"
+#include "database.h"
+#include "metrics.h"
+
+#if defined __EXCEPTION_TRACER__
+#include "exception.h"
+#endif
+
+DatabaseTasks::DatabaseTasks()
+{
+	m_threads = 0;
+	OTSYS_THREAD_LOCKVARINIT(m_taskLock);
+	OTSYS_THREAD_SIGNALVARINIT(m_taskSignal);
+}
+
+void DatabaseTasks::start(int32_t threads)
+{
+	for(; m_threads < threads; ++m_threads)
+		OTSYS_CREATE_THREAD(DatabaseTasks::workerThread, NULL);
+}
+
+OTSYS_THREAD_RETURN DatabaseTasks::workerThread(void* p)
+{
+	#if defined __EXCEPTION_TRACER__
+	ExceptionHandler databaseExceptionHandler;
+	databaseExceptionHandler.InstallHandler();
+	#endif
+
+	//own connection when the driver allows it, otherwise queries share the main one
+	if(Database::getInstance()->getParam(DBPARAM_CONNECTIONPOOL))
+	{
+		Database* db = Database::createInstance();
+		if(db && db->isConnected())
+			Database::setThreadInstance(db);
+		else
+			std::cout << "> WARNING: Database thread could not open a connection, using the main one." << std::endl;
+	}
+
+	DatabaseTasks* tasks = DatabaseTasks::getInstance();
+	while(true)
+	{
+		OTSYS_THREAD_LOCK(tasks->m_taskLock, "");
+		while(tasks->m_taskList.empty())
+			OTSYS_THREAD_WAITSIGNAL(tasks->m_taskSignal, tasks->m_taskLock);
+
+		Task* task = tasks->m_taskList.front();
+		tasks->m_taskList.pop_front();
+		OTSYS_THREAD_UNLOCK(tasks->m_taskLock, "");
+
+		Metrics::getInstance()->observe(METRIC_DB_WAIT, OTSYS_TIME_MICRO() - task->getEnqueued());
+		(*task)();
+		delete task;
+	}
+
+	#if defined __EXCEPTION_TRACER__
+	databaseExceptionHandler.RemoveHandler();
+	#endif
+	#if not defined(__USE_BOOST_THREAD__) && not defined(WIN32)
+	return NULL;
+	#endif
+}
+
+void DatabaseTasks::addTask(Task* task)
+{
+	OTSYS_THREAD_LOCK(m_taskLock, "");
+	task->setEnqueued();
+	m_taskList.push_back(task);
+	OTSYS_THREAD_UNLOCK(m_taskLock, "");
+	OTSYS_THREAD_SIGNAL_SEND(m_taskSignal);
+}
+
+uint32_t DatabaseTasks::getTaskCount()
+{
+	OTSYS_THREAD_LOCK(m_taskLock, "");
+	uint32_t count = m_taskList.size();
+	OTSYS_THREAD_UNLOCK(m_taskLock, "");
+	return count;
+}
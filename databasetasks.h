@@ -0,0 +1,54 @@
+//////////////////////////////////////////////////////////////////////
+// OpenTibia - an opensource roleplaying game
+//////////////////////////////////////////////////////////////////////
+// Worker threads for blocking database work
+//////////////////////////////////////////////////////////////////////
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software Foundation,
+// Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+//////////////////////////////////////////////////////////////////////
+
+#ifndef __OTSERV_DATABASETASKS_H__
+#define __OTSERV_DATABASETASKS_H__
+
+#include "tasks.h"
+#include <list>
+
+//tasks run here may block on the database, results go back through the dispatcher
+class DatabaseTasks
+{
+	public:
+		virtual ~DatabaseTasks() {}
+		static DatabaseTasks* getInstance()
+		{
+			static DatabaseTasks instance;
+			return &instance;
+		}
+
+		void start(int32_t threads);
+		void addTask(Task* task);
+		uint32_t getTaskCount();
+
+		static OTSYS_THREAD_RETURN workerThread(void* p);
+
+	protected:
+		DatabaseTasks();
+
+		int32_t m_threads;
+		std::list<Task*> m_taskList;
+
+		OTSYS_THREAD_LOCKVAR_PTR m_taskLock;
+		OTSYS_THREAD_SIGNALVAR m_taskSignal;
+};
+
+#endif
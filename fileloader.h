@@ -266,6 +266,16 @@ class PropStream
 			return true;
 		}
 
+		inline bool GET_BYTES(uint32_t n, std::string& ret)
+		{
+			if((uint32_t)size() < n)
+				return false;
+
+			ret.assign(p, n);
+			p += n;
+			return true;
+		}
+
 		inline bool SKIP_N(unsigned short n)
 		{
 			if(size() < n)
@@ -31,6 +31,7 @@
 #include "tile.h"
 #include "house.h"
 #include "iologindata.h"
+#include "playerjournal.h"
 #include "ioguild.h"
 #include "actions.h"
 #include "globalevent.h"
@@ -46,6 +47,7 @@
 #include "chat.h"
 #include "server.h"
 #include "quests.h"
+#include "networkmessage.h"
 #include "monsters.h"
 #ifdef __LOGIN_SERVER__
 #include "gameservers.h"
@@ -198,7 +200,7 @@ void Game::saveGameState(bool savePlayers)
 		for(AutoList<Player>::listiterator it = Player::listPlayer.list.begin(); it != Player::listPlayer.list.end(); ++it)
 		{
 			(*it).second->loginPosition = (*it).second->getPosition();
-			IOLoginData::getInstance()->savePlayer((*it).second, false);
+			IOLoginData::getInstance()->savePlayer((*it).second, false, true);
 		}
 	}
 
@@ -2130,6 +2132,16 @@ bool Game::playerStopAutoWalk(uint32_t playerId)
 	return true;
 }
 
+bool Game::playerCancelWalk(uint32_t playerId)
+{
+	Player* player = getPlayerByID(playerId);
+	if(!player || player->isRemoved())
+		return false;
+
+	player->sendCancelWalk();
+	return true;
+}
+
 bool Game::playerUseItemEx(uint32_t playerId, const Position& fromPos, uint8_t fromStackPos, uint16_t fromSpriteId,
 	const Position& toPos, uint8_t toStackPos, uint16_t toSpriteId, bool isHotkey)
 {
@@ -3582,12 +3594,15 @@ bool Game::internalCreatureSay(Creature* creature, SpeakClasses type, const std:
 				Map::maxClientViewportX, Map::maxClientViewportX,
 				Map::maxClientViewportY, Map::maxClientViewportY);
 
-		//send to client
+		//send to client, the message is the same for everyone
+		EncodedMessage packet;
+		ProtocolGame::AddCreatureSpeak(&packet, creature, type, text, 0, 0, &destPos);
+
 		Player* tmpPlayer = NULL;
 		for(it = list.begin(); it != list.end(); ++it)
 		{
 			if((tmpPlayer = (*it)->getPlayer()))
-				tmpPlayer->sendCreatureSay(creature, type, text, &destPos);
+				tmpPlayer->sendCreatureSay(packet);
 		}
 
 		//event method
@@ -4134,11 +4149,14 @@ void Game::addCreatureHealth(const Creature* target)
 
 void Game::addCreatureHealth(const SpectatorVec& list, const Creature* target)
 {
+	EncodedMessage packet;
+	ProtocolGame::AddCreatureHealth(&packet, target);
+
 	Player* player = NULL;
 	for(SpectatorVec::const_iterator it = list.begin(); it != list.end(); ++it)
 	{
 		if((player = (*it)->getPlayer()))
-			player->sendCreatureHealth(target);
+			player->sendCreatureHealth(packet);
 	}
 }
 
@@ -4152,11 +4170,14 @@ void Game::addAnimatedText(const Position& pos, uint8_t textColor,
 void Game::addAnimatedText(const SpectatorVec& list, const Position& pos, uint8_t textColor,
 	const std::string& text)
 {
+	EncodedMessage packet;
+	ProtocolGame::AddAnimatedText(&packet, pos, textColor, text);
+
 	Player* player = NULL;
 	for(SpectatorVec::const_iterator it = list.begin(); it != list.end(); ++it)
 	{
 		if((player = (*it)->getPlayer()))
-			player->sendAnimatedText(pos, textColor, text);
+			player->sendAnimatedText(pos, packet);
 	}
 }
 
@@ -4174,11 +4195,14 @@ void Game::addMagicEffect(const SpectatorVec& list, const Position& pos, uint8_t
 	if(ghostMode)
 		return;
 
+	EncodedMessage packet;
+	ProtocolGame::AddMagicEffect(&packet, pos, effect);
+
 	Player* player = NULL;
 	for(SpectatorVec::const_iterator it = list.begin(); it != list.end(); ++it)
 	{
 		if((player = (*it)->getPlayer()))
-			player->sendMagicEffect(pos, effect);
+			player->sendMagicEffect(pos, effect, packet);
 	}
 }
 
@@ -4194,11 +4218,14 @@ void Game::addDistanceEffect(const Position& fromPos, const Position& toPos, uin
 
 void Game::addDistanceEffect(const SpectatorVec& list, const Position& fromPos, const Position& toPos, uint8_t effect)
 {
+	EncodedMessage packet;
+	ProtocolGame::AddDistanceShoot(&packet, fromPos, toPos, effect);
+
 	Player* player = NULL;
 	for(SpectatorVec::const_iterator it = list.begin(); it != list.end(); ++it)
 	{
 		if((player = (*it)->getPlayer()))
-			player->sendDistanceShoot(fromPos, toPos, effect);
+			player->sendDistanceShoot(fromPos, toPos, effect, packet);
 	}
 }
 
@@ -5206,17 +5233,13 @@ Highscore Game::getHighscore(uint16_t skill)
 		else
 			query << "SELECT `level`, `name` FROM `players` ORDER BY `level` DESC, `experience` DESC LIMIT " << limit;
 
-		if((result = db->storeQuery(query.str())))
+		if((result = db->streamQuery(query.str())))
 		{
+			int32_t levelColumn = result->getColumn(skill == 7 ? "maglevel" : "level"), nameColumn = result->getColumn("name");
 			do
 			{
-				uint32_t level;
-				if(skill == 7)
-					level = result->getDataInt("maglevel");
-				else
-					level = result->getDataInt("level");
-
-				std::string name = result->getDataString("name");
+				uint32_t level = result->getDataInt(levelColumn);
+				std::string name = result->getDataString(nameColumn);
 				if(name.length() > 0)
 					hs.push_back(std::make_pair(name, level));
 			}
@@ -5227,12 +5250,13 @@ Highscore Game::getHighscore(uint16_t skill)
 	else
 	{
 		query << "SELECT `player_skills`.`value`, `players`.`name` FROM `player_skills`,`players` WHERE `player_skills`.`skillid`=" << skill << " AND `player_skills`.`player_id`=`players`.`id` ORDER BY `player_skills`.`value` DESC, `player_skills`.`count` DESC LIMIT " << limit;
-		if((result = db->storeQuery(query.str())))
+		if((result = db->streamQuery(query.str())))
 		{
+			int32_t levelColumn = result->getColumn("value"), nameColumn = result->getColumn("name");
 			do
 			{
-				uint32_t level = result->getDataInt("value");
-				std::string name = result->getDataString("name");
+				uint32_t level = result->getDataInt(levelColumn);
+				std::string name = result->getDataString(nameColumn);
 				if(name.length() > 0)
 					hs.push_back(std::make_pair(name, level));
 			}
@@ -5608,6 +5632,8 @@ void Game::globalSave()
 void Game::shutdown()
 {
 	std::cout << "Preparing";
+	IOLoginData::getInstance()->flushPlayerSaves();
+	PlayerJournal::getInstance()->flush(true);
 	Spawns::getInstance()->clear();
 	std::cout << " shutdown";
 	Scheduler::getScheduler().shutdown();
@@ -442,6 +442,7 @@ class Game
 		bool playerReceivePing(uint32_t playerId);
 		bool playerAutoWalk(uint32_t playerId, std::list<Direction>& listDir);
 		bool playerStopAutoWalk(uint32_t playerId);
+		bool playerCancelWalk(uint32_t playerId);
 		bool playerUseItemEx(uint32_t playerId, const Position& fromPos, uint8_t fromStackPos,
 			uint16_t fromSpriteId, const Position& toPos, uint8_t toStackPos, uint16_t toSpriteId, bool isHotkey);
 		bool playerUseItem(uint32_t playerId, const Position& pos, uint8_t stackPos,
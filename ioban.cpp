@@ -25,41 +25,184 @@
 #include "iologindata.h"
 #include "tools.h"
 #include "database.h"
+#include "configmanager.h"
+#include "scheduler.h"
+
+extern ConfigManager g_config;
+
+//masks with all their set bits at the top are walked in the trie
+static bool isPrefixMask(uint32_t mask)
+{
+	uint32_t rest = ~mask;
+	return !(rest & (rest + 1));
+}
+
+static bool isBanActive(int64_t expires, time_t now)
+{
+	return expires <= 0 || expires > now;
+}
+
+//the later of two expiries, where 0 and below never expire
+static int64_t getLaterExpiry(int64_t a, int64_t b)
+{
+	if(a <= 0 || b <= 0)
+		return std::min(a, b);
+
+	return std::max(a, b);
+}
+
+static bool findIpBan(const IpBanNode* node, uint32_t ip, uint32_t mask, uint32_t depth, time_t now, std::vector<uint32_t>& expired)
+{
+	bool found = false;
+	for(std::map<uint32_t, int64_t>::const_iterator it = node->bans.begin(); it != node->bans.end(); ++it)
+	{
+		if(isBanActive(it->second, now))
+			found = true;
+		else
+			expired.push_back(it->first);
+	}
+
+	if(found || depth == 32)
+		return found;
+
+	uint32_t bit = 0x80000000 >> depth;
+	for(int32_t i = 0; i < 2; ++i)
+	{
+		//bits outside of the checked mask match either way
+		if(!node->children[i] || ((mask & bit) && i != ((ip & bit) ? 1 : 0)))
+			continue;
+
+		if(findIpBan(node->children[i], ip, mask, depth + 1, now, expired))
+			return true;
+	}
+
+	return false;
+}
+
+static void pruneIpBans(IpBanNode* node, time_t now)
+{
+	for(std::map<uint32_t, int64_t>::iterator it = node->bans.begin(); it != node->bans.end(); )
+	{
+		//same condition clearTemporials() deactivates them by
+		if(it->second >= 0 && it->second <= now)
+			node->bans.erase(it++);
+		else
+			++it;
+	}
+
+	for(int32_t i = 0; i < 2; ++i)
+	{
+		if(node->children[i])
+			pruneIpBans(node->children[i], now);
+	}
+}
+
+void BanIndex::swap(BanIndex& index)
+{
+	std::swap(ipBans.children[0], index.ipBans.children[0]);
+	std::swap(ipBans.children[1], index.ipBans.children[1]);
+	ipBans.bans.swap(index.ipBans.bans);
+
+	ipMaskBans.swap(index.ipMaskBans);
+	ipMasks.swap(index.ipMasks);
+	banishments.swap(index.banishments);
+	namelocks.swap(index.namelocks);
+	deletions.swap(index.deletions);
+}
+
+void IOBan::addIpBan(BanIndex& index, uint32_t ip, uint32_t mask, int64_t expires)
+{
+	index.ipMasks.insert(std::make_pair(ip, mask));
+	if(!isPrefixMask(mask))
+	{
+		IpMaskBan ban;
+		ban.value = ip;
+		ban.mask = mask;
+		ban.expires = expires;
+		index.ipMaskBans.push_back(ban);
+		return;
+	}
+
+	IpBanNode* node = &index.ipBans;
+	for(uint32_t bit = 0x80000000; bit && (mask & bit); bit >>= 1)
+	{
+		IpBanNode*& child = node->children[(ip & bit) ? 1 : 0];
+		if(!child)
+			child = new IpBanNode;
+
+		node = child;
+	}
+
+	std::map<uint32_t, int64_t>::iterator it = node->bans.find(ip);
+	if(it != node->bans.end())
+		it->second = getLaterExpiry(it->second, expires);
+	else
+		node->bans[ip] = expires;
+}
+
+void IOBan::removeIpBan(BanIndex& index, uint32_t ip)
+{
+	typedef std::multimap<uint32_t, uint32_t>::iterator MaskIterator;
+	std::pair<MaskIterator, MaskIterator> range = index.ipMasks.equal_range(ip);
+	for(MaskIterator it = range.first; it != range.second; ++it)
+	{
+		if(!isPrefixMask(it->second))
+			continue;
+
+		IpBanNode* node = &index.ipBans;
+		for(uint32_t bit = 0x80000000; node && bit && (it->second & bit); bit >>= 1)
+			node = node->children[(ip & bit) ? 1 : 0];
+
+		if(node)
+			node->bans.erase(ip);
+	}
+
+	index.ipMasks.erase(range.first, range.second);
+	for(std::vector<IpMaskBan>::iterator it = index.ipMaskBans.begin(); it != index.ipMaskBans.end(); )
+	{
+		if(it->value == ip)
+			it = index.ipMaskBans.erase(it);
+		else
+			++it;
+	}
+}
 
 bool IOBan::isIpBanished(uint32_t ip, uint32_t mask /*= 0xFFFFFFFF*/)
 {
 	if(ip == 0)
 		return false;
 
-	Database* db = Database::getInstance();
-	DBResult* result;
-
-	DBQuery query;
-	query << "SELECT `expires` FROM `bans` WHERE `type` = " << (BanType_t)BANTYPE_IP_BANISHMENT << " AND ((" << ip << " & " << mask << " & `param`) = (`value` & `param` & " << mask << ")) AND `active` = 1";
-	if(!(result = db->storeQuery(query.str())))
-		return false;
+	time_t now = time(NULL);
+	std::vector<uint32_t> expired;
+	bool banished;
+	{
+		OTSYS_THREAD_LOCK_CLASS lockClass(m_banLock);
+		banished = findIpBan(&m_index.ipBans, ip, mask, 0, now, expired);
+		for(std::vector<IpMaskBan>::iterator it = m_index.ipMaskBans.begin(); !banished && it != m_index.ipMaskBans.end(); ++it)
+		{
+			if((ip & mask & it->mask) != (it->value & it->mask & mask))
+				continue;
+
+			if(isBanActive(it->expires, now))
+				banished = true;
+			else
+				expired.push_back(it->value);
+		}
+	}
 
-	uint64_t expires = result->getDataLong("expires");
-	db->freeResult(result);
-	if(expires == 0 || (time_t)expires > time(NULL))
+	if(banished)
 		return true;
 
-	removeIpBanishment(ip);
+	for(std::vector<uint32_t>::iterator it = expired.begin(); it != expired.end(); ++it)
+		removeIpBanishment(*it);
+
 	return false;
 }
 
 bool IOBan::isNamelocked(uint32_t guid)
 {
-	Database* db = Database::getInstance();
-	DBResult* result;
-
-	DBQuery query;
-	query << "SELECT `id` FROM `bans` WHERE `value` = " << guid << " AND `type` = " << (BanType_t)BANTYPE_NAMELOCK << " AND `active` = 1";
-	if(!(result = db->storeQuery(query.str())))
-		return false;
-
-	db->freeResult(result);
-	return true;
+	OTSYS_THREAD_LOCK_CLASS lockClass(m_banLock);
+	return m_index.namelocks.find(guid) != m_index.namelocks.end();
 }
 
 bool IOBan::isNamelocked(std::string name)
@@ -73,18 +216,15 @@ bool IOBan::isNamelocked(std::string name)
 
 bool IOBan::isBanished(uint32_t account)
 {
-	Database* db = Database::getInstance();
-	DBResult* result;
-
-	DBQuery query;
-	query << "SELECT `expires` FROM `bans` WHERE `value` = " << account << " AND `type` = " << (BanType_t)BANTYPE_BANISHMENT << " AND `active` = 1";
-	if(!(result = db->storeQuery(query.str())))
-		return false;
+	{
+		OTSYS_THREAD_LOCK_CLASS lockClass(m_banLock);
+		OTSERV_HASH_MAP<uint32_t, int64_t>::iterator it = m_index.banishments.find(account);
+		if(it == m_index.banishments.end())
+			return false;
 
-	uint64_t expires = result->getDataInt("expires");
-	db->freeResult(result);
-	if(expires == 0 || (time_t)expires > time(NULL))
-		return true;
+		if(isBanActive(it->second, time(NULL)))
+			return true;
+	}
 
 	removeBanishment(account);
 	return false;
@@ -92,16 +232,8 @@ bool IOBan::isBanished(uint32_t account)
 
 bool IOBan::isDeleted(uint32_t account)
 {
-	Database* db = Database::getInstance();
-	DBResult* result;
-
-	DBQuery query;
-	query << "SELECT `id` FROM `bans` WHERE `value` = " << account << " AND `type` = " << (BanType_t)BANTYPE_DELETION << " AND `active` = 1";
-	if(!(result = db->storeQuery(query.str())))
-		return false;
-
-	db->freeResult(result);
-	return true;
+	OTSYS_THREAD_LOCK_CLASS lockClass(m_banLock);
+	return m_index.deletions.find(account) != m_index.deletions.end();
 }
 
 bool IOBan::addIpBanishment(uint32_t ip, time_t banTime, std::string comment, uint32_t gamemaster, std::string statement/* = ""*/)
@@ -112,7 +244,13 @@ bool IOBan::addIpBanishment(uint32_t ip, time_t banTime, std::string comment, ui
 	Database* db = Database::getInstance();
 	DBQuery query;
 	query << "INSERT INTO `bans` (`id`, `type`, `value`, `param`, `expires`, `added`, `admin_id`, `comment`) VALUES (NULL, " << (BanType_t)BANTYPE_IP_BANISHMENT << ", " << ip << ", 4294967295, " << banTime << ", " << time(NULL) << ", " << gamemaster << ", " << db->escapeString(comment.c_str()) << ")";
-	return db->executeQuery(query.str());
+	if(!db->executeQuery(query.str()))
+		return false;
+
+	OTSYS_THREAD_LOCK_CLASS lockClass(m_banLock);
+	addIpBan(m_index, ip, 0xFFFFFFFF, banTime);
+	m_revision++;
+	return true;
 }
 
 bool IOBan::addNamelock(uint32_t playerId, uint32_t reasonId, uint32_t actionId, std::string comment, uint32_t gamemaster, std::string statement/* = ""*/)
@@ -123,7 +261,13 @@ bool IOBan::addNamelock(uint32_t playerId, uint32_t reasonId, uint32_t actionId,
 	Database* db = Database::getInstance();
 	DBQuery query;
 	query << "INSERT INTO `bans` (`id`, `type`, `value`, `expires`, `added`, `admin_id`, `comment`, `reason`, `action`) VALUES (NULL, " << (BanType_t)BANTYPE_NAMELOCK << ", " << playerId << ", '-1', " << time(NULL) << ", " << gamemaster << ", " << db->escapeString(comment.c_str()) << ", " << reasonId << ", " << actionId << ");";
-	return db->executeQuery(query.str());
+	if(!db->executeQuery(query.str()))
+		return false;
+
+	OTSYS_THREAD_LOCK_CLASS lockClass(m_banLock);
+	m_index.namelocks.insert(playerId);
+	m_revision++;
+	return true;
 }
 
 bool IOBan::addNamelock(std::string name, uint32_t reasonId, uint32_t actionId, std::string comment, uint32_t gamemaster, std::string statement/* = ""*/)
@@ -143,7 +287,13 @@ bool IOBan::addBanishment(uint32_t account, time_t banTime, uint32_t reasonId, u
 	Database* db = Database::getInstance();
 	DBQuery query;
 	query << "INSERT INTO `bans` (`id`, `type`, `value`, `expires`, `added`, `admin_id`, `comment`, `reason`, `action`) VALUES (NULL, " << (BanType_t)BANTYPE_BANISHMENT << ", " << account << ", " << banTime << ", " << time(NULL) << ", " << gamemaster << ", " << db->escapeString(comment.c_str()) << ", " << reasonId << ", " << actionId << ");";
-	return db->executeQuery(query.str());
+	if(!db->executeQuery(query.str()))
+		return false;
+
+	OTSYS_THREAD_LOCK_CLASS lockClass(m_banLock);
+	m_index.banishments[account] = banTime;
+	m_revision++;
+	return true;
 }
 
 bool IOBan::addDeletion(uint32_t account, uint32_t reasonId, uint32_t actionId, std::string comment, uint32_t gamemaster, std::string statement/* = ""*/)
@@ -160,7 +310,13 @@ bool IOBan::addDeletion(uint32_t account, uint32_t reasonId, uint32_t actionId,
 	Database* db = Database::getInstance();
 	DBQuery query;
 	query << "INSERT INTO `bans` (`id`, `type`, `value`, `expires`, `added`, `admin_id`, `comment`, `reason`, `action`) VALUES (NULL, " << (BanType_t)BANTYPE_DELETION << ", " << account << ", '-1', " << time(NULL) << ", " << gamemaster << ", " << db->escapeString(comment.c_str()) << ", " << reasonId << ", " << actionId << ");";
-	return db->executeQuery(query.str());
+	if(!db->executeQuery(query.str()))
+		return false;
+
+	OTSYS_THREAD_LOCK_CLASS lockClass(m_banLock);
+	m_index.deletions.insert(account);
+	m_revision++;
+	return true;
 }
 
 void IOBan::addNotation(uint32_t account, uint32_t reasonId, uint32_t actionId, std::string comment, uint32_t gamemaster, std::string statement/* = ""*/)
@@ -177,10 +333,13 @@ bool IOBan::removeIpBanishment(uint32_t ip)
 
 	DBQuery query;
 	query << "UPDATE `bans` SET `active` = 0 WHERE `value` = " << ip << " AND `type` = " << (BanType_t)BANTYPE_IP_BANISHMENT;
-	if(db->executeQuery(query.str()))
-		return true;
+	if(!db->executeQuery(query.str()))
+		return false;
 
-	return false;
+	OTSYS_THREAD_LOCK_CLASS lockClass(m_banLock);
+	removeIpBan(m_index, ip);
+	m_revision++;
+	return true;
 }
 
 bool IOBan::removeNamelock(uint32_t guid)
@@ -189,10 +348,13 @@ bool IOBan::removeNamelock(uint32_t guid)
 
 	DBQuery query;
 	query << "UPDATE `bans` SET `active` = 0 WHERE `value` = " << guid << " AND `type` = " << (BanType_t)BANTYPE_NAMELOCK;
-	if(db->executeQuery(query.str()))
-		return true;
+	if(!db->executeQuery(query.str()))
+		return false;
 
-	return false;
+	OTSYS_THREAD_LOCK_CLASS lockClass(m_banLock);
+	m_index.namelocks.erase(guid);
+	m_revision++;
+	return true;
 }
 
 bool IOBan::removeNamelock(std::string name)
@@ -210,10 +372,13 @@ bool IOBan::removeBanishment(uint32_t account)
 
 	DBQuery query;
 	query << "UPDATE `bans` SET `active` = 0 WHERE `value` = " << account << " AND `type` = " << (BanType_t)BANTYPE_BANISHMENT;
-	if(db->executeQuery(query.str()))
-		return true;
+	if(!db->executeQuery(query.str()))
+		return false;
 
-	return false;
+	OTSYS_THREAD_LOCK_CLASS lockClass(m_banLock);
+	m_index.banishments.erase(account);
+	m_revision++;
+	return true;
 }
 
 bool IOBan::removeDeletion(uint32_t account)
@@ -222,10 +387,13 @@ bool IOBan::removeDeletion(uint32_t account)
 
 	DBQuery query;
 	query << "UPDATE `bans` SET `active` = 0 WHERE `value` = " << account << " AND `type` = " << (BanType_t)BANTYPE_DELETION;
-	if(db->executeQuery(query.str()))
-		return true;
+	if(!db->executeQuery(query.str()))
+		return false;
 
-	return false;
+	OTSYS_THREAD_LOCK_CLASS lockClass(m_banLock);
+	m_index.deletions.erase(account);
+	m_revision++;
+	return true;
 }
 
 void IOBan::removeNotations(uint32_t account)
@@ -406,5 +574,125 @@ bool IOBan::clearTemporials()
 	Database* db = Database::getInstance();
 	DBQuery query;
 	query << "UPDATE `bans` SET `active` = 0 WHERE `expires` <= " << time(NULL) << " AND `expires` >= 0 AND `active` = 1;";
-	return db->executeQuery(query.str());
+	if(!db->executeQuery(query.str()))
+		return false;
+
+	time_t now = time(NULL);
+	OTSYS_THREAD_LOCK_CLASS lockClass(m_banLock);
+	pruneIpBans(&m_index.ipBans, now);
+	for(std::vector<IpMaskBan>::iterator it = m_index.ipMaskBans.begin(); it != m_index.ipMaskBans.end(); )
+	{
+		if(it->expires >= 0 && it->expires <= now)
+			it = m_index.ipMaskBans.erase(it);
+		else
+			++it;
+	}
+
+	for(OTSERV_HASH_MAP<uint32_t, int64_t>::iterator it = m_index.banishments.begin(); it != m_index.banishments.end(); )
+	{
+		if(it->second >= 0 && it->second <= now)
+			m_index.banishments.erase(it++);
+		else
+			++it;
+	}
+
+	m_revision++;
+	return true;
+}
+
+bool IOBan::loadBans()
+{
+	Database* db = Database::getInstance();
+	DBResult* result;
+
+	DBQuery query;
+	query << "SELECT `type`, `value`, `param`, `expires` FROM `bans` WHERE `type` IN (" << BANTYPE_IP_BANISHMENT << ", "
+		<< BANTYPE_NAMELOCK << ", " << BANTYPE_BANISHMENT << ", " << BANTYPE_DELETION << ") AND `active` = 1";
+
+	BanIndex index;
+	if((result = db->streamQuery(query.str())))
+	{
+		readBans(result, index);
+		db->freeResult(result);
+	}
+
+	OTSYS_THREAD_LOCK_CLASS lockClass(m_banLock);
+	m_index.swap(index);
+	m_revision++;
+	return true;
+}
+
+void IOBan::refreshBans()
+{
+	std::stringstream query;
+	query << "SELECT `type`, `value`, `param`, `expires` FROM `bans` WHERE `type` IN (" << BANTYPE_IP_BANISHMENT << ", "
+		<< BANTYPE_NAMELOCK << ", " << BANTYPE_BANISHMENT << ", " << BANTYPE_DELETION << ") AND `active` = 1";
+
+	uint32_t revision;
+	{
+		OTSYS_THREAD_LOCK_CLASS lockClass(m_banLock);
+		revision = m_revision;
+	}
+
+	Database::asyncStore(query.str(), boost::bind(&IOBan::updateBans, this, _1, _2, revision));
+	Scheduler::getScheduler().addEvent(createSchedulerTask(std::max((int32_t)1000, g_config.getNumber(ConfigManager::BAN_REFRESH_INTERVAL)),
+		boost::bind(&IOBan::refreshBans, this)));
+}
+
+void IOBan::updateBans(DBResult* result, bool success, uint32_t revision)
+{
+	//database thread, the index is kept when the query failed and emptied when no bans are left
+	if(!success)
+		return;
+
+	BanIndex index;
+	if(result)
+		readBans(result, index);
+
+	OTSYS_THREAD_LOCK_CLASS lockClass(m_banLock);
+	if(revision != m_revision)
+		return;
+
+	m_index.swap(index);
+	m_revision++;
+}
+
+void IOBan::readBans(DBResult* result, BanIndex& index)
+{
+	int32_t typeColumn = result->getColumn("type"), valueColumn = result->getColumn("value"),
+		paramColumn = result->getColumn("param"), expiresColumn = result->getColumn("expires");
+	do
+	{
+		uint32_t value = (uint32_t)result->getDataLong(valueColumn);
+		int64_t expires = result->getDataLong(expiresColumn);
+		switch((BanType_t)result->getDataInt(typeColumn))
+		{
+			case BANTYPE_IP_BANISHMENT:
+				addIpBan(index, value, (uint32_t)result->getDataLong(paramColumn), expires);
+				break;
+
+			case BANTYPE_NAMELOCK:
+				index.namelocks.insert(value);
+				break;
+
+			case BANTYPE_BANISHMENT:
+			{
+				OTSERV_HASH_MAP<uint32_t, int64_t>::iterator it = index.banishments.find(value);
+				if(it != index.banishments.end())
+					it->second = getLaterExpiry(it->second, expires);
+				else
+					index.banishments[value] = expires;
+
+				break;
+			}
+
+			case BANTYPE_DELETION:
+				index.deletions.insert(value);
+				break;
+
+			default:
+				break;
+		}
+	}
+	while(result->next());
 }
@@ -23,7 +23,9 @@
 
 #include "otsystem.h"
 #include <list>
+#include <map>
 #include "player.h"
+#include "database.h"
 
 enum BanType_t
 {
@@ -43,13 +45,60 @@ struct Ban
 
 typedef std::vector<Ban> BansVec;
 
+//bit trie of the banned addresses, a ban sits at the depth of its mask length
+struct IpBanNode
+{
+	IpBanNode() {children[0] = children[1] = NULL;}
+	virtual ~IpBanNode()
+	{
+		delete children[0];
+		delete children[1];
+	}
+
+	IpBanNode* children[2];
+	//expiry by banned address
+	std::map<uint32_t, int64_t> bans;
+
+	private:
+		IpBanNode(const IpBanNode&);
+		IpBanNode& operator=(const IpBanNode&);
+};
+
+//ip bans with masks that are not a prefix, checked one by one
+struct IpMaskBan
+{
+	uint32_t value, mask;
+	int64_t expires;
+};
+
+struct BanIndex
+{
+	IpBanNode ipBans;
+	std::vector<IpMaskBan> ipMaskBans;
+	//masks of each banned address, to find its nodes again
+	std::multimap<uint32_t, uint32_t> ipMasks;
+
+	OTSERV_HASH_MAP<uint32_t, int64_t> banishments;
+	OTSERV_HASH_SET<uint32_t> namelocks, deletions;
+
+	void swap(BanIndex& index);
+};
+
 class IOBan
 {
 	protected:
-		IOBan() {}
+		IOBan()
+		{
+			OTSYS_THREAD_LOCKVARINIT(m_banLock);
+			m_revision = 0;
+		}
 
 	public:
-		virtual ~IOBan() {}
+		virtual ~IOBan()
+		{
+			OTSYS_THREAD_LOCKVARRELEASE(m_banLock);
+		}
+
 		static IOBan* getInstance()
 		{
 			static IOBan instance;
@@ -95,6 +144,23 @@ class IOBan
 
 		uint32_t getNotationsCount(uint32_t account);
 		bool clearTemporials();
+
+		//startup, reads the active bans the checks above are answered from
+		bool loadBans();
+		//dispatcher thread, picks up bans changed outside of the server, reschedules itself
+		void refreshBans();
+
+	protected:
+		void updateBans(DBResult* result, bool success, uint32_t revision);
+		static void readBans(DBResult* result, BanIndex& index);
+
+		static void addIpBan(BanIndex& index, uint32_t ip, uint32_t mask, int64_t expires);
+		static void removeIpBan(BanIndex& index, uint32_t ip);
+
+		BanIndex m_index;
+		//bumped on every change made here, a refresh read before it is dropped
+		uint32_t m_revision;
+		OTSYS_THREAD_LOCKVAR m_banLock;
 };
 
 #endif
@@ -22,116 +22,217 @@
 #include "database.h"
 #include "game.h"
 #include "configmanager.h"
+#include "tools.h"
 
 extern Game g_game;
 extern ConfigManager g_config;
 
-bool IOGuild::getGuildIdByName(uint32_t& guildId, const std::string& guildName)
+bool IOGuild::getGuild(uint32_t guildId, CachedGuild& guild)
 {
+	{
+		OTSYS_THREAD_LOCK_CLASS lockClass(m_guildLock);
+		GuildMap::iterator it = m_guilds.find(guildId);
+		if(it != m_guilds.end() && it->second.expires > time(NULL))
+		{
+			guild = it->second;
+			return true;
+		}
+	}
+
 	Database* db = Database::getInstance();
 	DBResult* result;
 
 	DBQuery query;
-	query << "SELECT `id` FROM `guilds` WHERE `name` " << db->getStringComparisonOperator() << " " << db->escapeString(guildName) << " AND `world_id` = " << g_config.getNumber(ConfigManager::WORLD_ID);
+	query << "SELECT `world_id`, `name` FROM `guilds` WHERE `id` = " << guildId;
 	if(!(result = db->storeQuery(query.str())))
+	{
+		invalidateGuild(guildId);
 		return false;
+	}
 
-	guildId = result->getDataInt("id");
+	guild.worldId = result->getDataInt("world_id");
+	guild.name = result->getDataString("name");
+	guild.ranks.clear();
 	db->freeResult(result);
+
+	query.str("");
+	query << "SELECT `id`, `level`, `name` FROM `guild_ranks` WHERE `guild_id` = " << guildId;
+	if((result = db->storeQuery(query.str())))
+	{
+		do
+		{
+			GuildRank rank;
+			rank.id = result->getDataInt("id");
+			rank.level = result->getDataInt("level");
+			rank.name = result->getDataString("name");
+			guild.ranks.push_back(rank);
+		}
+		while(result->next());
+		db->freeResult(result);
+	}
+
+	guild.expires = time(NULL) + GUILD_CACHE_TTL;
+	OTSYS_THREAD_LOCK_CLASS lockClass(m_guildLock);
+	invalidateGuild(guildId);
+
+	m_guilds[guildId] = guild;
+	if(guild.worldId == (uint32_t)g_config.getNumber(ConfigManager::WORLD_ID))
+		m_guildNames[asLowerCaseString(guild.name)] = guildId;
+
 	return true;
 }
 
-bool IOGuild::guildExists(uint32_t guildId)
+bool IOGuild::getRank(uint32_t guildId, int32_t level, GuildRank& rank)
+{
+	CachedGuild guild;
+	if(!getGuild(guildId, guild))
+		return false;
+
+	for(std::vector<GuildRank>::iterator it = guild.ranks.begin(); it != guild.ranks.end(); ++it)
+	{
+		if(it->level == level)
+		{
+			rank = *it;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+bool IOGuild::getRank(uint32_t guildId, const std::string& name, GuildRank& rank)
+{
+	CachedGuild guild;
+	if(!getGuild(guildId, guild))
+		return false;
+
+	//matches the case insensitive comparison of the databases
+	std::string lowerName = asLowerCaseString(name);
+	for(std::vector<GuildRank>::iterator it = guild.ranks.begin(); it != guild.ranks.end(); ++it)
+	{
+		if(asLowerCaseString(it->name) == lowerName)
+		{
+			rank = *it;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+void IOGuild::invalidateGuild(uint32_t guildId)
 {
+	OTSYS_THREAD_LOCK_CLASS lockClass(m_guildLock);
+	GuildMap::iterator it = m_guilds.find(guildId);
+	if(it == m_guilds.end())
+		return;
+
+	GuildNameMap::iterator nit = m_guildNames.find(asLowerCaseString(it->second.name));
+	if(nit != m_guildNames.end() && nit->second == guildId)
+		m_guildNames.erase(nit);
+
+	m_guilds.erase(it);
+}
+
+bool IOGuild::getGuildIdByName(uint32_t& guildId, const std::string& guildName)
+{
+	{
+		OTSYS_THREAD_LOCK_CLASS lockClass(m_guildLock);
+		GuildNameMap::iterator it = m_guildNames.find(asLowerCaseString(guildName));
+		if(it != m_guildNames.end())
+		{
+			GuildMap::iterator git = m_guilds.find(it->second);
+			if(git != m_guilds.end() && git->second.expires > time(NULL))
+			{
+				guildId = it->second;
+				return true;
+			}
+		}
+	}
+
 	Database* db = Database::getInstance();
 	DBResult* result;
 
 	DBQuery query;
-	query << "SELECT `id` FROM `guilds` WHERE `id` = " << guildId << " AND `world_id` = " << g_config.getNumber(ConfigManager::WORLD_ID);
+	query << "SELECT `id` FROM `guilds` WHERE `name` " << db->getStringComparisonOperator() << " " << db->escapeString(guildName) << " AND `world_id` = " << g_config.getNumber(ConfigManager::WORLD_ID);
 	if(!(result = db->storeQuery(query.str())))
 		return false;
 
+	guildId = result->getDataInt("id");
 	db->freeResult(result);
+
+	//fills the cache, the guild row is read again in case it went away meanwhile
+	invalidateGuild(guildId);
+	CachedGuild guild;
+	return getGuild(guildId, guild);
+}
+
+bool IOGuild::getGuildNameById(std::string& guildName, uint32_t guildId)
+{
+	CachedGuild guild;
+	if(!getGuild(guildId, guild))
+		return false;
+
+	guildName = guild.name;
 	return true;
 }
 
-bool IOGuild::getRankIdByGuildIdAndName(uint32_t &rankId, const std::string& rankName, uint32_t& guildId)
+bool IOGuild::guildExists(uint32_t guildId)
 {
-	Database* db = Database::getInstance();
-	DBResult* result;
+	CachedGuild guild;
+	return getGuild(guildId, guild) && guild.worldId == (uint32_t)g_config.getNumber(ConfigManager::WORLD_ID);
+}
 
-	DBQuery query;
-	query << "SELECT `id` FROM `guild_ranks` WHERE `guild_id` = " << guildId << " AND `name` " << db->getStringComparisonOperator() << " " << db->escapeString(rankName);
-	if(!(result = db->storeQuery(query.str())))
+bool IOGuild::getRankIdByGuildIdAndName(uint32_t &rankId, const std::string& rankName, uint32_t& guildId)
+{
+	GuildRank rank;
+	if(!getRank(guildId, rankName, rank))
 		return false;
 
-	rankId = result->getDataInt("id");
-	db->freeResult(result);
+	rankId = rank.id;
 	return true;
 }
 
 uint32_t IOGuild::getRankIdByGuildIdAndLevel(uint32_t guildId, uint32_t guildLevel)
 {
-	Database* db = Database::getInstance();
-	DBResult* result;
-
-	DBQuery query;
-	query << "SELECT `id` FROM `guild_ranks` WHERE `level` = " << guildLevel << " AND `guild_id` = " << guildId;
-	if(!(result = db->storeQuery(query.str())))
+	GuildRank rank;
+	if(!getRank(guildId, (int32_t)guildLevel, rank))
 		return 0;
 
-	const uint32_t id = result->getDataInt("id");
-	db->freeResult(result);
-	return id;
+	return rank.id;
 }
 
 std::string IOGuild::getRankName(int16_t guildLevel, uint32_t guildId)
 {
-	Database* db = Database::getInstance();
-	DBResult* result;
-
-	DBQuery query;
-	query << "SELECT `name` FROM `guild_ranks` WHERE `level` = " << guildLevel << " AND `guild_id` = " << guildId;
-	if(!(result = db->storeQuery(query.str())))
+	GuildRank rank;
+	if(!getRank(guildId, guildLevel, rank))
 		return "";
 
-	const std::string name = result->getDataString("name");
-	db->freeResult(result);
-	return name;
+	return rank.name;
 }
 
 bool IOGuild::rankNameExists(std::string rankName, uint32_t guildId)
 {
-	Database* db = Database::getInstance();
-	DBResult* result;
-
-	DBQuery query;
-	query << "SELECT `id` FROM `guild_ranks` WHERE `guild_id` = " << guildId << " AND `name` " << db->getStringComparisonOperator() << " " << db->escapeString(rankName);
-	if(!(result = db->storeQuery(query.str())))
-		return false;
-
-	db->freeResult(result);
-	return true;
+	GuildRank rank;
+	return getRank(guildId, rankName, rank);
 }
 
 bool IOGuild::changeRankName(std::string oldRankName, std::string newRankName, uint32_t guildId)
 {
-	Database* db = Database::getInstance();
-	DBResult* result;
-
-	DBQuery query;
-	query << "SELECT `id` FROM `guild_ranks` WHERE `name` " << db->getStringComparisonOperator() << " " << db->escapeString(oldRankName) << " AND `guild_id` = " << guildId;
-	if(!(result = db->storeQuery(query.str())))
+	GuildRank rank;
+	if(!getRank(guildId, oldRankName, rank))
 		return false;
 
-	const uint32_t rankId = result->getDataInt("id");
-	db->freeResult(result);
+	const uint32_t rankId = rank.id;
+	Database* db = Database::getInstance();
 
-	query.str("");
+	DBQuery query;
 	query << "UPDATE `guild_ranks` SET `name` = " << db->escapeString(newRankName) << " WHERE `id` = " << rankId << " AND `guild_id` = " << guildId;
 	if(!db->executeQuery(query.str()))
 		return false;
 
+	invalidateGuild(guildId);
+
 	for(AutoList<Player>::listiterator it = Player::listPlayer.list.begin(); it != Player::listPlayer.list.end(); ++it)
 	{
 		if((*it).second->getGuildId() == guildId && (*it).second->getGuildRankId() == rankId)
@@ -158,36 +259,27 @@ bool IOGuild::createGuild(Player* player)
 
 	const uint32_t guildId = result->getDataInt("id");
 	db->freeResult(result);
+
+	//the ranks are only inserted with the guild
+	invalidateGuild(guildId);
 	return joinGuild(player, guildId, true);
 }
 
 bool IOGuild::joinGuild(Player* player, uint32_t guildId, bool creation/* = false*/)
 {
-	Database* db = Database::getInstance();
-	DBResult* result;
-
-	DBQuery query;
-	query << "SELECT `id`, `name` FROM `guild_ranks` WHERE `guild_id` = " << guildId << " AND `level` = " << (creation ? "3" : "1");
-	if(!(result = db->storeQuery(query.str())))
+	GuildRank rank;
+	if(!getRank(guildId, creation ? GUILDLEVEL_LEADER : GUILDLEVEL_MEMBER, rank))
 		return false;
 
-	const uint32_t rankId = result->getDataInt("id");
-	const std::string rankName = result->getDataString("name");
-	db->freeResult(result);
+	const uint32_t rankId = rank.id;
+	const std::string rankName = rank.name;
 
 	std::string guildName;
-	if(!creation)
-	{
-		query.str("");
-		query << "SELECT `name` as `guildname` FROM `guilds` WHERE `id` = " << guildId;
-		if(!(result = db->storeQuery(query.str())))
-			return false;
-
-		guildName = result->getDataString("guildname");
-		db->freeResult(result);
-	}
+	if(!creation && !getGuildNameById(guildName, guildId))
+		return false;
 
-	query.str("");
+	Database* db = Database::getInstance();
+	DBQuery query;
 	query << "UPDATE `players` SET `rank_id` = " << rankId << " WHERE `id` = " << player->getGUID() << ";";
 	if(!db->executeQuery(query.str()))
 		return false;
@@ -224,7 +316,10 @@ bool IOGuild::disbandGuild(uint32_t guildId)
 
 	query.str("");
 	query << "DELETE FROM `guilds` WHERE `id` = " << guildId;
-	if(!db->executeQuery(query.str()))
+	bool deleted = db->executeQuery(query.str());
+
+	invalidateGuild(guildId);
+	if(!deleted)
 		return false;
 
 	query.str("");
@@ -314,17 +409,13 @@ int8_t IOGuild::getGuildLevel(uint32_t guid)
 
 bool IOGuild::setGuildLevel(uint32_t guid, GuildLevel_t level)
 {
-	Database* db = Database::getInstance();
-	DBResult* result;
-
-	DBQuery query;
-	query << "SELECT `id` FROM `guild_ranks` WHERE `guild_id` = " << getGuildId(guid) << " AND `level` = " << level;
-	if(!(result = db->storeQuery(query.str())))
+	GuildRank rank;
+	if(!getRank(getGuildId(guid), level, rank))
 		return false;
 
-	query.str("");
-	query << "UPDATE `players` SET `rank_id` = " << result->getDataInt("id") << " WHERE `id` = " << guid;
-	db->freeResult(result);
+	Database* db = Database::getInstance();
+	DBQuery query;
+	query << "UPDATE `players` SET `rank_id` = " << rank.id << " WHERE `id` = " << guid;
 	return db->executeQuery(query.str());
 }
 
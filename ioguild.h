@@ -21,13 +21,21 @@
 #ifndef __OTSERV_IOGUILD_H__
 #define __OTSERV_IOGUILD_H__
 
+#include "otsystem.h"
 #include "player.h"
 
+#include <string>
+#include <vector>
+#include <map>
+
+//seconds a cached guild is trusted, guilds are also created, renamed and disbanded outside of the server
+#define GUILD_CACHE_TTL 300
+
 class IOGuild
 {
 	public:
-		IOGuild() {}
-		virtual ~IOGuild() {}
+		IOGuild() {OTSYS_THREAD_LOCKVARINIT(m_guildLock);}
+		virtual ~IOGuild() {OTSYS_THREAD_LOCKVARRELEASE(m_guildLock);}
 
 		static IOGuild* getInstance()
 		{
@@ -43,6 +51,7 @@ class IOGuild
 
 		bool guildExists(uint32_t guildId);
 		bool getGuildIdByName(uint32_t& guildId, const std::string& guildName);
+		bool getGuildNameById(std::string& guildName, uint32_t guildId);
 
 		bool rankNameExists(std::string rankName, uint32_t guildId);
 		std::string getRankName(int16_t guildLevel, uint32_t guildId);
@@ -60,6 +69,35 @@ class IOGuild
 		bool setGuildLevel(uint32_t guid, GuildLevel_t level);
 		bool setGuildNick(uint32_t guid, std::string guildNick);
 		bool hasGuild(uint32_t guildId);
+
+	protected:
+		struct GuildRank
+		{
+			uint32_t id;
+			int32_t level;
+			std::string name;
+		};
+
+		//guild rows and their ranks, membership is always read from the database
+		struct CachedGuild
+		{
+			uint32_t worldId;
+			std::string name;
+			std::vector<GuildRank> ranks;
+			time_t expires;
+		};
+
+		typedef std::map<uint32_t, CachedGuild> GuildMap;
+		typedef std::map<std::string, uint32_t> GuildNameMap;
+
+		bool getGuild(uint32_t guildId, CachedGuild& guild);
+		bool getRank(uint32_t guildId, int32_t level, GuildRank& rank);
+		bool getRank(uint32_t guildId, const std::string& name, GuildRank& rank);
+		void invalidateGuild(uint32_t guildId);
+
+		GuildMap m_guilds;
+		GuildNameMap m_guildNames;
+		OTSYS_THREAD_LOCKVAR m_guildLock;
 };
 
 #endif
@@ -30,6 +30,12 @@
 #include "game.h"
 #include "vocation.h"
 #include "house.h"
+#include "ioguild.h"
+#include "databasetasks.h"
+#include "databasemanager.h"
+#include "metrics.h"
+#include "playerjournal.h"
+#include "scheduler.h"
 #ifdef __LOGIN_SERVER__
 #include "gameservers.h"
 #endif
@@ -52,9 +58,10 @@ Account IOLoginData::loadAccount(uint32_t accId, bool preLoad/* = false*/)
 	Database* db = Database::getInstance();
 	DBResult* result;
 
-	DBQuery query;
-	query << "SELECT `id`, `name`, `password`, `premdays`, `lastday`, `key`, `warnings` FROM `accounts` WHERE `id` = " << accId;
-	if(!(result = db->storeQuery(query.str())))
+	DBQuery lock;
+	DBStatement stmt("SELECT `id`, `name`, `password`, `premdays`, `lastday`, `key`, `warnings` FROM `accounts` WHERE `id` = ?");
+	stmt.bindInt(accId);
+	if(!(result = db->storeStatement(stmt)))
 		return acc;
 
 	acc.number = result->getDataInt("id");
@@ -65,17 +72,18 @@ Account IOLoginData::loadAccount(uint32_t accId, bool preLoad/* = false*/)
 	acc.recoveryKey = result->getDataString("key");
 	acc.warnings = result->getDataInt("warnings");
 
-	query.str("");
 	db->freeResult(result);
 	if(preLoad)
 		return acc;
 
 #ifndef __LOGIN_SERVER__
-	query << "SELECT `name` FROM `players` WHERE `account_id` = " << accId << " AND `world_id` = " << g_config.getNumber(ConfigManager::WORLD_ID) << " AND `deleted` = 0;";
+	DBStatement charStmt("SELECT `name` FROM `players` WHERE `account_id` = ? AND `world_id` = ? AND `deleted` = 0");
+	charStmt.bindInt(accId).bindInt(g_config.getNumber(ConfigManager::WORLD_ID));
 #else
-	query << "SELECT `name`, `world_id` FROM `players` WHERE `account_id` = " << accId << " AND `deleted` = 0;";
+	DBStatement charStmt("SELECT `name`, `world_id` FROM `players` WHERE `account_id` = ? AND `deleted` = 0");
+	charStmt.bindInt(accId);
 #endif
-	if(!(result = db->storeQuery(query.str())))
+	if(!(result = db->storeStatement(charStmt)))
 		return acc;
 
 	do
@@ -115,9 +123,10 @@ bool IOLoginData::getAccountId(const std::string& name, uint32_t& number)
 	Database* db = Database::getInstance();
 	DBResult* result;
 
-	DBQuery query;
-	query << "SELECT `id` FROM `accounts` WHERE `name` " << db->getStringComparisonOperator() << " " << db->escapeString(name);
-	if(!(result = db->storeQuery(query.str())))
+	DBQuery lock;
+	DBStatement stmt("SELECT `id` FROM `accounts` WHERE `name` " + db->getStringComparisonOperator() + " ?");
+	stmt.bindString(name);
+	if(!(result = db->storeStatement(stmt)))
 		return false;
 
 	number = result->getDataInt("id");
@@ -136,9 +145,10 @@ bool IOLoginData::getAccountName(uint32_t number, std::string& name)
 	Database* db = Database::getInstance();
 	DBResult* result;
 
-	DBQuery query;
-	query << "SELECT `name` FROM `accounts` WHERE `id` = " << number;
-	if(!(result = db->storeQuery(query.str())))
+	DBQuery lock;
+	DBStatement stmt("SELECT `name` FROM `accounts` WHERE `id` = ?");
+	stmt.bindInt(number);
+	if(!(result = db->storeStatement(stmt)))
 		return false;
 
 	name = result->getDataString("name");
@@ -209,16 +219,18 @@ bool IOLoginData::getPassword(uint32_t accId, const std::string& name, std::stri
 	Database* db = Database::getInstance();
 	DBResult* result;
 
-	DBQuery query;
-	query << "SELECT `password` FROM `accounts` WHERE `id` = " << accId;
-	if(!(result = db->storeQuery(query.str())))
+	DBQuery lock;
+	DBStatement stmt("SELECT `password` FROM `accounts` WHERE `id` = ?");
+	stmt.bindInt(accId);
+	if(!(result = db->storeStatement(stmt)))
 		return false;
 
 	std::string accountPassword = result->getDataString("password");
 	db->freeResult(result);
-	query.str("");
-	query << "SELECT `name` FROM `players` WHERE `account_id` = " << accId;
-	if(!(result = db->storeQuery(query.str())))
+
+	DBStatement charStmt("SELECT `name` FROM `players` WHERE `account_id` = ?");
+	charStmt.bindInt(accId);
+	if(!(result = db->storeStatement(charStmt)))
 		return false;
 
 	do
@@ -396,24 +408,146 @@ bool IOLoginData::internalHasCustomFlag(uint32_t groupId, PlayerCustomFlags valu
 	return (0 != (flags & ((uint64_t)1 << value)));
 }
 
-bool IOLoginData::loadPlayer(Player* player, const std::string& name, bool preLoad /*= false*/)
+PlayerLoadData::PlayerLoadData()
+{
+	player = guild = guildInvites = skills = spells = items = depotItems = storage = vips = vipIds = mail = NULL;
+	nameGeneration = 0;
+}
+
+PlayerLoadData::~PlayerLoadData()
+{
+	DBResult* results[] = {player, guild, guildInvites, skills, spells, items, depotItems, storage, vips, vipIds, mail};
+	for(uint32_t i = 0; i < sizeof(results) / sizeof(DBResult*); ++i)
+	{
+		if(results[i])
+			Database::getInstance()->freeResult(results[i]);
+	}
+}
+
+bool IOLoginData::fetchPlayer(PlayerLoadData& data, const std::string& name, bool preLoad /*= false*/)
 {
+	//any thread, only touches the database
+	flushPlayerSave(name);
 	Database* db = Database::getInstance();
-	DBResult* result;
 
-	DBQuery query;
-	query << "SELECT `id`, `account_id`, `group_id`, `sex`, `vocation`, `experience`, `level`, `maglevel`, `health`, `healthmax`, `blessings`, `mana`, `manamax`, `manaspent`, `soul`, `lookbody`, `lookfeet`, `lookhead`, `looklegs`, `looktype`, `lookaddons`, `posx`, `posy`, `posz`, `cap`, `lastlogin`, `lastlogout`, `lastip`, `conditions`, `redskulltime`, `redskull`, `guildnick`, `rank_id`, `town_id`, `balance`, `stamina`, `loss_experience`, `loss_mana`, `loss_skills`, `loss_items`, `marriage`, `promotion` FROM `players` WHERE `name` " << db->getStringComparisonOperator() << " " << db->escapeString(name) << " AND `deleted` = 0;";
-	if(!(result = db->storeQuery(query.str())))
+	DBQuery lock;
+	DBStatement stmt("SELECT `id`, `account_id`, `group_id`, `sex`, `vocation`, `experience`, `level`, `maglevel`, `health`, `healthmax`, `blessings`, `mana`, `manamax`, `manaspent`, `soul`, `lookbody`, `lookfeet`, `lookhead`, `looklegs`, `looktype`, `lookaddons`, `posx`, `posy`, `posz`, `cap`, `lastlogin`, `lastlogout`, `lastip`, `conditions`, `redskulltime`, `redskull`, `guildnick`, `rank_id`, `town_id`, `balance`, `stamina`, `loss_experience`, `loss_mana`, `loss_skills`, `loss_items`, `marriage`, `promotion` FROM `players` WHERE `name` " + db->getStringComparisonOperator() + " ? AND `deleted` = 0");
+	stmt.bindString(name);
+	if(!(data.player = db->storeStatement(stmt)))
 		return false;
 
-	uint32_t accId = result->getDataInt("account_id");
+	uint32_t accId = data.player->getDataInt("account_id");
 	if(accId < 1)
-	{
-		db->freeResult(result);
 		return false;
+
+	data.account = loadAccount(accId, true);
+	if(preLoad)
+		return true;
+
+	if(!data.account.number)
+		return false;
+
+	const uint32_t guid = data.player->getDataInt("id"), rankId = data.player->getDataInt("rank_id");
+	if(rankId > 0)
+	{
+		DBStatement guildStmt("SELECT `guild_ranks`.`name` AS `rank`, `guild_ranks`.`guild_id` AS `guildid`, `guild_ranks`.`level` AS `level`, `guilds`.`name` AS `guildname` FROM `guild_ranks`, `guilds` WHERE `guild_ranks`.`id` = ? AND `guild_ranks`.`guild_id` = `guilds`.`id`");
+		guildStmt.bindInt(rankId);
+		data.guild = db->storeStatement(guildStmt);
+	}
+	else if(g_config.getBool(ConfigManager::INGAME_GUILD_MANAGEMENT))
+	{
+		DBStatement inviteStmt("SELECT `guild_id` FROM `guild_invites` WHERE `player_id` = ?");
+		inviteStmt.bindInt(guid);
+		data.guildInvites = db->storeStatement(inviteStmt);
+	}
+
+	DBStatement skillStmt("SELECT `skillid`, `value`, `count` FROM `player_skills` WHERE `player_id` = ?");
+	skillStmt.bindInt(guid);
+	data.skills = db->storeStatement(skillStmt);
+
+	DBStatement spellStmt("SELECT `player_id`, `name` FROM `player_spells` WHERE `player_id` = ?");
+	spellStmt.bindInt(guid);
+	data.spells = db->storeStatement(spellStmt);
+
+	if(m_itemBlobTable)
+	{
+		DBStatement blobStmt("SELECT `type`, `data` FROM `player_itemblobs` WHERE `player_id` = ?");
+		blobStmt.bindInt(guid);
+		if(DBResult* result = db->storeStatement(blobStmt))
+		{
+			do
+			{
+				int32_t type = result->getDataInt("type");
+				uint64_t blobSize = 0;
+				const char* blob = result->getDataStream("data", blobSize);
+				if(type >= ITEMBLOB_INVENTORY && type < ITEMBLOB_LAST && blob)
+					data.itemBlobs[type].assign(blob, blobSize);
+			}
+			while(result->next());
+			db->freeResult(result);
+		}
+	}
+
+	//a tree stored as blob has no rows
+	if(data.itemBlobs[ITEMBLOB_INVENTORY].empty())
+	{
+		DBStatement itemStmt("SELECT `pid`, `sid`, `itemtype`, `count`, `attributes` FROM `player_items` WHERE `player_id` = ? ORDER BY `sid` DESC");
+		itemStmt.bindInt(guid);
+		data.items = db->storeStatement(itemStmt);
+	}
+
+	if(data.itemBlobs[ITEMBLOB_DEPOT].empty())
+	{
+		DBStatement depotStmt("SELECT `pid`, `sid`, `itemtype`, `count`, `attributes` FROM `player_depotitems` WHERE `player_id` = ? ORDER BY `sid` DESC");
+		depotStmt.bindInt(guid);
+		data.depotItems = db->storeStatement(depotStmt);
+	}
+
+	DBStatement storageStmt("SELECT `key`, `value` FROM `player_storage` WHERE `player_id` = ?");
+	storageStmt.bindInt(guid);
+	data.storage = db->storeStatement(storageStmt);
+
+	//names come along, so loading the list needs no query per entry
+	data.nameGeneration = m_nameCache.getGeneration();
+	DBStatement vipStmt("SELECT `player_viplist`.`vip_id`, `players`.`name`, `players`.`world_id`, `players`.`group_id` FROM `player_viplist`, `players` WHERE `player_viplist`.`player_id` = ? AND `players`.`id` = `player_viplist`.`vip_id` AND `players`.`deleted` = 0");
+	vipStmt.bindInt(guid);
+	data.vips = db->storeStatement(vipStmt);
+	if(g_config.getBool(ConfigManager::INCREMENTAL_PLAYER_SAVE))
+	{
+		//the join skips deleted players, their rows still have to be known to be removed
+		DBStatement vipIdStmt("SELECT `vip_id` FROM `player_viplist` WHERE `player_id` = ?");
+		vipIdStmt.bindInt(guid);
+		data.vipIds = db->storeStatement(vipIdStmt);
+	}
+
+	if(m_mailTable)
+	{
+		DBStatement mailStmt("SELECT `id`, `data` FROM `player_mail` WHERE `player_id` = ? ORDER BY `id`");
+		mailStmt.bindInt(guid);
+		data.mail = db->storeStatement(mailStmt);
 	}
 
-	Account acc = loadAccount(accId, true);
+	return true;
+}
+
+bool IOLoginData::loadPlayer(Player* player, const std::string& name, bool preLoad /*= false*/)
+{
+	PlayerLoadData data;
+	return fetchPlayer(data, name, preLoad) && loadPlayer(player, data, preLoad);
+}
+
+bool IOLoginData::loadPlayer(Player* player, PlayerLoadData& data, bool preLoad /*= false*/)
+{
+	//dispatcher thread, applies the rows fetched by fetchPlayer
+	DBResult* result = data.player;
+	if(!result)
+		return false;
+
+	uint32_t accId = result->getDataInt("account_id");
+	if(accId < 1)
+		return false;
+
+	const Account& acc = data.account;
 	player->accountId = accId;
 	player->account = acc.name;
 
@@ -424,7 +558,6 @@ bool IOLoginData::loadPlayer(Player* player, const std::string& name, bool preLo
 	if(preLoad)
 	{
 		//only loading basic info
-		db->freeResult(result);
 		return true;
 	}
 
@@ -526,51 +659,39 @@ bool IOLoginData::loadPlayer(Player* player, const std::string& name, bool preLo
 	if(loginPos.x == 0 && loginPos.y == 0 && loginPos.z == 0)
 		player->loginPosition = player->masterPos;
 
+	PlayerSaveState* state = NULL;
+	if(g_config.getBool(ConfigManager::INCREMENTAL_PLAYER_SAVE))
+	{
+		//the rows as they are in the database, the players row itself is written by the first save
+		delete player->saveState;
+		player->saveState = state = new PlayerSaveState;
+		state->known = true;
+	}
+
 	const uint32_t rankId = result->getDataInt("rank_id");
 	const std::string nick = result->getDataString("guildnick");
-	db->freeResult(result);
-	if(rankId > 0)
+	if((result = data.guild))
 	{
-		query.str("");
-		query << "SELECT `guild_ranks`.`name` AS `rank`, `guild_ranks`.`guild_id` AS `guildid`, `guild_ranks`.`level` AS `level`, `guilds`.`name` AS `guildname` FROM `guild_ranks`, `guilds` WHERE `guild_ranks`.`id` = " << rankId << " AND `guild_ranks`.`guild_id` = `guilds`.`id`";
-		if((result = db->storeQuery(query.str())))
-		{
-			player->guildName = result->getDataString("guildname");
-			player->guildLevel = result->getDataInt("level");
-			player->guildId = result->getDataInt("guildid");
-			player->guildRank = result->getDataString("rank");
-			player->guildRankId = rankId;
-			player->guildNick = nick;
-		}
-
-		db->freeResult(result);
+		player->guildName = result->getDataString("guildname");
+		player->guildLevel = result->getDataInt("level");
+		player->guildId = result->getDataInt("guildid");
+		player->guildRank = result->getDataString("rank");
+		player->guildRankId = rankId;
+		player->guildNick = nick;
 	}
-	else if(g_config.getBool(ConfigManager::INGAME_GUILD_MANAGEMENT))
+	else if((result = data.guildInvites))
 	{
-		query.str("");
-		query << "SELECT `guild_id` FROM `guild_invites` WHERE `player_id` = " << player->getGUID();
-		if((result = db->storeQuery(query.str())))
-		{
-			do
-				player->invitedToGuildsList.push_back((uint32_t)result->getDataInt("guild_id"));
-			while(result->next());
-			db->freeResult(result);
-		}
-	}
+		do
+			player->invitedToGuildsList.push_back((uint32_t)result->getDataInt("guild_id"));
+		while(result->next());
 
-	query.str("");
-	query << "SELECT `password` FROM `accounts` WHERE `id` = " << accId;
-	if(!(result = db->storeQuery(query.str())))
-		return false;
+		if(state)
+			state->invites = player->invitedToGuildsList;
+	}
 
-	player->password = result->getDataString("password");
-	db->freeResult(result);
+	player->password = acc.password;
 
-	// we need to find out our skills
-	// so we query the skill table
-	query.str("");
-	query << "SELECT `skillid`, `value`, `count` FROM `player_skills` WHERE `player_id` = " << player->getGUID();
-	if((result = db->storeQuery(query.str())))
+	if((result = data.skills))
 	{
 		//now iterate over the skills
 		do
@@ -580,6 +701,11 @@ bool IOLoginData::loadPlayer(Player* player, const std::string& name, bool preLo
 			{
 				uint32_t skillLevel = result->getDataInt("value");
 				uint64_t skillCount = result->getDataLong("count");
+				if(state)
+				{
+					state->skills[skillid][SKILL_LEVEL] = skillLevel;
+					state->skills[skillid][SKILL_TRIES] = skillCount;
+				}
 
 				uint64_t nextSkillCount = player->vocation->getReqSkillTries(skillid, skillLevel + 1);
 				if(skillCount > nextSkillCount)
@@ -591,13 +717,9 @@ bool IOLoginData::loadPlayer(Player* player, const std::string& name, bool preLo
 			}
 		}
 		while(result->next());
-
-		db->freeResult(result);
 	}
 
-	query.str("");
- 	query << "SELECT `player_id`, `name` FROM `player_spells` WHERE `player_id` = " << player->getGUID();
-	if((result = db->storeQuery(query.str())))
+	if((result = data.spells))
 	{
 		do
 		{
@@ -606,102 +728,113 @@ bool IOLoginData::loadPlayer(Player* player, const std::string& name, bool preLo
 		}
 		while(result->next());
 
-		db->freeResult(result);
+		if(state)
+			state->spells = player->learnedInstantSpellList;
 	}
 
 	//load inventory items
 	ItemMap itemMap;
-	query.str("");
-	query << "SELECT `pid`, `sid`, `itemtype`, `count`, `attributes` FROM `player_items` WHERE `player_id` = " << player->getGUID() << " ORDER BY `sid` DESC";
-	if((result = db->storeQuery(query.str())))
+	loadItemTree(player, data, ITEMBLOB_INVENTORY, state, itemMap);
+	ItemMap::iterator it;
+	for(ItemMap::reverse_iterator rit = itemMap.rbegin(); rit != itemMap.rend(); ++rit)
 	{
-		loadItems(itemMap, result);
-		ItemMap::iterator it;
-		for(ItemMap::reverse_iterator rit = itemMap.rbegin(); rit != itemMap.rend(); ++rit)
+		Item* item = rit->second.first;
+		int32_t pid = rit->second.second;
+		if(pid >= 1 && pid <= 10)
+			player->__internalAddThing(pid, item);
+		else
 		{
-			Item* item = rit->second.first;
-			int32_t pid = rit->second.second;
-			if(pid >= 1 && pid <= 10)
-				player->__internalAddThing(pid, item);
-			else
+			it = itemMap.find(pid);
+			if(it != itemMap.end())
 			{
-				it = itemMap.find(pid);
-				if(it != itemMap.end())
-				{
-					if(Container* container = it->second.first->getContainer())
-						container->__internalAddThing(item);
-				}
+				if(Container* container = it->second.first->getContainer())
+					container->__internalAddThing(item);
 			}
 		}
-
-		db->freeResult(result);
 	}
 
 	//load depot items
 	itemMap.clear();
-	query.str("");
-	query << "SELECT `pid`, `sid`, `itemtype`, `count`, `attributes` FROM `player_depotitems` WHERE `player_id` = " << player->getGUID() << " ORDER BY `sid` DESC";
-	if((result = db->storeQuery(query.str())))
+	loadItemTree(player, data, ITEMBLOB_DEPOT, state, itemMap);
+	for(ItemMap::reverse_iterator rit = itemMap.rbegin(); rit != itemMap.rend(); ++rit)
 	{
-		loadItems(itemMap, result);
-		ItemMap::iterator it;
-		for(ItemMap::reverse_iterator rit = itemMap.rbegin(); rit != itemMap.rend(); ++rit)
+		Item* item = rit->second.first;
+		int32_t pid = rit->second.second;
+		if(pid >= 0 && pid < 100)
 		{
-			Item* item = rit->second.first;
-			int32_t pid = rit->second.second;
-			if(pid >= 0 && pid < 100)
+			if(Container* c = item->getContainer())
 			{
-				if(Container* c = item->getContainer())
-				{
-					if(Depot* depot = c->getDepot())
-						player->addDepot(depot, pid);
-					else
-						std::cout << "Error loading depot " << pid << " for player " << player->getGUID() << std::endl;
-				}
+				if(Depot* depot = c->getDepot())
+					player->addDepot(depot, pid);
 				else
 					std::cout << "Error loading depot " << pid << " for player " << player->getGUID() << std::endl;
 			}
 			else
+				std::cout << "Error loading depot " << pid << " for player " << player->getGUID() << std::endl;
+		}
+		else
+		{
+			it = itemMap.find(pid);
+			if(it != itemMap.end())
 			{
-				it = itemMap.find(pid);
-				if(it != itemMap.end())
-				{
-					if(Container* container = it->second.first->getContainer())
-						container->__internalAddThing(item);
-				}
+				if(Container* container = it->second.first->getContainer())
+					container->__internalAddThing(item);
 			}
 		}
-
-		db->freeResult(result);
 	}
 
+	//the depot rows do not hold the mail yet, so the save state makes the next save write it
+	player->deliveredMail.clear();
+	if((result = data.mail))
+		loadMail(player, result);
+
 	//load storage map
-	query.str("");
-	query << "SELECT `key`, `value` FROM `player_storage` WHERE `player_id` = " << player->getGUID();
-	if((result = db->storeQuery(query.str())))
+	if((result = data.storage))
 	{
 		do
-			player->addStorageValue((uint32_t)result->getDataInt("key"), result->getDataString("value"));
+		{
+			uint32_t key = result->getDataInt("key");
+			std::string value = result->getDataString("value");
+			player->addStorageValue(key, value);
+			if(state)
+				state->storage[key] = value;
+		}
 		while(result->next());
-
-		db->freeResult(result);
 	}
 
 	//load vip
-	query.str("");
-	query << "SELECT `vip_id` FROM `player_viplist` WHERE `player_id` = " << player->getGUID();
-	if((result = db->storeQuery(query.str())))
+	if((result = data.vips))
 	{
 		do
 		{
 			uint32_t vid = result->getDataInt("vip_id");
+
+			PlayerNameEntry entry;
+			entry.guid = vid;
+			entry.name = result->getDataString("name");
+			entry.worldId = result->getDataInt("world_id");
+			entry.groupId = result->getDataInt("group_id");
+			m_nameCache.add(entry, data.nameGeneration);
+
 			std::string vname;
-			if(storeNameByGuid(vid))
-				player->addVIP(vid, vname, false, true);
+			player->addVIP(vid, vname, false, true);
 		}
 		while(result->next());
+	}
 
-		db->freeResult(result);
+	if(state && (result = data.vipIds))
+	{
+		do
+			state->vips.insert(result->getDataInt("vip_id"));
+		while(result->next());
+	}
+
+	{
+		//the mail just loaded is still in the database
+		OTSYS_THREAD_LOCK_CLASS lockClass(m_saveLock);
+		m_deletedMail.erase(player->getGUID());
+		if(state)
+			m_invalidSaves.erase(player->getGUID());
 	}
 
 	player->updateBaseSpeed();
@@ -710,327 +843,1383 @@ bool IOLoginData::loadPlayer(Player* player, const std::string& name, bool preLo
 	return true;
 }
 
-void IOLoginData::loadItems(ItemMap& itemMap, DBResult* result)
+void IOLoginData::loadItemTree(Player* player, const PlayerLoadData& data, ItemBlob_t type, PlayerSaveState* state, ItemMap& itemMap)
 {
-	do
+	PlayerItemRows rows;
+	const std::string& blob = data.itemBlobs[type];
+	if(!blob.empty())
 	{
-		int32_t sid = result->getDataInt("sid");
-		int32_t pid = result->getDataInt("pid");
-		int32_t type = result->getDataInt("itemtype");
-		int32_t count = result->getDataInt("count");
+		if(!decodeItemBlob(blob, rows))
+			std::cout << "WARNING: Corrupted item blob " << type << " for player " << player->getGUID() << std::endl;
+	}
+	else if(DBResult* result = (type == ITEMBLOB_INVENTORY ? data.items : data.depotItems))
+		readItemRows(result, rows);
 
+	if(state)
+	{
+		if(!blob.empty())
+			state->items[type].blob = blob;
+		else
+			state->items[type].rows = rows;
+	}
+
+	loadItems(itemMap, rows);
+}
+
+void IOLoginData::readItemRows(DBResult* result, PlayerItemRows& rows)
+{
+	do
+	{
 		uint64_t attrSize = 0;
 		const char* attr = result->getDataStream("attributes", attrSize);
 
+		int32_t sid = result->getDataInt("sid");
+		PlayerItemRow& row = rows[sid];
+		row.pid = result->getDataInt("pid");
+		row.sid = sid;
+		row.itemType = result->getDataInt("itemtype");
+		row.count = result->getDataInt("count");
+		row.attributes.assign(attr ? attr : "", attr ? attrSize : 0);
+	}
+	while(result->next());
+}
+
+void IOLoginData::loadItems(ItemMap& itemMap, const PlayerItemRows& rows)
+{
+	for(PlayerItemRows::const_iterator it = rows.begin(); it != rows.end(); ++it)
+	{
+		const PlayerItemRow& row = it->second;
 		PropStream propStream;
-		propStream.init(attr, attrSize);
+		propStream.init(row.attributes.c_str(), row.attributes.length());
 
-		if(Item* item = Item::CreateItem(type, count))
+		if(Item* item = Item::CreateItem(row.itemType, row.count))
 		{
 			if(!item->unserializeAttr(propStream))
 				std::cout << "WARNING: Serialize error in IOLoginData::loadItems" << std::endl;
-			std::pair<Item*, int32_t> pair(item, pid);
-			itemMap[sid] = pair;
+			std::pair<Item*, int32_t> pair(item, row.pid);
+			itemMap[row.sid] = pair;
 		}
 	}
-	while(result->next());
 }
 
-bool IOLoginData::savePlayer(Player* player, bool preSave/* = true*/)
+void IOLoginData::loadMail(Player* player, DBResult* result)
 {
-	if(preSave && player->health <= 0)
+	do
 	{
-		player->health = player->healthMax;
-		player->mana = player->manaMax;
-	}
+		const int64_t mailId = result->getDataLong("id");
+		uint64_t blobSize = 0;
+		const char* blob = result->getDataStream("data", blobSize);
 
-	Database* db = Database::getInstance();
-	DBResult* result;
+		PlayerItemRows rows;
+		if(!blob || !decodeItemBlob(std::string(blob, blobSize), rows))
+		{
+			std::cout << "WARNING: Corrupted mail " << mailId << " for player " << player->getGUID() << std::endl;
+			continue;
+		}
 
-	DBQuery query;
-	query << "SELECT `save` FROM `players` WHERE `id` = " << player->getGUID();
-	if(!(result = db->storeQuery(query.str())))
-		return false;
+		ItemMap itemMap;
+		loadItems(itemMap, rows);
+		for(ItemMap::reverse_iterator rit = itemMap.rbegin(); rit != itemMap.rend(); ++rit)
+		{
+			Item* item = rit->second.first;
+			int32_t pid = rit->second.second;
+			if(pid >= 0 && pid < 100)
+			{
+				if(Depot* depot = player->getDepot(pid, true))
+					depot->__internalAddThing(item);
+				else
+					delete item;
+			}
+			else
+			{
+				ItemMap::iterator it = itemMap.find(pid);
+				if(it != itemMap.end())
+				{
+					if(Container* container = it->second.first->getContainer())
+						container->__internalAddThing(item);
+				}
+			}
+		}
 
-	const bool save = result->getDataInt("save");
-	db->freeResult(result);
-	DBTransaction trans(db);
-	if(!trans.begin())
-		return false;
+		player->deliveredMail.push_back(mailId);
+	}
+	while(result->next());
+}
 
-	query.str("");
-	query << "UPDATE `players` SET `lastlogin` = " << player->lastLoginSaved << ", `lastip` = " << player->lastIP;
-	if(!save || !player->isSaving())
-	{
-		query << " WHERE `id` = " << player->getGUID();
-		if(!db->executeQuery(query.str()))
-			return false;
+typedef std::map<int32_t, std::vector<const PlayerItemRow*> > ItemChildMap;
 
-		return trans.commit();
-	}
+template <typename T>
+static void addBlobValue(std::string& blob, T value)
+{
+	blob.append((const char*)&value, sizeof(T));
+}
 
-	query << ", ";
-	query << "`level` = " << player->level << ", ";
-	query << "`group_id` = " << player->groupId << ", ";
-	query << "`health` = " << player->health << ", ";
-	query << "`healthmax` = " << player->healthMax << ", ";
-	query << "`experience` = " << player->experience << ", ";
-	query << "`lookbody` = " << (uint32_t)player->defaultOutfit.lookBody << ", ";
-	query << "`lookfeet` = " << (uint32_t)player->defaultOutfit.lookFeet << ", ";
-	query << "`lookhead` = " << (uint32_t)player->defaultOutfit.lookHead << ", ";
-	query << "`looklegs` = " << (uint32_t)player->defaultOutfit.lookLegs << ", ";
-	query << "`looktype` = " << (uint32_t)player->defaultOutfit.lookType << ", ";
-	query << "`lookaddons` = " << (uint32_t)player->defaultOutfit.lookAddons << ", ";
-	query << "`maglevel` = " << player->magLevel << ", ";
-	query << "`mana` = " << player->mana << ", ";
-	query << "`manamax` = " << player->manaMax << ", ";
-	query << "`manaspent` = " << player->manaSpent << ", ";
-	query << "`soul` = " << player->soul << ", ";
-	query << "`town_id` = " << player->town << ", ";
-	query << "`posx` = " << player->getLoginPosition().x << ", ";
-	query << "`posy` = " << player->getLoginPosition().y << ", ";
-	query << "`posz` = " << player->getLoginPosition().z << ", ";
-	query << "`cap` = " << player->getCapacity() << ", ";
-	query << "`sex` = " << player->sex << ", ";
-	query << "`balance` = " << player->balance << ", ";
-	query << "`stamina` = " << player->getStamina() << ", ";
-	query << "`promotion` = " << player->promotionLevel << ", ";
+static void encodeBlobItem(std::string& blob, const PlayerItemRow& row, const ItemChildMap& children)
+{
+	addBlobValue<uint16_t>(blob, row.itemType);
+	addBlobValue<uint16_t>(blob, row.count);
+	addBlobValue<uint32_t>(blob, row.attributes.length());
+	blob += row.attributes;
 
-	//serialize conditions
-	PropWriteStream propWriteStream;
-	for(ConditionList::const_iterator it = player->conditions.begin(); it != player->conditions.end(); ++it)
+	ItemChildMap::const_iterator it = children.find(row.sid);
+	if(it == children.end())
 	{
-		if((*it)->isPersistent())
-		{
-			if(!(*it)->serialize(propWriteStream))
-				return false;
-
-			propWriteStream.ADD_UCHAR(CONDITIONATTR_END);
-		}
+		addBlobValue<uint16_t>(blob, 0);
+		return;
 	}
 
-	uint32_t conditionsSize = 0;
-	const char* conditions = propWriteStream.getStream(conditionsSize);
-	query << "`conditions` = " << db->escapeBlob(conditions, conditionsSize) << ", ";
-	query << "`loss_experience` = " << (uint32_t)player->getLossPercent(LOSS_EXPERIENCE) << ", ";
-	query << "`loss_mana` = " << (uint32_t)player->getLossPercent(LOSS_MANASPENT) << ", ";
-	query << "`loss_skills` = " << (uint32_t)player->getLossPercent(LOSS_SKILLTRIES) << ", ";
-	query << "`loss_items` = " << (uint32_t)player->getLossPercent(LOSS_ITEMS) << ", ";
-	if(g_game.getWorldType() != WORLD_TYPE_PVP_ENFORCED)
-	{
-		int32_t redSkullTime = 0;
-		if(player->redSkullTicks > 0)
-			redSkullTime = time(NULL) + player->redSkullTicks/1000;
+	addBlobValue<uint16_t>(blob, it->second.size());
+	for(std::vector<const PlayerItemRow*>::const_iterator cit = it->second.begin(); cit != it->second.end(); ++cit)
+		encodeBlobItem(blob, **cit, children);
+}
 
-		query << "`redskulltime` = " << redSkullTime << ", ";
-		int32_t redSkull = 0;
-		if(player->skull == SKULL_RED)
-			redSkull = 1;
+static bool decodeBlobItem(PropStream& propStream, int32_t pid, int32_t& runningId, PlayerItemRows& rows)
+{
+	uint16_t itemType, count, children;
+	uint32_t attributesSize;
+	std::string attributes;
+	if(!propStream.GET_USHORT(itemType) || !propStream.GET_USHORT(count) || !propStream.GET_ULONG(attributesSize)
+		|| !propStream.GET_BYTES(attributesSize, attributes) || !propStream.GET_USHORT(children))
+		return false;
 
-		query << "`redskull` = " << redSkull << ", ";
+	const int32_t sid = ++runningId;
+	PlayerItemRow& row = rows[sid];
+	row.pid = pid;
+	row.sid = sid;
+	row.itemType = itemType;
+	row.count = count;
+	row.attributes = attributes;
+	for(uint16_t i = 0; i < children; ++i)
+	{
+		if(!decodeBlobItem(propStream, sid, runningId, rows))
+			return false;
 	}
 
-	query << "`lastlogout` = " << player->getLastLogout() << ", ";
-	if(player->isPremium() || !g_config.getBool(ConfigManager::BLESSING_ONLY_PREMIUM))
-		query << "`blessings` = " << player->blessings << ", ";
+	return true;
+}
 
-	query << "`marriage` = " << player->marriage << ", ";
-	if(g_config.getBool(ConfigManager::INGAME_GUILD_MANAGEMENT))
+void IOLoginData::encodeItemBlob(const PlayerItemRows& rows, std::string& blob)
+{
+	//version, then every top level item with its slot or depot id followed by its tree:
+	//type, count, attributes as serializeAttr wrote them and the contained items in order
+	ItemChildMap children;
+	std::vector<const PlayerItemRow*> topItems;
+	for(PlayerItemRows::const_iterator it = rows.begin(); it != rows.end(); ++it)
 	{
-		query << "`guildnick` = " << db->escapeString(player->guildNick) << ", ";
-		query << "`rank_id` = " << IOGuild::getInstance()->getRankIdByGuildIdAndLevel(player->getGuildId(), player->getGuildLevel()) << ", ";
+		if(rows.find(it->second.pid) == rows.end())
+			topItems.push_back(&it->second);
+		else
+			children[it->second.pid].push_back(&it->second);
+	}
+
+	blob.clear();
+	addBlobValue<uint8_t>(blob, ITEMBLOB_VERSION);
+	addBlobValue<uint32_t>(blob, topItems.size());
+	for(std::vector<const PlayerItemRow*>::const_iterator it = topItems.begin(); it != topItems.end(); ++it)
+	{
+		addBlobValue<int32_t>(blob, (*it)->pid);
+		encodeBlobItem(blob, **it, children);
+	}
+}
+
+bool IOLoginData::decodeItemBlob(const std::string& blob, PlayerItemRows& rows)
+{
+	PropStream propStream;
+	propStream.init(blob.c_str(), blob.length());
+
+	uint8_t version;
+	uint32_t topItems;
+	if(!propStream.GET_UCHAR(version) || version != ITEMBLOB_VERSION || !propStream.GET_ULONG(topItems))
+		return false;
+
+	//contained items get higher sids than their container and keep their order, as loadItems expects
+	int32_t runningId = 100;
+	for(uint32_t i = 0; i < topItems; ++i)
+	{
+		int32_t pid;
+		if(!propStream.GET_VALUE(pid) || !decodeBlobItem(propStream, pid, runningId, rows))
+			return false;
+	}
+
+	return true;
+}
+
+PlayerSaveData::PlayerSaveData()
+{
+	sequence = 0;
+	guid = lastIP = guildId = guildLevel = 0;
+	lastLogin = 0;
+	saving = guildManagement = false;
+}
+
+bool IOLoginData::savePlayer(Player* player, bool preSave/* = true*/, bool async/* = false*/)
+{
+	PlayerSaveData* data = new PlayerSaveData;
+	if(!snapshotPlayer(player, *data, preSave))
+	{
+		delete data;
+		return false;
+	}
+
+	if(data->saving)
+		trackSaveState(player, *data);
+
+	if(!m_loginFetches.empty())
+	{
+		LoginFetchMap::iterator it = m_loginFetches.find(asLowerCaseString(data->name));
+		if(it != m_loginFetches.end())
+			it->second.saves++;
+	}
+
+	const uint32_t guid = data->guid;
+	{
+		OTSYS_THREAD_LOCK_CLASS lockClass(m_saveLock);
+		PendingSaveMap::iterator it = m_pendingSaves.find(guid);
+		if(it != m_pendingSaves.end())
+		{
+			//never written, the new snapshot covers it and writes against what the database still holds
+			data->saved = it->second->saved;
+			delete it->second;
+			it->second = data;
+		}
+		else
+			m_pendingSaves[guid] = data;
+	}
+
+	if(!async)
+		return flushPlayerSave(guid);
+
+	DatabaseTasks::getInstance()->addTask(createTask(boost::bind(&IOLoginData::runPlayerSave, this, guid)));
+	return true;
+}
+
+uint32_t IOLoginData::beginLoginFetch(const std::string& name)
+{
+	LoginFetchMap::iterator it = m_loginFetches.find(asLowerCaseString(name));
+	if(it == m_loginFetches.end())
+	{
+		LoginFetch fetch;
+		fetch.fetches = fetch.saves = 0;
+		it = m_loginFetches.insert(std::make_pair(asLowerCaseString(name), fetch)).first;
+	}
+
+	it->second.fetches++;
+	return it->second.saves;
+}
+
+bool IOLoginData::endLoginFetch(const std::string& name, uint32_t token)
+{
+	LoginFetchMap::iterator it = m_loginFetches.find(asLowerCaseString(name));
+	if(it == m_loginFetches.end())
+		return false;
+
+	bool stale = it->second.saves != token;
+	if(!--it->second.fetches)
+		m_loginFetches.erase(it);
+
+	return stale;
+}
+
+void IOLoginData::runPlayerSave(uint32_t guid)
+{
+	//database thread, a thread already writing the player picks the snapshot up itself
+	flushPlayerSave(guid, false);
+}
+
+bool IOLoginData::flushPlayerSave(uint32_t guid, bool wait/* = true*/)
+{
+	bool success = true;
+	while(true)
+	{
+		PlayerSaveData* data = NULL;
+		{
+			OTSYS_THREAD_LOCK_CLASS lockClass(m_saveLock);
+			if(m_writingSaves.find(guid) == m_writingSaves.end())
+			{
+				PendingSaveMap::iterator it = m_pendingSaves.find(guid);
+				if(it == m_pendingSaves.end())
+					return success;
+
+				data = it->second;
+				m_pendingSaves.erase(it);
+				m_writingSaves[guid] = data->name;
+			}
+			else if(!wait)
+				return true;
+		}
+
+		if(!data)
+		{
+			OTSYS_SLEEP(PLAYER_SAVE_WAIT);
+			continue;
+		}
+
+		success = false;
+		for(uint32_t tries = 0; tries < PLAYER_SAVE_ATTEMPTS && !success; ++tries)
+		{
+			success = writePlayer(*data);
+#ifdef __DEBUG__
+			if(!success)
+				std::cout << "Error while saving player: " << data->name << ", strike " << tries << std::endl;
+#endif
+		}
+
+		if(!success)
+		{
+			std::cout << "Error while saving player: " << data->name << std::endl;
+			invalidateSave(guid);
+		}
+		else
+			PlayerJournal::getInstance()->addSaved(guid, data->sequence);
+
+		delete data;
+		OTSYS_THREAD_LOCK_CLASS lockClass(m_saveLock);
+		m_writingSaves.erase(guid);
+	}
+}
+
+void IOLoginData::flushPlayerSave(const std::string& name)
+{
+	//the player may not be loaded before its last save is written
+	uint32_t guid = 0;
+	{
+		OTSYS_THREAD_LOCK_CLASS lockClass(m_saveLock);
+		for(PendingSaveMap::iterator it = m_pendingSaves.begin(); !guid && it != m_pendingSaves.end(); ++it)
+		{
+			if(!strcasecmp(it->second->name.c_str(), name.c_str()))
+				guid = it->first;
+		}
+
+		for(std::map<uint32_t, std::string>::iterator it = m_writingSaves.begin(); !guid && it != m_writingSaves.end(); ++it)
+		{
+			if(!strcasecmp(it->second.c_str(), name.c_str()))
+				guid = it->first;
+		}
+	}
+
+	if(guid)
+		flushPlayerSave(guid);
+}
+
+void IOLoginData::flushPlayerSaves()
+{
+	while(true)
+	{
+		std::vector<uint32_t> guids;
+		{
+			OTSYS_THREAD_LOCK_CLASS lockClass(m_saveLock);
+			for(PendingSaveMap::iterator it = m_pendingSaves.begin(); it != m_pendingSaves.end(); ++it)
+				guids.push_back(it->first);
+
+			for(std::map<uint32_t, std::string>::iterator it = m_writingSaves.begin(); it != m_writingSaves.end(); ++it)
+				guids.push_back(it->first);
+		}
+
+		if(guids.empty())
+			return;
+
+		for(std::vector<uint32_t>::iterator it = guids.begin(); it != guids.end(); ++it)
+			flushPlayerSave(*it);
+	}
+}
+
+void IOLoginData::invalidateSave(uint32_t guid)
+{
+	//the database does not hold the rows the player save state expects, next save writes everything
+	OTSYS_THREAD_LOCK_CLASS lockClass(m_saveLock);
+	m_invalidSaves.insert(guid);
+
+	PendingSaveMap::iterator it = m_pendingSaves.find(guid);
+	if(it != m_pendingSaves.end())
+		it->second->saved = PlayerSaveState();
+}
+
+uint32_t IOLoginData::getPendingSaveCount()
+{
+	OTSYS_THREAD_LOCK_CLASS lockClass(m_saveLock);
+	return m_pendingSaves.size() + m_writingSaves.size();
+}
+
+void IOLoginData::journalPlayers()
+{
+	//dispatcher thread, the journal skips states it already holds, every task snapshots one slice
+	//of the players so each of them is still journaled once per interval
+	PlayerJournal* journal = PlayerJournal::getInstance();
+	AutoList<Player>::list_type& players = Player::listPlayer.list;
+	uint32_t count = (players.size() + PLAYER_JOURNAL_SLICES - 1) / PLAYER_JOURNAL_SLICES;
+
+	AutoList<Player>::listiterator it = players.lower_bound(m_journalCursor);
+	for(; count > 0 && it != players.end(); ++it, --count)
+	{
+		Player* player = it->second;
+		player->loginPosition = player->getPosition();
+
+		PlayerSaveData data;
+		if(!snapshotPlayer(player, data, false) || !data.saving)
+			continue;
+
+		std::string state;
+		serializeSave(data, state);
+		journal->addState(data.guid, data.sequence, state);
+	}
+
+	m_journalCursor = it != players.end() ? it->first : 0;
+	Scheduler::getScheduler().addEvent(createSchedulerTask(std::max((int32_t)1000, g_config.getNumber(ConfigManager::PLAYER_JOURNAL_INTERVAL)) / PLAYER_JOURNAL_SLICES,
+		boost::bind(&IOLoginData::journalPlayers, this)));
+}
+
+bool IOLoginData::replayJournal(uint32_t guid, uint64_t sequence, const std::string& state)
+{
+	//startup, all rows are rewritten unless a save of the same or a later sequence was committed
+	PlayerSaveData data;
+	if(!unserializeSave(state, data))
+		return false;
+
+	data.guid = guid;
+	data.sequence = sequence;
+	return writePlayer(data);
+}
+
+static void addBlobString(std::string& blob, const std::string& value)
+{
+	addBlobValue<uint32_t>(blob, value.size());
+	blob += value;
+}
+
+static bool getBlobString(PropStream& propStream, std::string& value)
+{
+	uint32_t size;
+	return propStream.GET_ULONG(size) && propStream.GET_BYTES(size, value);
+}
+
+void IOLoginData::serializeSave(const PlayerSaveData& data, std::string& state)
+{
+	addBlobString(state, data.name);
+	addBlobValue<uint8_t>(state, data.saving);
+	addBlobValue<uint8_t>(state, data.guildManagement);
+	addBlobValue<int64_t>(state, data.lastLogin);
+	addBlobValue<uint32_t>(state, data.lastIP);
+	addBlobValue<uint32_t>(state, data.guildId);
+	addBlobValue<uint32_t>(state, data.guildLevel);
+
+	const DBStatement& stmt = data.state.player;
+	addBlobString(state, stmt.getQuery());
+	addBlobValue<uint32_t>(state, stmt.getParams().size());
+	for(DBStatement::ParamList::const_iterator it = stmt.getParams().begin(); it != stmt.getParams().end(); ++it)
+	{
+		addBlobValue<uint8_t>(state, it->type);
+		addBlobValue<int64_t>(state, it->number);
+		addBlobString(state, it->data);
+	}
+
+	for(int32_t i = 0; i <= SKILL_LAST; ++i)
+	{
+		addBlobValue<uint32_t>(state, data.state.skills[i][SKILL_LEVEL]);
+		addBlobValue<uint32_t>(state, data.state.skills[i][SKILL_TRIES]);
+	}
+
+	addBlobValue<uint32_t>(state, data.state.spells.size());
+	for(LearnedInstantSpellList::const_iterator it = data.state.spells.begin(); it != data.state.spells.end(); ++it)
+		addBlobString(state, *it);
+
+	//trees stored as rows go in the blob encoding as well
+	for(int32_t i = ITEMBLOB_INVENTORY; i < ITEMBLOB_LAST; ++i)
+	{
+		const PlayerItemTree& tree = data.state.items[i];
+		addBlobValue<uint8_t>(state, !tree.blob.empty());
+		if(tree.blob.empty())
+		{
+			std::string blob;
+			encodeItemBlob(tree.rows, blob);
+			addBlobString(state, blob);
+		}
+		else
+			addBlobString(state, tree.blob);
+	}
+
+	addBlobValue<uint32_t>(state, data.state.storage.size());
+	for(StorageMap::const_iterator it = data.state.storage.begin(); it != data.state.storage.end(); ++it)
+	{
+		addBlobValue<uint32_t>(state, it->first);
+		addBlobString(state, it->second);
+	}
+
+	addBlobValue<uint32_t>(state, data.state.invites.size());
+	for(InvitedToGuildsList::const_iterator it = data.state.invites.begin(); it != data.state.invites.end(); ++it)
+		addBlobValue<uint32_t>(state, *it);
+
+	addBlobValue<uint32_t>(state, data.state.vips.size());
+	for(VIPListSet::const_iterator it = data.state.vips.begin(); it != data.state.vips.end(); ++it)
+		addBlobValue<uint32_t>(state, *it);
+
+	addBlobValue<uint32_t>(state, data.mail.size());
+	for(std::vector<int64_t>::const_iterator it = data.mail.begin(); it != data.mail.end(); ++it)
+		addBlobValue<int64_t>(state, *it);
+}
+
+bool IOLoginData::unserializeSave(const std::string& state, PlayerSaveData& data)
+{
+	PropStream propStream;
+	propStream.init(state.c_str(), state.length());
+
+	uint8_t saving, guildManagement;
+	int64_t lastLogin;
+	if(!getBlobString(propStream, data.name) || !propStream.GET_UCHAR(saving) || !propStream.GET_UCHAR(guildManagement)
+		|| !propStream.GET_VALUE(lastLogin) || !propStream.GET_ULONG(data.lastIP) || !propStream.GET_ULONG(data.guildId)
+		|| !propStream.GET_ULONG(data.guildLevel))
+		return false;
+
+	data.saving = saving != 0;
+	data.guildManagement = guildManagement != 0;
+	data.lastLogin = (time_t)lastLogin;
+
+	std::string query;
+	uint32_t size;
+	if(!getBlobString(propStream, query) || !propStream.GET_ULONG(size))
+		return false;
+
+	DBStatement& stmt = data.state.player;
+	stmt = DBStatement(query);
+	for(uint32_t i = 0; i < size; ++i)
+	{
+		uint8_t type;
+		int64_t number;
+		std::string value;
+		if(!propStream.GET_UCHAR(type) || !propStream.GET_VALUE(number) || !getBlobString(propStream, value))
+			return false;
+
+		if(type == DBSTATEMENT_INT)
+			stmt.bindInt(number);
+		else if(type == DBSTATEMENT_STRING)
+			stmt.bindString(value);
+		else
+			stmt.bindBlob(value.c_str(), value.length());
+	}
+
+	for(int32_t i = 0; i <= SKILL_LAST; ++i)
+	{
+		if(!propStream.GET_ULONG(data.state.skills[i][SKILL_LEVEL]) || !propStream.GET_ULONG(data.state.skills[i][SKILL_TRIES]))
+			return false;
+	}
+
+	if(!propStream.GET_ULONG(size))
+		return false;
+
+	for(uint32_t i = 0; i < size; ++i)
+	{
+		std::string spell;
+		if(!getBlobString(propStream, spell))
+			return false;
+
+		data.state.spells.push_back(spell);
+	}
+
+	for(int32_t i = ITEMBLOB_INVENTORY; i < ITEMBLOB_LAST; ++i)
+	{
+		PlayerItemTree& tree = data.state.items[i];
+		uint8_t isBlob;
+		std::string blob;
+		if(!propStream.GET_UCHAR(isBlob) || !getBlobString(propStream, blob))
+			return false;
+
+		if(isBlob && m_itemBlobTable)
+			tree.blob = blob;
+		else if(!decodeItemBlob(blob, tree.rows))
+			return false;
+	}
+
+	if(!propStream.GET_ULONG(size))
+		return false;
+
+	for(uint32_t i = 0; i < size; ++i)
+	{
+		uint32_t key;
+		std::string value;
+		if(!propStream.GET_ULONG(key) || !getBlobString(propStream, value))
+			return false;
+
+		data.state.storage[key] = value;
+	}
+
+	if(!propStream.GET_ULONG(size))
+		return false;
+
+	for(uint32_t i = 0; i < size; ++i)
+	{
+		uint32_t guildId;
+		if(!propStream.GET_ULONG(guildId))
+			return false;
+
+		data.state.invites.push_back(guildId);
+	}
+
+	if(!propStream.GET_ULONG(size))
+		return false;
+
+	for(uint32_t i = 0; i < size; ++i)
+	{
+		uint32_t vip;
+		if(!propStream.GET_ULONG(vip))
+			return false;
+
+		data.state.vips.insert(vip);
 	}
 
+	//states journaled before mail was delivered end here
+	if(propStream.GET_ULONG(size))
+	{
+		for(uint32_t i = 0; i < size; ++i)
+		{
+			int64_t mailId;
+			if(!propStream.GET_VALUE(mailId))
+				return false;
+
+			data.mail.push_back(mailId);
+		}
+	}
+
+	data.state.known = true;
+	return true;
+}
+
+bool IOLoginData::snapshotPlayer(Player* player, PlayerSaveData& data, bool preSave)
+{
+	//dispatcher thread, does not touch the database
+	if(preSave && player->health <= 0)
+	{
+		player->health = player->healthMax;
+		player->mana = player->manaMax;
+	}
+
+	data.sequence = ++m_saveSequence;
+	data.guid = player->getGUID();
+	data.name = player->getName();
+	data.saving = player->isSaving();
+	data.lastLogin = player->lastLoginSaved;
+	data.lastIP = player->lastIP;
+	if(!data.saving)
+		return true;
+
+	//serialize conditions
+	PropWriteStream propWriteStream;
+	for(ConditionList::const_iterator it = player->conditions.begin(); it != player->conditions.end(); ++it)
+	{
+		if((*it)->isPersistent())
+		{
+			if(!(*it)->serialize(propWriteStream))
+				return false;
+
+			propWriteStream.ADD_UCHAR(CONDITIONATTR_END);
+		}
+	}
+
+	uint32_t conditionsSize = 0;
+	const char* conditions = propWriteStream.getStream(conditionsSize);
+
+	std::stringstream query;
+	query << "UPDATE `players` SET `lastlogin` = ?, `lastip` = ?, `level` = ?, `group_id` = ?, `health` = ?, `healthmax` = ?, `experience` = ?, ";
+	query << "`lookbody` = ?, `lookfeet` = ?, `lookhead` = ?, `looklegs` = ?, `looktype` = ?, `lookaddons` = ?, ";
+	query << "`maglevel` = ?, `mana` = ?, `manamax` = ?, `manaspent` = ?, `soul` = ?, `town_id` = ?, `posx` = ?, `posy` = ?, `posz` = ?, ";
+	query << "`cap` = ?, `sex` = ?, `balance` = ?, `stamina` = ?, `promotion` = ?, `conditions` = ?, ";
+	query << "`loss_experience` = ?, `loss_mana` = ?, `loss_skills` = ?, `loss_items` = ?, `lastlogout` = ?, `marriage` = ?, `vocation` = ?";
+
+	const bool redSkull = g_game.getWorldType() != WORLD_TYPE_PVP_ENFORCED;
+	if(redSkull)
+		query << ", `redskulltime` = ?, `redskull` = ?";
+
+	const bool blessings = player->isPremium() || !g_config.getBool(ConfigManager::BLESSING_ONLY_PREMIUM);
+	if(blessings)
+		query << ", `blessings` = ?";
+
+	data.guildManagement = g_config.getBool(ConfigManager::INGAME_GUILD_MANAGEMENT);
+	if(data.guildManagement)
+		query << ", `guildnick` = ?";
+
+	query << " WHERE `id` = ?";
+
 	Vocation* tmpVoc = player->vocation;
 	for(uint32_t i = 0; i <= player->promotionLevel; i++)
 		tmpVoc = g_vocations.getVocation(tmpVoc->getFromVocation());
 
-	query << "`vocation` = " << tmpVoc->getVocId() << " WHERE `id` = " << player->getGUID();
-	if(!db->executeQuery(query.str()))
+	PlayerSaveState& state = data.state;
+	state.known = true;
+
+	DBStatement* stmt = &state.player;
+	*stmt = DBStatement(query.str());
+	stmt->bindInt(player->lastLoginSaved).bindInt(player->lastIP).bindInt(player->level).bindInt(player->groupId)
+		.bindInt(player->health).bindInt(player->healthMax).bindInt(player->experience);
+	stmt->bindInt(player->defaultOutfit.lookBody).bindInt(player->defaultOutfit.lookFeet).bindInt(player->defaultOutfit.lookHead)
+		.bindInt(player->defaultOutfit.lookLegs).bindInt(player->defaultOutfit.lookType).bindInt(player->defaultOutfit.lookAddons);
+	stmt->bindInt(player->magLevel).bindInt(player->mana).bindInt(player->manaMax).bindInt(player->manaSpent).bindInt(player->soul)
+		.bindInt(player->town).bindInt(player->getLoginPosition().x).bindInt(player->getLoginPosition().y).bindInt(player->getLoginPosition().z);
+	stmt->bindInt((int64_t)player->getCapacity()).bindInt(player->sex).bindInt(player->balance).bindInt(player->getStamina())
+		.bindInt(player->promotionLevel).bindBlob(conditions, conditionsSize);
+	stmt->bindInt(player->getLossPercent(LOSS_EXPERIENCE)).bindInt(player->getLossPercent(LOSS_MANASPENT))
+		.bindInt(player->getLossPercent(LOSS_SKILLTRIES)).bindInt(player->getLossPercent(LOSS_ITEMS))
+		.bindInt(player->getLastLogout()).bindInt(player->marriage).bindInt(tmpVoc->getVocId());
+	if(redSkull)
+	{
+		int32_t redSkullTime = 0;
+		if(player->redSkullTicks > 0)
+			redSkullTime = time(NULL) + player->redSkullTicks/1000;
+
+		stmt->bindInt(redSkullTime).bindInt(player->skull == SKULL_RED ? 1 : 0);
+	}
+
+	if(blessings)
+		stmt->bindInt(player->blessings);
+
+	if(data.guildManagement)
+	{
+		stmt->bindString(player->guildNick);
+		data.guildId = player->getGuildId();
+		data.guildLevel = player->getGuildLevel();
+		state.invites = player->invitedToGuildsList;
+	}
+
+	stmt->bindInt(data.guid);
+	for(int32_t i = 0; i <= SKILL_LAST; ++i)
+	{
+		state.skills[i][SKILL_LEVEL] = player->skills[i][SKILL_LEVEL];
+		state.skills[i][SKILL_TRIES] = player->skills[i][SKILL_TRIES];
+	}
+
+	state.spells = player->learnedInstantSpellList;
+
+	ItemBlockList itemList;
+	for(int32_t slotId = 1; slotId < 11; ++slotId)
+	{
+		if(Item* item = player->inventory[slotId])
+			itemList.push_back(itemBlock(slotId, item));
+	}
+
+	snapshotItems(itemList, state.items[ITEMBLOB_INVENTORY].rows);
+	itemList.clear();
+	for(DepotMap::iterator it = player->depots.begin(); it != player->depots.end(); ++it)
+		itemList.push_back(itemBlock(it->first, it->second));
+
+	snapshotItems(itemList, state.items[ITEMBLOB_DEPOT].rows);
+	{
+		OTSYS_THREAD_LOCK_CLASS lockClass(m_saveLock);
+		std::map<uint32_t, std::vector<int64_t> >::iterator it = m_deletedMail.find(data.guid);
+		if(it != m_deletedMail.end())
+		{
+			for(std::vector<int64_t>::iterator mit = it->second.begin(); mit != it->second.end(); ++mit)
+				player->deliveredMail.erase(std::remove(player->deliveredMail.begin(), player->deliveredMail.end(), *mit), player->deliveredMail.end());
+
+			m_deletedMail.erase(it);
+		}
+	}
+
+	data.mail = player->deliveredMail;
+	if(m_itemBlobTable && g_config.getBool(ConfigManager::ITEM_BLOB_STORAGE))
+	{
+		for(int32_t i = ITEMBLOB_INVENTORY; i < ITEMBLOB_LAST; ++i)
+		{
+			PlayerItemTree& tree = state.items[i];
+			encodeItemBlob(tree.rows, tree.blob);
+			tree.rows.clear();
+		}
+	}
+
+	player->genReservedStorageRange();
+	state.storage.insert(player->getStorageIteratorBegin(), player->getStorageIteratorEnd());
+
+	state.vips = player->VIPList;
+	return true;
+}
+
+void IOLoginData::trackSaveState(Player* player, PlayerSaveData& data)
+{
+	if(!g_config.getBool(ConfigManager::INCREMENTAL_PLAYER_SAVE))
+		return;
+
+	bool invalid = false;
+	{
+		OTSYS_THREAD_LOCK_CLASS lockClass(m_saveLock);
+		invalid = m_invalidSaves.erase(data.guid) != 0;
+	}
+
+	if(!player->saveState)
+		player->saveState = new PlayerSaveState;
+	else if(!invalid)
+		data.saved = *player->saveState;
+
+	*player->saveState = data.state;
+}
+
+void IOLoginData::snapshotItems(const ItemBlockList& itemList, PlayerItemRows& rows)
+{
+	typedef std::pair<Container*, int32_t> containerBlock;
+	std::list<containerBlock> stack;
+
+	int32_t runningId = 100;
+	for(ItemBlockList::const_iterator it = itemList.begin(); it != itemList.end(); ++it)
+	{
+		Item* item = it->second;
+		++runningId;
+
+		uint32_t attributesSize;
+		PropWriteStream propWriteStream;
+		item->serializeAttr(propWriteStream);
+		const char* attributes = propWriteStream.getStream(attributesSize);
+
+		PlayerItemRow row;
+		row.pid = it->first;
+		row.sid = runningId;
+		row.itemType = item->getID();
+		row.count = (int32_t)item->getSubType();
+		row.attributes.assign(attributes, attributesSize);
+		rows[row.sid] = row;
+
+		if(Container* container = item->getContainer())
+			stack.push_back(containerBlock(container, runningId));
+	}
+
+	while(stack.size() > 0)
+	{
+		const containerBlock& cb = stack.front();
+		Container* container = cb.first;
+		int32_t parentId = cb.second;
+		stack.pop_front();
+		for(uint32_t i = 0; i < container->size(); ++i)
+		{
+			++runningId;
+			Item* item = container->getItem(i);
+			if(Container* subContainer = item->getContainer())
+				stack.push_back(containerBlock(subContainer, runningId));
+
+			uint32_t attributesSize;
+			PropWriteStream propWriteStream;
+			item->serializeAttr(propWriteStream);
+			const char* attributes = propWriteStream.getStream(attributesSize);
+
+			PlayerItemRow row;
+			row.pid = parentId;
+			row.sid = runningId;
+			row.itemType = item->getID();
+			row.count = (int32_t)item->getSubType();
+			row.attributes.assign(attributes, attributesSize);
+			rows[row.sid] = row;
+		}
+	}
+}
+
+//executes the queries of one player save, counting what is sent for the save metrics
+class PlayerSaveWriter
+{
+	public:
+		PlayerSaveWriter(Database* db): m_insert(db)
+		{
+			m_db = db;
+			m_multiLine = db->getParam(DBPARAM_MULTIINSERT) != 0;
+			m_insertSize = m_rows = 0;
+			m_statements = m_bytes = 0;
+		}
+
+		virtual ~PlayerSaveWriter()
+		{
+			Metrics::getInstance()->addCounter(METRIC_SAVE_STATEMENTS, m_statements);
+			Metrics::getInstance()->addCounter(METRIC_SAVE_BYTES, m_bytes);
+		}
+
+		bool executeQuery(const std::string& query)
+		{
+			m_statements++;
+			m_bytes += query.length();
+			return m_db->executeQuery(query);
+		}
+
+		bool executeStatement(const DBStatement& stmt)
+		{
+			m_statements++;
+			m_bytes += stmt.getQuery().length();
+			for(DBStatement::ParamList::const_iterator it = stmt.getParams().begin(); it != stmt.getParams().end(); ++it)
+				m_bytes += it->type == DBSTATEMENT_INT ? sizeof(it->number) : it->data.length();
+
+			return m_db->executeStatement(stmt);
+		}
+
+		void setInsert(const std::string& query)
+		{
+			m_insert.setQuery(query);
+			m_insertSize = query.length();
+			m_rows = 0;
+		}
+
+		bool addRow(std::stringstream& row)
+		{
+			if(!m_multiLine || !m_rows)
+			{
+				m_statements++;
+				m_bytes += m_insertSize;
+			}
+
+			m_rows++;
+			m_bytes += row.str().length() + 3;
+			return m_insert.addRow(row);
+		}
+
+		bool executeInsert() {return m_insert.execute();}
+
+		//removes the given keys of one player from a table
+		bool deleteRows(const std::string& table, const std::string& column, uint32_t guid, const std::vector<int64_t>& keys)
+		{
+			if(keys.empty())
+				return true;
+
+			std::stringstream query;
+			query << "DELETE FROM `" << table << "` WHERE `player_id` = " << guid << " AND `" << column << "` IN (";
+			for(std::vector<int64_t>::const_iterator it = keys.begin(); it != keys.end(); ++it)
+			{
+				if(it != keys.begin())
+					query << ", ";
+
+				query << *it;
+			}
+
+			query << ")";
+			return executeQuery(query.str());
+		}
+
+	protected:
+		Database* m_db;
+		DBInsert m_insert;
+		bool m_multiLine;
+
+		uint32_t m_insertSize, m_rows;
+		int64_t m_statements, m_bytes;
+};
+
+bool IOLoginData::writePlayer(const PlayerSaveData& data)
+{
+	//any thread, only touches the database
+	Database* db = Database::getInstance();
+	DBResult* result;
+
+	DBQuery query;
+	DBStatement stmt("SELECT `save`, `save_sequence` FROM `players` WHERE `id` = ?");
+	stmt.bindInt(data.guid);
+	if(!(result = db->storeStatement(stmt)))
+		return false;
+
+	const bool save = result->getDataInt("save");
+	const uint64_t savedSequence = result->getDataLong("save_sequence");
+	db->freeResult(result);
+	if(data.saving && save && savedSequence >= data.sequence)
+	{
+		//the rows are newer, a journal state whose save record never reached the disk
+		return true;
+	}
+
+	DBTransaction trans(db);
+	if(!trans.begin())
+		return false;
+
+	PlayerSaveWriter writer(db);
+	if(!save || !data.saving)
+	{
+		DBStatement loginStmt("UPDATE `players` SET `lastlogin` = ?, `lastip` = ? WHERE `id` = ?");
+		loginStmt.bindInt(data.lastLogin).bindInt(data.lastIP).bindInt(data.guid);
+		if(!writer.executeStatement(loginStmt))
+			return false;
+
+		if(data.saving)
+			invalidateSave(data.guid);
+
+		return trans.commit();
+	}
+
+	//a known saved state holds the rows in the database, only what differs from it is written
+	const PlayerSaveState& state = data.state;
+	const PlayerSaveState& saved = data.saved;
+	const bool known = saved.known;
+	if(!known || !(state.player == saved.player))
+	{
+		if(!writer.executeStatement(state.player))
+			return false;
+	}
+
+	//committed with the rows, a journal replay never writes an older state over them
+	DBStatement sequenceStmt("UPDATE `players` SET `save_sequence` = ? WHERE `id` = ?");
+	sequenceStmt.bindInt(data.sequence).bindInt(data.guid);
+	if(!writer.executeStatement(sequenceStmt))
 		return false;
 
+	if(data.guildManagement)
+	{
+		DBStatement rankStmt("UPDATE `players` SET `rank_id` = ? WHERE `id` = ?");
+		rankStmt.bindInt(IOGuild::getInstance()->getRankIdByGuildIdAndLevel(data.guildId, data.guildLevel)).bindInt(data.guid);
+		if(!writer.executeStatement(rankStmt))
+			return false;
+	}
+
 	// skills
-	for(int32_t i = 0; i <= 6; i++)
+	DBStatement skillStmt("UPDATE `player_skills` SET `value` = ?, `count` = ? WHERE `player_id` = ? AND `skillid` = ?");
+	for(int32_t i = 0; i <= SKILL_LAST; i++)
 	{
-		query.str("");
-		query << "UPDATE `player_skills` SET `value` = " << player->skills[i][SKILL_LEVEL] << ", `count` = " << player->skills[i][SKILL_TRIES] << " WHERE `player_id` = " << player->getGUID() << " AND `skillid` = " << i;
-		if(!db->executeQuery(query.str()))
+		if(known && state.skills[i][SKILL_LEVEL] == saved.skills[i][SKILL_LEVEL]
+			&& state.skills[i][SKILL_TRIES] == saved.skills[i][SKILL_TRIES])
+			continue;
+
+		skillStmt.clear();
+		skillStmt.bindInt(state.skills[i][SKILL_LEVEL]).bindInt(state.skills[i][SKILL_TRIES]).bindInt(data.guid).bindInt(i);
+		if(!writer.executeStatement(skillStmt))
 			return false;
 	}
 
 	// learned spells
-	query.str("");
-	query << "DELETE FROM `player_spells` WHERE `player_id` = " << player->getGUID();
-	if(!db->executeQuery(query.str()))
-		return false;
-
-	char buffer[280];
-	DBInsert query_insert(db);
-	query_insert.setQuery("INSERT INTO `player_spells` (`player_id`, `name`) VALUES ");
-	for(LearnedInstantSpellList::const_iterator it = player->learnedInstantSpellList.begin(); it != player->learnedInstantSpellList.end(); ++it)
+	std::stringstream row;
+	if(!known || state.spells != saved.spells)
 	{
-		sprintf(buffer, "%d, %s", player->getGUID(), db->escapeString(*it).c_str());
-		if(!query_insert.addRow(buffer))
+		query << "DELETE FROM `player_spells` WHERE `player_id` = " << data.guid;
+		if(!writer.executeQuery(query.str()))
 			return false;
-	}
 
-	if(!query_insert.execute())
-		return false;
+		writer.setInsert("INSERT INTO `player_spells` (`player_id`, `name`) VALUES ");
+		for(LearnedInstantSpellList::const_iterator it = state.spells.begin(); it != state.spells.end(); ++it)
+		{
+			row << data.guid << ", " << db->escapeString(*it);
+			if(!writer.addRow(row))
+				return false;
+		}
 
-	//item saving
-	query.str("");
-	query << "DELETE FROM `player_items` WHERE `player_id` = " << player->getGUID();
-	if(!db->executeQuery(query.str()))
-		return false;
+		if(!writer.executeInsert())
+			return false;
+	}
 
-	ItemBlockList itemList;
-	for(int32_t slotId = 1; slotId < 11; ++slotId)
+	//item saving
+	for(int32_t i = ITEMBLOB_INVENTORY; i < ITEMBLOB_LAST; ++i)
 	{
-		if(Item* item = player->inventory[slotId])
-			itemList.push_back(itemBlock(slotId, item));
+		if(!writeItems(writer, data.guid, (ItemBlob_t)i, state.items[i], saved.items[i], known))
+			return false;
 	}
 
-	query_insert.setQuery("INSERT INTO `player_items` (`player_id`, `pid`, `sid`, `itemtype`, `count`, `attributes`) VALUES ");
-	if(!saveItems(player, itemList, query_insert))
-		return false;
-
-	//save depot items
-	query.str("");
-	query << "DELETE FROM `player_depotitems` WHERE `player_id` = " << player->getGUID();
-	if(!db->executeQuery(query.str()))
+	//the depot holds the mail now, a mail row left behind would deliver it twice
+	if(!writer.deleteRows("player_mail", "id", data.guid, data.mail))
 		return false;
 
-	itemList.clear();
-	for(DepotMap::iterator it = player->depots.begin(); it != player->depots.end(); ++it)
-		itemList.push_back(itemBlock(it->first, it->second));
-
-	query_insert.setQuery("INSERT INTO `player_depotitems` (`player_id`, `pid`, `sid`, `itemtype`, `count`, `attributes`) VALUES ");
-	if(!saveItems(player, itemList, query_insert))
-		return false;
+	std::vector<int64_t> keys;
+	if(!known)
+	{
+		query.str("");
+		query << "DELETE FROM `player_storage` WHERE `player_id` = " << data.guid;
+		if(!writer.executeQuery(query.str()))
+			return false;
+	}
+	else
+	{
+		for(StorageMap::const_iterator it = saved.storage.begin(); it != saved.storage.end(); ++it)
+		{
+			StorageMap::const_iterator sit = state.storage.find(it->first);
+			if(sit == state.storage.end() || sit->second != it->second)
+				keys.push_back(it->first);
+		}
 
-	query.str("");
-	query << "DELETE FROM `player_storage` WHERE `player_id` = " << player->getGUID();
-	if(!db->executeQuery(query.str()))
-		return false;
+		if(!writer.deleteRows("player_storage", "key", data.guid, keys))
+			return false;
+	}
 
-	player->genReservedStorageRange();
-	query_insert.setQuery("INSERT INTO `player_storage` (`player_id`, `key`, `value`) VALUES ");
-	for(StorageMap::const_iterator cit = player->getStorageIteratorBegin(); cit != player->getStorageIteratorEnd(); ++cit)
+	writer.setInsert("INSERT INTO `player_storage` (`player_id`, `key`, `value`) VALUES ");
+	for(StorageMap::const_iterator cit = state.storage.begin(); cit != state.storage.end(); ++cit)
 	{
-		sprintf(buffer, "%u, %u, %s", player->getGUID(), cit->first, db->escapeString(cit->second).c_str());
-		if(!query_insert.addRow(buffer))
+		if(known)
+		{
+			StorageMap::const_iterator sit = saved.storage.find(cit->first);
+			if(sit != saved.storage.end() && sit->second == cit->second)
+				continue;
+		}
+
+		row << data.guid << ", " << cit->first << ", " << db->escapeString(cit->second);
+		if(!writer.addRow(row))
 			return false;
 	}
 
-	if(!query_insert.execute())
+	if(!writer.executeInsert())
 		return false;
 
-	if(g_config.getBool(ConfigManager::INGAME_GUILD_MANAGEMENT))
+	if(data.guildManagement && (!known || state.invites != saved.invites))
 	{
 		//save guild invites
 		query.str("");
-		query << "DELETE FROM `guild_invites` WHERE player_id = " << player->getGUID();
+		query << "DELETE FROM `guild_invites` WHERE player_id = " << data.guid;
 
-		if(!db->executeQuery(query.str()))
+		if(!writer.executeQuery(query.str()))
 			return false;
 
-		query_insert.setQuery("INSERT INTO `guild_invites` (`player_id`, `guild_id`) VALUES ");
-		for(InvitedToGuildsList::const_iterator it = player->invitedToGuildsList.begin(); it != player->invitedToGuildsList.end(); ++it)
+		writer.setInsert("INSERT INTO `guild_invites` (`player_id`, `guild_id`) VALUES ");
+		for(InvitedToGuildsList::const_iterator it = state.invites.begin(); it != state.invites.end(); ++it)
 		{
-			sprintf(buffer, "%d, %d", player->getGUID(), *it);
-			if(!query_insert.addRow(buffer))
+			row << data.guid << ", " << *it;
+			if(!writer.addRow(row))
 				return false;
 		}
 
-		if(!query_insert.execute())
+		if(!writer.executeInsert())
 			return false;
 	}
 
 	//save vip list
-	query.str("");
-	query << "DELETE FROM `player_viplist` WHERE `player_id` = " << player->getGUID() << ";";
-	if(!db->executeQuery(query.str()))
-		return false;
+	keys.clear();
+	if(!known)
+	{
+		query.str("");
+		query << "DELETE FROM `player_viplist` WHERE `player_id` = " << data.guid << ";";
+		if(!writer.executeQuery(query.str()))
+			return false;
+	}
+	else
+	{
+		for(VIPListSet::const_iterator it = saved.vips.begin(); it != saved.vips.end(); ++it)
+		{
+			if(state.vips.find(*it) == state.vips.end())
+				keys.push_back(*it);
+		}
+
+		if(!writer.deleteRows("player_viplist", "vip_id", data.guid, keys))
+			return false;
+	}
 
-	query_insert.setQuery("INSERT INTO `player_viplist` (`player_id`, `vip_id`) VALUES ");
-	for(VIPListSet::iterator it = player->VIPList.begin(); it != player->VIPList.end(); it++)
+	writer.setInsert("INSERT INTO `player_viplist` (`player_id`, `vip_id`) VALUES ");
+	for(VIPListSet::const_iterator it = state.vips.begin(); it != state.vips.end(); it++)
 	{
+		if(known && saved.vips.find(*it) != saved.vips.end())
+			continue;
+
 		if(playerExists(*it))
 		{
-			sprintf(buffer, "%d, %d", player->getGUID(), *it);
-			if(!query_insert.addRow(buffer))
+			row << data.guid << ", " << *it;
+			if(!writer.addRow(row))
 				return false;
 		}
 	}
 
-	if(!query_insert.execute())
+	if(!writer.executeInsert())
 		return false;
 
 	//End the transaction
-	return trans.commit();
+	if(!trans.commit())
+		return false;
+
+	if(!data.mail.empty())
+	{
+		OTSYS_THREAD_LOCK_CLASS lockClass(m_saveLock);
+		std::vector<int64_t>& deleted = m_deletedMail[data.guid];
+		deleted.insert(deleted.end(), data.mail.begin(), data.mail.end());
+	}
+
+	return true;
 }
 
-bool IOLoginData::saveItems(const Player* player, const ItemBlockList& itemList, DBInsert& query_insert)
+static const char* itemTables[ITEMBLOB_LAST] = {"player_items", "player_depotitems"};
+
+bool IOLoginData::writeItems(PlayerSaveWriter& writer, uint32_t guid, ItemBlob_t type, const PlayerItemTree& tree,
+	const PlayerItemTree& saved, bool known)
 {
-	Database* db = Database::getInstance();
-	std::list<Container*> listContainer;
+	const std::string table = itemTables[type];
+	std::stringstream query;
+	if(!tree.blob.empty())
+	{
+		//the whole tree goes as one row, the rows it was stored as before are dropped
+		if(known && tree.blob == saved.blob && saved.rows.empty())
+			return true;
 
-	typedef std::pair<Container*, int32_t> containerBlock;
-	std::list<containerBlock> stack;
+		if(!known || !saved.rows.empty())
+		{
+			query << "DELETE FROM `" << table << "` WHERE `player_id` = " << guid;
+			if(!writer.executeQuery(query.str()))
+				return false;
+		}
+
+		if(!known || tree.blob != saved.blob)
+		{
+			query.str("");
+			query << "DELETE FROM `player_itemblobs` WHERE `player_id` = " << guid << " AND `type` = " << type;
+			if(!writer.executeQuery(query.str()))
+				return false;
 
-	int32_t parentId = 0, runningId = 100, pid;
-	Item* item;
+			DBStatement blobStmt("INSERT INTO `player_itemblobs` (`player_id`, `type`, `data`) VALUES (?, ?, ?)");
+			blobStmt.bindInt(guid).bindInt(type).bindBlob(tree.blob.c_str(), tree.blob.length());
+			if(!writer.executeStatement(blobStmt))
+				return false;
+		}
 
-	for(ItemBlockList::const_iterator it = itemList.begin(); it != itemList.end(); ++it)
+		return true;
+	}
+
+	if(m_itemBlobTable && (!known || !saved.blob.empty()))
 	{
-		pid = it->first;
-		item = it->second;
-		++runningId;
+		query << "DELETE FROM `player_itemblobs` WHERE `player_id` = " << guid << " AND `type` = " << type;
+		if(!writer.executeQuery(query.str()))
+			return false;
+	}
 
-		uint32_t attributesSize;
-		PropWriteStream propWriteStream;
-		item->serializeAttr(propWriteStream);
-		const char* attributes = propWriteStream.getStream(attributesSize);
+	//rows are identified by sid, a changed row is removed and inserted again
+	if(!known)
+	{
+		query.str("");
+		query << "DELETE FROM `" << table << "` WHERE `player_id` = " << guid;
+		if(!writer.executeQuery(query.str()))
+			return false;
+	}
+	else
+	{
+		std::vector<int64_t> sids;
+		for(PlayerItemRows::const_iterator it = saved.rows.begin(); it != saved.rows.end(); ++it)
+		{
+			PlayerItemRows::const_iterator rit = tree.rows.find(it->first);
+			if(rit == tree.rows.end() || !(rit->second == it->second))
+				sids.push_back(it->first);
+		}
 
-		char buffer[attributesSize * 3 + 100]; //MUST be (size * 2), else people can crash server when filling writable with native characters
-		sprintf(buffer, "%d, %d, %d, %d, %d, %s", player->getGUID(), pid, runningId, item->getID(), (int32_t)item->getSubType(), db->escapeBlob(attributes, attributesSize).c_str());
-		if(!query_insert.addRow(buffer))
+		if(!writer.deleteRows(table, "sid", guid, sids))
 			return false;
+	}
 
-		if(Container* container = item->getContainer())
-			stack.push_back(containerBlock(container, runningId));
+	Database* db = Database::getInstance();
+	writer.setInsert("INSERT INTO `" + table + "` (`player_id`, `pid`, `sid`, `itemtype`, `count`, `attributes`) VALUES ");
+
+	std::stringstream row;
+	for(PlayerItemRows::const_iterator it = tree.rows.begin(); it != tree.rows.end(); ++it)
+	{
+		if(known)
+		{
+			PlayerItemRows::const_iterator sit = saved.rows.find(it->first);
+			if(sit != saved.rows.end() && sit->second == it->second)
+				continue;
+		}
+
+		const PlayerItemRow& item = it->second;
+		row << guid << ", " << item.pid << ", " << item.sid << ", " << item.itemType << ", " << item.count << ", "
+			<< db->escapeBlob(item.attributes.c_str(), item.attributes.length());
+		if(!writer.addRow(row))
+			return false;
 	}
 
-	while(stack.size() > 0)
+	return writer.executeInsert();
+}
+
+void IOLoginData::loadSaveSequence()
+{
+	//startup, sequences go on from the last run so committed rows never look newer than a snapshot
+	Database* db = Database::getInstance();
+	DBResult* result;
+
+	DBQuery query;
+	query << "SELECT MAX(`save_sequence`) AS `sequence` FROM `players`";
+	if(!(result = db->storeQuery(query.str())))
+		return;
+
+	seedSaveSequence(result->getDataLong("sequence"));
+	db->freeResult(result);
+}
+
+void IOLoginData::checkItemBlobs()
+{
+	//startup, before any player is loaded
+	m_itemBlobTable = DatabaseManager::getInstance()->tableExists("player_itemblobs");
+	m_mailTable = DatabaseManager::getInstance()->tableExists("player_mail");
+	if(!g_config.getBool(ConfigManager::ITEM_BLOB_STORAGE))
+		return;
+
+	if(!m_itemBlobTable)
 	{
-		const containerBlock& cb = stack.front();
-		Container* container = cb.first;
-		parentId = cb.second;
-		stack.pop_front();
-		for(uint32_t i = 0; i < container->size(); ++i)
+		std::cout << "> WARNING: Table player_itemblobs does not exist, items are stored as rows." << std::endl;
+		return;
+	}
+
+	if(uint32_t players = convertItemRows())
+		std::cout << "> Converted items of " << players << " players to blobs." << std::endl;
+}
+
+uint32_t IOLoginData::convertItemRows()
+{
+	Database* db = Database::getInstance();
+	DBResult* result;
+
+	DBQuery query;
+	query << "SELECT DISTINCT `player_id` FROM `player_items` UNION SELECT DISTINCT `player_id` FROM `player_depotitems`";
+	if(!(result = db->storeQuery(query.str())))
+		return 0;
+
+	std::vector<uint32_t> guids;
+	do
+		guids.push_back(result->getDataInt("player_id"));
+	while(result->next());
+	db->freeResult(result);
+
+	uint32_t converted = 0;
+	for(std::vector<uint32_t>::iterator it = guids.begin(); it != guids.end(); ++it)
+	{
+		DBTransaction trans(db);
+		if(!trans.begin())
+			break;
+
+		bool success = true;
+		for(int32_t i = ITEMBLOB_INVENTORY; i < ITEMBLOB_LAST && success; ++i)
 		{
-			++runningId;
-			item = container->getItem(i);
-			Container* container = item->getContainer();
-			if(container)
-				stack.push_back(containerBlock(container, runningId));
+			PlayerItemRows rows;
+			DBStatement rowStmt("SELECT `pid`, `sid`, `itemtype`, `count`, `attributes` FROM `" + std::string(itemTables[i]) + "` WHERE `player_id` = ?");
+			rowStmt.bindInt(*it);
+			if((result = db->storeStatement(rowStmt)))
+			{
+				readItemRows(result, rows);
+				db->freeResult(result);
+			}
 
-			uint32_t attributesSize;
-			PropWriteStream propWriteStream;
-			item->serializeAttr(propWriteStream);
-			const char* attributes = propWriteStream.getStream(attributesSize);
+			//a player with a blob already keeps it, its rows are leftovers
+			DBStatement blobStmt("SELECT `type` FROM `player_itemblobs` WHERE `player_id` = ? AND `type` = ?");
+			blobStmt.bindInt(*it).bindInt(i);
+			if((result = db->storeStatement(blobStmt)))
+				db->freeResult(result);
+			else
+			{
+				std::string blob;
+				encodeItemBlob(rows, blob);
 
-			char buffer[attributesSize * 3 + 100]; //MUST be (size * 2), else people can crash server when filling writable with native characters
-			sprintf(buffer, "%d, %d, %d, %d, %d, %s", player->getGUID(), parentId, runningId, item->getID(), (int32_t)item->getSubType(), db->escapeBlob(attributes, attributesSize).c_str());
-			if(!query_insert.addRow(buffer))
-				return false;
+				DBStatement insertStmt("INSERT INTO `player_itemblobs` (`player_id`, `type`, `data`) VALUES (?, ?, ?)");
+				insertStmt.bindInt(*it).bindInt(i).bindBlob(blob.c_str(), blob.length());
+				success = db->executeStatement(insertStmt);
+			}
+
+			DBStatement deleteStmt("DELETE FROM `" + std::string(itemTables[i]) + "` WHERE `player_id` = ?");
+			deleteStmt.bindInt(*it);
+			success = success && db->executeStatement(deleteStmt);
+		}
+
+		if(!success || !trans.commit())
+		{
+			std::cout << "> ERROR: Couldn't convert items of player " << *it << " to blobs." << std::endl;
+			continue;
 		}
+
+		converted++;
 	}
 
-	if(!query_insert.execute())
+	return converted;
+}
+
+bool IOLoginData::sendMail(uint32_t guid, uint32_t depotId, Item* item, uint16_t newId/* = 0*/)
+{
+	//one row in the blob encoding, instead of loading and saving the whole player
+	if(!m_mailTable)
 		return false;
 
-	return true;
+	ItemBlockList itemList;
+	itemList.push_back(itemBlock(depotId, item));
+
+	PlayerItemRows rows;
+	snapshotItems(itemList, rows);
+	if(newId)
+		rows.begin()->second.itemType = newId;
+
+	std::string blob;
+	encodeItemBlob(rows, blob);
+
+	DBQuery lock;
+	DBStatement stmt("INSERT INTO `player_mail` (`player_id`, `data`) VALUES (?, ?)");
+	stmt.bindInt(guid).bindBlob(blob.c_str(), blob.length());
+	return Database::getInstance()->executeStatement(stmt);
 }
 
 bool IOLoginData::updateOnlineStatus(uint32_t guid, bool login)
@@ -1038,9 +2227,10 @@ bool IOLoginData::updateOnlineStatus(uint32_t guid, bool login)
 	Database* db = Database::getInstance();
 	DBResult* result;
 
-	DBQuery query;
-	query << "SELECT `online` FROM `players` WHERE `id` = " << guid << " AND `deleted` = 0;";
-	if(!(result = db->storeQuery(query.str())))
+	DBQuery lock;
+	DBStatement stmt("SELECT `online` FROM `players` WHERE `id` = ? AND `deleted` = 0");
+	stmt.bindInt(guid);
+	if(!(result = db->storeStatement(stmt)))
 		return false;
 
 	uint16_t onlineValue = result->getDataInt("online");
@@ -1052,9 +2242,9 @@ bool IOLoginData::updateOnlineStatus(uint32_t guid, bool login)
 	else if(onlineValue > 0)
 		onlineValue--;
 
-	query.str("");
-	query << "UPDATE `players` SET `online` = " << onlineValue << " WHERE `id` = " << guid;
-	return db->executeQuery(query.str());
+	DBStatement updateStmt("UPDATE `players` SET `online` = ? WHERE `id` = ?");
+	updateStmt.bindInt(onlineValue).bindInt(guid);
+	return db->executeStatement(updateStmt);
 }
 
 bool IOLoginData::hasFlag(std::string name, PlayerFlags value)
@@ -1117,129 +2307,141 @@ bool IOLoginData::isPremium(uint32_t guid)
 
 bool IOLoginData::playerExists(uint32_t guid, bool multiworld /*= false*/)
 {
-	Database* db = Database::getInstance();
-	DBResult* result;
-
-	DBQuery query;
-	query << "SELECT `id` FROM `players` WHERE `id` = " << guid << " AND `deleted` = 0";
-	if(!multiworld)
-		query << " AND `world_id` = " << g_config.getNumber(ConfigManager::WORLD_ID);
-
-	if(!(result = db->storeQuery(query.str())))
-		return false;
-
-	db->freeResult(result);
-	return true;
+	std::string name;
+	return getNameByGuid(guid, name, multiworld);
 }
 
 bool IOLoginData::playerExists(std::string name, bool multiworld /*= false*/)
+{
+	uint32_t guid;
+	return getGuidByName(guid, name, multiworld);
+}
+
+bool IOLoginData::findPlayer(DBStatement& stmt, PlayerNameEntry& entry, uint32_t generation)
 {
 	Database* db = Database::getInstance();
 	DBResult* result;
 
-	DBQuery query;
-	query << "SELECT `id` FROM `players` WHERE `name` " << db->getStringComparisonOperator() << " " << db->escapeString(name) << " AND `deleted` = 0";
-	if(!multiworld)
-		query << " AND `world_id` = " << g_config.getNumber(ConfigManager::WORLD_ID);
-
-	if(!(result = db->storeQuery(query.str())))
+	DBQuery lock;
+	if(!(result = db->storeStatement(stmt)))
 		return false;
 
+	entry.guid = result->getDataInt("id");
+	entry.name = result->getDataString("name");
+	entry.worldId = result->getDataInt("world_id");
+	entry.groupId = result->getDataInt("group_id");
+
 	db->freeResult(result);
+	m_nameCache.add(entry, generation);
 	return true;
 }
 
 bool IOLoginData::getNameByGuid(uint32_t guid, std::string& name, bool multiworld /*= false*/)
 {
-	NameCacheMap::iterator it = nameCacheMap.find(guid);
-	if(it != nameCacheMap.end())
+	//the world is checked here, so whatever the query finds can be cached
+	PlayerNameEntry entry;
+	bool found;
+	uint32_t generation = m_nameCache.getGeneration();
+	if(!m_nameCache.getByGuid(guid, entry, found))
 	{
-		name = it->second;
-		return true;
-	}
+		DBStatement stmt("SELECT `id`, `name`, `world_id`, `group_id` FROM `players` WHERE `id` = ? AND `deleted` = 0");
+		stmt.bindInt(guid);
 
-	Database* db = Database::getInstance();
-	DBResult* result;
-
-	DBQuery query;
-	query << "SELECT `name` FROM `players` WHERE `id` = " << guid << " AND `deleted` = 0";
-	if(!multiworld)
-		query << " AND `world_id` = " << g_config.getNumber(ConfigManager::WORLD_ID);
+		found = findPlayer(stmt, entry, generation);
+		if(!found)
+			m_nameCache.addMissingGuid(guid, generation);
+	}
 
-	if(!(result = db->storeQuery(query.str())))
+	if(!found || (!multiworld && entry.worldId != (uint32_t)g_config.getNumber(ConfigManager::WORLD_ID)))
 		return false;
 
-	name = result->getDataString("name");
-	db->freeResult(result);
-
-	nameCacheMap[guid] = name;
+	name = entry.name;
 	return true;
 }
 
-bool IOLoginData::storeNameByGuid(uint32_t guid)
+bool IOLoginData::getGuidByName(uint32_t &guid, std::string& name, bool multiworld /*= false*/)
 {
-	NameCacheMap::iterator it = nameCacheMap.find(guid);
-	if(it != nameCacheMap.end())
-		return true;
+	PlayerNameEntry entry;
+	bool found;
+	uint32_t generation = m_nameCache.getGeneration();
+	if(!m_nameCache.getByName(name, entry, found))
+	{
+		DBStatement stmt("SELECT `id`, `name`, `world_id`, `group_id` FROM `players` WHERE `name` "
+			+ Database::getInstance()->getStringComparisonOperator() + " ? AND `deleted` = 0");
+		stmt.bindString(name);
 
-	Database* db = Database::getInstance();
-	DBResult* result;
+		found = findPlayer(stmt, entry, generation);
+		if(!found)
+			m_nameCache.addMissingName(name, generation);
+	}
 
-	DBQuery query;
-	query << "SELECT `name` FROM `players` WHERE `id` = " << guid << " AND `deleted` = 0;";
-	if(!(result = db->storeQuery(query.str())))
+	if(!found || (!multiworld && entry.worldId != (uint32_t)g_config.getNumber(ConfigManager::WORLD_ID)))
 		return false;
 
-	nameCacheMap[guid] = result->getDataString("name");
-	db->freeResult(result);
+	name = entry.name;
+	guid = entry.guid;
 	return true;
 }
 
-bool IOLoginData::getGuidByName(uint32_t &guid, std::string& name, bool multiworld /*= false*/)
+bool IOLoginData::getGuidByNameEx(uint32_t& guid, bool &specialVip, std::string& name)
 {
-	GuidCacheMap::iterator it = guidCacheMap.find(name);
-	if(it != guidCacheMap.end())
+	PlayerNameEntry entry;
+	bool found;
+	uint32_t generation = m_nameCache.getGeneration();
+	if(!m_nameCache.getByName(name, entry, found))
 	{
-		name = it->first;
-		guid = it->second;
-		return true;
-	}
-
-	Database* db = Database::getInstance();
-	DBResult* result;
+		DBStatement stmt("SELECT `id`, `name`, `world_id`, `group_id` FROM `players` WHERE `name` "
+			+ Database::getInstance()->getStringComparisonOperator() + " ? AND `deleted` = 0");
+		stmt.bindString(name);
 
-	DBQuery query;
-	query << "SELECT `name`, `id` FROM `players` WHERE `name` " << db->getStringComparisonOperator() << " " << db->escapeString(name) << " AND `deleted` = 0";
-	if(!multiworld)
-		query << " AND `world_id` = " << g_config.getNumber(ConfigManager::WORLD_ID);
+		found = findPlayer(stmt, entry, generation);
+		if(!found)
+			m_nameCache.addMissingName(name, generation);
+	}
 
-	if(!(result = db->storeQuery(query.str())))
+	if(!found || entry.worldId != (uint32_t)g_config.getNumber(ConfigManager::WORLD_ID))
 		return false;
 
-	name = result->getDataString("name");
-	guid = result->getDataInt("id");
-
-	guidCacheMap[name] = guid;
-	db->freeResult(result);
+	guid = entry.guid;
+	specialVip = internalHasFlag(entry.groupId, PlayerFlag_SpecialVIP);
+	name = entry.name;
 	return true;
 }
 
-bool IOLoginData::getGuidByNameEx(uint32_t& guid, bool &specialVip, std::string& name)
+void IOLoginData::loadNameCache()
 {
+	uint32_t capacity = std::max((int32_t)0, g_config.getNumber(ConfigManager::NAME_CACHE_SIZE));
+	m_nameCache.setCapacity(capacity);
+	if(!capacity)
+		return;
+
 	Database* db = Database::getInstance();
 	DBResult* result;
 
+	uint32_t generation = m_nameCache.getGeneration();
 	DBQuery query;
-	query << "SELECT `id`, `name`, `group_id` FROM `players` WHERE `name` " << db->getStringComparisonOperator() << " " << db->escapeString(name) << " AND `deleted` = 0 AND `world_id` = " << g_config.getNumber(ConfigManager::WORLD_ID);
-	if(!(result = db->storeQuery(query.str())))
-		return false;
-
-	guid = result->getDataInt("id");
-	specialVip = internalHasFlag(result->getDataInt("group_id"), PlayerFlag_SpecialVIP);
-	name = result->getDataString("name");
-
+	query << "SELECT `id`, `name`, `world_id`, `group_id` FROM `players` WHERE `deleted` = 0 ORDER BY `lastlogin` DESC LIMIT " << capacity;
+	if(!(result = db->streamQuery(query.str())))
+		return;
+
+	//oldest first, so the latest logins end up the most recently used
+	std::vector<PlayerNameEntry> entries;
+	int32_t idColumn = result->getColumn("id"), nameColumn = result->getColumn("name"),
+		worldColumn = result->getColumn("world_id"), groupColumn = result->getColumn("group_id");
+	do
+	{
+		PlayerNameEntry entry;
+		entry.guid = result->getDataInt(idColumn);
+		entry.name = result->getDataString(nameColumn);
+		entry.worldId = result->getDataInt(worldColumn);
+		entry.groupId = result->getDataInt(groupColumn);
+		entries.push_back(entry);
+	}
+	while(result->next());
 	db->freeResult(result);
-	return true;
+
+	for(std::vector<PlayerNameEntry>::reverse_iterator it = entries.rbegin(); it != entries.rend(); ++it)
+		m_nameCache.add(*it, generation);
 }
 
 uint32_t IOLoginData::getAccountIdByName(std::string name)
@@ -1263,20 +2465,13 @@ bool IOLoginData::changeName(uint32_t guid, std::string newName, std::string old
 
 	DBQuery query;
 	query << "UPDATE `players` SET `name` = " << db->escapeString(newName) << " WHERE `id` = " << guid;
-	if(db->executeQuery(query.str()))
-	{
-		GuidCacheMap::iterator it = guidCacheMap.find(oldName);
-		if(it != guidCacheMap.end())
-		{
-			guidCacheMap.erase(it);
-			guidCacheMap[newName] = guid;
-		}
-
-		nameCacheMap[guid] = newName;
-		return true;
-	}
+	if(!db->executeQuery(query.str()))
+		return false;
 
-	return false;
+	m_nameCache.removeGuid(guid);
+	m_nameCache.removeName(oldName);
+	m_nameCache.removeName(newName);
+	return true;
 }
 
 bool IOLoginData::createCharacter(uint32_t accountId, std::string characterName, int32_t vocationId, PlayerSex_t sex)
@@ -1318,7 +2513,12 @@ bool IOLoginData::createCharacter(uint32_t accountId, std::string characterName,
 
 	DBQuery query;
 	query << "INSERT INTO `players` (`id`, `name`, `world_id`, `group_id`, `account_id`, `level`, `vocation`, `health`, `healthmax`, `experience`, `lookbody`, `lookfeet`, `lookhead`, `looklegs`, `looktype`, `lookaddons`, `maglevel`, `mana`, `manamax`, `manaspent`, `soul`, `town_id`, `posx`, `posy`, `posz`, `conditions`, `cap`, `sex`, `lastlogin`, `lastip`, `redskull`, `redskulltime`, `save`, `rank_id`, `guildnick`, `lastlogout`, `blessings`, `online`) VALUES (NULL, " << db->escapeString(characterName) << ", " << g_config.getNumber(ConfigManager::WORLD_ID) << ", 1, " << accountId << ", " << level << ", " << vocationId << ", " << healthMax << ", " << healthMax << ", " << exp << ", 68, 76, 78, 39, " << lookType << ", 0, " << g_config.getNumber(ConfigManager::START_MAGICLEVEL) << ", " << manaMax << ", " << manaMax << ", 0, 100, " << g_config.getNumber(ConfigManager::SPAWNTOWN_ID) << ", " << g_config.getNumber(ConfigManager::SPAWNPOS_X) << ", " << g_config.getNumber(ConfigManager::SPAWNPOS_Y) << ", " << g_config.getNumber(ConfigManager::SPAWNPOS_Z) << ", 0, " << capMax << ", " << sex << ", 0, 0, 0, 0, 1, 0, '', 0, 0, 0)";
-	return db->executeQuery(query.str());
+	if(!db->executeQuery(query.str()))
+		return false;
+
+	//playerExists() above left a miss for the name
+	m_nameCache.removeName(characterName);
+	return true;
 }
 
 DeleteCharacter_t IOLoginData::deleteCharacter(uint32_t accountId, const std::string characterName)
@@ -1349,6 +2549,9 @@ DeleteCharacter_t IOLoginData::deleteCharacter(uint32_t accountId, const std::st
 	if(!db->executeQuery(query.str()))
 		return DELETE_INTERNAL;
 
+	m_nameCache.removeGuid(id);
+	m_nameCache.removeName(characterName);
+
 	query.str("");
 	query << "DELETE FROM `guild_invites` WHERE `player_id` = " << id;
 	db->executeQuery(query.str());
@@ -25,6 +25,7 @@
 #include "account.h"
 #include "player.h"
 #include "database.h"
+#include "namecache.h"
 
 enum DeleteCharacter_t
 {
@@ -51,14 +52,130 @@ class PlayerGroup
 		uint16_t m_outfit;
 };
 
+//item trees stored as one blob per player, instead of one row per item
+enum ItemBlob_t
+{
+	ITEMBLOB_INVENTORY = 0,
+	ITEMBLOB_DEPOT,
+	ITEMBLOB_LAST /* this must be the last one */
+};
+
+//format of the item blobs, bumped when the encoding changes
+#define ITEMBLOB_VERSION 1
+
+//rows of one player, fetched by any thread and applied on the dispatcher
+struct PlayerLoadData
+{
+	PlayerLoadData();
+	virtual ~PlayerLoadData();
+
+	Account account;
+	DBResult* player;
+	DBResult* guild;
+	DBResult* guildInvites;
+	DBResult* skills;
+	DBResult* spells;
+	DBResult* items;
+	DBResult* depotItems;
+	DBResult* storage;
+	DBResult* vips;
+	//every vip row, also those of deleted players, only read for incremental saves
+	DBResult* vipIds;
+	DBResult* mail;
+	//of the name cache when the vips were read
+	uint32_t nameGeneration;
+
+	//empty when the tree is stored as rows
+	std::string itemBlobs[ITEMBLOB_LAST];
+};
+
 typedef std::pair<int32_t, Item*> itemBlock;
 typedef std::list<itemBlock> ItemBlockList;
 
+//how many times a player save is written before it is given up
+#define PLAYER_SAVE_ATTEMPTS 3
+//how long a thread waits for another one to finish writing the same player, in milliseconds
+#define PLAYER_SAVE_WAIT 10
+//the journal pass over the online players is spread over this many dispatcher tasks
+#define PLAYER_JOURNAL_SLICES 10
+
+class PlayerSaveWriter;
+
+struct PlayerItemRow
+{
+	int32_t pid, sid, itemType, count;
+	std::string attributes;
+
+	bool operator==(const PlayerItemRow& row) const
+	{
+		return pid == row.pid && sid == row.sid && itemType == row.itemType && count == row.count && attributes == row.attributes;
+	}
+};
+
+typedef std::map<int32_t, PlayerItemRow> PlayerItemRows;
+
+//one item tree of a player, either its rows or its blob
+struct PlayerItemTree
+{
+	PlayerItemRows rows;
+	std::string blob;
+};
+
+//rows of one player as saved, a save writes only what differs from the previous state
+struct PlayerSaveState
+{
+	PlayerSaveState(): player("")
+	{
+		known = false;
+		memset(skills, 0, sizeof(skills));
+	}
+
+	//false when the database rows are unknown, everything is rewritten then
+	bool known;
+
+	DBStatement player;
+	uint32_t skills[SKILL_LAST + 1][2];
+
+	LearnedInstantSpellList spells;
+	PlayerItemTree items[ITEMBLOB_LAST];
+	StorageMap storage;
+	InvitedToGuildsList invites;
+	VIPListSet vips;
+};
+
+//everything savePlayer writes, copied on the dispatcher and written by any thread
+struct PlayerSaveData
+{
+	PlayerSaveData();
+	virtual ~PlayerSaveData() {}
+
+	uint64_t sequence;
+	uint32_t guid;
+	std::string name;
+	bool saving, guildManagement;
+
+	time_t lastLogin;
+	uint32_t lastIP;
+	uint32_t guildId, guildLevel;
+
+	//rows to write and the rows the database holds before the write
+	PlayerSaveState state, saved;
+	//mail rows already in the depot rows
+	std::vector<int64_t> mail;
+};
+
 class IOLoginData
 {
 	public:
-		IOLoginData(){}
-		virtual ~IOLoginData() {}
+		IOLoginData()
+		{
+			OTSYS_THREAD_LOCKVARINIT(m_saveLock);
+			m_itemBlobTable = m_mailTable = false;
+			m_saveSequence = 0;
+			m_journalCursor = 0;
+		}
+
+		virtual ~IOLoginData() {OTSYS_THREAD_LOCKVARRELEASE(m_saveLock);}
 
 		static IOLoginData* getInstance()
 		{
@@ -86,10 +203,30 @@ class IOLoginData
 		bool createAccount(std::string name, std::string password);
 		void removePremium(Account account);
 
+		bool fetchPlayer(PlayerLoadData& data, const std::string& name, bool preLoad = false);
+		bool loadPlayer(Player* player, PlayerLoadData& data, bool preLoad = false);
 		bool loadPlayer(Player* player, const std::string& name, bool preLoad = false);
-		bool savePlayer(Player* player, bool preSave = true);
+		bool savePlayer(Player* player, bool preSave = true, bool async = false);
+		bool flushPlayerSave(uint32_t guid, bool wait = true);
+		//dispatcher thread, a login fetch is stale when the player was saved after it was queued
+		uint32_t beginLoginFetch(const std::string& name);
+		bool endLoginFetch(const std::string& name, uint32_t token);
+		void flushPlayerSave(const std::string& name);
+		void flushPlayerSaves();
+		uint32_t getPendingSaveCount();
+		uint32_t getNameCacheSize() {return m_nameCache.getSize();}
+		void checkItemBlobs();
+		void loadSaveSequence();
+		void journalPlayers();
+		bool replayJournal(uint32_t guid, uint64_t sequence, const std::string& state);
+		//startup, snapshots taken from now on are newer than any journaled one
+		void seedSaveSequence(uint64_t sequence) {m_saveSequence = std::max(m_saveSequence, sequence);}
 		bool updateOnlineStatus(uint32_t guid, bool login);
 
+		//dispatcher thread, stores an item for an offline player to be put into its depot at next login,
+		//newId replaces the type of the item itself, as stamping a parcel does
+		bool sendMail(uint32_t guid, uint32_t depotId, Item* item, uint16_t newId = 0);
+
 		const PlayerGroup* getPlayerGroup(uint32_t groupId);
 		const PlayerGroup* getPlayerGroupByAccount(uint32_t accId);
 		uint32_t getLastIPByName(std::string name);
@@ -105,6 +242,8 @@ class IOLoginData
 		bool getNameByGuid(uint32_t guid, std::string& name, bool multiworld = false);
 		bool getGuidByName(uint32_t& guid, std::string& name, bool multiworld = false);
 		bool getGuidByNameEx(uint32_t& guid, bool& specialVip, std::string& name);
+		//startup, fills the name cache with the players who logged in last
+		void loadNameCache();
 
 		bool changeName(uint32_t guid, std::string newName, std::string oldName);
 		bool createCharacter(uint32_t accountId, std::string characterName, int32_t vocationId, PlayerSex_t sex);
@@ -118,30 +257,60 @@ class IOLoginData
 		bool resetGuildInformation(uint32_t guid);
 
 	protected:
-		struct StringCompareCase
-		{
-			bool operator()(const std::string& l, const std::string& r) const
-			{
-				return strcasecmp(l.c_str(), r.c_str()) < 0;
-			}
-		};
-
 		typedef std::map<int,std::pair<Item*, int32_t> > ItemMap;
-		typedef std::map<uint32_t, std::string> NameCacheMap;
-		typedef std::map<std::string, uint32_t, StringCompareCase> GuidCacheMap;
 		typedef std::map<uint32_t, PlayerGroup*> PlayerGroupMap;
 
-		void loadItems(ItemMap& itemMap, DBResult *result);
-		bool saveItems(const Player* player, const ItemBlockList& itemList, DBInsert& query_insert);
+		void loadItemTree(Player* player, const PlayerLoadData& data, ItemBlob_t type, PlayerSaveState* state, ItemMap& itemMap);
+		void readItemRows(DBResult* result, PlayerItemRows& rows);
+		void loadItems(ItemMap& itemMap, const PlayerItemRows& rows);
+		void loadMail(Player* player, DBResult* result);
+		static void encodeItemBlob(const PlayerItemRows& rows, std::string& blob);
+		static bool decodeItemBlob(const std::string& blob, PlayerItemRows& rows);
+		uint32_t convertItemRows();
+		bool snapshotPlayer(Player* player, PlayerSaveData& data, bool preSave);
+		void trackSaveState(Player* player, PlayerSaveData& data);
+		void serializeSave(const PlayerSaveData& data, std::string& state);
+		bool unserializeSave(const std::string& state, PlayerSaveData& data);
+		void snapshotItems(const ItemBlockList& itemList, PlayerItemRows& rows);
+		bool writePlayer(const PlayerSaveData& data);
+		bool writeItems(PlayerSaveWriter& writer, uint32_t guid, ItemBlob_t type, const PlayerItemTree& tree,
+			const PlayerItemTree& saved, bool known);
+		void runPlayerSave(uint32_t guid);
+		void invalidateSave(uint32_t guid);
 
 		bool internalHasFlag(uint32_t groupId, PlayerFlags value);
 		bool internalHasCustomFlag(uint32_t groupId, PlayerCustomFlags value);
 
-		bool storeNameByGuid(uint32_t guid);
+		bool findPlayer(DBStatement& stmt, PlayerNameEntry& entry, uint32_t generation);
 
 		PlayerGroupMap playerGroupMap;
-		NameCacheMap nameCacheMap;
-		GuidCacheMap guidCacheMap;
+		PlayerNameCache m_nameCache;
+
+		//latest snapshot not yet written and the players being written, by guid
+		typedef std::map<uint32_t, PlayerSaveData*> PendingSaveMap;
+		PendingSaveMap m_pendingSaves;
+		std::map<uint32_t, std::string> m_writingSaves;
+		//players whose rows were not written as their save state expects
+		std::set<uint32_t> m_invalidSaves;
+		//mail rows a committed save deleted, the next snapshot drops them from the player
+		std::map<uint32_t, std::vector<int64_t> > m_deletedMail;
+		//set at startup, the item blob table exists in the database
+		bool m_itemBlobTable;
+		//set at startup, the mail table exists in the database
+		bool m_mailTable;
+		//orders the snapshots, a written save makes older journal states obsolete
+		uint64_t m_saveSequence;
+		OTSYS_THREAD_LOCKVAR m_saveLock;
+		//dispatcher only, id of the first player of the next journal slice
+		uint32_t m_journalCursor;
+
+		//dispatcher only, players with a login fetch in flight by lower case name
+		struct LoginFetch
+		{
+			uint32_t fetches, saves;
+		};
+		typedef std::map<std::string, LoginFetch> LoginFetchMap;
+		LoginFetchMap m_loginFetches;
 };
 
 #endif
@@ -38,62 +38,157 @@ bool IOMapSerialize::loadMap(Map* map)
 			loadTile(*db, *tit);
 	}
 
+	//the table may hold rows no loaded house owns, so the first save still rewrites everything
 	return true;
 }
 
 bool IOMapSerialize::saveMap(Map* map)
 {
 	Database* db = Database::getInstance();
+	const int32_t worldId = g_config.getNumber(ConfigManager::WORLD_ID);
 	//Start the transaction
 	DBTransaction trans(db);
 	if(!trans.begin())
 		return false;
 
-	//clear old tile data
 	DBQuery query;
-	query << "DELETE FROM `tile_items` WHERE `world_id` = " << g_config.getNumber(ConfigManager::WORLD_ID);
-	if(!db->executeQuery(query.str()))
+	if(!m_known)
+	{
+		//clear old tile data
+		query << "DELETE FROM `tile_items` WHERE `world_id` = " << worldId;
+		if(!db->executeQuery(query.str()))
+			return false;
+
+		query.str("");
+		query << "DELETE FROM `tiles` WHERE `world_id` = " << worldId;
+		if(!db->executeQuery(query.str()))
+			return false;
+
+		query.str("");
+	}
+
+	//only houses whose rows changed are replaced, under new tile ids
+	SavedHouseMap savedHouses;
+	std::vector<uint32_t> staleTiles;
+	std::vector<HouseRows> changedHouses;
+	uint32_t nextTileId = m_known ? m_nextTileId : 1;
+	for(HouseMap::iterator it = Houses::getInstance().getHouseBegin(); it != Houses::getInstance().getHouseEnd(); ++it)
+	{
+		HouseRows rows;
+		std::string content;
+		serializeHouse(db, it->second, rows, content);
+
+		SavedHouse& saved = savedHouses[it->first];
+		SavedHouseMap::iterator sit = m_savedHouses.find(it->first);
+		if(m_known && sit != m_savedHouses.end())
+		{
+			if(sit->second.content == content)
+			{
+				saved = sit->second;
+				continue;
+			}
+
+			staleTiles.insert(staleTiles.end(), sit->second.tileIds.begin(), sit->second.tileIds.end());
+		}
+
+		saved.content.swap(content);
+		for(HouseRows::iterator tit = rows.begin(); tit != rows.end(); ++tit)
+			saved.tileIds.push_back(nextTileId++);
+
+		changedHouses.push_back(rows);
+	}
+
+	if(m_known)
+	{
+		for(SavedHouseMap::iterator it = m_savedHouses.begin(); it != m_savedHouses.end(); ++it)
+		{
+			if(savedHouses.find(it->first) == savedHouses.end())
+				staleTiles.insert(staleTiles.end(), it->second.tileIds.begin(), it->second.tileIds.end());
+		}
+	}
+
+	if(!deleteTiles(db, staleTiles))
 		return false;
 
-	query.str("");
-	query << "DELETE FROM `tiles` WHERE `world_id` = " << g_config.getNumber(ConfigManager::WORLD_ID);
-	if(!db->executeQuery(query.str()))
+	//tiles go first, tile_items rows reference them
+	uint32_t tileId = m_known ? m_nextTileId : 1;
+	DBInsert query_insert(db);
+	query_insert.setQuery("INSERT INTO `tiles` (`id`, `world_id`, `x`, `y`, `z`) VALUES ");
+	for(std::vector<HouseRows>::iterator it = changedHouses.begin(); it != changedHouses.end(); ++it)
+	{
+		for(HouseRows::iterator tit = it->begin(); tit != it->end(); ++tit)
+		{
+			const Position& tilePosition = tit->first->getPosition();
+			query << tileId++ << ", " << worldId << ", " << tilePosition.x << ", " << tilePosition.y << ", " << tilePosition.z;
+			if(!query_insert.addRow(query))
+				return false;
+		}
+	}
+
+	if(!query_insert.execute())
 		return false;
 
-	uint32_t tileId = 0;
-	for(HouseMap::iterator it = Houses::getInstance().getHouseBegin(); it != Houses::getInstance().getHouseEnd(); ++it)
+	tileId = m_known ? m_nextTileId : 1;
+	query_insert.setQuery("INSERT INTO `tile_items` (`tile_id`, `world_id`, `sid`, `pid`, `itemtype`, `count`, `attributes`) VALUES ");
+	for(std::vector<HouseRows>::iterator it = changedHouses.begin(); it != changedHouses.end(); ++it)
 	{
-		//save house items
-		for(HouseTileList::iterator tit = it->second->getHouseTileBegin(); tit != it->second->getHouseTileEnd(); ++tit)
-			saveTile(db, ++tileId, *tit);
+		for(HouseRows::iterator tit = it->begin(); tit != it->end(); ++tit, ++tileId)
+		{
+			for(std::vector<std::string>::iterator rit = tit->second.begin(); rit != tit->second.end(); ++rit)
+			{
+				query << tileId << ", " << worldId << ", " << *rit;
+				if(!query_insert.addRow(query))
+					return false;
+			}
+		}
 	}
 
+	if(!query_insert.execute())
+		return false;
+
 	//End the transaction
-	return trans.commit();
+	if(!trans.commit())
+		return false;
+
+	m_savedHouses.swap(savedHouses);
+	m_nextTileId = nextTileId;
+	m_known = true;
+	return true;
 }
 
-bool IOMapSerialize::saveTile(Database* db, uint32_t tileId, const Tile* tile)
+void IOMapSerialize::serializeHouse(Database* db, House* house, HouseRows& rows, std::string& content)
+{
+	std::stringstream stream;
+	for(HouseTileList::iterator it = house->getHouseTileBegin(); it != house->getHouseTileEnd(); ++it)
+	{
+		std::vector<std::string> tileRows;
+		if(!serializeTile(db, *it, tileRows))
+			continue;
+
+		const Position& tilePosition = (*it)->getPosition();
+		stream << tilePosition.x << ", " << tilePosition.y << ", " << tilePosition.z << "\n";
+		for(std::vector<std::string>::iterator rit = tileRows.begin(); rit != tileRows.end(); ++rit)
+			stream << *rit << "\n";
+
+		rows.push_back(std::make_pair(*it, tileRows));
+	}
+
+	content = stream.str();
+}
+
+bool IOMapSerialize::serializeTile(Database* db, const Tile* tile, std::vector<std::string>& rows)
 {
-	const Position& tilePosition = tile->getPosition();
 	uint32_t tileCount = tile->getThingCount();
 	if(!tileCount)
-		return true;
-
-	DBQuery query;
-	query << "INSERT INTO `tiles` (`id`, `world_id`, `x`, `y`, `z`) VALUES " << "(" << tileId << ", " << g_config.getNumber(ConfigManager::WORLD_ID)
-		<< ", " << tilePosition.x << ", " << tilePosition.y << ", " << tilePosition.z << ")";
-	if(!db->executeQuery(query.str()))
 		return false;
 
-	query.str("");
 	ContainerStackList containerStackList;
 	int32_t runningId = 0, parentId = 0;
 
 	Item* item = NULL;
 	Container* container = NULL;
 
-	DBInsert query_insert(db);
-	query_insert.setQuery("INSERT INTO `tile_items` (`tile_id`, `world_id`, `sid`, `pid`, `itemtype`, `count`, `attributes`) VALUES ");
+	std::stringstream query;
 	for(uint32_t i = 0; i < tileCount; ++i)
 	{
 		item = tile->__getThing(i)->getItem();
@@ -109,10 +204,9 @@ bool IOMapSerialize::saveTile(Database* db, uint32_t tileId, const Tile* tile)
 		const char* attributes = propWriteStream.getStream(attributesSize);
 
 		runningId++;
-		query << tileId << ", " << g_config.getNumber(ConfigManager::WORLD_ID) << ", " << runningId << ", " << parentId << ", "
-			<< item->getID() << ", " << (int32_t)item->getSubType() << ", " << db->escapeBlob(attributes, attributesSize);
-		if(!query_insert.addRow(query.str()))
-			return false;
+		query << runningId << ", " << parentId << ", " << item->getID() << ", " << (int32_t)item->getSubType() << ", "
+			<< db->escapeBlob(attributes, attributesSize);
+		rows.push_back(query.str());
 
 		query.str("");
 		if(item->getContainer())
@@ -133,10 +227,9 @@ bool IOMapSerialize::saveTile(Database* db, uint32_t tileId, const Tile* tile)
 			const char* attributes = propWriteStream.getStream(attributesSize);
 
 			runningId++;
-			query << tileId << ", " << g_config.getNumber(ConfigManager::WORLD_ID) << ", " << runningId << ", " << parentId << ", "
-				<< item->getID() << ", " << (int32_t)item->getSubType() << ", " << db->escapeBlob(attributes, attributesSize);
-			if(!query_insert.addRow(query.str()))
-				return false;
+			query << runningId << ", " << parentId << ", " << item->getID() << ", " << (int32_t)item->getSubType() << ", "
+				<< db->escapeBlob(attributes, attributesSize);
+			rows.push_back(query.str());
 
 			query.str("");
 			if(item->getContainer())
@@ -144,8 +237,33 @@ bool IOMapSerialize::saveTile(Database* db, uint32_t tileId, const Tile* tile)
 		}
 	}
 
-	if(!query_insert.execute())
-		return false;
+	return !rows.empty();
+}
+
+bool IOMapSerialize::deleteTiles(Database* db, const std::vector<uint32_t>& tileIds)
+{
+	const int32_t worldId = g_config.getNumber(ConfigManager::WORLD_ID);
+	for(uint32_t i = 0; i < tileIds.size(); i += 1000)
+	{
+		std::stringstream ids;
+		for(uint32_t j = i; j < tileIds.size() && j < i + 1000; ++j)
+		{
+			if(j != i)
+				ids << ", ";
+
+			ids << tileIds[j];
+		}
+
+		DBQuery query;
+		query << "DELETE FROM `tile_items` WHERE `world_id` = " << worldId << " AND `tile_id` IN (" << ids.str() << ")";
+		if(!db->executeQuery(query.str()))
+			return false;
+
+		query.str("");
+		query << "DELETE FROM `tiles` WHERE `world_id` = " << worldId << " AND `id` IN (" << ids.str() << ")";
+		if(!db->executeQuery(query.str()))
+			return false;
+	}
 
 	return true;
 }
@@ -157,29 +275,33 @@ bool IOMapSerialize::loadTile(Database& db, Tile* tile)
 
 	const Position& tilePos = tile->getPosition();
 
-	DBQuery query;
-	query.str("");
-	query << "SELECT `tiles`.`id` FROM `tiles` WHERE `x` = " << tilePos.x << " AND `y` = " << tilePos.y << " AND `z` = " << tilePos.z << " AND `world_id` = " << g_config.getNumber(ConfigManager::WORLD_ID);
+	DBQuery lock;
+	DBStatement stmt("SELECT `tiles`.`id` FROM `tiles` WHERE `x` = ? AND `y` = ? AND `z` = ? AND `world_id` = ?");
+	stmt.bindInt(tilePos.x).bindInt(tilePos.y).bindInt(tilePos.z).bindInt(g_config.getNumber(ConfigManager::WORLD_ID));
 
 	DBResult* result;
-	if(!(result = db.storeQuery(query.str())))
+	if(!(result = db.storeStatement(stmt)))
 		return false;
 
-	int32_t tileId = result->getDataInt("id");
+	uint32_t tileId = result->getDataInt("id");
 	db.freeResult(result);
-	query.str("");
-	query << "SELECT * FROM `tile_items` WHERE `tile_id` = " << tileId << " AND `world_id` = " << g_config.getNumber(ConfigManager::WORLD_ID) << " ORDER BY `sid` DESC;";
-	if((result = db.storeQuery(query.str())))
+
+	DBStatement itemStmt("SELECT `sid`, `pid`, `itemtype`, `count`, `attributes` FROM `tile_items` WHERE `tile_id` = ? AND `world_id` = ? ORDER BY `sid` DESC");
+	itemStmt.bindInt(tileId).bindInt(g_config.getNumber(ConfigManager::WORLD_ID));
+	if((result = db.storeStatement(itemStmt)))
 	{
+		int32_t sidColumn = result->getColumn("sid"), pidColumn = result->getColumn("pid"), typeColumn = result->getColumn("itemtype"),
+			countColumn = result->getColumn("count"), attributesColumn = result->getColumn("attributes");
+
 		Item* item = NULL;
 		do
 		{
-			int32_t sid = result->getDataInt("sid"), pid = result->getDataInt("pid");
-			int32_t type = result->getDataInt("itemtype"), count = result->getDataInt("count");
+			int32_t sid = result->getDataInt(sidColumn), pid = result->getDataInt(pidColumn);
+			int32_t type = result->getDataInt(typeColumn), count = result->getDataInt(countColumn);
 			item = NULL;
 
 			uint64_t attrSize = 0;
-			const char* attr = result->getDataStream("attributes", attrSize);
+			const char* attr = result->getDataStream(attributesColumn, attrSize);
 			PropStream propStream;
 			propStream.init(attr, attrSize);
 
@@ -258,31 +380,34 @@ bool IOMapSerialize::loadHouseInfo(Map* map)
 	DBResult* result;
 
 	DBQuery query;
-	query << "SELECT * FROM `houses` WHERE `world_id` = " << g_config.getNumber(ConfigManager::WORLD_ID);
-	if(!(result = db->storeQuery(query.str())))
+	query << "SELECT `id`, `owner`, `paid`, `warnings`, `lastwarning` FROM `houses` WHERE `world_id` = " << g_config.getNumber(ConfigManager::WORLD_ID);
+	if(!(result = db->streamQuery(query.str())))
 		return false;
 
+	int32_t idColumn = result->getColumn("id"), ownerColumn = result->getColumn("owner"), paidColumn = result->getColumn("paid"),
+		warningsColumn = result->getColumn("warnings"), lastWarningColumn = result->getColumn("lastwarning");
 	do
 	{
-		if(House* house = Houses::getInstance().getHouse(result->getDataInt("id")))
+		if(House* house = Houses::getInstance().getHouse(result->getDataInt(idColumn)))
 		{
-			house->setHouseOwner(result->getDataInt("owner"));
-			house->setPaidUntil(result->getDataInt("paid"));
-			house->setPayRentWarnings(result->getDataInt("warnings"));
-			house->setLastWarning(result->getDataInt("lastwarning"));
+			house->setHouseOwner(result->getDataInt(ownerColumn));
+			house->setPaidUntil(result->getDataInt(paidColumn));
+			house->setPayRentWarnings(result->getDataInt(warningsColumn));
+			house->setLastWarning(result->getDataInt(lastWarningColumn));
 		}
 	}
 	while(result->next());
 	db->freeResult(result);
 
+	DBStatement listStmt("SELECT `listid`, `list` FROM `house_lists` WHERE `house_id` = ? AND `world_id` = ?");
 	for(HouseMap::iterator it = Houses::getInstance().getHouseBegin(); it != Houses::getInstance().getHouseEnd(); ++it)
 	{
-		query.str("");
 		House* house = it->second;
 		if(house->getHouseOwner() != 0 && house->getHouseId() != 0)
 		{
-			query << "SELECT `listid`, `list` FROM `house_lists` WHERE `house_id` = " << house->getHouseId() << " AND `world_id` = " << g_config.getNumber(ConfigManager::WORLD_ID);
-			if((result = db->storeQuery(query.str())))
+			listStmt.clear();
+			listStmt.bindInt(house->getHouseId()).bindInt(g_config.getNumber(ConfigManager::WORLD_ID));
+			if((result = db->storeStatement(listStmt)))
 			{
 				do
 					house->setAccessList(result->getDataInt("listid"), result->getDataString("list"));
@@ -26,13 +26,21 @@
 
 #include <string>
 #include <list>
+#include <map>
+#include <vector>
 
 typedef std::list<std::pair<Container*, int32_t> > ContainerStackList;
 
+class House;
+
 class IOMapSerialize
 {
 	public:
-		IOMapSerialize() {}
+		IOMapSerialize()
+		{
+			m_known = false;
+			m_nextTileId = 1;
+		}
 		virtual ~IOMapSerialize() {}
 
 		bool loadMap(Map* map);
@@ -41,8 +49,26 @@ class IOMapSerialize
 		bool saveHouseInfo(Map* map);
 
 	protected:
-		bool saveTile(Database* db, uint32_t tileId, const Tile* tile);
+		//tile_items rows of every tile of a house, without the tile id
+		typedef std::vector<std::pair<const Tile*, std::vector<std::string> > > HouseRows;
+
+		//a house as last written, a save rewrites only the houses whose rows differ
+		struct SavedHouse
+		{
+			std::vector<uint32_t> tileIds;
+			std::string content;
+		};
+		typedef std::map<uint32_t, SavedHouse> SavedHouseMap;
+
+		void serializeHouse(Database* db, House* house, HouseRows& rows, std::string& content);
+		bool serializeTile(Database* db, const Tile* tile, std::vector<std::string>& rows);
+		bool deleteTiles(Database* db, const std::vector<uint32_t>& tileIds);
 		bool loadTile(Database& db, Tile* tile);
+
+		//false until a save has rewritten every row of this world, only then are tile ids and rows known
+		bool m_known;
+		uint32_t m_nextTileId;
+		SavedHouseMap m_savedHouses;
 };
 
 #endif
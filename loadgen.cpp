@@ -0,0 +1,804 @@
+//////////////////////////////////////////////////////////////////////
+// OpenTibia - an opensource roleplaying game
+//////////////////////////////////////////////////////////////////////
+// Headless load generator, logs synthetic clients into the server
+//////////////////////////////////////////////////////////////////////
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software Foundation,
+// Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+//////////////////////////////////////////////////////////////////////
+#include "otsystem.h"
+#include "resources.h"
+
+#include <boost/asio.hpp>
+#include <boost/thread.hpp>
+#include <boost/bind.hpp>
+
+#include <gmp.h>
+
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+#include <string>
+#include <vector>
+
+//public half of the key loaded in otserv.cpp
+#define LOADGEN_RSA_MODULUS "109120132967399429278860960508995541528237502902798129123468757937266291492576446330739696001110603907230888610072655818825358503429057592827629436413108566029093628212635953836686562675849720620786279431090218017681061521755056710823876476444260558147179707119674283982419152118103759076030616683978566631413"
+#define LOADGEN_RSA_EXPONENT 65537
+//actions the server did not answer within this time are counted as unanswered
+#define LOADGEN_REPLY_TIMEOUT 2000
+#define LOADGEN_REPORT_INTERVAL 5000
+
+typedef std::vector<uint8_t> ByteBuffer;
+
+enum LoadAction_t
+{
+	LOAD_ACTION_NORTH = 0,
+	LOAD_ACTION_EAST,
+	LOAD_ACTION_SOUTH,
+	LOAD_ACTION_WEST,
+	LOAD_ACTION_SAY,
+	LOAD_ACTION_ATTACK,
+	LOAD_ACTION_USE,
+	LOAD_ACTION_IDLE,
+	LOAD_ACTION_LAST /* this must be the last one */
+};
+
+struct LoadConfig
+{
+	LoadConfig()
+	{
+		host = "127.0.0.1";
+		port = 7171;
+		clients = 10;
+		accountFormat = "loadgen%d";
+		password = "loadgen";
+		text = "load test";
+		interval = 500;
+		duration = 60;
+		rampUp = 50;
+		useSlot = 3;
+		useSprite = 0;
+		attackId = 0;
+		handshakes = false;
+	}
+
+	std::string host, accountFormat, password, text;
+	uint16_t port;
+	int32_t clients, interval, duration, rampUp;
+	uint8_t useSlot;
+	uint16_t useSprite;
+	uint32_t attackId;
+	bool handshakes;
+	std::vector<LoadAction_t> script;
+};
+
+class LoadStats
+{
+	public:
+		LoadStats()
+		{
+			online = logins = loginFailures = disconnects = 0;
+			actions = unanswered = packetsIn = bytesIn = bytesOut = handshakes = 0;
+		}
+
+		void addLatency(int64_t micros)
+		{
+			boost::mutex::scoped_lock lockClass(m_statsLock);
+			m_latencies.push_back(micros);
+		}
+
+		void add(uint64_t& counter, uint64_t value = 1)
+		{
+			boost::mutex::scoped_lock lockClass(m_statsLock);
+			counter += value;
+		}
+
+		void add(int32_t& counter, int32_t value = 1)
+		{
+			boost::mutex::scoped_lock lockClass(m_statsLock);
+			counter += value;
+		}
+
+		void print(int64_t elapsed, bool final);
+
+		int32_t online, logins, loginFailures, disconnects;
+		uint64_t actions, unanswered, packetsIn, bytesIn, bytesOut, handshakes;
+
+	protected:
+		int64_t getPercentile(std::vector<int64_t>& sorted, int32_t percent) const
+		{
+			if(sorted.empty())
+				return 0;
+
+			size_t index = (sorted.size() * percent + 99) / 100;
+			return sorted[index ? index - 1 : 0];
+		}
+
+		boost::mutex m_statsLock;
+		std::vector<int64_t> m_latencies;
+};
+
+void LoadStats::print(int64_t elapsed, bool final)
+{
+	std::vector<int64_t> sorted;
+	{
+		boost::mutex::scoped_lock lockClass(m_statsLock);
+		sorted = m_latencies;
+	}
+
+	std::sort(sorted.begin(), sorted.end());
+	double seconds = std::max((double)elapsed / 1000., 0.001);
+
+	boost::mutex::scoped_lock lockClass(m_statsLock);
+	std::cout << (final ? "Total" : "Running") << " after " << std::fixed << std::setprecision(1) << seconds << "s: "
+		<< online << " online, " << logins << " logins, " << loginFailures << " failed logins, "
+		<< disconnects << " disconnects, " << handshakes << " handshakes (" << handshakes / seconds << "/s)" << std::endl;
+	std::cout << "\t" << actions << " actions (" << actions / seconds << "/s), " << unanswered << " unanswered, "
+		<< packetsIn << " packets in (" << packetsIn / seconds << "/s), " << bytesIn / seconds / 1024. << " KB/s in, "
+		<< bytesOut / seconds / 1024. << " KB/s out" << std::endl;
+	std::cout << "\tresponse latency ms: p50 " << getPercentile(sorted, 50) / 1000. << ", p95 " << getPercentile(sorted, 95) / 1000.
+		<< ", p99 " << getPercentile(sorted, 99) / 1000. << ", max " << (sorted.empty() ? 0 : sorted.back()) / 1000.
+		<< " (" << sorted.size() << " samples)" << std::endl;
+}
+
+class LoadClient
+{
+	public:
+		LoadClient(boost::asio::io_service& service, const LoadConfig& config, LoadStats& stats, int32_t index):
+			m_socket(service), m_config(config), m_stats(stats)
+		{
+			m_index = index;
+			m_playerId = 0;
+			m_step = 0;
+			m_pendingAction = LOAD_ACTION_LAST;
+			m_pendingSince = 0;
+		}
+
+		void run(int64_t deadline);
+
+	protected:
+		bool connect(uint16_t port);
+		bool requestCharacter(std::string& account, std::string& character, uint16_t& port);
+		bool enterGame(const std::string& account, const std::string& character);
+
+		void sendAction(LoadAction_t action);
+		bool isReply(LoadAction_t action, uint8_t opcode) const;
+
+		void generateKey();
+		void encryptRSA(ByteBuffer& block);
+		void sendPacket(const ByteBuffer& body, bool encrypt);
+		bool readPacket(ByteBuffer& payload);
+
+		static void addU16(ByteBuffer& buffer, uint16_t value);
+		static void addU32(ByteBuffer& buffer, uint32_t value);
+		static void addString(ByteBuffer& buffer, const std::string& value);
+		static uint32_t adlerChecksum(const uint8_t* data, size_t length);
+
+		boost::asio::ip::tcp::socket m_socket;
+		const LoadConfig& m_config;
+		LoadStats& m_stats;
+
+		int32_t m_index;
+		uint32_t m_key[4];
+		uint32_t m_playerId;
+
+		size_t m_step;
+		LoadAction_t m_pendingAction;
+		int64_t m_pendingSince;
+};
+
+void LoadClient::addU16(ByteBuffer& buffer, uint16_t value)
+{
+	buffer.push_back(value & 0xFF);
+	buffer.push_back(value >> 8);
+}
+
+void LoadClient::addU32(ByteBuffer& buffer, uint32_t value)
+{
+	for(int32_t i = 0; i < 4; ++i)
+		buffer.push_back((value >> (i * 8)) & 0xFF);
+}
+
+void LoadClient::addString(ByteBuffer& buffer, const std::string& value)
+{
+	addU16(buffer, value.length());
+	buffer.insert(buffer.end(), value.begin(), value.end());
+}
+
+uint32_t LoadClient::adlerChecksum(const uint8_t* data, size_t length)
+{
+	uint32_t a = 1, b = 0;
+	while(length > 0)
+	{
+		size_t tmp = length > 5552 ? 5552 : length;
+		length -= tmp;
+		do
+		{
+			a += *data++;
+			b += a;
+		}
+		while(--tmp);
+
+		a %= 65521;
+		b %= 65521;
+	}
+
+	return (b << 16) | a;
+}
+
+void LoadClient::generateKey()
+{
+	for(int32_t i = 0; i < 4; ++i)
+		m_key[i] = ((uint32_t)rand() << 16) ^ (uint32_t)rand();
+}
+
+void LoadClient::encryptRSA(ByteBuffer& block)
+{
+	//pad the plain block with random bytes, the leading zero keeps it below the modulus
+	while(block.size() < 128)
+		block.push_back(rand() & 0xFF);
+
+	mpz_t m, c, mod;
+	mpz_init2(m, 1024);
+	mpz_init2(c, 1024);
+	mpz_init2(mod, 1024);
+
+	mpz_set_str(mod, LOADGEN_RSA_MODULUS, 10);
+	mpz_import(m, 128, 1, 1, 0, 0, &block[0]);
+	mpz_powm_ui(c, m, LOADGEN_RSA_EXPONENT, mod);
+
+	size_t count = (mpz_sizeinbase(c, 2) + 7) / 8;
+	memset(&block[0], 0, 128 - count);
+	mpz_export(&block[128 - count], NULL, 1, 1, 0, 0, c);
+
+	mpz_clear(m);
+	mpz_clear(c);
+	mpz_clear(mod);
+}
+
+void LoadClient::sendPacket(const ByteBuffer& body, bool encrypt)
+{
+	ByteBuffer data;
+	if(encrypt)
+	{
+		addU16(data, body.size());
+		data.insert(data.end(), body.begin(), body.end());
+		while(data.size() % 8)
+			data.push_back(0x33);
+
+		uint32_t* buffer = (uint32_t*)&data[0];
+		for(size_t i = 0; i < data.size() / 4; i += 2)
+		{
+			uint32_t v0 = buffer[i], v1 = buffer[i + 1], sum = 0;
+			for(int32_t r = 0; r < 32; ++r)
+			{
+				v0 += ((v1 << 4 ^ v1 >> 5) + v1) ^ (sum + m_key[sum & 3]);
+				sum -= 0x61C88647;
+				v1 += ((v0 << 4 ^ v0 >> 5) + v0) ^ (sum + m_key[sum >> 11 & 3]);
+			}
+
+			buffer[i] = v0;
+			buffer[i + 1] = v1;
+		}
+	}
+	else
+		data = body;
+
+	ByteBuffer packet;
+	addU16(packet, data.size() + 4);
+	addU32(packet, adlerChecksum(&data[0], data.size()));
+	packet.insert(packet.end(), data.begin(), data.end());
+
+	boost::asio::write(m_socket, boost::asio::buffer(packet));
+	m_stats.add(m_stats.bytesOut, packet.size());
+}
+
+bool LoadClient::readPacket(ByteBuffer& payload)
+{
+	boost::system::error_code error;
+	uint8_t header[2];
+	boost::asio::read(m_socket, boost::asio::buffer(header, 2), error);
+	if(error)
+		return false;
+
+	uint16_t length = header[0] | (header[1] << 8);
+	if(length < 12 || (length - 4) % 8)
+		return false;
+
+	ByteBuffer data(length);
+	boost::asio::read(m_socket, boost::asio::buffer(data), error);
+	if(error)
+		return false;
+
+	m_stats.add(m_stats.bytesIn, length + 2);
+	m_stats.add(m_stats.packetsIn);
+
+	//skip the checksum, the rest is xtea encrypted
+	uint32_t* buffer = (uint32_t*)&data[4];
+	for(size_t i = 0; i < (data.size() - 4) / 4; i += 2)
+	{
+		uint32_t v0 = buffer[i], v1 = buffer[i + 1], sum = 0xC6EF3720;
+		for(int32_t r = 0; r < 32; ++r)
+		{
+			v1 -= ((v0 << 4 ^ v0 >> 5) + v0) ^ (sum + m_key[sum >> 11 & 3]);
+			sum += 0x61C88647;
+			v0 -= ((v1 << 4 ^ v1 >> 5) + v1) ^ (sum + m_key[sum & 3]);
+		}
+
+		buffer[i] = v0;
+		buffer[i + 1] = v1;
+	}
+
+	uint16_t size = data[4] | (data[5] << 8);
+	if(size > data.size() - 6)
+		return false;
+
+	payload.assign(data.begin() + 6, data.begin() + 6 + size);
+	return !payload.empty();
+}
+
+bool LoadClient::connect(uint16_t port)
+{
+	boost::system::error_code error;
+	if(m_socket.is_open())
+		m_socket.close(error);
+
+	m_socket.connect(boost::asio::ip::tcp::endpoint(
+		boost::asio::ip::address::from_string(m_config.host), port), error);
+	return !error;
+}
+
+bool LoadClient::requestCharacter(std::string& account, std::string& character, uint16_t& port)
+{
+	char buffer[64];
+	sprintf(buffer, m_config.accountFormat.c_str(), m_index);
+	account = buffer;
+
+	if(!connect(m_config.port))
+		return false;
+
+	generateKey();
+	ByteBuffer body;
+	body.push_back(0x01);
+	addU16(body, 0x02);
+	addU16(body, CLIENT_VERSION_MIN);
+	body.insert(body.end(), 12, 0);
+
+	ByteBuffer block;
+	block.push_back(0x00);
+	for(int32_t i = 0; i < 4; ++i)
+		addU32(block, m_key[i]);
+
+	addString(block, account);
+	addString(block, m_config.password);
+	encryptRSA(block);
+
+	body.insert(body.end(), block.begin(), block.end());
+	sendPacket(body, false);
+
+	ByteBuffer payload;
+	if(!readPacket(payload))
+		return false;
+
+	size_t pos = 0;
+	while(pos < payload.size())
+	{
+		uint8_t opcode = payload[pos++];
+		if(opcode == 0x14)
+			pos += 2 + (payload[pos] | (payload[pos + 1] << 8));
+		else if(opcode == 0x64)
+		{
+			if(payload[pos++] == 0)
+				return false;
+
+			uint16_t length = payload[pos] | (payload[pos + 1] << 8);
+			character.assign((const char*)&payload[pos + 2], length);
+			pos += 2 + length;
+			//world name and ip, the game server is expected on the configured host
+			pos += 2 + (payload[pos] | (payload[pos + 1] << 8)) + 4;
+			port = payload[pos] | (payload[pos + 1] << 8);
+			return true;
+		}
+		else
+			break;
+	}
+
+	return false;
+}
+
+bool LoadClient::enterGame(const std::string& account, const std::string& character)
+{
+	generateKey();
+	ByteBuffer body;
+	body.push_back(0x0A);
+	addU16(body, 0x02);
+	addU16(body, CLIENT_VERSION_MIN);
+
+	ByteBuffer block;
+	block.push_back(0x00);
+	for(int32_t i = 0; i < 4; ++i)
+		addU32(block, m_key[i]);
+
+	block.push_back(0x00);
+	addString(block, account);
+	addString(block, character);
+	addString(block, m_config.password);
+	encryptRSA(block);
+
+	body.insert(body.end(), block.begin(), block.end());
+	sendPacket(body, false);
+
+	ByteBuffer payload;
+	while(readPacket(payload))
+	{
+		switch(payload[0])
+		{
+			case 0x0A:
+				if(payload.size() < 5)
+					return false;
+
+				m_playerId = payload[1] | (payload[2] << 8) | (payload[3] << 16) | (payload[4] << 24);
+				return true;
+
+			case 0x14: //disconnect message
+			case 0x16: //waiting list
+				return false;
+
+			default:
+				break;
+		}
+	}
+
+	return false;
+}
+
+bool LoadClient::isReply(LoadAction_t action, uint8_t opcode) const
+{
+	switch(action)
+	{
+		case LOAD_ACTION_NORTH:
+		case LOAD_ACTION_EAST:
+		case LOAD_ACTION_SOUTH:
+		case LOAD_ACTION_WEST:
+			return opcode == 0x6D || opcode == 0xB5 || opcode == 0xB4;
+
+		case LOAD_ACTION_SAY:
+			return opcode == 0xAA || opcode == 0xB4;
+
+		case LOAD_ACTION_ATTACK:
+			return opcode == 0xA3 || opcode == 0x86 || opcode == 0xB4;
+
+		case LOAD_ACTION_USE:
+			return opcode == 0x6E || opcode == 0x6F || opcode == 0x6B || opcode == 0x6C || opcode == 0x78
+				|| opcode == 0x79 || opcode == 0xB4;
+
+		default:
+			break;
+	}
+
+	return false;
+}
+
+void LoadClient::sendAction(LoadAction_t action)
+{
+	ByteBuffer body;
+	switch(action)
+	{
+		case LOAD_ACTION_NORTH:
+		case LOAD_ACTION_EAST:
+		case LOAD_ACTION_SOUTH:
+		case LOAD_ACTION_WEST:
+			body.push_back(0x65 + (action - LOAD_ACTION_NORTH));
+			break;
+
+		case LOAD_ACTION_SAY:
+			body.push_back(0x96);
+			body.push_back(0x01);
+			addString(body, m_config.text);
+			break;
+
+		case LOAD_ACTION_ATTACK:
+			body.push_back(0xA1);
+			addU32(body, m_config.attackId ? m_config.attackId : m_playerId);
+			break;
+
+		case LOAD_ACTION_USE:
+			//inventory position, the same the client sends for equipment
+			body.push_back(0x82);
+			addU16(body, 0xFFFF);
+			addU16(body, m_config.useSlot);
+			body.push_back(0x00);
+			addU16(body, m_config.useSprite);
+			body.push_back(0x00);
+			body.push_back(0x00);
+			break;
+
+		default:
+			return;
+	}
+
+	sendPacket(body, true);
+	m_stats.add(m_stats.actions);
+	if(m_pendingAction == LOAD_ACTION_LAST)
+	{
+		m_pendingAction = action;
+		m_pendingSince = OTSYS_TIME_MICRO();
+	}
+}
+
+void LoadClient::run(int64_t deadline)
+{
+	std::string account, character;
+	uint16_t port = m_config.port;
+	if(m_config.handshakes)
+	{
+		//login storm, only the login server handshake is repeated
+		boost::system::error_code error;
+		while(OTSYS_TIME() < deadline)
+		{
+			try
+			{
+				if(requestCharacter(account, character, port))
+					m_stats.add(m_stats.handshakes);
+				else
+					m_stats.add(m_stats.loginFailures);
+			}
+			catch(boost::system::system_error&)
+			{
+				m_stats.add(m_stats.loginFailures);
+			}
+
+			m_socket.close(error);
+		}
+
+		return;
+	}
+
+	try
+	{
+		if(!requestCharacter(account, character, port) || !connect(port) || !enterGame(account, character))
+		{
+			m_stats.add(m_stats.loginFailures);
+			return;
+		}
+	}
+	catch(boost::system::system_error&)
+	{
+		m_stats.add(m_stats.loginFailures);
+		return;
+	}
+
+	m_stats.add(m_stats.logins);
+	m_stats.add(m_stats.online);
+
+	bool disconnected = false;
+	int64_t nextAction = OTSYS_TIME() + m_config.interval;
+	try
+	{
+		ByteBuffer payload;
+		while(OTSYS_TIME() < deadline)
+		{
+			if(m_socket.available())
+			{
+				if(!readPacket(payload))
+				{
+					disconnected = true;
+					break;
+				}
+
+				uint8_t opcode = payload[0];
+				if(opcode == 0x14)
+				{
+					disconnected = true;
+					break;
+				}
+
+				if(opcode == 0x1E)
+				{
+					ByteBuffer pong(1, 0x1E);
+					sendPacket(pong, true);
+				}
+
+				if(m_pendingAction != LOAD_ACTION_LAST && isReply(m_pendingAction, opcode))
+				{
+					m_stats.addLatency(OTSYS_TIME_MICRO() - m_pendingSince);
+					m_pendingAction = LOAD_ACTION_LAST;
+				}
+
+				continue;
+			}
+
+			if(m_pendingAction != LOAD_ACTION_LAST && OTSYS_TIME_MICRO() - m_pendingSince > LOADGEN_REPLY_TIMEOUT * 1000)
+			{
+				m_stats.add(m_stats.unanswered);
+				m_pendingAction = LOAD_ACTION_LAST;
+			}
+
+			int64_t now = OTSYS_TIME();
+			if(now >= nextAction && !m_config.script.empty())
+			{
+				sendAction(m_config.script[m_step++ % m_config.script.size()]);
+				nextAction = now + m_config.interval;
+			}
+			else
+				boost::this_thread::sleep(boost::posix_time::milliseconds(1));
+		}
+	}
+	catch(boost::system::system_error&)
+	{
+		disconnected = true;
+	}
+
+	if(disconnected)
+		m_stats.add(m_stats.disconnects);
+
+	m_stats.add(m_stats.online, -1);
+	if(!disconnected)
+	{
+		//logout
+		ByteBuffer body(1, 0x14);
+		boost::system::error_code error;
+		try
+		{
+			sendPacket(body, true);
+		}
+		catch(boost::system::system_error&) {}
+		m_socket.close(error);
+	}
+}
+
+bool parseScript(const std::string& script, std::vector<LoadAction_t>& actions)
+{
+	std::stringstream ss(script);
+	std::string step;
+	while(std::getline(ss, step, ','))
+	{
+		if(step == "north")
+			actions.push_back(LOAD_ACTION_NORTH);
+		else if(step == "east")
+			actions.push_back(LOAD_ACTION_EAST);
+		else if(step == "south")
+			actions.push_back(LOAD_ACTION_SOUTH);
+		else if(step == "west")
+			actions.push_back(LOAD_ACTION_WEST);
+		else if(step == "say")
+			actions.push_back(LOAD_ACTION_SAY);
+		else if(step == "attack")
+			actions.push_back(LOAD_ACTION_ATTACK);
+		else if(step == "use")
+			actions.push_back(LOAD_ACTION_USE);
+		else if(step == "idle")
+			actions.push_back(LOAD_ACTION_IDLE);
+		else
+		{
+			std::cout << "Unknown script step: " << step << std::endl;
+			return false;
+		}
+	}
+
+	return !actions.empty();
+}
+
+void printUsage(const char* name)
+{
+	std::cout << "Usage: " << name << " [options]" << std::endl;
+	std::cout << "\t--host=127.0.0.1\tserver address" << std::endl;
+	std::cout << "\t--port=7171\t\tlogin port" << std::endl;
+	std::cout << "\t--clients=10\t\tnumber of synthetic clients" << std::endl;
+	std::cout << "\t--account=loadgen%d\taccount name, %d is replaced by the client index" << std::endl;
+	std::cout << "\t--password=loadgen\tpassword of every account" << std::endl;
+	std::cout << "\t--script=north,east,south,west,say\tsteps repeated by every client" << std::endl;
+	std::cout << "\t\t(north, east, south, west, say, attack, use, idle)" << std::endl;
+	std::cout << "\t--interval=500\t\tmilliseconds between steps" << std::endl;
+	std::cout << "\t--duration=60\t\tseconds to run" << std::endl;
+	std::cout << "\t--rampup=50\t\tmilliseconds between client logins" << std::endl;
+	std::cout << "\t--text=\"load test\"\ttext spoken by the say step" << std::endl;
+	std::cout << "\t--attack=0\t\tcreature id to attack, 0 attacks itself" << std::endl;
+	std::cout << "\t--useslot=3\t\tinventory slot used by the use step" << std::endl;
+	std::cout << "\t--usesprite=0\t\tclient id of the item in that slot" << std::endl;
+	std::cout << "\t--handshakes\t\tonly repeat the login handshake, measures a login storm" << std::endl;
+}
+
+int main(int argc, char* argv[])
+{
+	LoadConfig config;
+	std::string script = "north,east,south,west,say";
+	for(int32_t i = 1; i < argc; ++i)
+	{
+		std::string arg = argv[i], value;
+		std::string::size_type pos = arg.find('=');
+		if(pos != std::string::npos)
+		{
+			value = arg.substr(pos + 1);
+			arg = arg.substr(0, pos);
+		}
+
+		if(arg == "--host")
+			config.host = value;
+		else if(arg == "--port")
+			config.port = atoi(value.c_str());
+		else if(arg == "--clients")
+			config.clients = atoi(value.c_str());
+		else if(arg == "--account")
+			config.accountFormat = value;
+		else if(arg == "--password")
+			config.password = value;
+		else if(arg == "--script")
+			script = value;
+		else if(arg == "--interval")
+			config.interval = std::max(1, atoi(value.c_str()));
+		else if(arg == "--duration")
+			config.duration = atoi(value.c_str());
+		else if(arg == "--rampup")
+			config.rampUp = atoi(value.c_str());
+		else if(arg == "--text")
+			config.text = value;
+		else if(arg == "--attack")
+			config.attackId = strtoul(value.c_str(), NULL, 10);
+		else if(arg == "--useslot")
+			config.useSlot = atoi(value.c_str());
+		else if(arg == "--usesprite")
+			config.useSprite = atoi(value.c_str());
+		else if(arg == "--handshakes")
+			config.handshakes = true;
+		else
+		{
+			printUsage(argv[0]);
+			return 1;
+		}
+	}
+
+	if(!parseScript(script, config.script) || config.clients < 1)
+	{
+		printUsage(argv[0]);
+		return 1;
+	}
+
+	srand((uint32_t)OTSYS_TIME());
+	std::cout << "Starting " << config.clients << " clients against " << config.host << ":" << config.port
+		<< " for " << config.duration << " seconds" << std::endl;
+
+	boost::asio::io_service service;
+	LoadStats stats;
+
+	int64_t start = OTSYS_TIME(), deadline = start + (int64_t)config.rampUp * config.clients + config.duration * 1000;
+	std::vector<LoadClient*> clients;
+	boost::thread_group threads;
+	for(int32_t i = 1; i <= config.clients; ++i)
+	{
+		LoadClient* client = new LoadClient(service, config, stats, i);
+		clients.push_back(client);
+		threads.create_thread(boost::bind(&LoadClient::run, client, deadline));
+		if(config.rampUp > 0)
+			boost::this_thread::sleep(boost::posix_time::milliseconds(config.rampUp));
+	}
+
+	int64_t nextReport = OTSYS_TIME() + LOADGEN_REPORT_INTERVAL;
+	while(OTSYS_TIME() < deadline)
+	{
+		boost::this_thread::sleep(boost::posix_time::milliseconds(100));
+		if(OTSYS_TIME() >= nextReport)
+		{
+			stats.print(OTSYS_TIME() - start, false);
+			nextReport += LOADGEN_REPORT_INTERVAL;
+		}
+	}
+
+	threads.join_all();
+	stats.print(OTSYS_TIME() - start, true);
+	for(std::vector<LoadClient*>::iterator it = clients.begin(); it != clients.end(); ++it)
+		delete *it;
+
+	return 0;
+}
@@ -42,6 +42,7 @@
 #include "teleport.h"
 #include "ioban.h"
 #include "raids.h"
+#include "metrics.h"
 
 extern Game g_game;
 extern Monsters g_monsters;
@@ -148,12 +149,13 @@ bool ScriptEnviroment::loadGameState()
 
 	DBQuery query;
 	query << "SELECT `key`, `value` FROM `global_storage` WHERE `world_id` = " << g_config.getNumber(ConfigManager::WORLD_ID);
-	if((result = db->storeQuery(query.str())))
+	if((result = db->streamQuery(query.str())))
 	{
+		int32_t keyColumn = result->getColumn("key"), valueColumn = result->getColumn("value");
 		do
 		{
-			int32_t key = result->getDataInt("key");
-			std::string value = result->getDataString("value");
+			int32_t key = result->getDataInt(keyColumn);
+			std::string value = result->getDataString(valueColumn);
 
 			m_globalStorageMap[key] = value;
 		}
@@ -811,7 +813,9 @@ int32_t LuaScriptInterface::callFunction(uint32_t nParams)
 	lua_pushcfunction(m_luaState, luaErrorHandler);
 	lua_insert(m_luaState, error_index);
 
+	int64_t start = OTSYS_TIME_MICRO();
 	int32_t ret = lua_pcall(m_luaState, nParams, 1, error_index);
+	Metrics::getInstance()->observe(METRIC_LUA_CALL, OTSYS_TIME_MICRO() - start);
 	if(ret != 0)
 	{
 		LuaScriptInterface::reportError(NULL, std::string(LuaScriptInterface::popString(m_luaState)));
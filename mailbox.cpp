@@ -135,6 +135,12 @@ bool Mailbox::sendItem(Creature* actor, Item* item)
 			}
 		}
 	}
+	else if(IOLoginData::getInstance()->sendMail(guid, dp, item, item->getID() + 1))
+	{
+		//stored for the next login, the receiver is not loaded
+		g_game.internalRemoveItem(actor, item, -1, false, FLAG_NOLIMIT);
+		return true;
+	}
 	else if(IOLoginData::getInstance()->playerExists(receiver))
 	{
 		Player* player = new Player(receiver, NULL);
@@ -49,6 +49,7 @@ Map::Map()
 {
 	mapWidth = 0;
 	mapHeight = 0;
+	tileCount = floorCount = leafCount = 0;
 }
 
 Map::~Map()
@@ -147,6 +148,7 @@ void Map::setTile(uint16_t x, uint16_t y, uint8_t z, Tile* newTile)
 	QTreeLeafNode* leaf = root.createLeaf(x, y, 15);
 	if(QTreeLeafNode::newLeaf)
 	{
+		leafCount++;
 		//update north
 		QTreeLeafNode* northLeaf = root.getLeaf(x, y - FLOOR_SIZE);
 		if(northLeaf)
@@ -168,11 +170,15 @@ void Map::setTile(uint16_t x, uint16_t y, uint8_t z, Tile* newTile)
 			leaf->m_leafE = eastLeaf;
 	}
 
+	if(!leaf->m_array[z])
+		floorCount++;
+
 	Floor* floor = leaf->createFloor(z);
 	uint32_t offsetX = x & FLOOR_MASK;
 	uint32_t offsetY = y & FLOOR_MASK;
 	if(!floor->tiles[offsetX][offsetY])
 	{
+		tileCount++;
 		floor->tiles[offsetX][offsetY] = newTile;
 		newTile->qt_node = leaf;
 	}
@@ -257,11 +257,20 @@ class Map
 			const FrozenPathingConditionCall& pathCondition, const FindPathParams& fpp);
 
 		QTreeLeafNode* getLeaf(uint16_t x, uint16_t y) {return root.getLeaf(x, y);}
+
+		uint32_t getTileCount() const {return tileCount;}
+		//tiles and the tree holding them, items are not included
+		uint64_t getMemoryUsage() const
+		{
+			return (uint64_t)tileCount * sizeof(Tile) + (uint64_t)floorCount * sizeof(Floor)
+				+ (uint64_t)leafCount * sizeof(QTreeLeafNode);
+		}
 		const Tile* canWalkTo(const Creature* creature, const Position& pos);
 		Waypoints waypoints;
 
 	protected:
 		uint32_t mapWidth, mapHeight;
+		uint32_t tileCount, floorCount, leafCount;
 		std::string spawnfile, housefile;
 		StringVec descriptions;
 		QTreeNode root;
@@ -0,0 +1,236 @@
+//////////////////////////////////////////////////////////////////////
+// OpenTibia - an opensource roleplaying game
+//////////////////////////////////////////////////////////////////////
+// Runtime counters exported through the http protocol
+//////////////////////////////////////////////////////////////////////
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software Foundation,
+// Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+//////////////////////////////////////////////////////////////////////
+#include "otpch.h"
+
+#include "metrics.h"
+#include "game.h"
+#include "map.h"
+#include "outputmessage.h"
+#include "rsa.h"
+#include "databasetasks.h"
+#include "iologindata.h"
+#include "scheduler.h"
+
+#include <sstream>
+
+extern Game g_game;
+
+static const int64_t metricBucketBounds[METRIC_BUCKETS] = METRIC_BUCKET_BOUNDS;
+static const char* metricHistogramNames[METRIC_LAST] =
+{
+	"tfs_dispatcher_task_wait_seconds",
+	"tfs_dispatcher_task_seconds",
+	"tfs_database_query_seconds",
+	"tfs_lua_call_seconds",
+	"tfs_database_task_wait_seconds"
+};
+
+Metrics::Metrics()
+{
+	OTSYS_THREAD_LOCKVARINIT(m_metricsLock);
+	for(int32_t i = 0; i < METRIC_LAST; ++i)
+	{
+		for(int32_t bucket = 0; bucket <= METRIC_BUCKETS; ++bucket)
+			m_histograms[i].buckets[bucket].store(0, boost::memory_order_relaxed);
+
+		m_histograms[i].sum.store(0, boost::memory_order_relaxed);
+	}
+
+	for(int32_t i = 0; i < METRIC_COUNTER_LAST; ++i)
+		m_counters[i].store(0, boost::memory_order_relaxed);
+
+	m_playersOnline = m_monstersOnline = m_npcsOnline = 0;
+	m_mapTiles = m_mapMemory = 0;
+}
+
+void Metrics::observe(MetricHistogram_t histogram, int64_t micros)
+{
+	if(micros < 0)
+		micros = 0;
+
+	int32_t bucket = 0;
+	while(bucket < METRIC_BUCKETS && micros > metricBucketBounds[bucket])
+		bucket++;
+
+	MetricHistogram& h = m_histograms[histogram];
+	h.buckets[bucket].fetch_add(1, boost::memory_order_relaxed);
+	h.sum.fetch_add(micros, boost::memory_order_relaxed);
+}
+
+void Metrics::addConnection(int32_t protocolId)
+{
+	OTSYS_THREAD_LOCK_CLASS lockClass(m_metricsLock);
+	m_connections[protocolId]++;
+}
+
+void Metrics::removeConnection(int32_t protocolId)
+{
+	OTSYS_THREAD_LOCK_CLASS lockClass(m_metricsLock);
+	m_connections[protocolId]--;
+}
+
+void Metrics::addCounter(MetricCounter_t counter, int64_t value)
+{
+	m_counters[counter].fetch_add(value, boost::memory_order_relaxed);
+}
+
+void Metrics::updateGauges()
+{
+	uint32_t playersOnline = g_game.getPlayersOnline(), monstersOnline = g_game.getMonstersOnline(),
+		npcsOnline = g_game.getNpcsOnline();
+
+	uint64_t mapTiles = 0, mapMemory = 0;
+	if(const Map* map = g_game.getMap())
+	{
+		mapTiles = map->getTileCount();
+		mapMemory = map->getMemoryUsage();
+	}
+
+	{
+		OTSYS_THREAD_LOCK_CLASS lockClass(m_metricsLock);
+		m_playersOnline = playersOnline;
+		m_monstersOnline = monstersOnline;
+		m_npcsOnline = npcsOnline;
+		m_mapTiles = mapTiles;
+		m_mapMemory = mapMemory;
+	}
+
+	Scheduler::getScheduler().addEvent(createSchedulerTask(METRIC_GAUGE_INTERVAL,
+		boost::bind(&Metrics::updateGauges, this)));
+}
+
+std::string Metrics::getText()
+{
+	std::stringstream text;
+	text << "# TYPE tfs_dispatcher_tasks gauge\n";
+	text << "tfs_dispatcher_tasks " << Dispatcher::getDispatcher().getTaskCount() << "\n";
+	text << "# TYPE tfs_scheduler_events gauge\n";
+	text << "tfs_scheduler_events " << Scheduler::getScheduler().getEventCount() << "\n";
+	text << "# TYPE tfs_database_tasks gauge\n";
+	text << "tfs_database_tasks " << DatabaseTasks::getInstance()->getTaskCount() << "\n";
+	text << "# TYPE tfs_player_saves gauge\n";
+	text << "tfs_player_saves " << IOLoginData::getInstance()->getPendingSaveCount() << "\n";
+	text << "# TYPE tfs_rsa_jobs gauge\n";
+	text << "tfs_rsa_jobs " << RSAPool::getInstance()->getJobCount() << "\n";
+	text << "# TYPE tfs_name_cache_entries gauge\n";
+	text << "tfs_name_cache_entries " << IOLoginData::getInstance()->getNameCacheSize() << "\n";
+
+	OutputMessagePool* pool = OutputMessagePool::getInstance();
+	text << "# TYPE tfs_output_buffers gauge\n";
+	for(uint32_t i = OUTPUT_BUFFER_CLASS_SMALL; i < OUTPUT_BUFFER_CLASS_LAST; ++i)
+	{
+		OutputBufferClass_t bufferClass = (OutputBufferClass_t)i;
+		text << "tfs_output_buffers{size=\"" << OutputMessagePool::getBufferSize(bufferClass) << "\",state=\"used\"} "
+			<< pool->getUsedBufferCount(bufferClass) << "\n";
+		text << "tfs_output_buffers{size=\"" << OutputMessagePool::getBufferSize(bufferClass) << "\",state=\"allocated\"} "
+			<< pool->getBufferCount(bufferClass) << "\n";
+	}
+
+	text << "# TYPE tfs_output_buffer_bytes gauge\n";
+	text << "tfs_output_buffer_bytes " << pool->getBufferMemory() << "\n";
+
+	//copied under the lock, formatted after it is released
+	ConnectionCountMap connections;
+	uint32_t playersOnline, monstersOnline, npcsOnline;
+	uint64_t mapTiles, mapMemory;
+	{
+		OTSYS_THREAD_LOCK_CLASS lockClass(m_metricsLock);
+		connections = m_connections;
+		playersOnline = m_playersOnline;
+		monstersOnline = m_monstersOnline;
+		npcsOnline = m_npcsOnline;
+		mapTiles = m_mapTiles;
+		mapMemory = m_mapMemory;
+	}
+
+	text << "# TYPE tfs_players_online gauge\n";
+	text << "tfs_players_online " << playersOnline << "\n";
+	text << "# TYPE tfs_monsters_online gauge\n";
+	text << "tfs_monsters_online " << monstersOnline << "\n";
+	text << "# TYPE tfs_npcs_online gauge\n";
+	text << "tfs_npcs_online " << npcsOnline << "\n";
+	text << "# TYPE tfs_map_tiles gauge\n";
+	text << "tfs_map_tiles " << mapTiles << "\n";
+	text << "# TYPE tfs_map_memory_bytes gauge\n";
+	text << "tfs_map_memory_bytes " << mapMemory << "\n";
+
+	text << "# TYPE tfs_database_queries_inflight gauge\n";
+	text << "tfs_database_queries_inflight " << m_counters[METRIC_DB_INFLIGHT].load(boost::memory_order_relaxed) << "\n";
+	text << "# TYPE tfs_database_reconnects_total counter\n";
+	text << "tfs_database_reconnects_total " << m_counters[METRIC_DB_RECONNECTS].load(boost::memory_order_relaxed) << "\n";
+	text << "# TYPE tfs_player_save_statements_total counter\n";
+	text << "tfs_player_save_statements_total " << m_counters[METRIC_SAVE_STATEMENTS].load(boost::memory_order_relaxed) << "\n";
+	text << "# TYPE tfs_player_save_bytes_total counter\n";
+	text << "tfs_player_save_bytes_total " << m_counters[METRIC_SAVE_BYTES].load(boost::memory_order_relaxed) << "\n";
+	text << "# TYPE tfs_name_cache_hits_total counter\n";
+	text << "tfs_name_cache_hits_total " << m_counters[METRIC_NAME_CACHE_HITS].load(boost::memory_order_relaxed) << "\n";
+	text << "# TYPE tfs_name_cache_misses_total counter\n";
+	text << "tfs_name_cache_misses_total " << m_counters[METRIC_NAME_CACHE_MISSES].load(boost::memory_order_relaxed) << "\n";
+
+	text << "# TYPE tfs_connections gauge\n";
+	for(ConnectionCountMap::const_iterator it = connections.begin(); it != connections.end(); ++it)
+	{
+		std::string protocol;
+		switch(it->first)
+		{
+			case 0x01:
+				protocol = "login";
+				break;
+			case 0x0A:
+				protocol = "game";
+				break;
+			case 0xFE:
+				protocol = "admin";
+				break;
+			case 0xFF:
+				protocol = "status";
+				break;
+			case 'G':
+				protocol = "http";
+				break;
+			default:
+				protocol = "old";
+				break;
+		}
+
+		text << "tfs_connections{protocol=\"" << protocol << "\"} " << it->second << "\n";
+	}
+
+	for(int32_t i = 0; i < METRIC_LAST; ++i)
+	{
+		const MetricHistogram& h = m_histograms[i];
+		const std::string name = metricHistogramNames[i];
+		text << "# TYPE " << name << " histogram\n";
+
+		uint64_t count = 0;
+		for(int32_t bucket = 0; bucket < METRIC_BUCKETS; ++bucket)
+		{
+			count += h.buckets[bucket].load(boost::memory_order_relaxed);
+			text << name << "_bucket{le=\"" << metricBucketBounds[bucket] / 1000000. << "\"} " << count << "\n";
+		}
+
+		count += h.buckets[METRIC_BUCKETS].load(boost::memory_order_relaxed);
+		text << name << "_bucket{le=\"+Inf\"} " << count << "\n";
+		text << name << "_sum " << h.sum.load(boost::memory_order_relaxed) / 1000000. << "\n";
+		text << name << "_count " << count << "\n";
+	}
+
+	return text.str();
+}
@@ -0,0 +1,142 @@
+//////////////////////////////////////////////////////////////////////
+// OpenTibia - an opensource roleplaying game
+//////////////////////////////////////////////////////////////////////
+// Runtime counters exported through the http protocol
+//////////////////////////////////////////////////////////////////////
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software Foundation,
+// Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+//////////////////////////////////////////////////////////////////////
+
+#ifndef __OTSERV_METRICS_H__
+#define __OTSERV_METRICS_H__
+
+#include "otsystem.h"
+#include <string>
+#include <map>
+
+#include <boost/atomic.hpp>
+
+//upper bounds of the histogram buckets, in microseconds
+#define METRIC_BUCKETS 8
+#define METRIC_BUCKET_BOUNDS {100, 500, 1000, 5000, 10000, 50000, 100000, 1000000}
+//how often the dispatcher samples the game state gauges, in milliseconds
+#define METRIC_GAUGE_INTERVAL 1000
+
+enum MetricHistogram_t
+{
+	METRIC_TASK_WAIT = 0,
+	METRIC_TASK_EXECUTION,
+	METRIC_DB_QUERY,
+	METRIC_LUA_CALL,
+	METRIC_DB_WAIT,
+	METRIC_LAST /* this must be the last one */
+};
+
+enum MetricCounter_t
+{
+	METRIC_DB_INFLIGHT = 0,
+	METRIC_DB_RECONNECTS,
+	METRIC_SAVE_STATEMENTS,
+	METRIC_SAVE_BYTES,
+	METRIC_NAME_CACHE_HITS,
+	METRIC_NAME_CACHE_MISSES,
+	METRIC_COUNTER_LAST /* this must be the last one */
+};
+
+//updated without a lock by every thread, the count is the sum of the buckets
+struct MetricHistogram
+{
+	boost::atomic<uint64_t> buckets[METRIC_BUCKETS + 1];
+	boost::atomic<uint64_t> sum;
+};
+
+class Metrics
+{
+	public:
+		virtual ~Metrics()
+		{
+			OTSYS_THREAD_LOCKVARRELEASE(m_metricsLock);
+		}
+
+		static Metrics* getInstance()
+		{
+			static Metrics instance;
+			return &instance;
+		}
+
+		//any thread
+		void observe(MetricHistogram_t histogram, int64_t micros);
+		void addConnection(int32_t protocolId);
+		void removeConnection(int32_t protocolId);
+		void addCounter(MetricCounter_t counter, int64_t value);
+
+		//dispatcher thread, reschedules itself
+		void updateGauges();
+
+		//network thread, plain text exposition format
+		std::string getText();
+
+	protected:
+		Metrics();
+
+		MetricHistogram m_histograms[METRIC_LAST];
+		boost::atomic<int64_t> m_counters[METRIC_COUNTER_LAST];
+
+		//the connections and gauges below are guarded by the lock
+		typedef std::map<int32_t, int32_t> ConnectionCountMap;
+		ConnectionCountMap m_connections;
+
+		//copied from the game state by updateGauges
+		uint32_t m_playersOnline, m_monstersOnline, m_npcsOnline;
+		uint64_t m_mapTiles, m_mapMemory;
+
+		OTSYS_THREAD_LOCKVAR m_metricsLock;
+};
+
+//measures the lifetime of the object into a histogram
+class MetricTimer
+{
+	public:
+		MetricTimer(MetricHistogram_t histogram)
+		{
+			m_histogram = histogram;
+			m_start = OTSYS_TIME_MICRO();
+		}
+
+		~MetricTimer()
+		{
+			Metrics::getInstance()->observe(m_histogram, OTSYS_TIME_MICRO() - m_start);
+		}
+
+	protected:
+		MetricHistogram_t m_histogram;
+		int64_t m_start;
+};
+
+//database query timer, also counts the queries being executed
+class QueryTimer : public MetricTimer
+{
+	public:
+		QueryTimer(): MetricTimer(METRIC_DB_QUERY)
+		{
+			Metrics::getInstance()->addCounter(METRIC_DB_INFLIGHT, 1);
+		}
+
+		~QueryTimer()
+		{
+			Metrics::getInstance()->addCounter(METRIC_DB_INFLIGHT, -1);
+		}
+};
+
+#endif
@@ -0,0 +1,205 @@
+//////////////////////////////////////////////////////////////////////
+// OpenTibia - an opensource roleplaying game
+//////////////////////////////////////////////////////////////////////
+// Bounded cache of player names and guids
+//////////////////////////////////////////////////////////////////////
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software Foundation,
+// Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+//////////////////////////////////////////////////////////////////////
+#include "otpch.h"
+
+#include "namecache.h"
+#include "metrics.h"
+#include "tools.h"
+
+PlayerNameCache::PlayerNameCache()
+{
+	OTSYS_THREAD_LOCKVARINIT(m_cacheLock);
+	m_capacity = m_size = m_generation = 0;
+}
+
+PlayerNameCache::~PlayerNameCache()
+{
+	OTSYS_THREAD_LOCKVARRELEASE(m_cacheLock);
+}
+
+void PlayerNameCache::setCapacity(uint32_t capacity)
+{
+	OTSYS_THREAD_LOCK_CLASS lockClass(m_cacheLock);
+	m_capacity = capacity;
+	while(m_size > m_capacity)
+		erase(--m_entries.end());
+}
+
+bool PlayerNameCache::getByGuid(uint32_t guid, PlayerNameEntry& entry, bool& found)
+{
+	OTSYS_THREAD_LOCK_CLASS lockClass(m_cacheLock);
+	GuidMap::iterator it = m_guids.find(guid);
+	if(it != m_guids.end())
+		return find(it->second, entry, found);
+
+	Metrics::getInstance()->addCounter(METRIC_NAME_CACHE_MISSES, 1);
+	return false;
+}
+
+bool PlayerNameCache::getByName(const std::string& name, PlayerNameEntry& entry, bool& found)
+{
+	OTSYS_THREAD_LOCK_CLASS lockClass(m_cacheLock);
+	NameMap::iterator it = m_names.find(asLowerCaseString(name));
+	if(it != m_names.end())
+		return find(it->second, entry, found);
+
+	Metrics::getInstance()->addCounter(METRIC_NAME_CACHE_MISSES, 1);
+	return false;
+}
+
+uint32_t PlayerNameCache::getGeneration()
+{
+	OTSYS_THREAD_LOCK_CLASS lockClass(m_cacheLock);
+	return m_generation;
+}
+
+void PlayerNameCache::add(const PlayerNameEntry& entry, uint32_t generation)
+{
+	CacheEntry cacheEntry;
+	cacheEntry.player = entry;
+	cacheEntry.missing = false;
+	cacheEntry.expires = time(NULL) + NAME_CACHE_TTL;
+	cacheEntry.key = asLowerCaseString(entry.name);
+
+	OTSYS_THREAD_LOCK_CLASS lockClass(m_cacheLock);
+	insert(cacheEntry, entry.guid, cacheEntry.key, generation);
+}
+
+void PlayerNameCache::addMissingGuid(uint32_t guid, uint32_t generation)
+{
+	CacheEntry cacheEntry;
+	cacheEntry.player.guid = guid;
+	cacheEntry.player.worldId = cacheEntry.player.groupId = 0;
+	cacheEntry.missing = true;
+	cacheEntry.expires = time(NULL) + NAME_CACHE_NEGATIVE_TTL;
+
+	OTSYS_THREAD_LOCK_CLASS lockClass(m_cacheLock);
+	insert(cacheEntry, guid, "", generation);
+}
+
+void PlayerNameCache::addMissingName(const std::string& name, uint32_t generation)
+{
+	CacheEntry cacheEntry;
+	cacheEntry.player.guid = cacheEntry.player.worldId = cacheEntry.player.groupId = 0;
+	cacheEntry.missing = true;
+	cacheEntry.expires = time(NULL) + NAME_CACHE_NEGATIVE_TTL;
+	cacheEntry.key = asLowerCaseString(name);
+
+	OTSYS_THREAD_LOCK_CLASS lockClass(m_cacheLock);
+	insert(cacheEntry, 0, cacheEntry.key, generation);
+}
+
+void PlayerNameCache::removeGuid(uint32_t guid)
+{
+	OTSYS_THREAD_LOCK_CLASS lockClass(m_cacheLock);
+	m_generation++;
+
+	GuidMap::iterator it = m_guids.find(guid);
+	if(it != m_guids.end())
+		erase(it->second);
+}
+
+void PlayerNameCache::removeName(const std::string& name)
+{
+	OTSYS_THREAD_LOCK_CLASS lockClass(m_cacheLock);
+	m_generation++;
+
+	NameMap::iterator it = m_names.find(asLowerCaseString(name));
+	if(it != m_names.end())
+		erase(it->second);
+}
+
+uint32_t PlayerNameCache::getSize()
+{
+	OTSYS_THREAD_LOCK_CLASS lockClass(m_cacheLock);
+	return m_size;
+}
+
+bool PlayerNameCache::find(EntryList::iterator it, PlayerNameEntry& entry, bool& found)
+{
+	if(it->expires <= time(NULL))
+	{
+		erase(it);
+		Metrics::getInstance()->addCounter(METRIC_NAME_CACHE_MISSES, 1);
+		return false;
+	}
+
+	//moves to the front, list iterators stay valid
+	m_entries.splice(m_entries.begin(), m_entries, it);
+	found = !it->missing;
+	if(found)
+		entry = it->player;
+
+	Metrics::getInstance()->addCounter(METRIC_NAME_CACHE_HITS, 1);
+	return true;
+}
+
+void PlayerNameCache::insert(const CacheEntry& entry, uint32_t guid, const std::string& name, uint32_t generation)
+{
+	//read from the database before a character changed, it may be outdated
+	if(!m_capacity || generation != m_generation)
+		return;
+
+	//whatever was cached for the same guid or name is outdated now
+	if(guid)
+	{
+		GuidMap::iterator it = m_guids.find(guid);
+		if(it != m_guids.end())
+			erase(it->second);
+	}
+
+	if(!name.empty())
+	{
+		NameMap::iterator it = m_names.find(name);
+		if(it != m_names.end())
+			erase(it->second);
+	}
+
+	m_entries.push_front(entry);
+	m_size++;
+	if(guid)
+		m_guids[guid] = m_entries.begin();
+
+	if(!name.empty())
+		m_names[name] = m_entries.begin();
+
+	while(m_size > m_capacity)
+		erase(--m_entries.end());
+}
+
+void PlayerNameCache::erase(EntryList::iterator it)
+{
+	if(it->player.guid)
+	{
+		GuidMap::iterator git = m_guids.find(it->player.guid);
+		if(git != m_guids.end() && git->second == it)
+			m_guids.erase(git);
+	}
+
+	if(!it->key.empty())
+	{
+		NameMap::iterator nit = m_names.find(it->key);
+		if(nit != m_names.end() && nit->second == it)
+			m_names.erase(nit);
+	}
+
+	m_entries.erase(it);
+	m_size--;
+}
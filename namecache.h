@@ -0,0 +1,93 @@
+//////////////////////////////////////////////////////////////////////
+// OpenTibia - an opensource roleplaying game
+//////////////////////////////////////////////////////////////////////
+// Bounded cache of player names and guids
+//////////////////////////////////////////////////////////////////////
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software Foundation,
+// Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+//////////////////////////////////////////////////////////////////////
+
+#ifndef __OTSERV_NAMECACHE_H__
+#define __OTSERV_NAMECACHE_H__
+
+#include "otsystem.h"
+#include <string>
+#include <list>
+#include <map>
+
+//seconds a name or guid that was not found is remembered, characters are also created outside of the server
+#define NAME_CACHE_NEGATIVE_TTL 60
+//seconds a found player is trusted, characters are also renamed and deleted outside of the server
+#define NAME_CACHE_TTL 300
+
+struct PlayerNameEntry
+{
+	uint32_t guid, worldId, groupId;
+	std::string name;
+};
+
+//least recently used players, any thread
+class PlayerNameCache
+{
+	public:
+		PlayerNameCache();
+		virtual ~PlayerNameCache();
+
+		void setCapacity(uint32_t capacity);
+
+		//false on a miss, on a cached miss found is set to false too
+		bool getByGuid(uint32_t guid, PlayerNameEntry& entry, bool& found);
+		bool getByName(const std::string& name, PlayerNameEntry& entry, bool& found);
+
+		//read before the database is queried, a fill is dropped if anything was removed since
+		uint32_t getGeneration();
+
+		void add(const PlayerNameEntry& entry, uint32_t generation);
+		void addMissingGuid(uint32_t guid, uint32_t generation);
+		void addMissingName(const std::string& name, uint32_t generation);
+
+		//renamed, deleted or created characters
+		void removeGuid(uint32_t guid);
+		void removeName(const std::string& name);
+
+		uint32_t getSize();
+
+	protected:
+		struct CacheEntry
+		{
+			PlayerNameEntry player;
+			//misses have no player but the key they were looked up by, every entry stops counting at expires
+			bool missing;
+			time_t expires;
+			std::string key;
+		};
+
+		typedef std::list<CacheEntry> EntryList;
+		typedef std::map<uint32_t, EntryList::iterator> GuidMap;
+		typedef std::map<std::string, EntryList::iterator> NameMap;
+
+		bool find(EntryList::iterator it, PlayerNameEntry& entry, bool& found);
+		void insert(const CacheEntry& entry, uint32_t guid, const std::string& name, uint32_t generation);
+		void erase(EntryList::iterator it);
+
+		//most recently used first
+		EntryList m_entries;
+		GuidMap m_guids;
+		NameMap m_names;
+		uint32_t m_capacity, m_size, m_generation;
+
+		OTSYS_THREAD_LOCKVAR m_cacheLock;
+};
+
+#endif
@@ -38,10 +38,24 @@ class NetworkMessage
 		enum {max_body_length = NETWORKMESSAGE_MAXSIZE - header_length};
 
 		// constructor/destructor
-		NetworkMessage() {Reset();}
-		virtual ~NetworkMessage(){}
+		NetworkMessage()
+		{
+			m_MsgBuf = new uint8_t[NETWORKMESSAGE_MAXSIZE];
+			m_bufferSize = NETWORKMESSAGE_MAXSIZE;
+			Reset();
+		}
+		virtual ~NetworkMessage() {delete[] m_MsgBuf;}
 
 	protected:
+		// for messages which manage their buffer on their own
+		NetworkMessage(uint8_t* buffer, int32_t size)
+		{
+			m_MsgBuf = buffer;
+			m_bufferSize = size;
+			Reset();
+		}
+
+
 		// resets the internal buffer to an empty message
 		void Reset()
 		{
@@ -137,13 +151,50 @@ class NetworkMessage
 	protected:
 		inline bool canAdd(int32_t size)
 		{
-			return (size + m_ReadPos < NETWORKMESSAGE_MAXSIZE - 16);
+			return (size + m_ReadPos < m_bufferSize - 16) || grow(size + m_ReadPos + 16);
 		};
 
+		// asks for a buffer bigger than required bytes, keeping the content
+		virtual bool grow(int32_t required) {return false;}
+
 		int32_t m_MsgSize;
 		int32_t m_ReadPos;
 
-		uint8_t m_MsgBuf[NETWORKMESSAGE_MAXSIZE];
+		uint8_t* m_MsgBuf;
+		int32_t m_bufferSize;
+
+	private:
+		//owns the buffer, a copy would free it twice
+		NetworkMessage(const NetworkMessage&);
+		NetworkMessage& operator=(const NetworkMessage&);
+};
+
+// encodes a payload once, so it can be copied into the buffers of many recipients
+class EncodedMessage : public NetworkMessage
+{
+	public:
+		EncodedMessage(): NetworkMessage(m_buffer, sizeof(m_buffer)) {}
+		virtual ~EncodedMessage()
+		{
+			if(m_MsgBuf == m_buffer)
+				m_MsgBuf = NULL;
+		}
+
+		const char* getPayload() const {return (const char*)(m_MsgBuf + m_ReadPos - m_MsgSize);}
+
+	protected:
+		virtual bool grow(int32_t required)
+		{
+			if(m_MsgBuf != m_buffer || required >= NETWORKMESSAGE_MAXSIZE)
+				return false;
+
+			m_MsgBuf = new uint8_t[NETWORKMESSAGE_MAXSIZE];
+			m_bufferSize = NETWORKMESSAGE_MAXSIZE;
+			memcpy(m_MsgBuf, m_buffer, m_ReadPos);
+			return true;
+		}
+
+		uint8_t m_buffer[512];
 };
 
 #endif // #ifndef __NETWORK_MESSAGE_H__
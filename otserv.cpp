@@ -27,6 +27,7 @@
 
 #include "server.h"
 #include "status.h"
+#include "metrics.h"
 #include "networkmessage.h"
 #ifdef __LOGIN_SERVER__
 #include "gameservers.h"
@@ -39,12 +40,14 @@
 #include "protocolgame.h"
 #include "tools.h"
 #include "rsa.h"
+#include "databasetasks.h"
 
 #include "scriptmanager.h"
 #include "configmanager.h"
 #include "databasemanager.h"
 
 #include "iologindata.h"
+#include "playerjournal.h"
 #include "ioban.h"
 #include "outfit.h"
 #include "vocation.h"
@@ -222,6 +225,15 @@ void serverMain(void* param)
 	OTSYS_THREAD_WAITSIGNAL(g_loaderSignal, g_loaderLock);
 
 	Server server(INADDR_ANY, g_config.getNumber(ConfigManager::PORT));
+	if(g_config.getBool(ConfigManager::HTTP_METRICS))
+	{
+		std::string metricsIp = g_config.getString(ConfigManager::HTTP_METRICS_IP);
+		uint32_t resolvedIp = inet_addr(metricsIp.c_str());
+		if(resolvedIp == INADDR_NONE || !server.openMetricsSocket(ntohl(resolvedIp), g_config.getNumber(ConfigManager::HTTP_METRICS_PORT)))
+			std::cout << "> WARNING: Unable to listen for http metrics on " << metricsIp << ":"
+				<< g_config.getNumber(ConfigManager::HTTP_METRICS_PORT) << "." << std::endl;
+	}
+
 	std::cout << ">> " << g_config.getString(ConfigManager::SERVER_NAME) << " server Online!" << std::endl << std::endl;
 	#if defined(WIN32) && not defined(__CONSOLE__)
 	SendMessage(GUI::getInstance()->m_statusBar, WM_SETTEXT, 0, (LPARAM)">> Status: Online!");
@@ -330,6 +342,8 @@ int argc, char *argv[]
 	const char* d("46730330223584118622160180015036832148732986808519344675210555262940258739805766860224610646919605860206328024326703361630109888417839241959507572247284807035235569619173792292786907845791904955103601652822519121908367187885509270025388641700821735345222087940578381210879116823013776808975766851829020659073");
 	g_otservRSA = new RSA();
 	g_otservRSA->setKey(p, q, d);
+	if(int32_t rsaThreads = g_config.getNumber(ConfigManager::RSA_THREADS))
+		RSAPool::getInstance()->start(g_otservRSA, rsaThreads);
 
 	std::cout << ">> Starting SQL connection" << std::endl;
 	#ifndef __CONSOLE__
@@ -359,8 +373,18 @@ int argc, char *argv[]
 
 		DatabaseManager::getInstance()->checkTriggers();
 		DatabaseManager::getInstance()->checkPasswordType();
+		IOLoginData::getInstance()->checkItemBlobs();
+		IOLoginData::getInstance()->loadSaveSequence();
+		IOBan::getInstance()->loadBans();
+		IOLoginData::getInstance()->loadNameCache();
+
+		const std::string journalFile = g_config.getString(ConfigManager::PLAYER_JOURNAL_FILE);
+		if(!journalFile.empty() && !PlayerJournal::getInstance()->open(journalFile, g_config.getNumber(ConfigManager::PLAYER_JOURNAL_SYNC)))
+			startupErrorMessage("Unable to open the player journal!");
 		if(g_config.getBool(ConfigManager::OPTIMIZE_DB_AT_STARTUP) && !DatabaseManager::getInstance()->optimizeTables())
 			std::cout << "> No tables were optimized." << std::endl;
+
+		DatabaseTasks::getInstance()->start(std::max((int32_t)1, g_config.getNumber(ConfigManager::DATABASE_THREADS)));
 	}
 
 	std::cout << ">> Loading vocations" << std::endl;
@@ -481,8 +505,17 @@ int argc, char *argv[]
 		status->setMaxPlayersOnline(g_config.getNumber(ConfigManager::MAX_PLAYERS));
 		status->setMapAuthor(g_config.getString(ConfigManager::MAP_AUTHOR));
 		status->setMapName(g_config.getString(ConfigManager::MAP_NAME));
+		status->updateCache();
 	}
 
+	if(g_config.getBool(ConfigManager::HTTP_METRICS))
+		Metrics::getInstance()->updateGauges();
+
+	if(PlayerJournal::getInstance()->isOpen())
+		IOLoginData::getInstance()->journalPlayers();
+
+	IOBan::getInstance()->refreshBans();
+
 	std::cout << ">> All modules were loaded, server starting up..." << std::endl;
 	#ifndef __CONSOLE__
 	SendMessage(GUI::getInstance()->m_statusBar, WM_SETTEXT, 0, (LPARAM)">> All modules were loaded, server starting up...");
@@ -47,6 +47,14 @@ inline int64_t OTSYS_TIME()
 	return ((int64_t)t.millitm) + ((int64_t)t.time) * 1000;
 }
 
+inline int64_t OTSYS_TIME_MICRO()
+{
+	LARGE_INTEGER counter, frequency;
+	QueryPerformanceCounter(&counter);
+	QueryPerformanceFrequency(&frequency);
+	return (counter.QuadPart / frequency.QuadPart) * 1000000 + (counter.QuadPart % frequency.QuadPart) * 1000000 / frequency.QuadPart;
+}
+
 #ifndef __USE_BOOST_THREAD__
 #define OTSYS_CREATE_THREAD(a, b)	_beginthread(a, 0, b)
 #define OTSYS_THREAD_LOCKVAR		CRITICAL_SECTION
@@ -101,6 +109,7 @@ inline int OTSYS_THREAD_WAITSIGNAL_TIMED(OTSYS_THREAD_SIGNALVAR& signal, OTSYS_T
 #include <time.h>
 #include <sys/types.h>
 #include <sys/timeb.h>
+#include <sys/time.h>
 #include <sys/socket.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
@@ -170,6 +179,13 @@ inline int64_t OTSYS_TIME()
 	ftime(&t);
 	return ((int64_t)t.millitm) + ((int64_t)t.time) * 1000;
 }
+
+inline int64_t OTSYS_TIME_MICRO()
+{
+	timeval t;
+	gettimeofday(&t, NULL);
+	return ((int64_t)t.tv_usec) + ((int64_t)t.tv_sec) * 1000000;
+}
 #endif
 
 #ifdef __USE_BOOST_THREAD__
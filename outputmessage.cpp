@@ -23,19 +23,54 @@
 #include "connection.h"
 #include "protocol.h"
 
-OutputMessage::OutputMessage()
+OutputMessage::OutputMessage(): NetworkMessage(NULL, 0)
 {
+	m_bufferClass = OUTPUT_BUFFER_CLASS_SMALL;
 	freeMessage();
 }
 
+void OutputMessage::setBuffer(uint8_t* buffer, OutputBufferClass_t bufferClass)
+{
+	m_MsgBuf = buffer;
+	m_bufferSize = OutputMessagePool::getBufferSize(bufferClass);
+	m_bufferClass = bufferClass;
+}
+
+bool OutputMessage::grow(int32_t required)
+{
+	for(int32_t i = m_bufferClass + 1; i < OUTPUT_BUFFER_CLASS_LAST; ++i)
+	{
+		OutputBufferClass_t bufferClass = (OutputBufferClass_t)i;
+		if(OutputMessagePool::getBufferSize(bufferClass) <= required)
+			continue;
+
+		//header space and body, everything before the write position
+		uint8_t* buffer = OutputMessagePool::getInstance()->allocateBuffer(bufferClass);
+		memcpy(buffer, m_MsgBuf, m_ReadPos);
+
+		OutputMessagePool::getInstance()->releaseBuffer(m_MsgBuf, m_bufferClass);
+		setBuffer(buffer, bufferClass);
+		return true;
+	}
+
+	return false;
+}
+
 //*********** OutputMessagePool ****************//
 
 OutputMessagePool::OutputMessagePool()
 {
 	OTSYS_THREAD_LOCKVARINIT(m_outputPoolLock);
+	for(uint32_t i = 0; i < OUTPUT_BUFFER_CLASS_LAST; ++i)
+	{
+		OTSYS_THREAD_LOCKVARINIT(m_buffers[i].lock);
+		m_buffers[i].allocated = m_buffers[i].used = m_buffers[i].peak = 0;
+	}
+
 	for(uint32_t i = 0; i < OUTPUT_POOL_SIZE; ++i)
 	{
 		OutputMessage* msg = new OutputMessage();
+		msg->setBuffer(allocateBuffer(OUTPUT_BUFFER_CLASS_SMALL), OUTPUT_BUFFER_CLASS_SMALL);
 		m_outputMessages.push_back(msg);
 #ifdef __TRACK_NETWORK__
 		m_allOutputMessages.push_back(msg);
@@ -58,9 +93,75 @@ OutputMessagePool::~OutputMessagePool()
 		delete *it;
 
 	m_outputMessages.clear();
+	for(uint32_t i = 0; i < OUTPUT_BUFFER_CLASS_LAST; ++i)
+	{
+		for(std::vector<uint8_t*>::iterator it = m_buffers[i].freeBuffers.begin(); it != m_buffers[i].freeBuffers.end(); ++it)
+			delete[] *it;
+
+		m_buffers[i].freeBuffers.clear();
+		OTSYS_THREAD_LOCKVARRELEASE(m_buffers[i].lock);
+	}
+
 	OTSYS_THREAD_LOCKVARRELEASE(m_outputPoolLock);
 }
 
+int32_t OutputMessagePool::getBufferSize(OutputBufferClass_t bufferClass)
+{
+	switch(bufferClass)
+	{
+		case OUTPUT_BUFFER_CLASS_SMALL:
+			return OUTPUT_BUFFER_SMALL;
+		case OUTPUT_BUFFER_CLASS_MEDIUM:
+			return OUTPUT_BUFFER_MEDIUM;
+		default:
+			break;
+	}
+
+	return NETWORKMESSAGE_MAXSIZE;
+}
+
+uint8_t* OutputMessagePool::allocateBuffer(OutputBufferClass_t bufferClass)
+{
+	//every size class has its own lock, so growing messages does not contend with the message pool
+	BufferClass& buffers = m_buffers[bufferClass];
+	OTSYS_THREAD_LOCK_CLASS lockClass(buffers.lock);
+	if(++buffers.used > buffers.peak)
+		buffers.peak = buffers.used;
+
+	if(!buffers.freeBuffers.empty())
+	{
+		uint8_t* buffer = buffers.freeBuffers.back();
+		buffers.freeBuffers.pop_back();
+		return buffer;
+	}
+
+	buffers.allocated++;
+	return new uint8_t[getBufferSize(bufferClass)];
+}
+
+void OutputMessagePool::releaseBuffer(uint8_t* buffer, OutputBufferClass_t bufferClass)
+{
+	BufferClass& buffers = m_buffers[bufferClass];
+	OTSYS_THREAD_LOCK_CLASS lockClass(buffers.lock);
+	buffers.used--;
+	if(buffers.freeBuffers.size() < OUTPUT_BUFFER_HIGHWATER)
+		buffers.freeBuffers.push_back(buffer);
+	else
+	{
+		buffers.allocated--;
+		delete[] buffer;
+	}
+}
+
+uint64_t OutputMessagePool::getBufferMemory() const
+{
+	uint64_t memory = 0;
+	for(uint32_t i = 0; i < OUTPUT_BUFFER_CLASS_LAST; ++i)
+		memory += (uint64_t)m_buffers[i].allocated * getBufferSize((OutputBufferClass_t)i);
+
+	return memory;
+}
+
 void OutputMessagePool::send(OutputMessage* msg)
 {
 	OTSYS_THREAD_LOCK(m_outputPoolLock, "");
@@ -163,6 +264,13 @@ void OutputMessagePool::internalReleaseMessage(OutputMessage* msg)
 		std::cout << "[Warning - OutputMessagePool::internalReleaseMessage] connection not found." << std::endl;
 
 	msg->freeMessage();
+	if(msg->getBufferClass() != OUTPUT_BUFFER_CLASS_SMALL)
+	{
+		//idle messages hold only a small buffer
+		releaseBuffer((uint8_t*)msg->getBuffer(), msg->getBufferClass());
+		msg->setBuffer(allocateBuffer(OUTPUT_BUFFER_CLASS_SMALL), OUTPUT_BUFFER_CLASS_SMALL);
+	}
+
 	m_outputMessages.push_back(msg);
 }
 
@@ -223,6 +331,7 @@ OutputMessage* OutputMessagePool::getOutputMessage(Protocol* protocol, bool auto
 		}
 #endif
 		outputmessage = new OutputMessage;
+		outputmessage->setBuffer(allocateBuffer(OUTPUT_BUFFER_CLASS_SMALL), OUTPUT_BUFFER_CLASS_SMALL);
 #ifdef __TRACK_NETWORK__
 		m_allOutputMessages.push_back(outputmessage);
 #endif
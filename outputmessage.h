@@ -38,6 +38,21 @@ class Connection;
 
 #define OUTPUT_POOL_SIZE 100
 
+//buffer sizes of the output message size classes, the large one is NETWORKMESSAGE_MAXSIZE
+#define OUTPUT_BUFFER_SMALL 512
+#define OUTPUT_BUFFER_MEDIUM 4096
+
+//free buffers kept by each size class, anything above goes back to the heap
+#define OUTPUT_BUFFER_HIGHWATER 64
+
+enum OutputBufferClass_t
+{
+	OUTPUT_BUFFER_CLASS_SMALL = 0,
+	OUTPUT_BUFFER_CLASS_MEDIUM,
+	OUTPUT_BUFFER_CLASS_LARGE,
+	OUTPUT_BUFFER_CLASS_LAST /* this must be the last one */
+};
+
 class OutputMessage : public NetworkMessage, boost::noncopyable
 {
 	private:
@@ -127,12 +142,17 @@ class OutputMessage : public NetworkMessage, boost::noncopyable
 		void setFrame(uint64_t frame) {m_frame = frame;}
 		uint64_t getFrame() const {return m_frame;}
 
+		void setBuffer(uint8_t* buffer, OutputBufferClass_t bufferClass);
+		OutputBufferClass_t getBufferClass() const {return m_bufferClass;}
+		virtual bool grow(int32_t required);
+
 		Protocol* m_protocol;
 		Connection* m_connection;
 
 		OutputMessageState m_state;
 		uint64_t m_frame;
 		uint32_t m_outputBufferStart;
+		OutputBufferClass_t m_bufferClass;
 
 #ifdef __TRACK_NETWORK__
 		std::list<std::string> lastUses;
@@ -166,10 +186,27 @@ class OutputMessagePool
 		size_t getAvailableMessageCount() const {return m_outputMessages.size();}
 		size_t getAutoMessageCount() const {return m_autoSendOutputMessages.size();}
 
+		uint8_t* allocateBuffer(OutputBufferClass_t bufferClass);
+		void releaseBuffer(uint8_t* buffer, OutputBufferClass_t bufferClass);
+
+		static int32_t getBufferSize(OutputBufferClass_t bufferClass);
+		uint32_t getBufferCount(OutputBufferClass_t bufferClass) const {return m_buffers[bufferClass].allocated;}
+		uint32_t getUsedBufferCount(OutputBufferClass_t bufferClass) const {return m_buffers[bufferClass].used;}
+		uint32_t getPeakBufferCount(OutputBufferClass_t bufferClass) const {return m_buffers[bufferClass].peak;}
+		uint64_t getBufferMemory() const;
+
 	protected:
 		void configureOutputMessage(OutputMessage* msg, Protocol* protocol, bool autosend);
 		void internalReleaseMessage(OutputMessage* msg);
 
+		struct BufferClass
+		{
+			std::vector<uint8_t*> freeBuffers;
+			uint32_t allocated, used, peak;
+			OTSYS_THREAD_LOCKVAR lock;
+		};
+		BufferClass m_buffers[OUTPUT_BUFFER_CLASS_LAST];
+
 		typedef std::list<OutputMessage*> OutputMessageVector;
 		OutputMessageVector m_outputMessages;
 		OutputMessageVector m_autoSendOutputMessages;
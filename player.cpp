@@ -180,6 +180,7 @@ Creature()
  	town = 0;
 
 	redSkullTicks = 0;
+	saveState = NULL;
 	setParty(NULL);
 
 	requestedOutfit = false;
@@ -212,6 +213,7 @@ Player::~Player()
 
 	setWriteItem(NULL);
 	setEditHouse(NULL);
+	delete saveState;
 #ifdef __ENABLE_SERVER_DIAGNOSTIC__
 
 	playerCount--;
@@ -1494,26 +1496,8 @@ void Player::onCreatureDisappear(const Creature* creature, uint32_t stackpos, bo
 		#endif
 		std::cout << getName() << " has logged out." << std::endl;
 
-		bool saved = false;
-		for(uint32_t tries = 0; tries < 3; ++tries)
-		{
-			if(IOLoginData::getInstance()->savePlayer(this))
-			{
-				saved = true;
-				break;
-			}
-#ifdef __DEBUG__
-			else
-				std::cout << "Error while saving player: " << getName() << ", strike " << tries << std::endl;
-#endif
-		}
-
-		if(!saved)
-#ifndef __DEBUG__
-			std::cout << "Error while saving player: " << getName() << std::endl;
-#else
-			std::cout << "Player " << getName() << " couldn't be saved." << std::endl;
-#endif
+		//written by a database thread, errors are reported there
+		IOLoginData::getInstance()->savePlayer(this, true, true);
 
 #ifdef __DEBUG__
 		std::cout << (uint32_t)g_game.getPlayersOnline() << " players online." << std::endl;
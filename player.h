@@ -45,6 +45,7 @@ class ProtocolGame;
 class Npc;
 class Party;
 class SchedulerTask;
+struct PlayerSaveState;
 
 enum skillsid_t
 {
@@ -212,6 +213,7 @@ class Player : public Creature, public Cylinder
 
 		bool isVirtual() const {return (getID() == 0);}
 		void disconnect() {if(client) client->disconnect();}
+		Connection* getConnection() const {return client ? client->getConnection() : NULL;}
 		uint32_t getIP() const;
 
 		void addContainer(uint32_t cid, Container* container);
@@ -511,6 +513,8 @@ class Player : public Creature, public Cylinder
 			{if(client) client->sendCreatureTurn(creature, stackpos);}
 		void sendCreatureSay(const Creature* creature, SpeakClasses type, const std::string& text, Position* pos = NULL)
 			{if(client) client->sendCreatureSay(creature, type, text, pos);}
+		void sendCreatureSay(const EncodedMessage& packet)
+			{if(client) client->sendEncodedMessage(packet);}
 		void sendCreatureSquare(const Creature* creature, SquareColor_t color)
 			{if(client) client->sendCreatureSquare(creature, color);}
 		void sendCreatureChangeOutfit(const Creature* creature, const Outfit_t& outfit)
@@ -579,6 +583,8 @@ class Player : public Creature, public Cylinder
 
 		void sendAnimatedText(const Position& pos, unsigned char color, std::string text) const
 			{if(client) client->sendAnimatedText(pos,color,text);}
+		void sendAnimatedText(const Position& pos, const EncodedMessage& packet) const
+			{if(client) client->sendAnimatedText(pos, packet);}
 		void sendCancel(const char* msg) const
 			{if(client) client->sendCancel(msg);}
 		void sendCancelMessage(ReturnValue message) const;
@@ -590,8 +596,12 @@ class Player : public Creature, public Cylinder
 			{if(client) client->sendChangeSpeed(creature, newSpeed);}
 		void sendCreatureHealth(const Creature* creature) const
 			{if(client) client->sendCreatureHealth(creature);}
+		void sendCreatureHealth(const EncodedMessage& packet) const
+			{if(client) client->sendEncodedMessage(packet);}
 		void sendDistanceShoot(const Position& from, const Position& to, unsigned char type) const
 			{if(client) client->sendDistanceShoot(from, to, type);}
+		void sendDistanceShoot(const Position& from, const Position& to, uint8_t type, const EncodedMessage& packet) const
+			{if(client) client->sendDistanceShoot(from, to, type, packet);}
 		void sendHouseWindow(House* house, uint32_t listId) const;
 		void sendOutfitWindow() const
 			{if(client) client->sendOutfitWindow();}
@@ -602,6 +612,8 @@ class Player : public Creature, public Cylinder
 		void sendIcons() const;
 		void sendMagicEffect(const Position& pos, uint8_t type) const
 			{if(client) client->sendMagicEffect(pos, type);}
+		void sendMagicEffect(const Position& pos, uint8_t type, const EncodedMessage& packet) const
+			{if(client) client->sendMagicEffect(pos, type, packet);}
 		void sendPing(uint32_t interval);
 		void sendStats();
 		void sendSkills() const
@@ -872,6 +884,11 @@ class Player : public Creature, public Cylinder
 		uint32_t editListId;
 
 		int64_t redSkullTicks;
+		//rows as last handed to IOLoginData, saves write only what changed since
+		PlayerSaveState* saveState;
+		//mail rows moved into the depots at login, every save removes them along with the depot
+		std::vector<int64_t> deliveredMail;
+
 		typedef std::set<uint32_t> AttackedSet;
 		AttackedSet attackedSet;
 
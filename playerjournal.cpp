@@ -0,0 +1,305 @@
+//////////////////////////////////////////////////////////////////////
+// OpenTibia - an opensource roleplaying game
+//////////////////////////////////////////////////////////////////////
+// Append only journal of player state between saves
+//////////////////////////////////////////////////////////////////////
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software Foundation,
+// Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+//////////////////////////////////////////////////////////////////////
+#include "otpch.h"
+
+#include "playerjournal.h"
+#include "iologindata.h"
+
+#include <boost/crc.hpp>
+#include <iostream>
+#ifdef WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+#if defined __EXCEPTION_TRACER__
+#include "exception.h"
+#endif
+
+PlayerJournal::PlayerJournal()
+{
+	m_file = NULL;
+	m_syncInterval = 0;
+	m_fileSize = 0;
+	OTSYS_THREAD_LOCKVARINIT(m_journalLock);
+	OTSYS_THREAD_LOCKVARINIT(m_fileLock);
+}
+
+bool PlayerJournal::open(const std::string& fileName, uint32_t syncInterval)
+{
+	m_fileName = fileName;
+	m_syncInterval = std::max((uint32_t)1, syncInterval);
+	if(!replay())
+		return false;
+
+	//states written by the replay are gone, the others stay for the next start
+	std::string data;
+	for(StateMap::iterator it = m_states.begin(); it != m_states.end(); ++it)
+		addRecord(data, JOURNAL_RECORD_STATE, it->first, it->second.sequence, it->second.state);
+
+	if(!rewrite(data))
+		return false;
+
+	OTSYS_CREATE_THREAD(PlayerJournal::journalThread, NULL);
+	return true;
+}
+
+void PlayerJournal::addState(uint32_t guid, uint64_t sequence, const std::string& state)
+{
+	OTSYS_THREAD_LOCK_CLASS lockClass(m_journalLock);
+	StateMap::iterator it = m_states.find(guid);
+	if(it != m_states.end() && it->second.state == state)
+		return;
+
+	addRecord(m_buffer, JOURNAL_RECORD_STATE, guid, sequence, state);
+	applyRecord(m_states, JOURNAL_RECORD_STATE, guid, sequence, state);
+}
+
+void PlayerJournal::addSaved(uint32_t guid, uint64_t sequence)
+{
+	OTSYS_THREAD_LOCK_CLASS lockClass(m_journalLock);
+	StateMap::iterator it = m_states.find(guid);
+	if(it == m_states.end())
+		return;
+
+	addRecord(m_buffer, JOURNAL_RECORD_SAVED, guid, sequence, "");
+	applyRecord(m_states, JOURNAL_RECORD_SAVED, guid, sequence, "");
+}
+
+void PlayerJournal::flush(bool compact/* = false*/)
+{
+	if(!m_file)
+		return;
+
+	OTSYS_THREAD_LOCK_CLASS fileLockClass(m_fileLock);
+	std::string data;
+	{
+		OTSYS_THREAD_LOCK_CLASS lockClass(m_journalLock);
+		if(!compact && m_fileSize + m_buffer.size() > PLAYER_JOURNAL_COMPACT_SIZE)
+		{
+			uint64_t liveSize = 0;
+			for(StateMap::iterator it = m_states.begin(); it != m_states.end(); ++it)
+				liveSize += it->second.state.size();
+
+			compact = m_fileSize + m_buffer.size() > 2 * liveSize;
+		}
+
+		if(compact)
+		{
+			//the live states cover everything buffered
+			m_buffer.clear();
+			for(StateMap::iterator it = m_states.begin(); it != m_states.end(); ++it)
+				addRecord(data, JOURNAL_RECORD_STATE, it->first, it->second.sequence, it->second.state);
+		}
+		else
+			data.swap(m_buffer);
+	}
+
+	if(compact)
+	{
+		if(!rewrite(data))
+			std::cout << "[Error - PlayerJournal::flush] Couldn't compact " << m_fileName << "." << std::endl;
+
+		return;
+	}
+
+	if(data.empty())
+		return;
+
+	if(fwrite(data.c_str(), 1, data.size(), m_file) != data.size() || !sync(m_file))
+		std::cout << "[Error - PlayerJournal::flush] Couldn't write " << m_fileName << "." << std::endl;
+
+	m_fileSize += data.size();
+}
+
+OTSYS_THREAD_RETURN PlayerJournal::journalThread(void* p)
+{
+	#if defined __EXCEPTION_TRACER__
+	ExceptionHandler journalExceptionHandler;
+	journalExceptionHandler.InstallHandler();
+	#endif
+
+	//group commit, everything appended since the last pass goes with one sync
+	PlayerJournal* journal = PlayerJournal::getInstance();
+	while(true)
+	{
+		OTSYS_SLEEP(journal->m_syncInterval);
+		journal->flush();
+	}
+
+	#if defined __EXCEPTION_TRACER__
+	journalExceptionHandler.RemoveHandler();
+	#endif
+	#if not defined(__USE_BOOST_THREAD__) && not defined(WIN32)
+	return NULL;
+	#endif
+}
+
+void PlayerJournal::addRecord(std::string& buffer, JournalRecord_t type, uint32_t guid, uint64_t sequence, const std::string& state)
+{
+	//size and checksum of the body, then the body: type, guid, sequence and the state
+	std::string body;
+	body.append(1, (char)type);
+	body.append((const char*)&guid, sizeof(guid));
+	body.append((const char*)&sequence, sizeof(sequence));
+	body += state;
+
+	boost::crc_32_type crc;
+	crc.process_bytes(body.c_str(), body.size());
+
+	uint32_t size = body.size(), checksum = crc.checksum();
+	buffer.append((const char*)&size, sizeof(size));
+	buffer.append((const char*)&checksum, sizeof(checksum));
+	buffer += body;
+}
+
+void PlayerJournal::applyRecord(StateMap& states, JournalRecord_t type, uint32_t guid, uint64_t sequence, const std::string& state)
+{
+	StateMap::iterator it = states.find(guid);
+	if(type == JOURNAL_RECORD_SAVED)
+	{
+		if(it != states.end() && it->second.sequence <= sequence)
+			states.erase(it);
+
+		return;
+	}
+
+	if(it != states.end() && it->second.sequence > sequence)
+		return;
+
+	JournalState& journalState = states[guid];
+	journalState.sequence = sequence;
+	journalState.state = state;
+}
+
+bool PlayerJournal::replay()
+{
+	FILE* file = fopen(m_fileName.c_str(), "rb");
+	if(!file)
+		return true;
+
+	std::string data;
+	char buffer[16384];
+	size_t read;
+	while((read = fread(buffer, 1, sizeof(buffer), file)) > 0)
+		data.append(buffer, read);
+
+	fclose(file);
+
+	//a torn record at the end was never synced, everything before it was
+	const size_t headerSize = 2 * sizeof(uint32_t), bodyHeaderSize = 1 + sizeof(uint32_t) + sizeof(uint64_t);
+	uint64_t maxSequence = 0;
+	size_t pos = 0;
+	while(data.size() - pos >= headerSize)
+	{
+		uint32_t size, checksum;
+		memcpy(&size, data.c_str() + pos, sizeof(size));
+		memcpy(&checksum, data.c_str() + pos + sizeof(size), sizeof(checksum));
+		if(size < bodyHeaderSize || data.size() - pos - headerSize < size)
+			break;
+
+		const char* body = data.c_str() + pos + headerSize;
+		boost::crc_32_type crc;
+		crc.process_bytes(body, size);
+		if(crc.checksum() != checksum)
+			break;
+
+		uint32_t guid;
+		uint64_t sequence;
+		memcpy(&guid, body + 1, sizeof(guid));
+		memcpy(&sequence, body + 1 + sizeof(guid), sizeof(sequence));
+		maxSequence = std::max(maxSequence, sequence);
+		applyRecord(m_states, (JournalRecord_t)body[0], guid, sequence, std::string(body + bodyHeaderSize, size - bodyHeaderSize));
+		pos += headerSize + size;
+	}
+
+	if(pos < data.size())
+		std::cout << "> WARNING: Ignoring " << data.size() - pos << " bytes at the end of " << m_fileName << "." << std::endl;
+
+	//a state kept for the next start must stay older than the saves of this run
+	IOLoginData::getInstance()->seedSaveSequence(maxSequence);
+
+	uint32_t replayed = 0;
+	for(StateMap::iterator it = m_states.begin(); it != m_states.end();)
+	{
+		if(IOLoginData::getInstance()->replayJournal(it->first, it->second.sequence, it->second.state))
+		{
+			m_states.erase(it++);
+			replayed++;
+		}
+		else
+		{
+			std::cout << "> ERROR: Couldn't replay the journal of player " << it->first << "." << std::endl;
+			++it;
+		}
+	}
+
+	if(replayed)
+		std::cout << "> Replayed the journal of " << replayed << " players." << std::endl;
+
+	return true;
+}
+
+bool PlayerJournal::rewrite(const std::string& data)
+{
+	//written aside and renamed over, a crash leaves either file complete
+	const std::string tmpName = m_fileName + ".tmp";
+	FILE* file = fopen(tmpName.c_str(), "wb");
+	if(!file)
+		return false;
+
+	if(fwrite(data.c_str(), 1, data.size(), file) != data.size() || !sync(file))
+	{
+		fclose(file);
+		return false;
+	}
+
+	fclose(file);
+	if(m_file)
+	{
+		fclose(m_file);
+		m_file = NULL;
+	}
+
+	#ifdef WIN32
+	remove(m_fileName.c_str());
+	#endif
+	if(rename(tmpName.c_str(), m_fileName.c_str()))
+		return false;
+
+	if(!(m_file = fopen(m_fileName.c_str(), "ab")))
+		return false;
+
+	m_fileSize = data.size();
+	return true;
+}
+
+bool PlayerJournal::sync(FILE* file)
+{
+	if(fflush(file))
+		return false;
+
+	#ifdef WIN32
+	return !_commit(_fileno(file));
+	#else
+	return !fdatasync(fileno(file));
+	#endif
+}
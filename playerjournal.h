@@ -0,0 +1,95 @@
+//////////////////////////////////////////////////////////////////////
+// OpenTibia - an opensource roleplaying game
+//////////////////////////////////////////////////////////////////////
+// Append only journal of player state between saves
+//////////////////////////////////////////////////////////////////////
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software Foundation,
+// Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+//////////////////////////////////////////////////////////////////////
+
+#ifndef __OTSERV_PLAYERJOURNAL_H__
+#define __OTSERV_PLAYERJOURNAL_H__
+
+#include "otsystem.h"
+#include <string>
+#include <map>
+
+//the file is rewritten with the live records only once it is larger than this and twice their size
+#define PLAYER_JOURNAL_COMPACT_SIZE 1048576
+
+enum JournalRecord_t
+{
+	JOURNAL_RECORD_STATE = 1,
+	JOURNAL_RECORD_SAVED = 2
+};
+
+//player snapshots taken between saves, synced to disk in groups and written to the database after a crash
+class PlayerJournal
+{
+	public:
+		virtual ~PlayerJournal()
+		{
+			OTSYS_THREAD_LOCKVARRELEASE(m_journalLock);
+			OTSYS_THREAD_LOCKVARRELEASE(m_fileLock);
+		}
+
+		static PlayerJournal* getInstance()
+		{
+			static PlayerJournal instance;
+			return &instance;
+		}
+
+		//startup, replays the states left in the file and starts the journal thread
+		bool open(const std::string& fileName, uint32_t syncInterval);
+		bool isOpen() const {return m_file != NULL;}
+
+		//any thread, states are kept until a save with the same or a later sequence is written
+		void addState(uint32_t guid, uint64_t sequence, const std::string& state);
+		void addSaved(uint32_t guid, uint64_t sequence);
+
+		//writes and syncs the appended records, compacting rewrites the file with the live states only
+		void flush(bool compact = false);
+
+		static OTSYS_THREAD_RETURN journalThread(void* p);
+
+	protected:
+		PlayerJournal();
+
+		struct JournalState
+		{
+			uint64_t sequence;
+			std::string state;
+		};
+		typedef std::map<uint32_t, JournalState> StateMap;
+
+		static void addRecord(std::string& buffer, JournalRecord_t type, uint32_t guid, uint64_t sequence, const std::string& state);
+		static void applyRecord(StateMap& states, JournalRecord_t type, uint32_t guid, uint64_t sequence, const std::string& state);
+		bool replay();
+		bool rewrite(const std::string& data);
+		static bool sync(FILE* file);
+
+		std::string m_fileName;
+		FILE* m_file;
+		uint32_t m_syncInterval;
+		uint64_t m_fileSize;
+
+		//records not on disk yet and the latest unsaved state of every player
+		std::string m_buffer;
+		StateMap m_states;
+		OTSYS_THREAD_LOCKVAR m_journalLock;
+		//held while the file is written
+		OTSYS_THREAD_LOCKVAR m_fileLock;
+};
+
+#endif
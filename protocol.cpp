@@ -31,28 +31,36 @@
 #include "scheduler.h"
 #include "rsa.h"
 
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
 void Protocol::onSendMessage(OutputMessage* msg)
 {
 	#ifdef __DEBUG_NET_DETAIL__
 	std::cout << "Protocol::onSendMessage" << std::endl;
 	#endif
-	if(!m_rawMessages)
-	{
-		msg->writeMessageLength();
-		if(m_encryptionEnabled)
-		{
-			#ifdef __DEBUG_NET_DETAIL__
-			std::cout << "Protocol::onSendMessage - encrypt" << std::endl;
-			#endif
-			XTEA_encrypt(*msg);
-			msg->addCryptoHeader(m_checksumEnabled);
-		}
-	}
-
 	if(msg == m_outputBuffer)
 		m_outputBuffer = NULL;
 }
 
+void Protocol::prepareMessage(OutputMessage* msg)
+{
+	//network thread
+	if(m_rawMessages)
+		return;
+
+	msg->writeMessageLength();
+	if(!m_encryptionEnabled)
+		return;
+
+	#ifdef __DEBUG_NET_DETAIL__
+	std::cout << "Protocol::prepareMessage - encrypt" << std::endl;
+	#endif
+	XTEA_encrypt(*msg);
+	msg->addCryptoHeader(m_checksumEnabled);
+}
+
 void Protocol::onRecvMessage(NetworkMessage& msg)
 {
 	#ifdef __DEBUG_NET_DETAIL__
@@ -103,12 +111,70 @@ void Protocol::deleteProtocolTask()
 	delete this;
 }
 
-void Protocol::XTEA_encrypt(OutputMessage& msg)
+void Protocol::setXTEAKey(const uint32_t* key)
 {
-	uint32_t k[4];
-	for(uint8_t i = 0; i < 4; i++)
-		k[i] = m_key[i];
+	memcpy(&m_key, key, sizeof(uint32_t) * 4);
+	//the round keys depend only on the key, so compute them once per session
+	uint32_t sum = 0;
+	for(int32_t i = 0; i < 32; i++)
+	{
+		m_keySchedule[i << 1] = sum + m_key[sum & 3];
+		sum -= 0x61C88647;
+		m_keySchedule[(i << 1) + 1] = sum + m_key[sum>>11 & 3];
+	}
+}
+
+#ifdef __SSE2__
+#define XTEA_ROUND(v, w, k) v = _mm_add_epi32(v, _mm_xor_si128(_mm_add_epi32(_mm_xor_si128(\
+	_mm_slli_epi32(w, 4), _mm_srli_epi32(w, 5)), w), k))
+
+inline void XTEA_deinterleave(__m128i& v0, __m128i& v1, const uint32_t* buffer)
+{
+	//a0 a1 b0 b1, c0 c1 d0 d1 -> a0 b0 c0 d0, a1 b1 c1 d1
+	__m128i x = _mm_loadu_si128((const __m128i*)buffer), y = _mm_loadu_si128((const __m128i*)(buffer + 4));
+	__m128i t0 = _mm_unpacklo_epi32(x, y), t1 = _mm_unpackhi_epi32(x, y);
+	v0 = _mm_unpacklo_epi32(t0, t1);
+	v1 = _mm_unpackhi_epi32(t0, t1);
+}
+
+inline void XTEA_interleave(uint32_t* buffer, const __m128i& v0, const __m128i& v1)
+{
+	_mm_storeu_si128((__m128i*)buffer, _mm_unpacklo_epi32(v0, v1));
+	_mm_storeu_si128((__m128i*)(buffer + 4), _mm_unpackhi_epi32(v0, v1));
+}
+
+//encrypts 8 blocks per iteration, XTEA is used in ECB mode so blocks are independent
+int32_t XTEA_encryptBlocks(uint32_t* buffer, int32_t blocks, const uint32_t* schedule)
+{
+	int32_t done = 0;
+	for(; done + 8 <= blocks; done += 8, buffer += 16)
+	{
+		__m128i a0, a1, b0, b1;
+		XTEA_deinterleave(a0, a1, buffer);
+		XTEA_deinterleave(b0, b1, buffer + 8);
+		for(int32_t i = 0; i < 64; i += 2)
+		{
+			__m128i k = _mm_set1_epi32(schedule[i]);
+			XTEA_ROUND(a0, a1, k);
+			XTEA_ROUND(b0, b1, k);
+
+			k = _mm_set1_epi32(schedule[i + 1]);
+			XTEA_ROUND(a1, a0, k);
+			XTEA_ROUND(b1, b0, k);
+		}
+
+		XTEA_interleave(buffer, a0, a1);
+		XTEA_interleave(buffer + 8, b0, b1);
+	}
 
+	return done;
+}
+
+#undef XTEA_ROUND
+#endif
+
+void Protocol::XTEA_encrypt(OutputMessage& msg)
+{
 	int32_t messageLength = msg.getMessageLength();
 	//add bytes until reach 8 multiple
 	uint32_t n;
@@ -119,18 +185,18 @@ void Protocol::XTEA_encrypt(OutputMessage& msg)
 		messageLength = messageLength + n;
 	}
 
-	int32_t readPos = 0;
 	uint32_t* buffer = (uint32_t*)msg.getOutputBuffer();
+	int32_t readPos = 0;
+	#ifdef __SSE2__
+	readPos = XTEA_encryptBlocks(buffer, messageLength / 8, m_keySchedule) << 1;
+	#endif
 	while(readPos < messageLength / 4)
 	{
 		uint32_t v0 = buffer[readPos], v1 = buffer[readPos + 1];
-		uint32_t delta = 0x61C88647;
-		uint32_t sum = 0;
-		for(int32_t i = 0; i < 32; i++)
+		for(int32_t i = 0; i < 64; i += 2)
 		{
-			v0 += ((v1 << 4 ^ v1 >> 5) + v1) ^ (sum + k[sum & 3]);
-			sum -= delta;
-			v1 += ((v0 << 4 ^ v0 >> 5) + v0) ^ (sum + k[sum>>11 & 3]);
+			v0 += ((v1 << 4 ^ v1 >> 5) + v1) ^ m_keySchedule[i];
+			v1 += ((v0 << 4 ^ v0 >> 5) + v0) ^ m_keySchedule[i + 1];
 		}
 
 		buffer[readPos] = v0;
@@ -191,7 +257,9 @@ bool Protocol::RSA_decrypt(RSA* rsa, NetworkMessage& msg)
 		return false;
 	}
 
-	rsa->decrypt((char*)(msg.getBuffer() + msg.getReadPos()), 128);
+	if(!m_rsaDecrypted)
+		rsa->decrypt((char*)(msg.getBuffer() + msg.getReadPos()), 128);
+
 	if(msg.GetByte() != 0)
 	{
 		std::cout << "Warning: [Protocol::RSA_decrypt]. First byte != 0" << std::endl;
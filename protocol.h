@@ -38,10 +38,12 @@ class Protocol : boost::noncopyable
 			m_encryptionEnabled = false;
 			m_checksumEnabled = true;
 			m_rawMessages = false;
+			m_rsaDecrypted = false;
 			m_key[0] = 0;
 			m_key[1] = 0;
 			m_key[2] = 0;
 			m_key[3] = 0;
+			memset(m_keySchedule, 0, sizeof(m_keySchedule));
 			m_outputBuffer = NULL;
 			m_refCount = 0;
 		}
@@ -52,7 +54,11 @@ class Protocol : boost::noncopyable
 
 		void onSendMessage(OutputMessage* msg);
 		void onRecvMessage(NetworkMessage& msg);
+		//network thread, called right before the message is written
+		void prepareMessage(OutputMessage* msg);
 		virtual void onRecvFirstMessage(NetworkMessage& msg) = 0;
+		//first message ends with a block for g_otservRSA, the connection may decrypt it beforehand
+		virtual bool hasRSAFirstMessage() const {return false;}
 
 		Connection* getConnection() {return m_connection;}
 		const Connection* getConnection() const {return m_connection;}
@@ -68,7 +74,7 @@ class Protocol : boost::noncopyable
 
 		void enableXTEAEncryption() {m_encryptionEnabled = true;}
 		void disableXTEAEncryption() {m_encryptionEnabled = false;}
-		void setXTEAKey(const uint32_t* key) {memcpy(&m_key, key, sizeof(uint32_t) * 4);}
+		void setXTEAKey(const uint32_t* key);
 
 		void XTEA_encrypt(OutputMessage& msg);
 		bool XTEA_decrypt(NetworkMessage& msg);
@@ -89,7 +95,9 @@ class Protocol : boost::noncopyable
 		bool m_encryptionEnabled;
 		bool m_checksumEnabled;
 		bool m_rawMessages;
+		bool m_rsaDecrypted;
 		uint32_t m_key[4];
+		uint32_t m_keySchedule[64];
 		uint32_t m_refCount;
 };
 
@@ -41,6 +41,8 @@
 #include "quests.h"
 #include "ioban.h"
 #include "creatureevent.h"
+#include "tasks.h"
+#include "databasetasks.h"
 
 #include <string>
 #include <iostream>
@@ -55,6 +57,17 @@ extern ConfigManager g_config;
 extern Actions actions;
 extern RSA* g_otservRSA;
 extern CreatureEvents* g_creatureEvents;
+
+//database results of a game login, prepared by a database thread
+struct GameLoginData
+{
+	uint32_t accountId;
+	std::string error;
+
+	bool fetched, banished, namelocked, multipleCharacters;
+	PlayerLoadData player;
+	Ban ban;
+};
 Chat g_chat;
 
 #ifdef __ENABLE_SERVER_DIAGNOSTIC__
@@ -229,7 +242,14 @@ ProtocolGame::ProtocolGame(Connection* connection) :
 	m_rejectCount = 0;
 	m_debugAssertSent = false;
 	m_acceptPackets = false;
+	m_walkDropped = false;
+	m_viewStamp = m_lastViewStamp = 0;
 	eventConnect = 0;
+	for(int32_t i = 0; i < PACKET_CLASS_LAST; ++i)
+	{
+		m_packetBuckets[i].tokens = 0;
+		m_packetBuckets[i].lastRefill = 0;
+	}
 #ifdef __ENABLE_SERVER_DIAGNOSTIC__
 	protocolGameCount++;
 #endif
@@ -267,7 +287,8 @@ void ProtocolGame::deleteProtocolTask()
 	Protocol::deleteProtocolTask();
 }
 
-bool ProtocolGame::login(const std::string& name, uint32_t accnumber, const std::string& password, uint16_t operatingSystem, uint8_t gamemasterLogin)
+bool ProtocolGame::login(const std::string& name, uint32_t accnumber, const std::string& password,
+	uint16_t operatingSystem, uint8_t gamemasterLogin, GameLoginData* data)
 {
 	//dispatcher thread
 	Player* _player = g_game.getPlayerByName(name);
@@ -277,14 +298,14 @@ bool ProtocolGame::login(const std::string& name, uint32_t accnumber, const std:
 		player->useThing2();
 		player->setID();
 
-		if(!IOLoginData::getInstance()->loadPlayer(player, name, true))
+		if(!data->fetched || !IOLoginData::getInstance()->loadPlayer(player, data->player, true))
 		{
 			disconnectClient(0x14, "Your character could not be loaded.");
 			return false;
 		}
 
 		bool isNamelocked = false;
-		if(IOBan::getInstance()->isNamelocked(player->getGUID()) && accnumber != 1)
+		if(data->namelocked && accnumber != 1)
 		{
 			if(g_config.getBool(ConfigManager::NAMELOCK_MANAGER))
 			{
@@ -315,8 +336,8 @@ bool ProtocolGame::login(const std::string& name, uint32_t accnumber, const std:
 			return false;
 		}
 
-		Ban ban;
-		if(IOBan::getInstance()->getData(accnumber, ban) && (ban.type == BANTYPE_BANISHMENT ||
+		const Ban& ban = data->ban;
+		if(data->banished && (ban.type == BANTYPE_BANISHMENT ||
 			ban.type == BANTYPE_DELETION) && !player->hasFlag(PlayerFlag_CannotBeBanned))
 		{
 			bool deletion = (ban.type == BANTYPE_DELETION);
@@ -355,7 +376,7 @@ bool ProtocolGame::login(const std::string& name, uint32_t accnumber, const std:
 			return false;
 		}
 
-		if(g_config.getBool(ConfigManager::ONE_PLAYER_ON_ACCOUNT) && !player->isAccountManager() && !IOLoginData::getInstance()->hasCustomFlag(accnumber, PlayerCustomFlag_CanLoginMultipleCharacters))
+		if(g_config.getBool(ConfigManager::ONE_PLAYER_ON_ACCOUNT) && !player->isAccountManager() && !data->multipleCharacters)
 		{
 			bool found = false;
 			PlayerVector tmp = g_game.getPlayersByAccount(accnumber);
@@ -398,7 +419,7 @@ bool ProtocolGame::login(const std::string& name, uint32_t accnumber, const std:
 			return false;
 		}
 
-		if(!IOLoginData::getInstance()->loadPlayer(player, name))
+		if(!IOLoginData::getInstance()->loadPlayer(player, data->player))
 		{
 			disconnectClient(0x14, "Your character could not be loaded.");
 			return false;
@@ -541,7 +562,6 @@ bool ProtocolGame::parseFirstPacket(NetworkMessage& msg)
 	toLowerCaseString(accName);
 	const std::string name = msg.GetString();
 	std::string password = msg.GetString();
-	uint32_t accId = 1;
 
 	if(version < CLIENT_VERSION_MIN || version > CLIENT_VERSION_MAX)
 	{
@@ -578,26 +598,86 @@ bool ProtocolGame::parseFirstPacket(NetworkMessage& msg)
 		return false;
 	}
 
-	if(IOBan::getInstance()->isIpBanished(getIP()))
+	//everything the login needs from the database is fetched before the dispatcher sees it
+	addRef();
+	Dispatcher::getDispatcher().addTask(createTask(boost::bind(&ProtocolGame::queueLogin, this,
+		accName, name, password, operatingSystem, gamemasterLogin, getIP())));
+	return true;
+}
+
+void ProtocolGame::queueLogin(std::string accName, std::string name, std::string password, uint16_t operatingSystem,
+	uint8_t gamemasterLogin, uint32_t ip)
+{
+	//dispatcher thread, a save of the player from now on makes the fetched rows stale
+	uint32_t token = IOLoginData::getInstance()->beginLoginFetch(name);
+	DatabaseTasks::getInstance()->addTask(createTask(boost::bind(&ProtocolGame::fetchLogin, this,
+		accName, name, password, operatingSystem, gamemasterLogin, ip, token)));
+}
+
+void ProtocolGame::fetchLogin(std::string accName, std::string name, std::string password, uint16_t operatingSystem,
+	uint8_t gamemasterLogin, uint32_t ip, uint32_t token)
+{
+	//database thread
+	GameLoginData* data = new GameLoginData;
+	data->accountId = 1;
+	data->fetched = data->banished = data->namelocked = data->multipleCharacters = false;
+	if(IOBan::getInstance()->isIpBanished(ip))
+		data->error = "Your IP is banished!";
+	else
 	{
-		disconnectClient(0x14, "Your IP is banished!");
-		return false;
+		std::string accPass;
+		if(((accName.length() && !IOLoginData::getInstance()->getAccountId(accName, data->accountId)) ||
+			!IOLoginData::getInstance()->getPassword(data->accountId, name, accPass) || !passwordTest(password, accPass)) && name != "Account Manager")
+		{
+			ConnectionManager::getInstance()->addAttempt(ip, false);
+			delete data;
+			data = NULL;
+		}
+		else
+		{
+			ConnectionManager::getInstance()->addAttempt(ip, true);
+			if((data->fetched = IOLoginData::getInstance()->fetchPlayer(data->player, name)))
+			{
+				data->namelocked = IOBan::getInstance()->isNamelocked((uint32_t)data->player.player->getDataInt("id"));
+				data->banished = IOBan::getInstance()->getData(data->accountId, data->ban);
+				if(g_config.getBool(ConfigManager::ONE_PLAYER_ON_ACCOUNT))
+					data->multipleCharacters = IOLoginData::getInstance()->hasCustomFlag(data->accountId,
+						PlayerCustomFlag_CanLoginMultipleCharacters);
+			}
+		}
+	}
+
+	Dispatcher::getDispatcher().addTask(createTask(boost::bind(&ProtocolGame::onLoginFetched, this,
+		accName, name, password, operatingSystem, gamemasterLogin, ip, token, data)));
+}
+
+void ProtocolGame::onLoginFetched(std::string accName, std::string name, std::string password, uint16_t operatingSystem,
+	uint8_t gamemasterLogin, uint32_t ip, uint32_t token, GameLoginData* data)
+{
+	//dispatcher thread
+	if(IOLoginData::getInstance()->endLoginFetch(name, token) && data && data->fetched && getConnection())
+	{
+		//the player logged out or was saved while its rows were read, they may predate that save
+		delete data;
+		queueLogin(accName, name, password, operatingSystem, gamemasterLogin, ip);
+		return;
 	}
 
-	std::string accPass;
-	if(((accName.length() && !IOLoginData::getInstance()->getAccountId(accName, accId)) ||
-		!IOLoginData::getInstance()->getPassword(accId, name, accPass) || !passwordTest(password, accPass)) && name != "Account Manager")
+	unRef();
+	if(!getConnection())
 	{
-		ConnectionManager::getInstance()->addAttempt(getIP(), false);
-		getConnection()->closeConnection();
-		return false;
+		delete data;
+		return;
 	}
 
-	ConnectionManager::getInstance()->addAttempt(getIP(), true);
-	Dispatcher::getDispatcher().addTask(
-		createTask(boost::bind(&ProtocolGame::login, this, name, accId, password, operatingSystem, gamemasterLogin)));
+	if(!data)
+		getConnection()->closeConnection();
+	else if(!data->error.empty())
+		disconnectClient(0x14, data->error.c_str());
+	else
+		login(name, data->accountId, password, operatingSystem, gamemasterLogin, data);
 
-	return true;
+	delete data;
 }
 
 void ProtocolGame::onRecvFirstMessage(NetworkMessage& msg)
@@ -653,6 +733,9 @@ void ProtocolGame::parsePacket(NetworkMessage &msg)
 	if((player->isRemoved() || player->getHealth() <= 0) && recvbyte != 0x14)
 		return;
 
+	if(!takePacketToken(recvbyte))
+		return;
+
 	if(player->isAccountManager())
 	{
 		switch(recvbyte)
@@ -935,26 +1018,142 @@ void ProtocolGame::parsePacket(NetworkMessage &msg)
 	}
 }
 
+bool ProtocolGame::getPacketClass(uint8_t recvbyte, PacketClass_t& packetClass)
+{
+	switch(recvbyte)
+	{
+		case 0x14: // logout
+		case 0x1E: // ping response
+		case 0x69: // stop-autowalk
+		case 0xBE: // cancel move
+			return false;
+
+		case 0x64: // move with steps
+		case 0x65: // move north
+		case 0x66: // move east
+		case 0x67: // move south
+		case 0x68: // move west
+		case 0x6A:
+		case 0x6B:
+		case 0x6C:
+		case 0x6D:
+			packetClass = PACKET_CLASS_WALK;
+			break;
+
+		case 0x79: // description in shop window
+		case 0x7E: // look at an item in trade
+		case 0x8C: // look at
+			packetClass = PACKET_CLASS_LOOK;
+			break;
+
+		case 0x78: // throw item
+		case 0x82: // use item
+		case 0x83: // use item with
+		case 0x84: // use item on creature
+		case 0x85: // rotate item
+			packetClass = PACKET_CLASS_ITEM;
+			break;
+
+		default:
+			packetClass = PACKET_CLASS_OTHER;
+			break;
+	}
+
+	return true;
+}
+
+static const ConfigManager::number_config_t packetClassRates[PACKET_CLASS_LAST] =
+{
+	ConfigManager::WALK_PACKETS_PER_SECOND,
+	ConfigManager::LOOK_PACKETS_PER_SECOND,
+	ConfigManager::ITEM_PACKETS_PER_SECOND,
+	ConfigManager::OTHER_PACKETS_PER_SECOND
+};
+
+bool ProtocolGame::takePacketToken(uint8_t recvbyte)
+{
+	//network thread, before any game task is created
+	PacketClass_t packetClass;
+	if(!getPacketClass(recvbyte, packetClass))
+		return true;
+
+	int64_t rate = g_config.getNumber(packetClassRates[packetClass]);
+	if(rate <= 0)
+		return true;
+
+	//tokens are counted in thousandths of a packet, a bucket holds one second worth of packets
+	PacketBucket& bucket = m_packetBuckets[packetClass];
+	bucket.tokens = std::min(rate * 1000, bucket.tokens + (m_now - bucket.lastRefill) * rate);
+	bucket.lastRefill = m_now;
+	if(bucket.tokens >= 1000)
+	{
+		bucket.tokens -= 1000;
+		if(packetClass == PACKET_CLASS_WALK)
+			m_walkDropped = false;
+
+		return true;
+	}
+
+	ConnectionManager::getInstance()->addDroppedPacket(getIP());
+	if(packetClass == PACKET_CLASS_WALK && !m_walkDropped)
+	{
+		//the client has already started the step, one cancel covers the whole burst
+		m_walkDropped = true;
+		addGameTask(&Game::playerCancelWalk, player->getID());
+	}
+
+	return false;
+}
+
+const TileItemCache* ProtocolGame::getTileItems(const Tile* tile)
+{
+	TileItemCache* cache = tile->getItemCache();
+	if(cache->version == tile->getVersion())
+		return cache;
+
+	EncodedMessage msg;
+	int32_t count = 0;
+	if(tile->ground)
+	{
+		msg.AddItem(tile->ground);
+		count++;
+	}
+
+	ItemVector::const_iterator it;
+	for(it = tile->topItems.begin(); ((it != tile->topItems.end()) && (count < TILE_MAX_DESCRIPTION_THINGS)); ++it)
+	{
+		msg.AddItem(*it);
+		count++;
+	}
+
+	cache->topCount = count;
+	cache->offsets[0] = msg.getMessageLength();
+
+	//creatures of the viewer take the place of the last down items
+	int32_t downCount = 0;
+	for(it = tile->downItems.begin(); ((it != tile->downItems.end()) && (count < TILE_MAX_DESCRIPTION_THINGS)); ++it)
+	{
+		msg.AddItem(*it);
+		cache->offsets[++downCount] = msg.getMessageLength();
+		count++;
+	}
+
+	cache->downCount = downCount;
+	memcpy(cache->buffer, msg.getPayload(), msg.getMessageLength());
+	cache->version = tile->getVersion();
+	return cache;
+}
+
 void ProtocolGame::GetTileDescription(const Tile* tile, NetworkMessage* msg)
 {
 	if(tile)
 	{
-		int32_t count = 0;
-		if(tile->ground)
-		{
-			msg->AddItem(tile->ground);
-			count++;
-		}
-
-		ItemVector::const_iterator it;
-		for(it = tile->topItems.begin(); ((it != tile->topItems.end()) && (count < 10)); ++it)
-		{
-			msg->AddItem(*it);
-			count++;
-		}
+		const TileItemCache* cache = getTileItems(tile);
+		msg->AddBytes((const char*)cache->buffer, cache->offsets[0]);
 
+		int32_t count = cache->topCount;
 		CreatureVector::const_iterator itc;
-		for(itc = tile->creatures.begin(); ((itc != tile->creatures.end()) && (count < 10)); ++itc)
+		for(itc = tile->creatures.begin(); ((itc != tile->creatures.end()) && (count < TILE_MAX_DESCRIPTION_THINGS)); ++itc)
 		{
 			if((*itc)->isInGhostMode() && !player->canSeeGhost((*itc)))
 				continue;
@@ -966,11 +1165,9 @@ void ProtocolGame::GetTileDescription(const Tile* tile, NetworkMessage* msg)
 			count++;
 		}
 
-		for(it = tile->downItems.begin(); ((it != tile->downItems.end()) && (count < 10)); ++it)
-		{
-			msg->AddItem(*it);
-			count++;
-		}
+		int32_t downCount = std::min((int32_t)cache->downCount, TILE_MAX_DESCRIPTION_THINGS - count);
+		if(downCount > 0)
+			msg->AddBytes((const char*)cache->buffer + cache->offsets[0], cache->offsets[downCount] - cache->offsets[0]);
 	}
 }
 
@@ -992,9 +1189,16 @@ void ProtocolGame::GetMapDescription(uint16_t x, uint16_t y, uint8_t z,
 		zstep = -1;
 	}
 
+	//nothing moves while the description is built, so visibility checked once stays valid until it is done
+	if(!++m_lastViewStamp)
+		++m_lastViewStamp;
+
+	m_viewStamp = m_lastViewStamp;
 	for(int32_t nz = startz; nz != endz + zstep; nz += zstep)
 		GetFloorDescription(msg, x, y, nz, width, height, z - nz, skip);
 
+	m_viewStamp = 0;
+
 	if(skip >= 0)
 	{
 		msg->AddByte(skip);
@@ -1038,18 +1242,11 @@ void ProtocolGame::GetFloorDescription(NetworkMessage* msg, int32_t x, int32_t y
 
 void ProtocolGame::checkCreatureAsKnown(uint32_t id, bool& known, uint32_t& removedKnown)
 {
-	// loop through the known creature list and check if the given creature is in
-	for(std::list<uint32_t>::iterator it = knownCreatureList.begin(); it != knownCreatureList.end(); ++it)
+	// check if the given creature is known, make it even more known if so...
+	if(knownCreatureList.touch(id))
 	{
-		if((*it) == id)
-		{
-			// know... make the creature even more known...
-			knownCreatureList.erase(it);
-			knownCreatureList.push_back(id);
-
-			known = true;
-			return;
-		}
+		known = true;
+		return;
 	}
 
 	// ok, he is unknown...
@@ -1057,19 +1254,23 @@ void ProtocolGame::checkCreatureAsKnown(uint32_t id, bool& known, uint32_t& remo
 	// ... but not in future
 	knownCreatureList.push_back(id);
 	// too many known creatures?
-	if(knownCreatureList.size() > 150)
+	if(knownCreatureList.size() > KNOWN_CREATURES_MAX)
 	{
 		// lets try to remove one from the end of the list
-		for(int32_t n = 0; n < 150; n++)
+		for(int32_t n = 0; n < KNOWN_CREATURES_MAX; n++)
 		{
 			removedKnown = knownCreatureList.front();
-			Creature* c = g_game.getCreatureByID(removedKnown);
-			if((!c) || (!canSee(c)))
-				break;
+			if(!knownCreatureList.frontVisible(m_viewStamp))
+			{
+				Creature* c = g_game.getCreatureByID(removedKnown);
+				if((!c) || (!canSee(c)))
+					break;
+
+				knownCreatureList.setFrontVisible(m_viewStamp);
+			}
 
 			// this creature we can't remove, still in sight, so back to the end
-			knownCreatureList.pop_front();
-			knownCreatureList.push_back(removedKnown);
+			knownCreatureList.rotate();
 		}
 
 		// hopefully we found someone to remove :S, we got only 150 tries
@@ -1131,6 +1332,132 @@ bool ProtocolGame::canSee(int32_t x, int32_t y, int32_t z) const
 	return false;
 }
 
+KnownCreatureList::KnownCreatureList()
+{
+	for(int16_t i = 0; i < tableSize; ++i)
+		m_table[i] = -1;
+
+	for(int16_t i = 0; i < capacity; ++i)
+		m_nodes[i].next = (i + 1 < capacity ? i + 1 : -1);
+
+	m_head = m_tail = -1;
+	m_free = 0;
+	m_size = 0;
+}
+
+int32_t KnownCreatureList::find(uint32_t id) const
+{
+	//linear probing, the table is kept at most about a third full
+	for(uint32_t i = slot(id); m_table[i] != -1; i = (i + 1) & (tableSize - 1))
+	{
+		if(m_nodes[m_table[i]].id == id)
+			return i;
+	}
+
+	return -1;
+}
+
+bool KnownCreatureList::touch(uint32_t id)
+{
+	int32_t i = find(id);
+	if(i == -1)
+		return false;
+
+	int16_t index = m_table[i];
+	if(index != m_tail)
+	{
+		unlink(index);
+		link(index);
+	}
+
+	return true;
+}
+
+void KnownCreatureList::push_back(uint32_t id)
+{
+	if(m_free == -1)
+		return;
+
+	int16_t index = m_free;
+	m_free = m_nodes[index].next;
+
+	m_nodes[index].id = id;
+	m_nodes[index].stamp = 0;
+	link(index);
+
+	uint32_t i = slot(id);
+	while(m_table[i] != -1)
+		i = (i + 1) & (tableSize - 1);
+
+	m_table[i] = index;
+	m_size++;
+}
+
+void KnownCreatureList::pop_front()
+{
+	if(m_head != -1)
+		erase(m_head);
+}
+
+void KnownCreatureList::rotate()
+{
+	if(m_head == m_tail)
+		return;
+
+	int16_t index = m_head;
+	unlink(index);
+	link(index);
+}
+
+void KnownCreatureList::link(int16_t index)
+{
+	m_nodes[index].prev = m_tail;
+	m_nodes[index].next = -1;
+	if(m_tail != -1)
+		m_nodes[m_tail].next = index;
+	else
+		m_head = index;
+
+	m_tail = index;
+}
+
+void KnownCreatureList::unlink(int16_t index)
+{
+	Node& node = m_nodes[index];
+	if(node.prev != -1)
+		m_nodes[node.prev].next = node.next;
+	else
+		m_head = node.next;
+
+	if(node.next != -1)
+		m_nodes[node.next].prev = node.prev;
+	else
+		m_tail = node.prev;
+}
+
+void KnownCreatureList::erase(int16_t index)
+{
+	uint32_t i = find(m_nodes[index].id);
+	unlink(index);
+	m_nodes[index].next = m_free;
+	m_free = index;
+	m_size--;
+
+	//backward shift deletion, keeps the probe chains intact without tombstones
+	m_table[i] = -1;
+	for(uint32_t j = (i + 1) & (tableSize - 1); m_table[j] != -1; j = (j + 1) & (tableSize - 1))
+	{
+		uint32_t home = slot(m_nodes[m_table[j]].id);
+		//move the entry back if its home slot is not within (i, j]
+		if((j > i && (home <= i || home > j)) || (j < i && (home <= i && home > j)))
+		{
+			m_table[i] = m_table[j];
+			m_table[j] = -1;
+			i = j;
+		}
+	}
+}
+
 //********************** Parse methods *******************************//
 void ProtocolGame::parseLogout(NetworkMessage& msg)
 {
@@ -2131,7 +2458,7 @@ void ProtocolGame::sendPing()
 
 void ProtocolGame::sendDistanceShoot(const Position& from, const Position& to, uint8_t type)
 {
-	if((canSee(from) || canSee(to)) && type <= 41)
+	if((canSee(from) || canSee(to)) && type <= 41 && canSendCosmetic())
 	{
 		NetworkMessage* msg = getOutputBuffer();
 		if(msg)
@@ -2144,7 +2471,7 @@ void ProtocolGame::sendDistanceShoot(const Position& from, const Position& to, u
 
 void ProtocolGame::sendMagicEffect(const Position& pos, uint8_t type)
 {
-	if(canSee(pos) && type <= 66)
+	if(canSee(pos) && type <= 66 && canSendCosmetic())
 	{
 		NetworkMessage* msg = getOutputBuffer();
 		if(msg)
@@ -2157,7 +2484,7 @@ void ProtocolGame::sendMagicEffect(const Position& pos, uint8_t type)
 
 void ProtocolGame::sendAnimatedText(const Position& pos, uint8_t color, std::string text)
 {
-	if(canSee(pos))
+	if(canSee(pos) && canSendCosmetic())
 	{
 		NetworkMessage* msg = getOutputBuffer();
 		if(msg)
@@ -2178,6 +2505,45 @@ void ProtocolGame::sendCreatureHealth(const Creature* creature)
 	}
 }
 
+void ProtocolGame::sendDistanceShoot(const Position& from, const Position& to, uint8_t type, const EncodedMessage& packet)
+{
+	if((canSee(from) || canSee(to)) && type <= 41 && canSendCosmetic())
+		sendEncodedMessage(packet);
+}
+
+void ProtocolGame::sendMagicEffect(const Position& pos, uint8_t type, const EncodedMessage& packet)
+{
+	if(canSee(pos) && type <= 66 && canSendCosmetic())
+		sendEncodedMessage(packet);
+}
+
+void ProtocolGame::sendAnimatedText(const Position& pos, const EncodedMessage& packet)
+{
+	if(canSee(pos) && canSendCosmetic())
+		sendEncodedMessage(packet);
+}
+
+bool ProtocolGame::canSendCosmetic()
+{
+	//effects and texts are dropped first when the client does not keep up
+	Connection* connection = getConnection();
+	if(!connection || !connection->isCongested())
+		return true;
+
+	connection->addDroppedMessage();
+	return false;
+}
+
+void ProtocolGame::sendEncodedMessage(const EncodedMessage& packet)
+{
+	NetworkMessage* msg = getOutputBuffer();
+	if(msg)
+	{
+		TRACK_MESSAGE(msg);
+		msg->AddBytes(packet.getPayload(), packet.getMessageLength());
+	}
+}
+
 void ProtocolGame::sendFYIBox(const std::string& message)
 {
 	NetworkMessage* msg = getOutputBuffer();
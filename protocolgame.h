@@ -35,13 +35,73 @@ enum connectResult_t
 };
 
 class NetworkMessage;
+class EncodedMessage;
 class Player;
 class Game;
 class House;
 class Container;
 class Tile;
+struct TileItemCache;
+struct GameLoginData;
 class Connection;
 
+#define KNOWN_CREATURES_MAX 150
+
+//known creatures in least recently used order, hash indexed by creature id
+class KnownCreatureList
+{
+	public:
+		KnownCreatureList();
+
+		bool touch(uint32_t id);
+		void push_back(uint32_t id);
+		void pop_front();
+		void rotate();
+
+		//visibility of the front entry, valid only while the stamp it was marked with is current
+		bool frontVisible(uint32_t stamp) const {return stamp && m_nodes[m_head].stamp == stamp;}
+		void setFrontVisible(uint32_t stamp) {m_nodes[m_head].stamp = stamp;}
+
+		uint32_t front() const {return m_nodes[m_head].id;}
+		uint32_t size() const {return m_size;}
+
+	private:
+		enum {capacity = KNOWN_CREATURES_MAX + 1, tableSize = 512};
+
+		int32_t find(uint32_t id) const;
+		uint32_t slot(uint32_t id) const {return (id * 2654435761U) >> 23;}
+
+		void link(int16_t index);
+		void unlink(int16_t index);
+		void erase(int16_t index);
+
+		struct Node
+		{
+			uint32_t id, stamp;
+			int16_t prev, next;
+		};
+
+		Node m_nodes[capacity];
+		int16_t m_table[tableSize];
+		int16_t m_head, m_tail, m_free;
+		uint32_t m_size;
+};
+
+enum PacketClass_t
+{
+	PACKET_CLASS_WALK = 0,
+	PACKET_CLASS_LOOK,
+	PACKET_CLASS_ITEM,
+	PACKET_CLASS_OTHER,
+	PACKET_CLASS_LAST /* this must be the last one */
+};
+
+struct PacketBucket
+{
+	int64_t tokens;
+	int64_t lastRefill;
+};
+
 class ProtocolGame : public Protocol
 {
 	public:
@@ -52,14 +112,23 @@ class ProtocolGame : public Protocol
 		virtual ~ProtocolGame();
 
 		virtual int32_t getProtocolId() {return 0x0A;}
+		virtual bool hasRSAFirstMessage() const {return true;}
 
-		bool login(const std::string& name, uint32_t accnumber, const std::string& password, uint16_t operatingSystem, uint8_t gamemasterLogin);
+		bool login(const std::string& name, uint32_t accnumber, const std::string& password,
+			uint16_t operatingSystem, uint8_t gamemasterLogin, GameLoginData* data);
 		bool logout(bool displayEffect, bool forced);
 
 		void setPlayer(Player* p);
 
+		//payloads that are the same for every spectator, Game encodes them once
+		static void AddAnimatedText(NetworkMessage* msg, const Position& pos, uint8_t color, const std::string& text);
+		static void AddMagicEffect(NetworkMessage* msg, const Position& pos, uint8_t type);
+		static void AddDistanceShoot(NetworkMessage* msg, const Position& from, const Position& to, uint8_t type);
+		static void AddCreatureSpeak(NetworkMessage* msg, const Creature* creature, SpeakClasses type, std::string text, uint16_t channelId, uint32_t time = 0, Position* pos = NULL);
+		static void AddCreatureHealth(NetworkMessage* msg, const Creature* creature);
+
 	private:
-		std::list<uint32_t> knownCreatureList;
+		KnownCreatureList knownCreatureList;
 
 		bool connect(uint32_t playerId);
 		void disconnect();
@@ -76,8 +145,16 @@ class ProtocolGame : public Protocol
 
 		// we have all the parse methods
 		virtual void parsePacket(NetworkMessage& msg);
+		static bool getPacketClass(uint8_t recvbyte, PacketClass_t& packetClass);
+		bool takePacketToken(uint8_t recvbyte);
 		virtual void onRecvFirstMessage(NetworkMessage& msg);
 		bool parseFirstPacket(NetworkMessage& msg);
+		void queueLogin(std::string accName, std::string name, std::string password, uint16_t operatingSystem,
+			uint8_t gamemasterLogin, uint32_t ip);
+		void fetchLogin(std::string accName, std::string name, std::string password, uint16_t operatingSystem,
+			uint8_t gamemasterLogin, uint32_t ip, uint32_t token);
+		void onLoginFetched(std::string accName, std::string name, std::string password, uint16_t operatingSystem,
+			uint8_t gamemasterLogin, uint32_t ip, uint32_t token, GameLoginData* data);
 
 		//Parse methods
 		void parseLogout(NetworkMessage& msg);
@@ -169,6 +246,12 @@ class ProtocolGame : public Protocol
 		void sendMagicEffect(const Position& pos, uint8_t type);
 		void sendAnimatedText(const Position& pos, uint8_t color, std::string text);
 		void sendCreatureHealth(const Creature* creature);
+
+		void sendDistanceShoot(const Position& from, const Position& to, uint8_t type, const EncodedMessage& packet);
+		void sendMagicEffect(const Position& pos, uint8_t type, const EncodedMessage& packet);
+		void sendAnimatedText(const Position& pos, const EncodedMessage& packet);
+		void sendEncodedMessage(const EncodedMessage& packet);
+		bool canSendCosmetic();
 		void sendSkills();
 		void sendPing();
 		void sendCreatureTurn(const Creature* creature, uint8_t stackpos);
@@ -238,6 +321,7 @@ class ProtocolGame : public Protocol
 		//Help functions
 
 		// translate a tile to clientreadable format
+		static const TileItemCache* getTileItems(const Tile* tile);
 		void GetTileDescription(const Tile* tile, NetworkMessage* msg);
 
 		// translate a floor to clientreadable format
@@ -250,13 +334,8 @@ class ProtocolGame : public Protocol
 
 		void AddMapDescription(NetworkMessage* msg, const Position& pos);
 		void AddTextMessage(NetworkMessage* msg,MessageClasses mclass, const std::string& message);
-		void AddAnimatedText(NetworkMessage* msg, const Position& pos, uint8_t color, const std::string& text);
-		void AddMagicEffect(NetworkMessage* msg, const Position& pos, uint8_t type);
-		void AddDistanceShoot(NetworkMessage* msg, const Position& from, const Position& to, uint8_t type);
 		void AddCreature(NetworkMessage* msg, const Creature* creature, bool known, uint32_t remove);
 		void AddPlayerStats(NetworkMessage* msg);
-		void AddCreatureSpeak(NetworkMessage* msg, const Creature* creature, SpeakClasses type, std::string text, uint16_t channelId, uint32_t time = 0, Position* pos = NULL);
-		void AddCreatureHealth(NetworkMessage* msg, const Creature* creature);
 		void AddCreatureOutfit(NetworkMessage* msg, const Creature* creature, const Outfit_t& outfit);
 		void AddCreatureInvisible(NetworkMessage* msg, const Creature* creature);
 		void AddPlayerSkills(NetworkMessage* msg);
@@ -335,6 +414,11 @@ class ProtocolGame : public Protocol
 		int32_t m_rejectCount;
 		uint32_t eventConnect;
 
+		PacketBucket m_packetBuckets[PACKET_CLASS_LAST];
+		bool m_walkDropped;
+
+		uint32_t m_viewStamp, m_lastViewStamp;
+
 		bool m_debugAssertSent;
 		bool m_acceptPackets;
 };
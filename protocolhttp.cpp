@@ -19,48 +19,61 @@
 
 #include "outputmessage.h"
 #include "connection.h"
+#include "metrics.h"
+#include "resources.h"
+
+#include <sstream>
 
 #ifdef __ENABLE_SERVER_DIAGNOSTIC__
 uint32_t ProtocolHTTP::protocolHTTPCount = 0;
 #endif
 
+#ifdef __DEBUG_NET_DETAIL__
 void ProtocolHTTP::deleteProtocolTask()
 {
-#ifdef __DEBUG_NET_DETAIL__
 	std::cout << "Deleting ProtocolHTTP" << std::endl;
-#endif
 	Protocol::deleteProtocolTask();
 }
+#endif
 
-void ProtocolHTTP::disconnectClient()
+void ProtocolHTTP::onRecvFirstMessage(NetworkMessage& msg)
 {
-	getConnection()->close();
+	//network thread, the connection hands over the raw request
+	std::string request(msg.getBuffer(), msg.getMessageLength());
+	std::string::size_type end = request.find("\r\n");
+	if(end != std::string::npos)
+		request.erase(end);
+
+	std::istringstream line(request);
+	std::string method, path;
+	line >> method >> path;
+	if(method == "GET" && path == "/metrics")
+		sendResponse("200 OK", "text/plain; version=0.0.4", Metrics::getInstance()->getText());
+	else
+		sendResponse("404 Not Found", "text/plain", "Not found\n");
+
+	getConnection()->closeConnection();
 }
 
-bool ProtocolHTTP::parseFirstPacket(NetworkMessage& msg)
+void ProtocolHTTP::sendResponse(const std::string& status, const std::string& contentType, const std::string& body)
 {
-	if(OutputMessage_ptr output = OutputMessagePool::getInstance()->getOutputMessage(this, false))
-	{
-		TRACK_MESSAGE(output);
+	OutputMessage* output = OutputMessagePool::getInstance()->getOutputMessage(this, false);
+	if(!output)
+		return;
 
-		output->AddString("HTTP/1.1 200 OK");
-		output->AddString("Date: Fri, 27 Mar 2009 17:28.13 GMT\r\n");
-		output->AddString("Server: The Forgotten Server httpd/0.4\r\n");
-		output->AddString("Content-Location: filename.html\r\n");
-		//Vary: negotiate\r\n
-		//TCN: choice\r\n
-		output->AddString("Last-Modified: Fri, 27 Mar 2009 17:28.13 GMT\r\n");
-		output->AddString("Accept-Ranges: bytes\r\n");
-		output->AddString("Content-Length: 1234\r\n");
-		output->AddString("Expires: Fri, 27 Mar 2009 17:28.13 GMT\r\n");
-		output->AddString("Connection: close\r\n");
-		output->AddString("Content-Type: text/html qs=0.7\r\n");
-		output->AddString("\r\n");
-		output->AddString("<html><head><title>The Forgotten Server httpd</title></head><body>It works (apache ripoff ;D)!</body></html>");
+	TRACK_MESSAGE(output);
+	std::stringstream header;
+	header << "HTTP/1.1 " << status << "\r\n";
+	header << "Server: " << STATUS_SERVER_NAME << "\r\n";
+	header << "Content-Type: " << contentType << "\r\n";
+	header << "Content-Length: " << body.size() << "\r\n";
+	header << "Connection: close\r\n\r\n";
 
-		OutputMessagePool::getInstance()->send(output);
-	}
+	std::string response = header.str() + body;
+	//AddBytes takes at most 8192 bytes at once
+	for(std::string::size_type pos = 0; pos < response.size(); pos += 8192)
+		output->AddBytes(response.c_str() + pos, std::min((std::string::size_type)8192, response.size() - pos));
 
-	getConnection()->close();
-	return true;
+	setRawMessages(true);
+	OutputMessagePool::getInstance()->send(output);
 }
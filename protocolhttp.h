@@ -18,6 +18,7 @@
 #ifndef __PROTOCOL_HTTP__
 #define __PROTOCOL_HTTP__
 #include "protocol.h"
+#include <string>
 
 class NetworkMessage;
 class OutputMessage;
@@ -28,15 +29,11 @@ class ProtocolHTTP : public Protocol
 #ifdef __ENABLE_SERVER_DIAGNOSTIC__
 		static uint32_t protocolHTTPCount;
 #endif
-		virtual void onRecvFirstMessage(NetworkMessage& msg) {parseFirstPacket(msg);}
-
 		ProtocolHTTP(Connection* connection) : Protocol(connection)
 		{
 #ifdef __ENABLE_SERVER_DIAGNOSTIC__
 			protocolHTTPCount++;
 #endif
-			disableXTEAEncryption();
-			disableChecksum();
 		}
 		virtual ~ProtocolHTTP()
 		{
@@ -45,15 +42,16 @@ class ProtocolHTTP : public Protocol
 #endif
 		}
 
-		enum {protocolId = 0x00};
-		enum {isSingleSocket = true};
-		enum {hasChecksum = false};
-		static const char* protocolName() {return "http protocol";}
+		//the first byte of a GET request, http has no protocol byte of its own
+		virtual int32_t getProtocolId() {return 0x47;}
+
+		virtual void onRecvFirstMessage(NetworkMessage& msg);
 
 	protected:
-		virtual void deleteProtocolTask();
+		void sendResponse(const std::string& status, const std::string& contentType, const std::string& body);
 
-		void disconnectClient();
-		bool parseFirstPacket(NetworkMessage& msg);
+		#ifdef __DEBUG_NET_DETAIL__
+		virtual void deleteProtocolTask();
+		#endif
 };
 #endif
@@ -32,6 +32,8 @@
 #include "ioban.h"
 #include <iomanip>
 #include "game.h"
+#include "tasks.h"
+#include "databasetasks.h"
 #ifndef __CONSOLE__
 #include "gui.h"
 #endif
@@ -105,8 +107,6 @@ bool ProtocolLogin::parseFirstPacket(NetworkMessage& msg)
 	std::string name = msg.GetString();
 	toLowerCaseString(name);
 	std::string password = msg.GetString();
-	uint32_t id = 1;
-
 	if(!name.length())
 	{
 		if(g_config.getBool(ConfigManager::ACCOUNT_MANAGER))
@@ -142,46 +142,71 @@ bool ProtocolLogin::parseFirstPacket(NetworkMessage& msg)
 		return false;
 	}
 
+	//the lookups below wait for the database, keep them off the network thread
+	addRef();
+	DatabaseTasks::getInstance()->addTask(createTask(boost::bind(&ProtocolLogin::loadAccount, this, name, password, clientIP)));
+	return true;
+}
+
+void ProtocolLogin::loadAccount(std::string name, std::string password, uint32_t clientIP)
+{
+	//database thread
+	Account account;
+	std::string error;
 	if(IOBan::getInstance()->isIpBanished(clientIP))
+		error = "Your IP is banished!";
+	else
 	{
-		disconnectClient(0x0A, "Your IP is banished!");
-		return false;
-	}
+		uint32_t id = 1;
+		if(IOLoginData::getInstance()->getAccountId(name, id) || (!name.length() && g_config.getBool(ConfigManager::ACCOUNT_MANAGER)))
+		{
+			account = IOLoginData::getInstance()->loadAccount(id);
+			if(id < 1 || id != account.number || !passwordTest(password, account.password))
+				account.number = 0;
+		}
 
-	uint32_t serverIP = serverIPs[0].first;
-	for(uint32_t i = 0; i < serverIPs.size(); i++)
-	{
-		if((serverIPs[i].first & serverIPs[i].second) == (clientIP & serverIPs[i].second))
+		if(!account.number)
 		{
-			serverIP = serverIPs[i].first;
-			break;
+			ConnectionManager::getInstance()->addAttempt(clientIP, false);
+			error = "Account name or password is not correct.";
+		}
+		else
+		{
+			//Remove premium days
+			IOLoginData::getInstance()->removePremium(account);
+			if(!g_config.getBool(ConfigManager::ACCOUNT_MANAGER) && !account.charList.size())
+				error = "This account does not contain any character yet.\nCreate a new character on the " + g_config.getString(ConfigManager::SERVER_NAME) + " website at " + g_config.getString(ConfigManager::URL) + ".";
+			else
+				ConnectionManager::getInstance()->addAttempt(clientIP, true);
 		}
 	}
 
-	Account account;
-	if(IOLoginData::getInstance()->getAccountId(name, id) || (!name.length() && g_config.getBool(ConfigManager::ACCOUNT_MANAGER)))
-	{
-		account = IOLoginData::getInstance()->loadAccount(id);
-		if(id < 1 || id != account.number || !passwordTest(password, account.password))
-			account.number = 0;
-	}
+	Dispatcher::getDispatcher().addTask(createTask(boost::bind(&ProtocolLogin::sendCharacterList, this, account, clientIP, error)));
+}
+
+void ProtocolLogin::sendCharacterList(const Account& account, uint32_t clientIP, const std::string& error)
+{
+	//dispatcher thread
+	unRef();
+	if(!getConnection())
+		return;
 
-	if(!account.number)
+	if(!error.empty())
 	{
-		ConnectionManager::getInstance()->addAttempt(clientIP, false);
-		disconnectClient(0x0A, "Account name or password is not correct.");
-		return false;
+		disconnectClient(0x0A, error.c_str());
+		return;
 	}
 
-	//Remove premium days
-	IOLoginData::getInstance()->removePremium(account);
-	if(!g_config.getBool(ConfigManager::ACCOUNT_MANAGER) && !account.charList.size())
+	uint32_t serverIP = serverIPs[0].first;
+	for(uint32_t i = 0; i < serverIPs.size(); i++)
 	{
-		disconnectClient(0x0A, std::string("This account does not contain any character yet.\nCreate a new character on the " + g_config.getString(ConfigManager::SERVER_NAME) + " website at " + g_config.getString(ConfigManager::URL) + ".").c_str());
-		return false;
+		if((serverIPs[i].first & serverIPs[i].second) == (clientIP & serverIPs[i].second))
+		{
+			serverIP = serverIPs[i].first;
+			break;
+		}
 	}
 
-	ConnectionManager::getInstance()->addAttempt(clientIP, true);
 	if(OutputMessage* output = OutputMessagePool::getInstance()->getOutputMessage(this, false))
 	{
 		TRACK_MESSAGE(output);
@@ -194,7 +219,7 @@ bool ProtocolLogin::parseFirstPacket(NetworkMessage& msg)
 
 		//Add char list
 		output->AddByte(0x64);
-		if(g_config.getBool(ConfigManager::ACCOUNT_MANAGER) && id != 1)
+		if(g_config.getBool(ConfigManager::ACCOUNT_MANAGER) && account.number != 1)
 		{
 			output->AddByte((uint8_t)account.charList.size() + 1);
 			output->AddString("Account Manager");
@@ -205,7 +230,7 @@ bool ProtocolLogin::parseFirstPacket(NetworkMessage& msg)
 		else
 			output->AddByte((uint8_t)account.charList.size());
 
-		for(Characters::iterator it = account.charList.begin(); it != account.charList.end(); it++)
+		for(Characters::const_iterator it = account.charList.begin(); it != account.charList.end(); it++)
 		{
 			#ifndef __LOGIN_SERVER__
 			output->AddString((*it));
@@ -239,7 +264,6 @@ bool ProtocolLogin::parseFirstPacket(NetworkMessage& msg)
 	}
 
 	getConnection()->closeConnection();
-	return true;
 }
 
 void ProtocolLogin::onRecvFirstMessage(NetworkMessage& msg)
@@ -22,6 +22,7 @@
 #define __OTSERV_PROTOCOL_LOGIN_H__
 
 #include "protocol.h"
+#include "account.h"
 
 class NetworkMessage;
 class OutputMessage;
@@ -46,6 +47,7 @@ class ProtocolLogin : public Protocol
 		}
 
 		virtual int32_t getProtocolId() {return 0x01;}
+		virtual bool hasRSAFirstMessage() const {return true;}
 
 		virtual void onRecvFirstMessage(NetworkMessage& msg);
 
@@ -53,6 +55,8 @@ class ProtocolLogin : public Protocol
 		void disconnectClient(uint8_t error, const char* message);
 
 		bool parseFirstPacket(NetworkMessage& msg);
+		void loadAccount(std::string name, std::string password, uint32_t clientIP);
+		void sendCharacterList(const Account& account, uint32_t clientIP, const std::string& error);
 
 		#ifdef __DEBUG_NET_DETAIL__
 		virtual void deleteProtocolTask();
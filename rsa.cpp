@@ -22,6 +22,24 @@
 #include "rsa.h"
 #include <string>
 
+RSAScratch::RSAScratch()
+{
+	mpz_init2(c, 1024);
+	mpz_init2(v1, 1024);
+	mpz_init2(v2, 1024);
+	mpz_init2(u2, 1024);
+	mpz_init2(tmp, 1024);
+}
+
+RSAScratch::~RSAScratch()
+{
+	mpz_clear(c);
+	mpz_clear(v1);
+	mpz_clear(v2);
+	mpz_clear(u2);
+	mpz_clear(tmp);
+}
+
 RSA::RSA()
 {
 	OTSYS_THREAD_LOCKVARINIT(rsaLock);
@@ -87,42 +105,34 @@ void RSA::setKey(const char* p, const char* q, const char* d)
 
 void RSA::decrypt(char* msg, int32_t size)
 {
-	OTSYS_THREAD_LOCK_CLASS lockClass(rsaLock);
-
-	mpz_t c,v1,v2,u2,tmp;
-	mpz_init2(c, 1024);
-	mpz_init2(v1, 1024);
-	mpz_init2(v2, 1024);
-	mpz_init2(u2, 1024);
-	mpz_init2(tmp, 1024);
-
-	mpz_import(c, 128, 1, 1, 0, 0, msg);
+	RSAScratch scratch;
+	decrypt(msg, size, scratch);
+}
 
-	mpz_mod(tmp, c, m_p);
-	mpz_powm(v1, tmp, m_dp, m_p);
-	mpz_mod(tmp, c, m_q);
-	mpz_powm(v2, tmp, m_dq, m_q);
-	mpz_sub(u2, v2, v1);
-	mpz_mul(tmp, u2, m_u);
-	mpz_mod(u2, tmp, m_q);
-	if(mpz_cmp_si(u2, 0) < 0)
+void RSA::decrypt(char* msg, int32_t size, RSAScratch& scratch)
+{
+	//chinese remainder theorem, two half size exponentiations
+	mpz_import(scratch.c, 128, 1, 1, 0, 0, msg);
+
+	mpz_mod(scratch.tmp, scratch.c, m_p);
+	mpz_powm(scratch.v1, scratch.tmp, m_dp, m_p);
+	mpz_mod(scratch.tmp, scratch.c, m_q);
+	mpz_powm(scratch.v2, scratch.tmp, m_dq, m_q);
+	mpz_sub(scratch.u2, scratch.v2, scratch.v1);
+	mpz_mul(scratch.tmp, scratch.u2, m_u);
+	mpz_mod(scratch.u2, scratch.tmp, m_q);
+	if(mpz_cmp_si(scratch.u2, 0) < 0)
 	{
-		mpz_add(tmp, u2, m_q);
-		mpz_set(u2, tmp);
+		mpz_add(scratch.tmp, scratch.u2, m_q);
+		mpz_set(scratch.u2, scratch.tmp);
 	}
-	mpz_mul(tmp, u2, m_p);
-	mpz_set_ui(c, 0);
-	mpz_add(c, v1, tmp);
+	mpz_mul(scratch.tmp, scratch.u2, m_p);
+	mpz_set_ui(scratch.c, 0);
+	mpz_add(scratch.c, scratch.v1, scratch.tmp);
 
-	size_t count = (mpz_sizeinbase(c, 2) + 7)/8;
+	size_t count = (mpz_sizeinbase(scratch.c, 2) + 7)/8;
 	memset(msg, 0, 128 - count);
-	mpz_export(&msg[128 - count], NULL, 1, 1, 0, 0, c);
-
-	mpz_clear(c);
-	mpz_clear(v1);
-	mpz_clear(v2);
-	mpz_clear(u2);
-	mpz_clear(tmp);
+	mpz_export(&msg[128 - count], NULL, 1, 1, 0, 0, scratch.c);
 }
 
 int32_t RSA::getKeySize()
@@ -136,3 +146,61 @@ void RSA::getPublicKey(char* buffer)
 	memset(buffer, 0, 128 - count);
 	mpz_export(&buffer[128 - count], NULL, 1, 1, 0, 0, m_mod);
 }
+
+RSAPool::RSAPool()
+{
+	m_rsa = NULL;
+	m_threads = 0;
+	OTSYS_THREAD_LOCKVARINIT(m_jobLock);
+	OTSYS_THREAD_SIGNALVARINIT(m_jobSignal);
+}
+
+void RSAPool::start(RSA* rsa, int32_t threads)
+{
+	m_rsa = rsa;
+	for(; m_threads < threads; ++m_threads)
+		OTSYS_CREATE_THREAD(RSAPool::workerThread, NULL);
+}
+
+OTSYS_THREAD_RETURN RSAPool::workerThread(void* p)
+{
+	RSAPool* pool = RSAPool::getInstance();
+	RSAScratch scratch;
+	while(true)
+	{
+		OTSYS_THREAD_LOCK(pool->m_jobLock, "");
+		while(pool->m_jobs.empty())
+			OTSYS_THREAD_WAITSIGNAL(pool->m_jobSignal, pool->m_jobLock);
+
+		RSAJob job = pool->m_jobs.front();
+		pool->m_jobs.pop_front();
+		OTSYS_THREAD_UNLOCK(pool->m_jobLock, "");
+
+		pool->m_rsa->decrypt(job.msg, 128, scratch);
+		job.callback();
+	}
+
+	#if not defined(__USE_BOOST_THREAD__) && not defined(WIN32)
+	return NULL;
+	#endif
+}
+
+void RSAPool::addJob(char* msg, const RSACallback& callback)
+{
+	RSAJob job;
+	job.msg = msg;
+	job.callback = callback;
+
+	OTSYS_THREAD_LOCK(m_jobLock, "");
+	m_jobs.push_back(job);
+	OTSYS_THREAD_UNLOCK(m_jobLock, "");
+	OTSYS_THREAD_SIGNAL_SEND(m_jobSignal);
+}
+
+uint32_t RSAPool::getJobCount()
+{
+	OTSYS_THREAD_LOCK(m_jobLock, "");
+	uint32_t count = m_jobs.size();
+	OTSYS_THREAD_UNLOCK(m_jobLock, "");
+	return count;
+}
@@ -24,6 +24,16 @@
 #include "otsystem.h"
 
 #include "gmp.h"
+#include <boost/function.hpp>
+
+//numbers reused by every decryption of one thread
+struct RSAScratch
+{
+	RSAScratch();
+	~RSAScratch();
+
+	mpz_t c, v1, v2, u2, tmp;
+};
 
 class RSA
 {
@@ -32,7 +42,10 @@ class RSA
 		~RSA();
 		void setKey(const char* p, const char* q, const char* d);
 		bool setKey(const std::string& file);
+
+		//the key is only set at startup, so decrypting needs no lock
 		void decrypt(char* msg, int32_t size);
+		void decrypt(char* msg, int32_t size, RSAScratch& scratch);
 
 		int32_t getKeySize();
 		void getPublicKey(char* buffer);
@@ -46,4 +59,42 @@ class RSA
 		mpz_t m_p, m_q, m_u, m_d, m_dp, m_dq, m_mod;
 };
 
+typedef boost::function<void (void)> RSACallback;
+struct RSAJob
+{
+	char* msg;
+	RSACallback callback;
+};
+
+//decrypts handshake blocks off the network thread
+class RSAPool
+{
+	public:
+		virtual ~RSAPool() {}
+		static RSAPool* getInstance()
+		{
+			static RSAPool instance;
+			return &instance;
+		}
+
+		void start(RSA* rsa, int32_t threads);
+		bool isRunning() const {return m_threads > 0;}
+
+		//any thread, decrypts the 128 bytes at msg in place and then calls back from a worker
+		void addJob(char* msg, const RSACallback& callback);
+		uint32_t getJobCount();
+
+		static OTSYS_THREAD_RETURN workerThread(void* p);
+
+	protected:
+		RSAPool();
+
+		RSA* m_rsa;
+		int32_t m_threads;
+
+		std::list<RSAJob> m_jobs;
+		OTSYS_THREAD_LOCKVAR_PTR m_jobLock;
+		OTSYS_THREAD_SIGNALVAR m_jobSignal;
+};
+
 #endif
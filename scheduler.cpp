@@ -162,6 +162,14 @@ bool Scheduler::stopEvent(uint32_t eventid)
 	}
 }
 
+uint32_t Scheduler::getEventCount()
+{
+	OTSYS_THREAD_LOCK(m_eventLock, "");
+	uint32_t count = m_eventIds.size();
+	OTSYS_THREAD_UNLOCK(m_eventLock, "");
+	return count;
+}
+
 void Scheduler::stop()
 {
 	OTSYS_THREAD_LOCK(m_eventLock, "");
@@ -90,6 +90,7 @@ class Scheduler
 
 		uint32_t addEvent(SchedulerTask* task);
 		bool stopEvent(uint32_t eventId);
+		uint32_t getEventCount();
 
 		void stop();
 		void shutdown();
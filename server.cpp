@@ -26,7 +26,7 @@
 Server::Server(uint32_t serverip, uint16_t port):
 m_io_service()
 {
-	m_acceptor = NULL;
+	m_acceptor = m_metricsAcceptor = NULL;
 	m_listenErrors = 0;
 	m_shutdown = false;
 	m_serverIp = serverip;
@@ -49,6 +49,61 @@ void Server::accept()
 		m_acceptor->async_accept(connection->getHandle(), boost::bind(&Server::onAccept, this, connection, boost::asio::placeholders::error));
 }
 
+void Server::acceptMetrics()
+{
+	if(m_shutdown || !m_metricsAcceptor)
+		return;
+
+	Connection* connection = ConnectionManager::getInstance()->createConnection(m_io_service);
+	if(connection)
+		m_metricsAcceptor->async_accept(connection->getHandle(), boost::bind(&Server::onAcceptMetrics, this, connection, boost::asio::placeholders::error));
+}
+
+bool Server::openMetricsSocket(uint32_t ip, uint16_t port)
+{
+	boost::system::error_code error;
+	boost::asio::ip::tcp::endpoint endpoint(boost::asio::ip::address(boost::asio::ip::address_v4(ip)), port);
+
+	m_metricsAcceptor = new boost::asio::ip::tcp::acceptor(m_io_service);
+	m_metricsAcceptor->open(endpoint.protocol(), error);
+	if(!error)
+	{
+		m_metricsAcceptor->set_option(boost::asio::ip::tcp::acceptor::reuse_address(true), error);
+		m_metricsAcceptor->bind(endpoint, error);
+	}
+
+	if(!error)
+		m_metricsAcceptor->listen(boost::asio::socket_base::max_connections, error);
+
+	if(error)
+	{
+		delete m_metricsAcceptor;
+		m_metricsAcceptor = NULL;
+		return false;
+	}
+
+	acceptMetrics();
+	return true;
+}
+
+void Server::onAcceptMetrics(Connection* connection, const boost::system::error_code& error)
+{
+	if(!error)
+	{
+		connection->acceptHttpConnection();
+		acceptMetrics();
+	}
+	else if(error != boost::asio::error::operation_aborted)
+	{
+		//metrics are not worth a retry loop, the game listener is unaffected
+		PRINT_ASIO_ERROR("Accepting metrics");
+		std::cout << "[Warning - Server::onAcceptMetrics] Metrics listener stopped." << std::endl;
+		delete connection;
+	}
+	else
+		delete connection;
+}
+
 void Server::closeListenSocket()
 {
 	if(m_acceptor)
@@ -117,5 +172,13 @@ void Server::stop()
 void Server::onStopServer()
 {
 	closeListenSocket();
+	if(m_metricsAcceptor)
+	{
+		boost::system::error_code error;
+		m_metricsAcceptor->close(error);
+		delete m_metricsAcceptor;
+		m_metricsAcceptor = NULL;
+	}
+
 	//ConnectionManager::getInstance()->closeAll();
 }
@@ -38,17 +38,23 @@ class Server : boost::noncopyable
 		void run() {m_io_service.run();}
 		void stop();
 
+		//http metrics get a listener of their own, game clients never reach them
+		bool openMetricsSocket(uint32_t ip, uint16_t port);
+
 	private:
 		void onAccept(Connection* connection, const boost::system::error_code& error);
+		void onAcceptMetrics(Connection* connection, const boost::system::error_code& error);
 		void onStopServer();
 
 		void accept();
+		void acceptMetrics();
 
 		void openListenSocket();
 		void closeListenSocket();
 
 		boost::asio::io_service m_io_service;
 		boost::asio::ip::tcp::acceptor* m_acceptor;
+		boost::asio::ip::tcp::acceptor* m_metricsAcceptor;
 
 		uint32_t m_listenErrors;
 		bool m_shutdown;
@@ -30,6 +30,7 @@
 #include "outputmessage.h"
 #include "tools.h"
 #include "resources.h"
+#include "tasks.h"
 
 #ifndef WIN32
 	#define SOCKET_ERROR -1
@@ -55,21 +56,38 @@ enum RequestedInfo_t
 	REQUEST_SERVER_SOFTWARE_INFO = 0x80
 };
 
-std::map<uint32_t, int64_t> ProtocolStatus::ipConnectMap;
+IpConnectMap ProtocolStatus::ipConnectMap[2];
+int64_t ProtocolStatus::ipConnectRotated = 0;
+
+bool ProtocolStatus::checkIp(uint32_t ip)
+{
+	int64_t now = OTSYS_TIME(), timeout = g_config.getNumber(ConfigManager::STATUSQUERY_TIMEOUT);
+	if(now >= ipConnectRotated + timeout || ipConnectMap[0].size() >= STATUS_MAX_TRACKED_IPS)
+	{
+		ipConnectMap[1].swap(ipConnectMap[0]);
+		ipConnectMap[0].clear();
+		ipConnectRotated = now;
+	}
+
+	for(int32_t i = 0; i < 2; ++i)
+	{
+		IpConnectMap::const_iterator it = ipConnectMap[i].find(ip);
+		if(it != ipConnectMap[i].end() && now < it->second + timeout)
+			return false;
+	}
+
+	ipConnectMap[0][ip] = now;
+	return true;
+}
 
 void ProtocolStatus::onRecvFirstMessage(NetworkMessage& msg)
 {
-	std::map<uint32_t, int64_t>::const_iterator it = ipConnectMap.find(getIP());
-	if(it != ipConnectMap.end())
+	if(!checkIp(getIP()))
 	{
-		if(OTSYS_TIME() < it->second + g_config.getNumber(ConfigManager::STATUSQUERY_TIMEOUT))
-		{
-			getConnection()->closeConnection();
-			return;
-		}
+		getConnection()->closeConnection();
+		return;
 	}
 
-	ipConnectMap[getIP()] = OTSYS_TIME();
 	switch(msg.GetByte())
 	{
 		//XML info protocol
@@ -125,12 +143,113 @@ void ProtocolStatus::deleteProtocolTask()
 
 Status::Status()
 {
+	OTSYS_THREAD_LOCKVARINIT(m_cacheLock);
 	m_playersOnline = 0;
 	m_playersMax = 0;
 	m_start = OTSYS_TIME();
+	m_cacheTime = 0;
+	m_cacheUpdating = m_snapshotChanged = false;
+
+	m_snapshot.playersRecord = m_snapshot.monstersOnline = m_snapshot.npcsOnline = 0;
+	m_snapshot.mapWidth = m_snapshot.mapHeight = 0;
+}
+
+void Status::checkCache()
+{
+	//network thread, with the cache lock held
+	if(m_cacheUpdating || OTSYS_TIME() < m_cacheTime + g_config.getNumber(ConfigManager::STATUS_CACHE_TIME))
+		return;
+
+	m_cacheUpdating = true;
+	Dispatcher::getDispatcher().addTask(createTask(boost::bind(&Status::updateCache, this)));
+}
+
+void Status::updateCache()
+{
+	//dispatcher thread, the only one that may read the game state, only copies it
+	StatusSnapshot snapshot;
+	snapshot.playersRecord = g_game.getLastPlayersRecord();
+	snapshot.monstersOnline = g_game.getMonstersOnline();
+	snapshot.npcsOnline = g_game.getNpcsOnline();
+	g_game.getMapDimensions(snapshot.mapWidth, snapshot.mapHeight);
+	for(AutoList<Player>::listiterator it = Player::listPlayer.list.begin(); it != Player::listPlayer.list.end(); ++it)
+	{
+		snapshot.players.push_back(std::make_pair(it->second->getName(), it->second->getLevel()));
+		snapshot.playerNames.insert(asLowerCaseString(it->second->getName()));
+	}
+
+	OTSYS_THREAD_LOCK_CLASS lockClass(m_cacheLock);
+	m_snapshot.players.swap(snapshot.players);
+	m_snapshot.playerNames.swap(snapshot.playerNames);
+	m_snapshot.playersRecord = snapshot.playersRecord;
+	m_snapshot.monstersOnline = snapshot.monstersOnline;
+	m_snapshot.npcsOnline = snapshot.npcsOnline;
+	m_snapshot.mapWidth = snapshot.mapWidth;
+	m_snapshot.mapHeight = snapshot.mapHeight;
+
+	m_cacheTime = OTSYS_TIME();
+	m_cacheUpdating = false;
+	m_snapshotChanged = true;
 }
 
-std::string Status::getStatusString() const
+void Status::refreshCache()
+{
+	//network thread, serializes a changed snapshot without holding the lock
+	StatusSnapshot snapshot;
+	{
+		OTSYS_THREAD_LOCK_CLASS lockClass(m_cacheLock);
+		checkCache();
+		if(!m_snapshotChanged)
+			return;
+
+		snapshot = m_snapshot;
+		m_snapshotChanged = false;
+	}
+
+	std::string statusString = buildStatusString(snapshot), infoBlocks[STATUS_INFO_BLOCKS];
+	for(int32_t i = 0; i < STATUS_INFO_BLOCKS; ++i)
+	{
+		if((1 << i) != REQUEST_PLAYER_STATUS_INFO)
+			infoBlocks[i] = buildInfo(1 << i, snapshot);
+	}
+
+	OTSYS_THREAD_LOCK_CLASS lockClass(m_cacheLock);
+	m_statusString.swap(statusString);
+	for(int32_t i = 0; i < STATUS_INFO_BLOCKS; ++i)
+		m_infoBlocks[i].swap(infoBlocks[i]);
+}
+
+std::string Status::getStatusString()
+{
+	refreshCache();
+	OTSYS_THREAD_LOCK_CLASS lockClass(m_cacheLock);
+	return m_statusString;
+}
+
+void Status::getInfo(uint32_t requestedInfo, OutputMessage* output, NetworkMessage& msg)
+{
+	refreshCache();
+	OTSYS_THREAD_LOCK_CLASS lockClass(m_cacheLock);
+	for(int32_t i = 0; i < STATUS_INFO_BLOCKS; ++i)
+	{
+		if(!(requestedInfo & (1 << i)))
+			continue;
+
+		if((1 << i) == REQUEST_PLAYER_STATUS_INFO)
+		{
+			output->AddByte(0x22); // players info - online status info of a player
+			const std::string name = msg.GetString();
+			if(m_snapshot.playerNames.find(asLowerCaseString(name)) != m_snapshot.playerNames.end())
+				output->AddByte(0x01);
+			else
+				output->AddByte(0x00);
+		}
+		else
+			output->AddBytes(m_infoBlocks[i].c_str(), m_infoBlocks[i].size());
+	}
+}
+
+std::string Status::buildStatusString(const StatusSnapshot& snapshot) const
 {
 	std::string xml;
 	char buffer[90];
@@ -168,28 +287,26 @@ std::string Status::getStatusString() const
 	xmlSetProp(p, (const xmlChar*)"online", (const xmlChar*)buffer);
 	sprintf(buffer, "%d", m_playersMax);
 	xmlSetProp(p, (const xmlChar*)"max", (const xmlChar*)buffer);
-	sprintf(buffer, "%d", g_game.getLastPlayersRecord());
+	sprintf(buffer, "%u", snapshot.playersRecord);
 	xmlSetProp(p, (const xmlChar*)"peak", (const xmlChar*)buffer);
 	xmlAddChild(root, p);
 
 	p = xmlNewNode(NULL,(const xmlChar*)"monsters");
-	sprintf(buffer, "%d", g_game.getMonstersOnline());
+	sprintf(buffer, "%u", snapshot.monstersOnline);
 	xmlSetProp(p, (const xmlChar*)"total", (const xmlChar*)buffer);
 	xmlAddChild(root, p);
 
 	p = xmlNewNode(NULL,(const xmlChar*)"npcs");
-	sprintf(buffer, "%d", g_game.getNpcsOnline());
+	sprintf(buffer, "%u", snapshot.npcsOnline);
 	xmlSetProp(p, (const xmlChar*)"total", (const xmlChar*)buffer);
 	xmlAddChild(root, p);
 
 	p = xmlNewNode(NULL,(const xmlChar*)"map");
 	xmlSetProp(p, (const xmlChar*)"name", (const xmlChar*)m_mapName.c_str());
 	xmlSetProp(p, (const xmlChar*)"author", (const xmlChar*)m_mapAuthor.c_str());
-	uint32_t mapWidth, mapHeight;
-	g_game.getMapDimensions(mapWidth, mapHeight);
-	sprintf(buffer, "%u", mapWidth);
+	sprintf(buffer, "%u", snapshot.mapWidth);
 	xmlSetProp(p, (const xmlChar*)"width", (const xmlChar*)buffer);
-	sprintf(buffer, "%u", mapHeight);
+	sprintf(buffer, "%u", snapshot.mapHeight);
 	xmlSetProp(p, (const xmlChar*)"height", (const xmlChar*)buffer);
 	xmlAddChild(root, p);
 
@@ -208,85 +325,83 @@ std::string Status::getStatusString() const
 	return xml;
 }
 
-void Status::getInfo(uint32_t requestedInfo, OutputMessage* output, NetworkMessage& msg) const
+std::string Status::buildInfo(uint32_t requestedInfo, const StatusSnapshot& snapshot) const
 {
+	EncodedMessage msg;
 	if(requestedInfo & REQUEST_BASIC_SERVER_INFO)
 	{
-		output->AddByte(0x10);
-		output->AddString(g_config.getString(ConfigManager::SERVER_NAME).c_str());
-		output->AddString(g_config.getString(ConfigManager::IP).c_str());
+		msg.AddByte(0x10);
+		msg.AddString(g_config.getString(ConfigManager::SERVER_NAME).c_str());
+		msg.AddString(g_config.getString(ConfigManager::IP).c_str());
 		char buffer[10];
 		sprintf(buffer, "%d", g_config.getNumber(ConfigManager::PORT));
-		output->AddString(buffer);
-  	}
+		msg.AddString(buffer);
+	}
 
 	if(requestedInfo & REQUEST_OWNER_SERVER_INFO)
 	{
-		output->AddByte(0x11);
-		output->AddString(g_config.getString(ConfigManager::OWNER_NAME).c_str());
-		output->AddString(g_config.getString(ConfigManager::OWNER_EMAIL).c_str());
-  	}
+		msg.AddByte(0x11);
+		msg.AddString(g_config.getString(ConfigManager::OWNER_NAME).c_str());
+		msg.AddString(g_config.getString(ConfigManager::OWNER_EMAIL).c_str());
+	}
 
 	if(requestedInfo & REQUEST_MISC_SERVER_INFO)
 	{
-		output->AddByte(0x12);
-		output->AddString(g_config.getString(ConfigManager::MOTD).c_str());
-		output->AddString(g_config.getString(ConfigManager::LOCATION).c_str());
-		output->AddString(g_config.getString(ConfigManager::URL).c_str());
+		msg.AddByte(0x12);
+		msg.AddString(g_config.getString(ConfigManager::MOTD).c_str());
+		msg.AddString(g_config.getString(ConfigManager::LOCATION).c_str());
+		msg.AddString(g_config.getString(ConfigManager::URL).c_str());
 		uint64_t uptime = getUptime();
-		output->AddU32((uint32_t)(uptime >> 32));
-		output->AddU32((uint32_t)(uptime));
-		output->AddString(STATUS_SERVER_VERSION);
-  	}
+		msg.AddU32((uint32_t)(uptime >> 32));
+		msg.AddU32((uint32_t)(uptime));
+		msg.AddString(STATUS_SERVER_VERSION);
+	}
 
 	if(requestedInfo & REQUEST_PLAYERS_INFO)
 	{
-		output->AddByte(0x20);
-		output->AddU32(m_playersOnline);
-		output->AddU32(m_playersMax);
-		output->AddU32(g_game.getLastPlayersRecord());
-  	}
+		msg.AddByte(0x20);
+		msg.AddU32(m_playersOnline);
+		msg.AddU32(m_playersMax);
+		msg.AddU32(snapshot.playersRecord);
+	}
 
-  	if(requestedInfo & REQUEST_MAP_INFO)
+	if(requestedInfo & REQUEST_MAP_INFO)
 	{
-		output->AddByte(0x30);
-		output->AddString(m_mapName.c_str());
-		output->AddString(m_mapAuthor.c_str());
-		uint32_t mapWidth, mapHeight;
-		g_game.getMapDimensions(mapWidth, mapHeight);
-		output->AddU16(mapWidth);
-		output->AddU16(mapHeight);
-  	}
+		msg.AddByte(0x30);
+		msg.AddString(m_mapName.c_str());
+		msg.AddString(m_mapAuthor.c_str());
+		msg.AddU16(snapshot.mapWidth);
+		msg.AddU16(snapshot.mapHeight);
+	}
 
 	if(requestedInfo & REQUEST_EXT_PLAYERS_INFO)
 	{
-		output->AddByte(0x21); // players info - online players list
-		output->AddU32(m_playersOnline);
-		for(AutoList<Player>::listiterator it = Player::listPlayer.list.begin(); it != Player::listPlayer.list.end(); ++it)
+		//the block is copied as a whole, so the list is cut where it would no longer fit
+		uint32_t count = 0, size = 5;
+		for(; count < snapshot.players.size(); ++count)
 		{
-			//Send the most common info
-			output->AddString(it->second->getName());
-			output->AddU32(it->second->getLevel());
+			size += snapshot.players[count].first.size() + 6;
+			if(size > 8192)
+				break;
 		}
-	}
 
-	if(requestedInfo & REQUEST_PLAYER_STATUS_INFO)
-	{
-		output->AddByte(0x22); // players info - online status info of a player
-		const std::string name = msg.GetString();
-		if(g_game.getPlayerByName(name) != NULL)
-			output->AddByte(0x01);
-		else
-			output->AddByte(0x00);
+		msg.AddByte(0x21); // players info - online players list
+		msg.AddU32(count);
+		for(uint32_t i = 0; i < count; ++i)
+		{
+			//Send the most common info
+			msg.AddString(snapshot.players[i].first);
+			msg.AddU32(snapshot.players[i].second);
+		}
 	}
 
 	if(requestedInfo & REQUEST_SERVER_SOFTWARE_INFO)
 	{
-		output->AddByte(0x23); // server software info
-		output->AddString(STATUS_SERVER_NAME);
-		output->AddString(STATUS_SERVER_VERSION);
-		output->AddString(STATUS_SERVER_PROTOCOL);
+		msg.AddByte(0x23); // server software info
+		msg.AddString(STATUS_SERVER_NAME);
+		msg.AddString(STATUS_SERVER_VERSION);
+		msg.AddString(STATUS_SERVER_PROTOCOL);
 	}
-		
-	return;
+
+	return std::string(msg.getPayload(), msg.getMessageLength());
 }
@@ -25,8 +25,26 @@
 #include "networkmessage.h"
 #include "protocol.h"
 #include <string>
+#include <vector>
+#include <set>
 #include <map>
 
+//ips remembered per generation of the status query throttle
+#define STATUS_MAX_TRACKED_IPS 4096
+//one cached block for each bit of the requested info
+#define STATUS_INFO_BLOCKS 8
+
+typedef std::map<uint32_t, int64_t> IpConnectMap;
+
+//copied from the game state by the dispatcher, the answers are built from it off the game thread
+struct StatusSnapshot
+{
+	uint32_t playersRecord, monstersOnline, npcsOnline, mapWidth, mapHeight;
+	//names and levels of the online players, and their lower case names for the online check
+	std::vector<std::pair<std::string, uint32_t> > players;
+	std::set<std::string> playerNames;
+};
+
 class ProtocolStatus : public Protocol
 {
 	public:
@@ -51,7 +69,12 @@ class ProtocolStatus : public Protocol
 		virtual void onRecvFirstMessage(NetworkMessage& msg);
 
 	protected:
-		static std::map<uint32_t, int64_t> ipConnectMap;
+		static bool checkIp(uint32_t ip);
+
+		//network thread only; an ip lives in the current generation or the previous one,
+		//generations rotate every status timeout so old entries expire without scanning
+		static IpConnectMap ipConnectMap[2];
+		static int64_t ipConnectRotated;
 
 		#ifdef __DEBUG_NET_DETAIL__
 		virtual void deleteProtocolTask();
@@ -61,7 +84,11 @@ class ProtocolStatus : public Protocol
 class Status
 {
 	public:
-		virtual ~Status() {}
+		virtual ~Status()
+		{
+			OTSYS_THREAD_LOCKVARRELEASE(m_cacheLock);
+		}
+
 		static Status* getInstance()
 		{
 			static Status status;
@@ -72,8 +99,10 @@ class Status
 		void removePlayer() {m_playersOnline--;}
 		bool hasSlot() const {return m_playersMax > m_playersOnline;}
 
-		std::string getStatusString() const;
-		void getInfo(uint32_t requestedInfo, OutputMessage* output, NetworkMessage& msg) const;
+		std::string getStatusString();
+		void getInfo(uint32_t requestedInfo, OutputMessage* output, NetworkMessage& msg);
+
+		void updateCache();
 
 		uint32_t getPlayersOnline() const {return m_playersOnline;}
 		uint32_t getMaxPlayersOnline() const {return m_playersMax;}
@@ -89,9 +118,23 @@ class Status
 		Status();
 
 	private:
+		void checkCache();
+		void refreshCache();
+
+		std::string buildStatusString(const StatusSnapshot& snapshot) const;
+		std::string buildInfo(uint32_t requestedInfo, const StatusSnapshot& snapshot) const;
+
 		uint64_t m_start;
 		uint32_t m_playersMax, m_playersOnline;
 		std::string m_mapName, m_mapAuthor;
+
+		//the snapshot is replaced by the dispatcher, the network thread serializes a changed one
+		//into the answers it copies
+		StatusSnapshot m_snapshot;
+		std::string m_statusString, m_infoBlocks[STATUS_INFO_BLOCKS];
+		int64_t m_cacheTime;
+		bool m_cacheUpdating, m_snapshotChanged;
+		OTSYS_THREAD_LOCKVAR m_cacheLock;
 };
 
 #endif
@@ -332,6 +332,26 @@ bool TalkAction::serverDiag(Player* player, const std::string& cmd, const std::s
 	text << "Total message pool: " << OutputMessagePool::getInstance()->getTotalMessageCount() << "\n";
 	text << "Auto message pool: " << OutputMessagePool::getInstance()->getAutoMessageCount() << "\n";
 	text << "Free message pool: " << OutputMessagePool::getInstance()->getAvailableMessageCount() << "\n";
+	for(uint32_t i = OUTPUT_BUFFER_CLASS_SMALL; i < OUTPUT_BUFFER_CLASS_LAST; ++i)
+	{
+		OutputBufferClass_t bufferClass = (OutputBufferClass_t)i;
+		text << "Buffers of " << OutputMessagePool::getBufferSize(bufferClass) << " bytes: "
+			<< OutputMessagePool::getInstance()->getUsedBufferCount(bufferClass) << "/"
+			<< OutputMessagePool::getInstance()->getBufferCount(bufferClass) << " (peak "
+			<< OutputMessagePool::getInstance()->getPeakBufferCount(bufferClass) << ")\n";
+	}
+
+	text << "Buffer memory: " << OutputMessagePool::getInstance()->getBufferMemory() / 1024 << " KB\n";
+	if(Connection* connection = player->getConnection())
+	{
+		text << "Own connection writes: " << connection->getWriteCount() << " (" << connection->getWrittenMessages() << " messages";
+		if(connection->getWriteCount())
+			text << ", " << (double)connection->getWrittenMessages() / connection->getWriteCount() << " per write";
+
+		text << ")\n";
+		text << "Own connection backlog: " << connection->getPendingBytes() << " bytes, "
+			<< connection->getDroppedMessages() << " effects dropped\n";
+	}
 	player->sendTextMessage(MSG_STATUS_CONSOLE_BLUE, text.str().c_str());
 
 	text.str("");
@@ -22,6 +22,7 @@
 #include "tasks.h"
 #include "outputmessage.h"
 #include "game.h"
+#include "metrics.h"
 
 extern Game g_game;
 
@@ -34,6 +35,7 @@ Dispatcher::DispatcherState Dispatcher::m_threadState = Dispatcher::STATE_TERMIN
 Dispatcher::Dispatcher()
 {
 	m_taskList.clear();
+	m_taskCount = 0;
 	Dispatcher::m_threadState = Dispatcher::STATE_RUNNING;
 	OTSYS_THREAD_LOCKVARINIT(m_taskLock);
 	OTSYS_THREAD_SIGNALVARINIT(m_taskSignal);
@@ -64,14 +66,20 @@ OTSYS_THREAD_RETURN Dispatcher::dispatcherThread(void* p)
 			// take the first task
 			task = getDispatcher().m_taskList.front();
 			getDispatcher().m_taskList.pop_front();
+			getDispatcher().m_taskCount--;
 		}
 
 		OTSYS_THREAD_UNLOCK(getDispatcher().m_taskLock, "");
 		// finally execute the task...
 		if(task)
 		{
+			Metrics::getInstance()->observe(METRIC_TASK_WAIT, OTSYS_TIME_MICRO() - task->getEnqueued());
 			OutputMessagePool::getInstance()->startExecutionFrame();
-			(*task)();
+			{
+				MetricTimer timer(METRIC_TASK_EXECUTION);
+				(*task)();
+			}
+
 			delete task;
 			OutputMessagePool::getInstance()->sendAll();
 			g_game.clearSpectatorCache();
@@ -93,7 +101,9 @@ void Dispatcher::addTask(Task* task)
 	{
 		OTSYS_THREAD_LOCK(m_taskLock, "");
 		signal = m_taskList.empty();
+		task->setEnqueued();
 		m_taskList.push_back(task);
+		m_taskCount++;
 		OTSYS_THREAD_UNLOCK(m_taskLock, "");
 	}
 	#ifdef __DEBUG_SCHEDULER__
@@ -106,6 +116,14 @@ void Dispatcher::addTask(Task* task)
 		OTSYS_THREAD_SIGNAL_SEND(m_taskSignal);
 }
 
+uint32_t Dispatcher::getTaskCount()
+{
+	OTSYS_THREAD_LOCK(m_taskLock, "");
+	uint32_t count = m_taskCount;
+	OTSYS_THREAD_UNLOCK(m_taskLock, "");
+	return count;
+}
+
 void Dispatcher::flush()
 {
 	Task* task = NULL;
@@ -113,6 +131,7 @@ void Dispatcher::flush()
 	{
 		task = getDispatcher().m_taskList.front();
 		m_taskList.pop_front();
+		m_taskCount--;
 		(*task)();
 		delete task;
 		OutputMessagePool::getInstance()->sendAll();
@@ -35,13 +35,18 @@ class Task
 			m_f();
 		}
 
+		void setEnqueued() {m_enqueued = OTSYS_TIME_MICRO();}
+		int64_t getEnqueued() const {return m_enqueued;}
+
 	protected:
 		Task(boost::function<void (void)> f)
 		{
 			m_f = f;
+			m_enqueued = 0;
 		}
 
 		boost::function<void (void)> m_f;
+		int64_t m_enqueued;
 
 		friend Task* createTask(boost::function<void (void)>);
 };
@@ -63,6 +68,7 @@ class Dispatcher
 		}
 
 		void addTask(Task* task);
+		uint32_t getTaskCount();
 
 		void stop();
 		void shutdown();
@@ -84,6 +90,7 @@ class Dispatcher
 		OTSYS_THREAD_SIGNALVAR m_taskSignal;
 
 		std::list<Task*> m_taskList;
+		uint32_t m_taskCount;
 		static DispatcherState m_threadState;
 };
 
@@ -258,6 +258,7 @@ Thing* Tile::getTopThing()
 
 void Tile::onAddTileItem(Item* item)
 {
+	++m_version;
 	updateTileFlags(item, false);
 
 	const Position& cylinderMapPos = getPosition();
@@ -281,6 +282,7 @@ void Tile::onAddTileItem(Item* item)
 void Tile::onUpdateTileItem(uint32_t index, Item* oldItem,
 	const ItemType& oldType, Item* newItem, const ItemType& newType)
 {
+	++m_version;
 	updateTileFlags(oldItem, true);
 	updateTileFlags(newItem, false);
 
@@ -304,6 +306,7 @@ void Tile::onUpdateTileItem(uint32_t index, Item* oldItem,
 
 void Tile::onRemoveTileItem(uint32_t index, Item* item)
 {
+	++m_version;
 	updateTileFlags(item, true);
 
 	const Position& cylinderMapPos = getPosition();
@@ -1301,6 +1304,7 @@ void Tile::__internalAddThing(uint32_t index, Thing* thing)
 			++thingCount;
 		}
 
+		++m_version;
 		//update floor change flags
 		updateTileFlags(item, false);
 	}
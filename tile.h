@@ -37,6 +37,18 @@ class BedItem;
 typedef std::vector<Item*> ItemVector;
 typedef std::vector<Creature*> CreatureVector;
 
+#define TILE_MAX_DESCRIPTION_THINGS 10
+
+// client encoding of the items on a tile, valid while version matches the tile's
+struct TileItemCache
+{
+	uint32_t version;
+	uint8_t topCount, downCount;
+	// offsets[0] is the end of ground and top items, offsets[n] the end of the n-th down item
+	uint8_t offsets[TILE_MAX_DESCRIPTION_THINGS + 1];
+	uint8_t buffer[TILE_MAX_DESCRIPTION_THINGS * 3];
+};
+
 enum tileflags_t
 {
 	TILESTATE_NONE = 0,
@@ -73,12 +85,14 @@ class Tile : public Cylinder
 		{
 			tilePos = Position(x, y, z);
 			qt_node = NULL;
-			thingCount = m_flags = 0;
+			thingCount = m_flags = m_version = 0;
 			ground = NULL;
+			m_itemCache = NULL;
 		}
 
 		virtual ~Tile()
 		{
+			delete m_itemCache;
 			#ifdef _DEBUG
 			delete ground;
 
@@ -152,6 +166,18 @@ class Tile : public Cylinder
 		void moveCreature(Creature* creature, Cylinder* toCylinder, bool teleport = false);
 		uint32_t getThingCount() const {return thingCount;}
 
+		uint32_t getVersion() const {return m_version;}
+		TileItemCache* getItemCache() const
+		{
+			if(!m_itemCache)
+			{
+				m_itemCache = new TileItemCache;
+				m_itemCache->version = m_version - 1;
+			}
+
+			return m_itemCache;
+		}
+
 		//cylinder implementations
 		virtual ReturnValue __queryAdd(int32_t index, const Thing* thing, uint32_t count,
 			uint32_t flags) const;
@@ -200,6 +226,9 @@ class Tile : public Cylinder
 		Position tilePos;
 		uint32_t thingCount;
 		uint32_t m_flags;
+
+		uint32_t m_version;
+		mutable TileItemCache* m_itemCache;
 };
 
 #endif
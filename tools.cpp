@@ -27,6 +27,10 @@
 #include <sstream>
 #include <iomanip>
 
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
 extern ConfigManager g_config;
 
 std::string transformToSHA1(std::string plainText, bool upperCase /*= false*/)
@@ -1172,6 +1176,39 @@ uint32_t adlerChecksum(uint8_t *data, size_t length)
 
 	const uint16_t adler = 65521;
 	uint32_t a = 1, b = 0;
+	#ifdef __SSE2__
+	//16 bytes at once: a grows by the byte sum, b by 16 * a plus the bytes weighted 16..1
+	const __m128i zero = _mm_setzero_si128(), highWeights = _mm_set_epi16(9, 10, 11, 12, 13, 14, 15, 16),
+		lowWeights = _mm_set_epi16(1, 2, 3, 4, 5, 6, 7, 8);
+	while(length >= 16)
+	{
+		size_t blocks = (length > 5552 ? 5552 : length) / 16;
+		length -= blocks * 16;
+
+		b += a * 16 * blocks;
+		__m128i sumA = zero, sumB = zero, prefixA = zero;
+		do
+		{
+			__m128i bytes = _mm_loadu_si128((const __m128i*)data);
+			prefixA = _mm_add_epi32(prefixA, sumA);
+			sumA = _mm_add_epi32(sumA, _mm_sad_epu8(bytes, zero));
+			sumB = _mm_add_epi32(sumB, _mm_madd_epi16(_mm_unpacklo_epi8(bytes, zero), highWeights));
+			sumB = _mm_add_epi32(sumB, _mm_madd_epi16(_mm_unpackhi_epi8(bytes, zero), lowWeights));
+			data += 16;
+		}
+		while(--blocks);
+
+		uint32_t tmp[4];
+		_mm_storeu_si128((__m128i*)tmp, _mm_add_epi32(_mm_slli_epi32(prefixA, 4), sumB));
+		b += tmp[0] + tmp[1] + tmp[2] + tmp[3];
+
+		_mm_storeu_si128((__m128i*)tmp, sumA);
+		a += tmp[0] + tmp[2];
+
+		a %= adler;
+		b %= adler;
+	}
+	#endif
 	while(length > 0)
 	{
 		size_t tmp = length > 5552 ? 5552 : length;